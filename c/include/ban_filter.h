@@ -0,0 +1,41 @@
+#ifndef BAN_FILTER_H
+#define BAN_FILTER_H
+
+#include <stdint.h>
+#include "common.h"
+#include "threads.h"
+
+// BAN_FILTER_INITIAL_CAPACITY: slots in the open addressing table (must be a power of two), it doubles at half load
+#define BAN_FILTER_INITIAL_CAPACITY 64
+// BAN_FILTER_BLOOM_BITS: bits in the prefilter (must be a power of two), 8 KB keeps the false positive rate low
+// for thousands of bans while staying in L1/L2
+#define BAN_FILTER_BLOOM_BITS (1 << 16)
+// BAN_ENTRY_BUFFER_SIZE calculation:
+// 15 (dotted quad) + 1 ('/') + 2 (prefix length) + 1 (null terminator)
+#define BAN_ENTRY_BUFFER_SIZE (15 + 1 + 2 + 1)
+
+// every entry is an IPv4 network and a prefix length, a single address is a /32,
+// addresses are kept in host byte order
+typedef struct
+{
+    // key = (prefix length + 1) << 32 | network, so 0 marks an empty slot
+    uint64_t *keys;
+    size_t capacity;
+    size_t count;
+    // bit n is set while some entry has prefix length n, a lookup only probes those lengths
+    uint64_t prefix_lengths;
+    uint64_t bloom[BAN_FILTER_BLOOM_BITS / 64];
+    // read without the lock so an empty filter costs a single load
+    atomic_int entries;
+    rwlock_t rwlock;
+} ban_filter_t;
+
+int ban_filter_init(ban_filter_t *filter, error_list_t *error);
+void ban_filter_destroy(ban_filter_t *filter);
+int ban_filter_add(ban_filter_t *filter, uint32_t address, int prefix_length, error_list_t *error);
+int ban_filter_contains(ban_filter_t *filter, uint32_t address);
+int ban_filter_add_list(ban_filter_t *filter, const char *list, error_list_t *error);
+int ban_filter_parse_entry(const char *entry, size_t length, uint32_t *address, int *prefix_length);
+char *ban_filter_format_list(ban_filter_t *filter);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef BLOB_STORE_H
+#define BLOB_STORE_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include "common.h"
+
+#define BLOB_STORE_DIRECTORY "blobs"
+// BLOB_MAX_SIZE: largest attachment the store accepts
+#define BLOB_MAX_SIZE (256ULL * 1024 * 1024)
+// BLOB_CHUNK_SIZE: bytes moved per splice/sendfile call, and per read where those aren't available
+#define BLOB_CHUNK_SIZE (64 * 1024)
+// BLOB_IO_TIMEOUT_MS: a transfer whose peer makes no progress for this long is dropped
+#define BLOB_IO_TIMEOUT_MS 10000
+// BLOB_STORE_DEFAULT_QUOTA: bytes of new attachments one room stores, 0 for no limit
+#define BLOB_STORE_DEFAULT_QUOTA (1024ULL * 1024 * 1024)
+// BLOB_UPLOAD_STALE_MS: a temporary upload file untouched for this long was left behind by a dropped transfer or a crash
+#define BLOB_UPLOAD_STALE_MS (BLOB_IO_TIMEOUT_MS * 3)
+
+// BLOB_PATH_BUFFER_SIZE calculation:
+// BLOB_DIRECTORY_BUFFER_SIZE - 1: the store directory without its null terminator
+// 1: the '/' separator
+// BLOB_HASH_HEX_LENGTH: a blob's file name, longer than any temporary upload name
+// 1: the null terminator
+#define BLOB_DIRECTORY_BUFFER_SIZE 256
+#define BLOB_PATH_BUFFER_SIZE ((BLOB_DIRECTORY_BUFFER_SIZE - 1) + 1 + BLOB_HASH_HEX_LENGTH + 1)
+
+typedef struct
+{
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    size_t block_length;
+} sha256_t;
+
+void sha256_init(sha256_t *context);
+void sha256_update(sha256_t *context, const void *data, size_t length);
+void sha256_final(sha256_t *context, unsigned char digest[BLOB_HASH_SIZE]);
+
+// blobs are files named by the hex SHA-256 of their content, so an upload of known content is stored once.
+// init starts the room's quota over and deletes temporary uploads left behind in the directory
+int blob_store_init(const char *directory, error_list_t *error);
+void blob_store_set_quota(uint64_t quota);
+// takes size bytes of the room's quota for an upload, blob_store_receive keeps them for a new blob and gives them back otherwise
+int blob_store_reserve(uint64_t size, error_list_t *error);
+void blob_store_unreserve(uint64_t size);
+int blob_store_stat(const char *hash_hex, uint64_t *size);
+int blob_store_receive(socket_t sock, uint64_t size, const char *received, size_t received_length, char *hash_hex, error_list_t *error);
+int blob_store_send(socket_t sock, const char *hash_hex, uint64_t offset, uint64_t length, error_list_t *error);
+int blob_store_put_file(const char *path, char *hash_hex, uint64_t *size, error_list_t *error);
+int blob_store_copy_out(const char *hash_hex, const char *path, error_list_t *error);
+
+// the byte movers behind the store, also used by clients on their end of a transfer
+int blob_file_open(const char *path, int writable, uint64_t offset);
+int blob_file_close(int fd);
+int blob_file_size(int fd, uint64_t *size);
+int blob_file_write(int fd, const char *data, size_t length, error_list_t *error);
+int blob_send_range(socket_t sock, int fd, uint64_t offset, uint64_t length, error_list_t *error);
+int blob_recv_range(socket_t sock, int fd, uint64_t length, error_list_t *error);
+
+#endif
\ No newline at end of file
@@ -3,14 +3,36 @@
 
 #include "common.h"
 #include "threads.h"
+#include "logger.h"
+#include "blob_store.h"
+#include "utf8.h"
+#include "local_transport.h"
 
-#define PUBLIC_IP_SERVICE_ONE "api.ipify.org"
-#define PUBLIC_IP_SERVICE_TWO "ifconfig.me"
-#define PUBLIC_IP_SERVICE_THREE "checkip.amazonaws.com"
-#define HTTP_GET_REQUEST_ONE "GET / HTTP/1.1\r\nHost: api.ipify.org\r\nConnection: close\r\n\r\n"
-#define HTTP_GET_REQUEST_TWO "GET / HTTP/1.1\r\nHost: ifconfig.me\r\nConnection: close\r\n\r\n"
-#define HTTP_GET_REQUEST_THREE "GET / HTTP/1.1\r\nHost: checkip.amazonaws.com\r\nConnection: close\r\n\r\n"
-#define HTTP_PORT "80"
+// TRANSFER_ADDRESS_BUFFER_SIZE: a host name or dotted quad the client connected to, kept for transfer connections
+#define TRANSFER_ADDRESS_BUFFER_SIZE 256
+#define TRANSFER_PORT_BUFFER_SIZE 6
+// CLIENT_SEND_QUEUE_LIMIT: frames waiting for the send thread, queueing past it fails at once instead of growing without bound
+#define CLIENT_SEND_QUEUE_LIMIT 1024
+// CLIENT_SEND_BATCH_SIZE: bytes of queued frames the send thread copies together and hands to a single send
+#define CLIENT_SEND_BATCH_SIZE (64 * 1024)
+
+typedef enum
+{
+    SEND_STATUS_COMPLETED,
+    SEND_STATUS_FAILED,
+    SEND_STATUS_CANCELLED
+} send_status_t;
+
+// a frame waiting for the send thread
+typedef struct client_send_request
+{
+    struct client_send_request *next;
+    uint64_t request_id;
+    // called on the send thread once the frame is written or has failed, on the cancelling thread when it is cancelled
+    void (*callback_send_func)(uint64_t, send_status_t);
+    size_t length;
+    char frame[];
+} client_send_request_t;
 
 typedef struct
 {
@@ -19,16 +41,51 @@ typedef struct
     void (*callback_message_func)(const char *, const char *);
     void (*callback_server_error_func)(error_type_t, const char *);
     void (*callback_notification_func)(notification_type_t, const char *);
+    void (*callback_presence_func)(presence_op_t, const char *, const char *);
+    void (*callback_attachment_func)(const char *, const char *, uint64_t, const char *);
+    void (*callback_search_func)(const char *, const char *, uint64_t);
+    void (*callback_typing_func)(const char **, size_t);
+    void (*callback_direct_func)(const char *, const char **, size_t, const char *);
+    void (*callback_direct_ack_func)(uint32_t, char, const char *);
     user_type_t user_type;
 } client_receive_thread_args_t;
 
-int join_chat_room(const char *ip_address, const char *port, const char *secret_key, const char *username, user_type_t user_type, error_t *error, void (*callback_error_func)(const char *, int), void (*callback_message_func)(const char *, const char *), void (*callback_server_error_func)(error_type_t, const char *), void (*callback_notification_func)(notification_type_t, const char *));
-int create_and_connect_client_socket(const char *server_address, const char *port, socket_t *sock, error_t *error);
-int get_public_ip(char *ip_buffer, size_t buffer_size, error_t *error);
+typedef struct
+{
+    char ip_address[TRANSFER_ADDRESS_BUFFER_SIZE];
+    char port[TRANSFER_PORT_BUFFER_SIZE];
+    char secret_key[SECRET_KEY_BUFFER_SIZE];
+    char username[USERNAME_BUFFER_SIZE];
+    // the callbacks the receive thread gets, its client_socket is unused
+    client_receive_thread_args_t receive_args;
+    void (*callback_join_func)(int);
+} client_join_thread_args_t;
+
+int join_chat_room(const char *ip_address, const char *port, const char *secret_key, const char *username, user_type_t user_type, error_list_t *error, void (*callback_error_func)(const char *, int), void (*callback_message_func)(const char *, const char *), void (*callback_server_error_func)(error_type_t, const char *), void (*callback_notification_func)(notification_type_t, const char *), void (*callback_presence_func)(presence_op_t, const char *, const char *), void (*callback_attachment_func)(const char *, const char *, uint64_t, const char *), void (*callback_search_func)(const char *, const char *, uint64_t), void (*callback_typing_func)(const char **, size_t), void (*callback_direct_func)(const char *, const char **, size_t, const char *), void (*callback_direct_ack_func)(uint32_t, char, const char *));
+int create_and_connect_client_socket(const char *server_address, const char *port, socket_profile_t profile, socket_t *sock, error_list_t *error);
+// connects and authenticates on a thread of its own and returns at once, callback_join_func gets join_chat_room's result.
+// cancel_client_connect stops it while it is still connecting
+int join_chat_room_async(const char *ip_address, const char *port, const char *secret_key, const char *username, user_type_t user_type, error_list_t *error, void (*callback_error_func)(const char *, int), void (*callback_message_func)(const char *, const char *), void (*callback_server_error_func)(error_type_t, const char *), void (*callback_notification_func)(notification_type_t, const char *), void (*callback_presence_func)(presence_op_t, const char *, const char *), void (*callback_attachment_func)(const char *, const char *, uint64_t, const char *), void (*callback_search_func)(const char *, const char *, uint64_t), void (*callback_typing_func)(const char **, size_t), void (*callback_direct_func)(const char *, const char **, size_t, const char *), void (*callback_direct_ack_func)(uint32_t, char, const char *), void (*callback_join_func)(int));
+void cancel_client_connect(void);
+// SOCKET_PROFILE_INTERACTIVE unless set before joining, applies to the chat connection only
+void set_client_socket_profile(socket_profile_t profile);
 
-void send_auth_message(socket_t client_socket, user_type_t user_type, const char *secret_key, const char *username, error_t *error, void (*callback_error_func)(const char *, int));
-void send_regular_message(const char *message, error_t *error, void (*callback_error_func)(const char *, int));
+void send_auth_message(user_type_t user_type, const char *secret_key, const char *username, error_list_t *error, void (*callback_error_func)(const char *, int));
+void send_regular_message(const char *message, error_list_t *error, void (*callback_error_func)(const char *, int));
+// every send only queues its frame, this one also hands back the request's ID for callback_send_func and cancel_queued_send.
+// returns 0 when nothing was queued
+uint64_t queue_regular_message(const char *message, void (*callback_send_func)(uint64_t, send_status_t), error_list_t *error, void (*callback_error_func)(const char *, int));
+// takes a frame the send thread has not picked up yet off the queue, returns 1 when it was already sent or unknown
+int cancel_queued_send(uint64_t request_id);
+void send_typing_state(int typing, error_list_t *error, void (*callback_error_func)(const char *, int));
+// returns the sequence number the recipients' acks will carry, 0 when nothing was sent
+uint32_t send_direct_message(const char **recipients, size_t recipient_count, const char *message, error_list_t *error, void (*callback_error_func)(const char *, int));
+void send_search_request(const char *query, uint64_t since, uint64_t until, error_list_t *error, void (*callback_error_func)(const char *, int));
+int upload_attachment(const char *path, const char *name, error_list_t *error, void (*callback_error_func)(const char *, int));
+int download_attachment(const char *hash_hex, uint64_t offset, uint64_t length, const char *path, error_list_t *error, void (*callback_error_func)(const char *, int));
 
 thread_ret_t THREAD_CALL client_receive_thread(void *arg);
+thread_ret_t THREAD_CALL client_send_thread(void *arg);
+thread_ret_t THREAD_CALL client_join_thread(void *arg);
 
 #endif
\ No newline at end of file
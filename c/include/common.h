@@ -12,17 +12,23 @@
 #define SECRET_KEY_BUFFER_SIZE (SECRET_KEY_LENGTH + 1)
 #define ENCODED_SECRET_KEY_BUFFER_SIZE ((SECRET_KEY_LENGTH * 3) + 1)
 
+// text limits in code points, the server checks every name, message and query against them (see utf8.h)
+#define USERNAME_MAX_CHARACTERS 20
+#define MESSAGE_MAX_CHARACTERS 250
+#define ATTACHMENT_NAME_MAX_CHARACTERS 100
+#define SEARCH_QUERY_MAX_CHARACTERS 100
+
 // USERNAME_BUFFER_SIZE calculation:
-// 20: The maximum number of characters for a username
+// USERNAME_MAX_CHARACTERS: The maximum number of characters for a username
 // x4: To account for multi-byte characters (e.g., UTF-8), assuming the worst-case scenario where each character is 4 bytes
 // 1: To account for the null terminator
-#define USERNAME_BUFFER_SIZE (20 * 4 + 1)
+#define USERNAME_BUFFER_SIZE (USERNAME_MAX_CHARACTERS * 4 + 1)
 
 // MESSAGE_BUFFER_SIZE calculation:
-// 250: The maximum number of characters for a message
+// MESSAGE_MAX_CHARACTERS: The maximum number of characters for a message
 // x4: To account for multi-byte characters (e.g., UTF-8), assuming the worst-case scenario where each character is 4 bytes
 // 1: To account for the null terminator
-#define MESSAGE_BUFFER_SIZE (250 * 4 + 1)
+#define MESSAGE_BUFFER_SIZE (MESSAGE_MAX_CHARACTERS * 4 + 1)
 #define ENCODED_MESSAGE_BUFFER_SIZE ((MESSAGE_BUFFER_SIZE - 1) * 3 + 1)
 
 // AUTH_MESSAGE_BUFFER_SIZE calculation:
@@ -50,6 +56,15 @@
 // 1: The null terminator for the entire formatted string
 #define MAX_BUFFER_SIZE (1 + 2 + (USERNAME_BUFFER_SIZE - 1) + (ENCODED_MESSAGE_BUFFER_SIZE - 1) + 1)
 
+// every frame on the wire is terminated by FRAME_DELIMITER (the null terminator is sent along),
+// so frames written back to back into one socket can be split apart again by the receiver
+#define FRAME_DELIMITER '\0'
+
+// FRAME_READER_BUFFER_SIZE calculation:
+// 2: room for one complete frame plus the beginning of the next one
+// MAX_BUFFER_SIZE: the largest frame, including its delimiter
+#define FRAME_READER_BUFFER_SIZE (2 * MAX_BUFFER_SIZE)
+
 typedef enum
 {
     USER_TYPE_REGULAR,
@@ -62,8 +77,119 @@ typedef enum
     MSG_TYPE_AUTH,
     MSG_TYPE_MESSAGE,
     MSG_TYPE_NOTIFICATION,
+    MSG_TYPE_PRESENCE,
+    MSG_TYPE_MEMBER_MESSAGE,
+    MSG_TYPE_ATTACHMENT,
+    MSG_TYPE_TRANSFER,
+    MSG_TYPE_SEARCH,
+    MSG_TYPE_TYPING,
+    MSG_TYPE_DIRECT,
 } message_type_t;
 
+// a presence frame is the message type followed by ':'-separated entries,
+// each entry is one op character followed by the encoded username,
+// a rename is a PRESENCE_OP_RENAME_FROM entry directly followed by a PRESENCE_OP_RENAME_TO entry,
+// a PRESENCE_OP_MEMBER_ID entry (decimal ID) binds that ID to the name of the entry right after it
+#define PRESENCE_OP_SNAPSHOT '*'
+#define PRESENCE_OP_JOIN '+'
+#define PRESENCE_OP_LEAVE '-'
+#define PRESENCE_OP_RENAME_FROM '~'
+#define PRESENCE_OP_RENAME_TO '='
+#define PRESENCE_OP_MEMBER_ID '#'
+// binds an ID to a name without announcing a join, sent before a member's first message in case its join is still being coalesced
+#define PRESENCE_OP_ALIAS '@'
+
+// a member message frame is the message type, ':', the sender's member ID as an LEB128 varint and the encoded message,
+// IDs start at 1 so no varint byte is ever 0 and the frame delimiter stays unambiguous
+// MEMBER_ID_VARINT_MAX_SIZE: 32 bits at 7 bits per byte
+#define MEMBER_ID_VARINT_MAX_SIZE 5
+// MEMBER_ID_DECIMAL_BUFFER_SIZE: 10 digits of a 32 bit ID plus the null terminator
+#define MEMBER_ID_DECIMAL_BUFFER_SIZE 11
+// an attachment frame references a blob by the hex SHA-256 of its content: "<hash>:<size>:<encoded name>",
+// sent by a client as is and broadcast by the server with the sender's member ID varint in front of the hash,
+// the bytes themselves only travel over a separate transfer connection (MSG_TYPE_TRANSFER as its first frame)
+#define BLOB_HASH_SIZE 32
+#define BLOB_HASH_HEX_LENGTH (BLOB_HASH_SIZE * 2)
+#define BLOB_HASH_HEX_BUFFER_SIZE (BLOB_HASH_HEX_LENGTH + 1)
+// ATTACHMENT_NAME_BUFFER_SIZE calculation:
+// ATTACHMENT_NAME_MAX_CHARACTERS: The maximum number of characters for a file name
+// x4: To account for multi-byte characters (e.g., UTF-8), assuming the worst-case scenario where each character is 4 bytes
+// 1: To account for the null terminator
+#define ATTACHMENT_NAME_BUFFER_SIZE (ATTACHMENT_NAME_MAX_CHARACTERS * 4 + 1)
+#define ENCODED_ATTACHMENT_NAME_BUFFER_SIZE ((ATTACHMENT_NAME_BUFFER_SIZE - 1) * 3 + 1)
+
+// a search request is "<since>:<until>:<encoded query>" (unix seconds, 0 for an open end), answered to the asking member only
+// by one frame per hit, "<timestamp>:<encoded sender>:<encoded message>", newest first, and then "*:<number of hits>".
+// hits name the sender rather than a member ID since the sender may have left long ago
+#define SEARCH_RESULT_END '*'
+// SEARCH_QUERY_BUFFER_SIZE calculation:
+// SEARCH_QUERY_MAX_CHARACTERS: The maximum number of characters for a query
+// x4: To account for multi-byte characters (e.g., UTF-8), assuming the worst-case scenario where each character is 4 bytes
+// 1: To account for the null terminator
+#define SEARCH_QUERY_BUFFER_SIZE (SEARCH_QUERY_MAX_CHARACTERS * 4 + 1)
+#define ENCODED_SEARCH_QUERY_BUFFER_SIZE ((SEARCH_QUERY_BUFFER_SIZE - 1) * 3 + 1)
+// SEARCH_RESULT_BUFFER_SIZE calculation:
+// 1: The maximum number of characters to represent an integer message type
+// 3: The three colons (:) used as delimiters in the formatted string
+// 20: The maximum number of digits of a 64 bit timestamp
+// (USERNAME_BUFFER_SIZE - 1) * 3: The maximum length of the encoded username string, minus the null terminator
+// ENCODED_MESSAGE_BUFFER_SIZE - 1: The maximum length of the encoded message string, minus the null terminator
+// 1: The null terminator for the entire formatted string
+// a hit is larger than MAX_BUFFER_SIZE, it still fits the FRAME_READER_BUFFER_SIZE a receiver reads into
+#define SEARCH_RESULT_BUFFER_SIZE (1 + 3 + 20 + (USERNAME_BUFFER_SIZE - 1) * 3 + (ENCODED_MESSAGE_BUFFER_SIZE - 1) + 1)
+
+// typing indicators are never stored or indexed. a member sends the message type, ':' and one of the ops below,
+// subscribers get the message type, ':' and one member ID varint for every member typing right now,
+// the whole set each time, so a receiver that misses a frame is corrected by the next one
+#define TYPING_OP_ACTIVE '1'
+#define TYPING_OP_STOPPED '0'
+#define TYPING_OP_SUBSCRIBE '+'
+#define TYPING_OP_UNSUBSCRIBE '-'
+// TYPING_REFRESH_MS: a member that keeps typing repeats TYPING_OP_ACTIVE this often, the server forgets it after twice that
+#define TYPING_REFRESH_MS 3000
+// TYPING_MAX_MEMBERS: members one typing frame names, anyone past that is left out until a slot frees up
+#define TYPING_MAX_MEMBERS 32
+// TYPING_FRAME_BUFFER_SIZE calculation:
+// 1: The maximum number of characters to represent an integer message type
+// 1: The colon (:) after the message type
+// TYPING_MAX_MEMBERS * MEMBER_ID_VARINT_MAX_SIZE: The longest varint of every member named
+// 1: The null terminator for the entire formatted string
+#define TYPING_FRAME_BUFFER_SIZE (1 + 1 + TYPING_MAX_MEMBERS * MEMBER_ID_VARINT_MAX_SIZE + 1)
+
+// a direct message only reaches the members it names, it never goes into a room log, the index or a linked room.
+// a member sends "<sequence>:<n>:<recipient 1>:...:<recipient n>:<encoded message>" with every name encoded,
+// each recipient gets DIRECT_DELIVERY, then ":<encoded sender>:<n>:<recipients>:<encoded message>" so it sees the whole group,
+// and the sender gets "<sequence>:<status>:<encoded recipient>" for every distinct recipient.
+// delivered means the frame was queued on the recipient's connection, not that it was read
+#define DIRECT_MAX_RECIPIENTS 8
+#define DIRECT_DELIVERY '@'
+#define DIRECT_STATUS_DELIVERED 'D'
+#define DIRECT_STATUS_NOT_FOUND 'N'
+// the recipient is in the room but its copy couldn't be queued
+#define DIRECT_STATUS_FAILED 'F'
+// DIRECT_MESSAGE_BUFFER_SIZE calculation:
+// 2: The maximum number of characters to represent an integer message type
+// 10: The maximum number of digits of a 32 bit sequence number, or the delivery marker in its place
+// 1: The one digit of the recipient count
+// (DIRECT_MAX_RECIPIENTS + 1) * (USERNAME_BUFFER_SIZE - 1) * 3: The encoded recipients and, in a delivery, the encoded sender
+// ENCODED_MESSAGE_BUFFER_SIZE - 1: The maximum length of the encoded message string, minus the null terminator
+// DIRECT_MAX_RECIPIENTS + 4: The colons (:) used as delimiters in the formatted string
+// 1: The null terminator for the entire formatted string
+// a direct message is larger than MAX_BUFFER_SIZE, it still fits the FRAME_READER_BUFFER_SIZE a receiver reads into
+#define DIRECT_MESSAGE_BUFFER_SIZE (2 + 10 + 1 + (DIRECT_MAX_RECIPIENTS + 1) * (USERNAME_BUFFER_SIZE - 1) * 3 + (ENCODED_MESSAGE_BUFFER_SIZE - 1) + DIRECT_MAX_RECIPIENTS + 4 + 1)
+
+// MEMBER_TABLE_INITIAL_CAPACITY: slots in a receiver's ID to name table (must be a power of two),
+// at half load departed members are dropped and it doubles if the remaining ones still fill a quarter
+#define MEMBER_TABLE_INITIAL_CAPACITY 64
+
+typedef enum
+{
+    PRESENCE_SNAPSHOT,
+    PRESENCE_JOIN,
+    PRESENCE_LEAVE,
+    PRESENCE_RENAME
+} presence_op_t;
+
 typedef enum
 {
     NOTIFICATION_AUTH_SUCCESS,
@@ -81,8 +207,69 @@ typedef struct
     user_type_t user_type;
 } user_info_t;
 
-void send_message(socket_t client_socket, const char *message, const char *sender_username, const char *receiver_username, context_t context, error_t *error, void (*callback_error_func)(const char *, int));
+typedef struct
+{
+    // 0 marks an empty slot, member IDs start at 1
+    uint32_t member_id;
+    // the member left, its messages can still be in a lane the leave overtook
+    int departed;
+    char username[USERNAME_BUFFER_SIZE];
+} member_entry_t;
+
+// a receiver's view of the room's member IDs, filled from presence frames
+typedef struct
+{
+    member_entry_t *entries;
+    size_t capacity;
+    size_t count;
+} member_table_t;
+
+typedef struct
+{
+    char buffer[FRAME_READER_BUFFER_SIZE];
+    size_t length;
+    size_t offset;
+} frame_reader_t;
+
+void send_message(socket_t client_socket, const char *message, const char *sender_username, const char *receiver_username, context_t context, error_list_t *error, void (*callback_error_func)(const char *, int));
 void encode_message(const char *input, char *output, size_t output_size);
 void decode_message(const char *input, char *output, size_t output_size);
+size_t format_message_frame(char *buffer, size_t buffer_size, const char *message, const char *sender_username, context_t context);
+size_t append_presence_entry(char *frame, size_t frame_length, size_t frame_size, char op, const char *username);
+size_t append_member_id_entry(char *frame, size_t frame_length, size_t frame_size, uint32_t member_id);
+void handle_presence_frame(char *frame, member_table_t *members, void (*callback_presence_func)(presence_op_t, const char *, const char *));
+
+size_t encode_member_id(uint32_t member_id, char *output);
+size_t decode_member_id(const char *input, uint32_t *member_id);
+size_t format_member_message_frame(char *buffer, size_t buffer_size, const char *message, uint32_t member_id);
+int parse_message_frame(const char *frame, const member_table_t *members, char *username, size_t username_size, char *message, size_t message_size);
+size_t format_attachment_frame(char *buffer, size_t buffer_size, const char *hash_hex, uint64_t size, const char *name, uint32_t member_id);
+int parse_attachment_reference(const char *reference, char *hash_hex, uint64_t *size, char *name, size_t name_size);
+int parse_attachment_frame(const char *frame, const member_table_t *members, char *username, size_t username_size, char *hash_hex, uint64_t *size, char *name, size_t name_size);
+int blob_hash_is_valid(const char *hash_hex);
+size_t format_search_request_frame(char *buffer, size_t buffer_size, const char *query, uint64_t since, uint64_t until);
+int parse_search_request_frame(const char *frame, char *query, size_t query_size, uint64_t *since, uint64_t *until);
+size_t format_search_result_frame(char *buffer, size_t buffer_size, uint64_t timestamp, const char *sender_username, const char *message);
+size_t format_search_end_frame(char *buffer, size_t buffer_size, size_t hits);
+void handle_search_frame(const char *frame, void (*callback_search_func)(const char *, const char *, uint64_t));
+size_t format_typing_request_frame(char *buffer, size_t buffer_size, char op);
+size_t format_typing_frame(char *buffer, size_t buffer_size, const uint32_t *member_ids, size_t count);
+void handle_typing_frame(const char *frame, const member_table_t *members, void (*callback_typing_func)(const char **, size_t));
+size_t format_direct_request_frame(char *buffer, size_t buffer_size, uint32_t sequence, const char **recipients, size_t recipient_count, const char *message);
+int parse_direct_request_frame(const char *frame, uint32_t *sequence, char recipients[][USERNAME_BUFFER_SIZE], size_t *recipient_count, char *encoded_message, size_t encoded_message_size);
+size_t format_direct_delivery_frame(char *buffer, size_t buffer_size, const char *sender_username, char recipients[][USERNAME_BUFFER_SIZE], size_t recipient_count, const char *encoded_message);
+size_t format_direct_ack_frame(char *buffer, size_t buffer_size, uint32_t sequence, char status, const char *recipient);
+void handle_direct_frame(const char *frame, void (*callback_direct_func)(const char *, const char **, size_t, const char *), void (*callback_direct_ack_func)(uint32_t, char, const char *));
+
+int member_table_init(member_table_t *table);
+void member_table_destroy(member_table_t *table);
+void member_table_clear(member_table_t *table);
+int member_table_set(member_table_t *table, uint32_t member_id, const char *username);
+void member_table_depart(member_table_t *table, uint32_t member_id);
+const char *member_table_find(const member_table_t *table, uint32_t member_id);
+
+void frame_reader_init(frame_reader_t *reader);
+int frame_reader_recv(frame_reader_t *reader, socket_t sock, const char *client_username, context_t context, error_list_t *error);
+char *frame_reader_next(frame_reader_t *reader);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+#ifndef CONTENT_FILTER_H
+#define CONTENT_FILTER_H
+
+#include <stdint.h>
+#include "common.h"
+#include "threads.h"
+#include "logger.h"
+#include "utf8.h"
+
+// CONTENT_FILTER_MAX_PATTERNS: rules one list compiles, a longer list is refused
+#define CONTENT_FILTER_MAX_PATTERNS 65536
+// CONTENT_FILTER_MAX_PATTERN_LENGTH: bytes of one pattern, a state's depth fits a byte
+#define CONTENT_FILTER_MAX_PATTERN_LENGTH 64
+// CONTENT_FILTER_MAX_TRANSITIONS: entries of the transition table (4 bytes each), a list that needs more is refused.
+// tens of thousands of words take a few million
+#define CONTENT_FILTER_MAX_TRANSITIONS (32u * 1024 * 1024)
+#define CONTENT_MASK_CHARACTER '*'
+
+// what a rule does to a message it matches, a message matching several rules gets all of their actions
+#define CONTENT_ACTION_FLAG 1u
+#define CONTENT_ACTION_MASK 2u
+#define CONTENT_ACTION_BLOCK 4u
+
+typedef struct
+{
+    // the nearest state down the failure chain that ends a pattern, 0 for none
+    uint32_t output_link;
+    // what the pattern ending exactly here does, and what every pattern ending here or along the output links does
+    uint8_t actions;
+    uint8_t chain_actions;
+    // bytes from the root, so the length of the pattern ending here
+    uint8_t depth;
+} content_state_t;
+
+// an Aho-Corasick automaton with every failure transition already followed, a byte of text is a single table load.
+// states are numbered breadth first, the shallow ones nearly every byte passes through share cache lines
+typedef struct
+{
+    // bytes, ASCII letters folded to lower case, map to classes, class 0 is every byte no pattern uses
+    uint8_t byte_class[256];
+    uint32_t class_count;
+    uint32_t state_count;
+    // state_count rows of class_count next states
+    uint32_t *transitions;
+    content_state_t *states;
+} content_automaton_t;
+
+// the room's filter. a new list is compiled without any lock and swapped in under the writer lock,
+// messages are only held up for the swap itself and never see a half built automaton
+typedef struct
+{
+    content_automaton_t *automaton;
+    // the list the automaton was compiled from, it goes along with a handoff
+    char *rules;
+    // read without the lock so an empty filter costs a single load
+    atomic_int loaded;
+    rwlock_t rwlock;
+} content_filter_t;
+
+void content_filter_init(content_filter_t *filter);
+void content_filter_destroy(content_filter_t *filter);
+// one rule per line, "block <pattern>", "mask <pattern>" or "flag <pattern>", blank lines and lines starting with '#' are skipped.
+// patterns match anywhere in a message, ASCII letters regardless of case. an empty list turns the filter off,
+// a malformed one leaves the current list in place
+int content_filter_load(content_filter_t *filter, const char *rules, error_list_t *error);
+// text is a decoded message of less than ENCODED_MESSAGE_BUFFER_SIZE bytes, masked patterns are overwritten in place
+// with one CONTENT_MASK_CHARACTER per character. returns the CONTENT_ACTION_ bits of every rule that matched
+unsigned int content_filter_apply(content_filter_t *filter, char *text);
+// a copy of the loaded list, NULL when there is none or no memory
+char *content_filter_format_rules(content_filter_t *filter);
+
+#endif
\ No newline at end of file
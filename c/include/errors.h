@@ -7,34 +7,84 @@
 #define MAX_ERRORS 10
 #define AGGREGATED_ERROR_SIZE 1024
 
-#define MALLOC_ERROR "MALLOC_ERROR"
-#define THREAD_CREATE_ERROR "THREAD_CREATE_ERROR"
-#define SERVER_DISCONNECTED "SERVER_DISCONNECTED"
-#define ERR_SECRET_KEY_LENGTH "ERR_SECRET_KEY_LENGTH"
-#define ERR_USERNAME_TOO_LONG "ERR_USERNAME_TOO_LONG"
-
-#define ERR_LOCAL_IP_FAILURE "ERR_LOCAL_IP_FAILURE"
-#define ERR_NO_RESPONSE_BODY "ERR_NO_RESPONSE_BODY"
-#define ERR_IP_TOO_LONG "ERR_IP_TOO_LONG"
+// ERROR_SUBJECT_SIZE calculation:
+// 20 * 4: a username, the only subject an error message names
+// 1: the null terminator
+#define ERROR_SUBJECT_SIZE (20 * 4 + 1)
+// ERROR_SUBJECTS_BUFFER_SIZE: the subjects of one list share this, two usernames fit whole and a third is cut short
+#define ERROR_SUBJECTS_BUFFER_SIZE (2 * ERROR_SUBJECT_SIZE)
 
 #ifdef _WIN32
-#define SOCKET_WSASYSNOTREADY "SOCKET_WSASYSNOTREADY"
-#define SOCKET_WSAVERNOTSUPPORTED "SOCKET_WSAVERNOTSUPPORTED"
-#define SOCKET_WSAVERSIONUNUSABLE "SOCKET_WSAVERSIONUNUSABLE"
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
 #endif
 
-#define GETADDRINFOERROR "GETADDRINFOERROR"
+// error codes are plain integers so classifying them is a compare or a switch,
+// the names only matter once report_errors formats the text
+typedef enum
+{
+    ERR_OK,
+
+    MALLOC_ERROR,
+    THREAD_CREATE_ERROR,
+    SERVER_DISCONNECTED,
+    ERR_SECRET_KEY_LENGTH,
+    ERR_USERNAME_TOO_LONG,
+    ERR_SLOW_CLIENT,
+    ERR_SERVER_FULL,
+    ERR_AUTH_DEADLINE,
+    ERR_SERVER_NOT_RUNNING,
+    ERR_USER_NOT_FOUND,
+    ERR_KICK_ADMIN,
+    ERR_BAN_ENTRY_INVALID,
+    ERR_BLOB_STORE,
+    ERR_BLOB_NOT_FOUND,
+    ERR_BLOB_TOO_LARGE,
+    ERR_TRANSFER_REJECTED,
+    ERR_TRANSFER_STALLED,
+    ERR_UPGRADE_UNSUPPORTED,
+    ERR_UPGRADE_FAILED,
+    ERR_INVALID_TEXT,
+    ERR_FILTER_RULE_INVALID,
+    ERR_MESSAGE_BLOCKED,
+    ERR_SEND_QUEUE_FULL,
+    ERR_LOCAL_TRANSPORT,
+    ERR_MEMORY_BUDGET,
+    ERR_BLOB_QUOTA,
+    ERR_FEDERATION_BAD_KEY,
+    ERR_BAN_LOOPBACK,
+    ERR_FRAME_TOO_LONG,
+
+    ERR_LOCAL_IP_FAILURE,
+    ERR_NO_RESPONSE_BODY,
+    ERR_IP_TOO_LONG,
+    ERR_PUBLIC_IP_UNAVAILABLE,
+
+    SOCKET_WSASYSNOTREADY,
+    SOCKET_WSAVERNOTSUPPORTED,
+    SOCKET_WSAVERSIONUNUSABLE,
+
+    GETADDRINFOERROR,
+
+    SOCKET_ECONNRESET,
+    SOCKET_EINTR,
+    SOCKET_EADDRINUSE,
+    SOCKET_EADDRNOTAVAIL,
+    SOCKET_ENETDOWN,
+    SOCKET_ENETUNREACH,
+    SOCKET_ETIMEDOUT,
+    SOCKET_ECONNREFUSED,
+    SOCKET_EHOSTUNREACH,
+    SOCKET_EWOULDBLOCK,
+    SOCKET_ECANCELED,
+    SOCKET_ECONNABORTED,
+    SOCKET_EMFILE,
+    SOCKET_ENOBUFS,
+    SOCKET_UNKNOWN_ERROR,
 
-#define SOCKET_ECONNRESET "SOCKET_ECONNRESET"
-#define SOCKET_EINTR "SOCKET_EINTR"
-#define SOCKET_EADDRINUSE "SOCKET_EADDRINUSE"
-#define SOCKET_EADDRNOTAVAIL "SOCKET_EADDRNOTAVAIL"
-#define SOCKET_ENETDOWN "SOCKET_ENETDOWN"
-#define SOCKET_ENETUNREACH "SOCKET_ENETUNREACH"
-#define SOCKET_ETIMEDOUT "SOCKET_ETIMEDOUT"
-#define SOCKET_ECONNREFUSED "SOCKET_ECONNREFUSED"
-#define SOCKET_EHOSTUNREACH "SOCKET_EHOSTUNREACH"
-#define SOCKET_UNKNOWN_ERROR "SOCKET_UNKNOWN_ERROR"
+    ERROR_CODE_COUNT
+} error_code_t;
 
 typedef enum
 {
@@ -52,22 +102,37 @@ typedef enum
 
 typedef struct
 {
-    const char *code;
-    int severity;
+    error_code_t code;
+    error_severity_t severity;
+    // message is a string literal, a subject takes the place of its single %s
     const char *message;
     const char *location;
+    // where the subject starts in the list's subjects, -1 without one
+    int subject_offset;
 } error_detail_t;
 
+// not error_t, glibc's errno.h declares that name when the build defines _GNU_SOURCE
 typedef struct
 {
     error_detail_t errors[MAX_ERRORS];
     int count;
-    char aggregated_message[AGGREGATED_ERROR_SIZE];
     int max_severity;
-} error_t;
+    char subjects[ERROR_SUBJECTS_BUFFER_SIZE];
+    size_t subjects_length;
+} error_list_t;
 
-void init_error(error_t *error);
-void add_error(error_t *error, const char *err_code, error_severity_t severity, const char *message, const char *location);
-void report_errors(error_t *error, void (*callback)(const char *, int));
+void init_error(error_list_t *error);
+void add_error(error_list_t *error, error_code_t err_code, error_severity_t severity, const char *message, const char *location);
+void add_error_with_subject(error_list_t *error, error_code_t err_code, error_severity_t severity, const char *message_format, const char *subject, const char *location);
+error_code_t last_error_code(const error_list_t *error);
+// the subject an entry of the list names, "" without one
+const char *error_subject(const error_list_t *error, const error_detail_t *detail);
+// the message with the subject in place of its %s, the subject is copied in and never read as a format
+void format_error_message(const char *message, const char *subject, char *buffer, size_t buffer_size);
+const char *error_code_name(error_code_t err_code);
+size_t format_errors(const error_list_t *error, char *buffer, size_t buffer_size);
+void report_errors(error_list_t *error, void (*callback)(const char *, int));
+// a reset error_list_t owned by the calling thread, meant for the per-message loop of a connection thread
+error_list_t *thread_error_context(void);
 
 #endif
\ No newline at end of file
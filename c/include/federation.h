@@ -0,0 +1,83 @@
+#ifndef FEDERATION_H
+#define FEDERATION_H
+
+#include <stdint.h>
+#include "common.h"
+#include "threads.h"
+#include "logger.h"
+#include "room_log.h"
+
+#define FEDERATION_MAX_PEERS 16
+#define FEDERATION_HOST_BUFFER_SIZE 256
+#define FEDERATION_PORT_BUFFER_SIZE 8
+#define FEDERATION_RECONNECT_INTERVAL_MS 1000
+#define FEDERATION_IDLE_TIMEOUT_MS 100
+// a peer that takes longer than this for one forwarded frame is dropped and resumes once it reconnects
+#define FEDERATION_SEND_TIMEOUT_MS 5000
+// FEDERATION_DEFAULT_LISTEN_ADDRESS: where the federation port listens unless the config names an address
+#define FEDERATION_DEFAULT_LISTEN_ADDRESS "127.0.0.1"
+
+// FEDERATION_FRAME_BUFFER_SIZE calculation:
+// 64: room for the "type:origin:epoch:sequence:" prefix (a digit, three 20-digit integers and four colons)
+// MAX_BUFFER_SIZE: the room message frame that is forwarded as-is, including its delimiter
+#define FEDERATION_FRAME_BUFFER_SIZE (64 + MAX_BUFFER_SIZE)
+
+// node-to-node frames, on the federation port only:
+// hello:   "0:<node id>:<epoch>:<encoded secret key>"      sent by the connecting node
+// resume:  "1:<node id>:<next expected sequence>"          the accepting node's answer
+// forward: "2:<origin node id>:<epoch>:<sequence>:<room message frame>"
+typedef enum
+{
+    FEDERATION_MSG_HELLO,
+    FEDERATION_MSG_RESUME,
+    FEDERATION_MSG_FORWARD
+} federation_message_type_t;
+
+typedef struct
+{
+    char host[FEDERATION_HOST_BUFFER_SIZE];
+    char port[FEDERATION_PORT_BUFFER_SIZE];
+} federation_peer_address_t;
+
+typedef struct
+{
+    unsigned long node_id;
+    // empty for FEDERATION_DEFAULT_LISTEN_ADDRESS
+    char listen_address[FEDERATION_HOST_BUFFER_SIZE];
+    char listen_port[FEDERATION_PORT_BUFFER_SIZE];
+    federation_peer_address_t peers[FEDERATION_MAX_PEERS];
+    size_t peer_count;
+} federation_config_t;
+
+typedef struct
+{
+    unsigned long node_id;
+    uint64_t epoch;
+    uint64_t next_sequence;
+    // held while one of its frames is delivered, so a reconnecting link can't overtake the old one
+    mutex_t deliver_mutex;
+} federation_origin_t;
+
+typedef struct
+{
+    size_t peer_index;
+    void (*callback_error_func)(const char *, int);
+} federation_sender_thread_args_t;
+
+typedef struct
+{
+    socket_t peer_socket;
+    void (*callback_error_func)(const char *, int);
+} federation_receiver_thread_args_t;
+
+int federation_parse_peers(const char *peer_list, federation_config_t *config);
+int federation_start(const federation_config_t *config, const char *secret_key, void (*deliver_frame_func)(const char *, size_t), error_list_t *error, void (*callback_error_func)(const char *, int));
+void federation_stop(void);
+int federation_is_running(void);
+int federation_publish(const char *frame, size_t frame_length, error_list_t *error);
+
+thread_ret_t THREAD_CALL federation_listener_thread(void *arg);
+thread_ret_t THREAD_CALL federation_sender_thread(void *arg);
+thread_ret_t THREAD_CALL federation_receiver_thread(void *arg);
+
+#endif
\ No newline at end of file
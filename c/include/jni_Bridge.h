@@ -29,6 +29,20 @@ extern "C"
    */
   JNIEXPORT void JNICALL Java_jni_Bridge_joinChatRoom(JNIEnv *, jclass, jstring, jstring, jstring, jstring);
 
+  /*
+   * Class:     jni_Bridge
+   * Method:    joinChatRoomAsync
+   * Signature: (Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)V
+   */
+  JNIEXPORT void JNICALL Java_jni_Bridge_joinChatRoomAsync(JNIEnv *, jclass, jstring, jstring, jstring, jstring);
+
+  /*
+   * Class:     jni_Bridge
+   * Method:    cancelConnect
+   * Signature: ()V
+   */
+  JNIEXPORT void JNICALL Java_jni_Bridge_cancelConnect(JNIEnv *, jclass);
+
   /*
    * Class:     jni_Bridge
    * Method:    sendMessage
@@ -36,6 +50,55 @@ extern "C"
    */
   JNIEXPORT void JNICALL Java_jni_Bridge_sendMessage(JNIEnv *, jclass, jstring);
 
+  /*
+   * Class:     jni_Bridge
+   * Method:    sendMessageAsync
+   * Signature: (Ljava/lang/String;)J
+   */
+  JNIEXPORT jlong JNICALL Java_jni_Bridge_sendMessageAsync(JNIEnv *, jclass, jstring);
+
+  /*
+   * Class:     jni_Bridge
+   * Method:    cancelSend
+   * Signature: (J)Z
+   */
+  JNIEXPORT jboolean JNICALL Java_jni_Bridge_cancelSend(JNIEnv *, jclass, jlong);
+
+  /*
+   * Class:     jni_Bridge
+   * Method:    sendAttachment
+   * Signature: (Ljava/lang/String;Ljava/lang/String;)V
+   */
+  JNIEXPORT void JNICALL Java_jni_Bridge_sendAttachment(JNIEnv *, jclass, jstring, jstring);
+
+  /*
+   * Class:     jni_Bridge
+   * Method:    downloadAttachment
+   * Signature: (Ljava/lang/String;Ljava/lang/String;)I
+   */
+  JNIEXPORT jint JNICALL Java_jni_Bridge_downloadAttachment(JNIEnv *, jclass, jstring, jstring);
+
+  /*
+   * Class:     jni_Bridge
+   * Method:    searchHistory
+   * Signature: (Ljava/lang/String;JJ)V
+   */
+  JNIEXPORT void JNICALL Java_jni_Bridge_searchHistory(JNIEnv *, jclass, jstring, jlong, jlong);
+
+  /*
+   * Class:     jni_Bridge
+   * Method:    sendTyping
+   * Signature: (Z)V
+   */
+  JNIEXPORT void JNICALL Java_jni_Bridge_sendTyping(JNIEnv *, jclass, jboolean);
+
+  /*
+   * Class:     jni_Bridge
+   * Method:    sendDirectMessage
+   * Signature: ([Ljava/lang/String;Ljava/lang/String;)J
+   */
+  JNIEXPORT jlong JNICALL Java_jni_Bridge_sendDirectMessage(JNIEnv *, jclass, jobjectArray, jstring);
+
   /*
    * Class:     jni_Bridge
    * Method:    kickUser
@@ -50,6 +113,13 @@ extern "C"
    */
   JNIEXPORT void JNICALL Java_jni_Bridge_banUser(JNIEnv *, jclass, jstring);
 
+  /*
+   * Class:     jni_Bridge
+   * Method:    setContentFilter
+   * Signature: (Ljava/lang/String;)I
+   */
+  JNIEXPORT jint JNICALL Java_jni_Bridge_setContentFilter(JNIEnv *, jclass, jstring);
+
   /*
    * Class:     jni_Bridge
    * Method:    leaveChatRoom
@@ -64,10 +134,25 @@ extern "C"
    */
   JNIEXPORT void JNICALL Java_jni_Bridge_closeChatRoom(JNIEnv *, jclass);
 
+  /*
+   * Class:     jni_Bridge
+   * Method:    getMemoryReport
+   * Signature: ()Ljava/lang/String;
+   */
+  JNIEXPORT jstring JNICALL Java_jni_Bridge_getMemoryReport(JNIEnv *, jclass);
+
   void callback_error(const char *aggregated_message, int max_severity);
   void callback_message(const char *message, const char *username);
   void callback_server_error(error_type_t error_type, const char *message);
   void callback_notification(notification_type_t notification_type, const char *message);
+  void callback_presence(presence_op_t presence_op, const char *username, const char *new_username);
+  void callback_attachment(const char *username, const char *hash_hex, uint64_t size, const char *name);
+  void callback_search(const char *username, const char *message, uint64_t timestamp);
+  void callback_typing(const char **usernames, size_t count);
+  void callback_direct(const char *sender_username, const char **recipients, size_t recipient_count, const char *message);
+  void callback_direct_ack(uint32_t sequence, char status, const char *recipient);
+  void callback_send(uint64_t request_id, send_status_t status);
+  void callback_join(int result);
 
 #ifdef __cplusplus
 }
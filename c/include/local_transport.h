@@ -0,0 +1,91 @@
+#ifndef LOCAL_TRANSPORT_H
+#define LOCAL_TRANSPORT_H
+
+#include <stdint.h>
+#include "sockets.h"
+#include "threads.h"
+
+// a local connection starts as a Unix domain socket, the server answers it with a shared memory region and the eventfds
+// both sides wake each other with. after that every byte goes through the region's two rings and the socket only
+// tells each side when the other one is gone. it is the same byte stream a TCP connection carries, the sockets
+// layer routes a local connection's socket_send, socket_recv and socket_poll here
+#define LOCAL_TRANSPORT_MAGIC 0x4c435243u
+#define LOCAL_TRANSPORT_VERSION 1
+// LOCAL_TRANSPORT_RING_SIZE: bytes in flight in one direction, a power of two so positions wrap with a mask
+#define LOCAL_TRANSPORT_RING_SIZE (256 * 1024)
+// LOCAL_TRANSPORT_MAX_DESCRIPTOR: connections are found by descriptor, a socket numbered past it is refused the transport
+#define LOCAL_TRANSPORT_MAX_DESCRIPTOR 4096
+// LOCAL_TRANSPORT_WAIT_SLICE_MS: a blocked send or recv checks the rings at least this often, two threads waiting
+// for the same ring may drain each other's wakeup
+#define LOCAL_TRANSPORT_WAIT_SLICE_MS 50
+// LOCAL_TRANSPORT_HANDSHAKE_TIMEOUT_MS: a server that doesn't hand over the region within this fails the connect
+#define LOCAL_TRANSPORT_HANDSHAKE_TIMEOUT_MS 2000
+// LOCAL_TRANSPORT_PORT_BUFFER_SIZE: the room's TCP port rides along in the handshake, attachments still travel over TCP
+#define LOCAL_TRANSPORT_PORT_BUFFER_SIZE 6
+// the region, the server's and the client's data doorbells and the server's and the client's space doorbells
+#define LOCAL_TRANSPORT_DESCRIPTOR_COUNT 5
+
+// one direction of the connection. positions only grow and wrap at 2^32, head - tail is what is waiting to be read.
+// the producer and the consumer each write their own cache line, the flags ask the other side for a wakeup
+typedef struct
+{
+    _Alignas(64) atomic_uint head;
+    atomic_int producer_waiting;
+    atomic_int producer_closed;
+    _Alignas(64) atomic_uint tail;
+    atomic_int consumer_waiting;
+    atomic_int consumer_closed;
+    _Alignas(64) char data[LOCAL_TRANSPORT_RING_SIZE];
+} local_ring_t;
+
+// what the memfd holds, both processes map it
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ring_size;
+    char port[LOCAL_TRANSPORT_PORT_BUFFER_SIZE];
+    local_ring_t to_server;
+    local_ring_t to_client;
+} local_region_t;
+
+// one end of a connection, it lives in the process that owns it and is found by the connection's socket
+typedef struct
+{
+    socket_t socket;
+    local_region_t *region;
+    local_ring_t *rx;
+    local_ring_t *tx;
+    // rung by the peer when rx has new data or tx has room again, we ring the other two
+    int rx_data_doorbell;
+    int tx_space_doorbell;
+    int tx_data_doorbell;
+    int rx_space_doorbell;
+    // set once the peer's socket hangs up, a peer that dies never closes its rings
+    atomic_int hung_up;
+    atomic_int nonblocking;
+    // several threads may write to one client, the ring takes one producer at a time
+    mutex_t send_mutex;
+} local_channel_t;
+
+socket_t local_transport_listen(const char *path, error_list_t *error);
+// the server's side of the handshake, port is the room's TCP port. the connection comes out non-blocking like an accepted one
+socket_t local_transport_accept(socket_t listener, const char *port, error_list_t *error);
+// the client's side, port receives the room's TCP port
+socket_t local_transport_connect(const char *path, char *port, size_t port_size, error_list_t *error);
+void local_transport_close_listener(socket_t listener);
+
+// 1 when the socket is a local connection, a single load while there are none
+int local_transport_owns(socket_t sock);
+// 1 while any local connection is open, a poll set without one goes to the kernel as it is
+int local_transport_active(void);
+// these follow send, recv and poll: -1 with errno set on failure, EAGAIN when a non-blocking call would wait
+int local_transport_send(socket_t sock, const void *buf, size_t len, int flags);
+int local_transport_recv(socket_t sock, void *buf, size_t len, int flags);
+int local_transport_poll(pollfd_t *fds, size_t count, int timeout_ms);
+void local_transport_set_nonblocking(socket_t sock, int nonblocking);
+void local_transport_shutdown(socket_t sock);
+// unmaps the region and closes the socket along with the doorbells
+int local_transport_close(socket_t sock);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,101 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdint.h>
+#include <stdarg.h>
+#include "common.h"
+#include "threads.h"
+
+// every thread that logs gets its own ring, only the writer thread reads them. a ring goes back to the pool
+// when its thread exits, past LOG_MAX_RINGS threads logging at once the extra ones lose their records
+#define LOG_MAX_RINGS 256
+#define LOG_RING_CAPACITY 256 // must be a power of 2
+#define LOG_FLUSH_INTERVAL_MS 20
+
+// LOG_ARGS_SIZE: the arguments of one event in binary form, strings are copied in and cut off when they don't fit
+#define LOG_ARGS_SIZE 192
+#define LOG_MAX_ARGS 8
+#define LOG_LINE_SIZE 1024
+
+// repeats of the same event beyond LOG_RATE_LIMIT_BURST per window are counted instead of written
+#define LOG_RATE_LIMIT_WINDOW_MS 1000
+#define LOG_RATE_LIMIT_BURST 5
+#define LOG_RATE_LIMIT_SLOTS 64
+
+typedef enum
+{
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_ERROR
+} log_level_t;
+
+typedef enum
+{
+    LOG_RECORD_EVENT,
+    LOG_RECORD_ERROR
+} log_record_kind_t;
+
+typedef enum
+{
+    LOG_ARG_STRING,
+    LOG_ARG_INT
+} log_arg_type_t;
+
+typedef struct
+{
+    uint64_t timestamp_ms;
+    log_level_t level;
+    log_record_kind_t kind;
+    const char *location;
+    // an event's format is a string literal using only %s and %d
+    const char *format;
+    // error reports span several records, the first one says how many follow
+    int batch_remaining;
+    int arg_count;
+    unsigned char arg_types[LOG_MAX_ARGS];
+    size_t args_length;
+    union
+    {
+        char args[LOG_ARGS_SIZE];
+        struct
+        {
+            error_detail_t detail;
+            // the list's subjects buffer stays behind, the record carries its own copy
+            char subject[ERROR_SUBJECT_SIZE];
+        } error;
+    } payload;
+} log_record_t;
+
+typedef struct
+{
+    log_record_t records[LOG_RING_CAPACITY];
+    // tail is only written by the owning thread, head only by the writer thread
+    atomic_size_t head;
+    atomic_size_t tail;
+    atomic_int in_use;
+} log_ring_t;
+
+typedef struct
+{
+    const char *key_location;
+    const void *key_format;
+    int key_code;
+    uint64_t window_start_ms;
+    int count;
+    int suppressed;
+    log_level_t level;
+} log_rate_slot_t;
+
+int logger_start(log_level_t min_level, error_list_t *error);
+void logger_stop(void);
+int logger_is_running(void);
+void logger_set_level(log_level_t min_level);
+void log_event(log_level_t level, const char *location, const char *format, ...);
+void log_errors(const error_list_t *error);
+void logger_thread_detach(void);
+uint64_t logger_dropped_count(void);
+
+thread_ret_t THREAD_CALL logger_writer_thread(void *arg);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <stddef.h>
+#include "common.h"
+#include "threads.h"
+
+// MEMORY_BUDGET_DEFAULT: bytes the room's connections may hold between them, stacks included.
+// MAX_CONNECTIONS connections at THREAD_STACK_SIZE take half of it, the rest is for their queues
+#define MEMORY_BUDGET_DEFAULT ((size_t)1024 * 1024 * 1024)
+
+// what a connection's bytes are spent on
+typedef enum
+{
+    // the client node, the strand, the frame reader and the thread's arguments, the same for every connection
+    MEMORY_CONNECTION,
+    // the stack reserved for the connection's reader thread
+    MEMORY_STACK,
+    // frames queued for one client only, the room logs every member reads are shared and counted apart
+    MEMORY_OUTBOX,
+    // frames read from a client and waiting for a worker
+    MEMORY_INBOX,
+    MEMORY_CATEGORY_COUNT
+} memory_category_t;
+
+// 0 lifts the limit, what is already charged stays charged
+void memory_budget_set(size_t budget);
+size_t memory_budget_get(void);
+// charges the bytes unless the total would go past the budget, returns 1 then and charges nothing
+int memory_budget_try_charge(memory_category_t category, size_t bytes);
+// charges the bytes even past the budget, for memory that is already spent or can't be refused
+void memory_budget_charge(memory_category_t category, size_t bytes);
+void memory_budget_release(memory_category_t category, size_t bytes);
+size_t memory_budget_used(memory_category_t category);
+size_t memory_budget_total(void);
+const char *memory_budget_category_name(memory_category_t category);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include "common.h"
+#include "threads.h"
+
+// deltas recorded within this window are merged and sent as one batch
+#define PRESENCE_COALESCE_WINDOW_MS 100
+
+// PRESENCE_TABLE_SIZE: open addressing slots for pending deltas (must be a power of two),
+// a batch is flushed early once it holds PRESENCE_TABLE_SIZE / 2 names
+#define PRESENCE_TABLE_SIZE 4096
+
+typedef struct
+{
+    char username[USERNAME_BUFFER_SIZE];
+    // set when the entry was created by a rename, so the batch can report it as one
+    char previous_username[USERNAME_BUFFER_SIZE];
+    // the member ID holding the name now and the one that held it when it was last announced
+    uint32_t member_id;
+    uint32_t previous_member_id;
+    int in_use;
+    int consumed;
+    // presence as last announced to the room and as of now, equal values cancel out
+    int was_present;
+    int is_present;
+} presence_entry_t;
+
+typedef struct
+{
+    presence_entry_t *entries;
+    size_t *order;
+    size_t count;
+} presence_table_t;
+
+int presence_start(void (*broadcast_frame_func)(const char *, size_t), error_list_t *error);
+void presence_stop(void);
+void presence_record_join(const char *username, uint32_t member_id);
+void presence_record_leave(const char *username, uint32_t member_id);
+void presence_record_rename(const char *old_username, const char *new_username, uint32_t member_id);
+void presence_flush(void);
+
+thread_ret_t THREAD_CALL presence_flush_thread(void *arg);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef PUBLIC_IP_H
+#define PUBLIC_IP_H
+
+#include "common.h"
+#include "threads.h"
+#include "logger.h"
+
+// a provider list is "host[:port][/path]" entries separated by commas
+#define PUBLIC_IP_DEFAULT_PROVIDERS "api.ipify.org,ifconfig.me,checkip.amazonaws.com"
+#define PUBLIC_IP_DEFAULT_PORT "80"
+#define PUBLIC_IP_MAX_PROVIDERS 8
+#define PUBLIC_IP_HOST_BUFFER_SIZE 256
+#define PUBLIC_IP_PORT_BUFFER_SIZE 8
+#define PUBLIC_IP_PATH_BUFFER_SIZE 128
+
+// the whole discovery gives up after PUBLIC_IP_TIMEOUT_MS, no matter how many providers are still pending
+#define PUBLIC_IP_TIMEOUT_MS 3000
+#define PUBLIC_IP_CACHE_TTL_MS (10 * 60 * 1000)
+
+// PUBLIC_IP_REQUEST_BUFFER_SIZE calculation:
+// 64: the request line and header text around the path and host
+// PUBLIC_IP_PATH_BUFFER_SIZE, PUBLIC_IP_HOST_BUFFER_SIZE: the path and host, each including a spare byte
+#define PUBLIC_IP_REQUEST_BUFFER_SIZE (64 + PUBLIC_IP_PATH_BUFFER_SIZE + PUBLIC_IP_HOST_BUFFER_SIZE)
+#define PUBLIC_IP_RESPONSE_BUFFER_SIZE 2048
+
+typedef struct
+{
+    char host[PUBLIC_IP_HOST_BUFFER_SIZE];
+    char port[PUBLIC_IP_PORT_BUFFER_SIZE];
+    char path[PUBLIC_IP_PATH_BUFFER_SIZE];
+} public_ip_provider_t;
+
+typedef struct
+{
+    public_ip_provider_t provider;
+    unsigned long round;
+} public_ip_query_thread_args_t;
+
+int set_public_ip_providers(const char *provider_list);
+void start_public_ip_discovery(void);
+int get_public_ip(char *ip_buffer, size_t buffer_size, error_list_t *error);
+int query_public_ip_provider(const public_ip_provider_t *provider, char *ip_buffer, size_t buffer_size);
+
+thread_ret_t THREAD_CALL public_ip_query_thread(void *arg);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef ROOM_LOG_H
+#define ROOM_LOG_H
+
+#include <stdint.h>
+#include "common.h"
+#include "threads.h"
+
+// ROOM_LOG_CAPACITY: number of frames kept in the shared log (must be a power of two),
+// a client whose cursor falls further behind than this loses the overwritten frames
+#define ROOM_LOG_CAPACITY 1024
+
+typedef struct
+{
+    uint64_t sequence;
+    size_t length;
+    char data[MAX_BUFFER_SIZE];
+} room_log_entry_t;
+
+typedef struct
+{
+    room_log_entry_t *entries;
+    size_t capacity;
+    atomic_ullong head;
+    rwlock_t rwlock;
+} room_log_t;
+
+int room_log_init(room_log_t *log, size_t capacity, error_list_t *error);
+void room_log_destroy(room_log_t *log);
+// a frame longer than an entry is refused, cutting it would leave readers without its delimiter
+int room_log_append(room_log_t *log, const char *frame, size_t length, error_list_t *error);
+uint64_t room_log_head(room_log_t *log);
+uint64_t room_log_tail(room_log_t *log);
+
+// room_log_get must be called between room_log_read_lock and room_log_read_unlock
+void room_log_read_lock(room_log_t *log);
+void room_log_read_unlock(room_log_t *log);
+const room_log_entry_t *room_log_get(room_log_t *log, uint64_t sequence);
+
+#endif
\ No newline at end of file
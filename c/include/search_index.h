@@ -0,0 +1,84 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <stdint.h>
+#include "common.h"
+#include "threads.h"
+
+// SEARCH_MAX_TERM_LENGTH: bytes of a term that are indexed, a longer word is cut at the last whole character before it
+#define SEARCH_MAX_TERM_LENGTH 32
+// SEARCH_MAX_QUERY_TERMS: terms of a query (phrases included) that are looked up, the rest is ignored
+#define SEARCH_MAX_QUERY_TERMS 8
+// SEARCH_MAX_RESULTS: hits sent back for one query, newest first
+#define SEARCH_MAX_RESULTS 50
+// SEARCH_POSTING_BLOCK_SIZE: postings per independently decodable block, a list is skipped through a block at a time
+#define SEARCH_POSTING_BLOCK_SIZE 128
+// SEARCH_TERM_TABLE_INITIAL_CAPACITY: open addressing slots for terms (must be a power of two), doubles at half load
+#define SEARCH_TERM_TABLE_INITIAL_CAPACITY 4096
+// SEARCH_INDEX_MAX_DOCUMENTS: messages indexed per room, SEARCH_INDEX_MAX_BYTES: what their text, postings and tables take.
+// past either one the oldest 1/SEARCH_INDEX_EVICT_DIVISOR of the messages stops being searchable, so the posting
+// lists are rebuilt once per that many new messages instead of on every one
+#define SEARCH_INDEX_MAX_DOCUMENTS (1024u * 1024)
+#define SEARCH_INDEX_MAX_BYTES ((size_t)128 * 1024 * 1024)
+#define SEARCH_INDEX_EVICT_DIVISOR 4
+// SEARCH_INDEX_MAX_PENDING: messages waiting for the indexer before new ones are dropped from the index,
+// broadcasting never waits on it
+#define SEARCH_INDEX_MAX_PENDING 65536
+// SEARCH_INDEX_BATCH: messages indexed under one hold of the writer lock, queries wait at most one batch
+#define SEARCH_INDEX_BATCH 256
+
+// a posting list is the ascending IDs of the messages containing a term, each stored as the LEB128 varint
+// of its distance to the previous one. every block starts from its base, so it decodes without the blocks before it
+typedef struct
+{
+    // the ID before the block's first one (0 for the first block) and the block's last ID
+    uint32_t base;
+    uint32_t last;
+    uint32_t offset;
+    uint32_t count;
+} posting_block_t;
+
+typedef struct
+{
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    posting_block_t *blocks;
+    size_t block_count;
+    size_t block_capacity;
+    uint32_t count;
+} posting_list_t;
+
+typedef struct
+{
+    char term[SEARCH_MAX_TERM_LENGTH + 1];
+    uint32_t hash;
+    posting_list_t postings;
+} search_term_t;
+
+// message IDs are positions in the document table plus one, in broadcast order, so time only ever grows with the ID
+typedef struct
+{
+    uint64_t timestamp;
+    // the sender and the decoded message, both null terminated, one after the other in the text arena
+    size_t text_offset;
+} search_document_t;
+
+typedef struct search_pending
+{
+    struct search_pending *next;
+    uint64_t timestamp;
+    // the sender's null terminated name followed by the encoded message
+    char data[];
+} search_pending_t;
+
+int search_index_start(error_list_t *error);
+void search_index_stop(void);
+void search_index_submit(const char *sender_username, const char *encoded_message);
+// terms, and "quoted phrases", that all have to occur in a message sent between since and until (unix seconds, 0 for open),
+// hit_func runs under the index's reader lock for each hit, newest first. returns the number of hits
+size_t search_index_query(const char *query, uint64_t since, uint64_t until, size_t max_hits, void (*hit_func)(uint64_t, const char *, const char *, void *), void *context);
+
+thread_ret_t THREAD_CALL search_index_thread(void *arg);
+
+#endif
\ No newline at end of file
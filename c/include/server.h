@@ -3,17 +3,217 @@
 
 #include "common.h"
 #include "threads.h"
+#include "logger.h"
+#include "room_log.h"
+#include "presence.h"
+#include "typing.h"
+#include "username_index.h"
+#include "worker_pool.h"
+#include "federation.h"
+#include "ban_filter.h"
+#include "content_filter.h"
+#include "blob_store.h"
+#include "upgrade.h"
+#include "local_transport.h"
+#include "search_index.h"
+#include "utf8.h"
+#include "memory_budget.h"
 
 #define PORT "6666"
 
+// ROOM_WRITER_BATCH_FRAMES: room log frames copied for one client per writer pass, they go out together before the next client
+#define ROOM_WRITER_BATCH_FRAMES 64
+#define ROOM_WRITER_POLL_TIMEOUT_MS 10
+#define ROOM_WRITER_IDLE_TIMEOUT_MS 100
+// FRAME_LANE_STARVATION_LIMIT: frames a client may be sent from higher lanes while a lower lane waits,
+// after that the waiting lane gets one frame through
+#define FRAME_LANE_STARVATION_LIMIT 16
+
+// CLIENT_STRAND_BATCH_FRAMES: frames of one client a worker handles before it requeues the client behind the others
+#define CLIENT_STRAND_BATCH_FRAMES 32
+// CLIENT_STRAND_MAX_PENDING: frames a client may have queued before its reader stops reading from the socket
+#define CLIENT_STRAND_MAX_PENDING 256
+
+// admission control defaults, see set_admission_limits
+#define MAX_CONNECTIONS 1024
+// MAX_PENDING_AUTH: connections that have not authenticated yet, a flood of idle sockets is shed here
+#define MAX_PENDING_AUTH 64
+#define AUTH_DEADLINE_MS 5000
+// ACCEPT_BATCH: connections taken off the backlog per wakeup before admission is checked again
+#define ACCEPT_BATCH 32
+#define ACCEPT_POLL_TIMEOUT_MS 100
+// ACCEPT_BACKOFF_MS: pause after the process ran out of descriptors or buffers, the backlog keeps the connections meanwhile
+#define ACCEPT_BACKOFF_MS 100
+#define CLIENT_READ_POLL_TIMEOUT_MS 1000
+// CLIENT_SEND_TIMEOUT_MS: a frame sent outside the room writer must be taken whole within this, a client that doesn't is cut off
+#define CLIENT_SEND_TIMEOUT_MS 2000
+// UPGRADE_PARK_TIMEOUT_MS: a handoff gives up when a reader hasn't parked within this, every reader wakes up at least once per read poll
+#define UPGRADE_PARK_TIMEOUT_MS (2 * CLIENT_READ_POLL_TIMEOUT_MS)
+// ROOM_CLOSE_DRAIN_TIMEOUT_MS: a closing room flushes what is queued for each client and the disconnect notice after it,
+// a client still behind after this is cut off without them
+#define ROOM_CLOSE_DRAIN_TIMEOUT_MS 2000
+// ROOM_CLOSE_EXIT_TIMEOUT_MS: connection threads get this long to see their sockets shut down and leave,
+// close_chat_room returns within the two timeouts plus the joins of the room's own threads
+#define ROOM_CLOSE_EXIT_TIMEOUT_MS 1000
+#define ROOM_CLOSE_POLL_MS 10
+// MEMORY_REPORT_INTERVAL_MS: how often the accept thread logs what the connections use, see format_memory_report
+#define MEMORY_REPORT_INTERVAL_MS 60000
+#define MEMORY_REPORT_BUFFER_SIZE 512
+
+// the host's in-process membership is keyed by a socket value no accepted connection can have
+#define LOCAL_MEMBER_SOCKET INVALID_SOCK
+// LOCAL_MEMBER_MAX_PENDING: frames queued for the host UI before new ones are dropped, like a client falling out of the room log
+#define LOCAL_MEMBER_MAX_PENDING 4096
+
 #define SECRET_KEY_CHAR_SET "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789!@#$%^&*()-_=+[]{}|;:,.<>?/"
 
+typedef enum
+{
+    DELIVERY_MODE_PUSH,
+    DELIVERY_MODE_PULL
+} delivery_mode_t;
+
+// a connection's frames by priority, a higher lane is always drained first (up to the starvation limit)
+typedef enum
+{
+    // errors and notifications addressed to one client: auth results, kicks, bans
+    FRAME_LANE_CONTROL,
+    // presence snapshots and deltas, and every lane below has a shared room log
+    FRAME_LANE_PRESENCE,
+    FRAME_LANE_CHAT,
+    // attachment references and search results
+    FRAME_LANE_BULK,
+    FRAME_LANE_COUNT
+} frame_lane_t;
+
+typedef enum
+{
+    FRAME_SOURCE_NONE,
+    FRAME_SOURCE_OUTBOX,
+    // room log frames, and the room's typing set when no lane has anything, copied into the client's frame_copy
+    FRAME_SOURCE_COPY
+} frame_source_t;
+
+typedef enum
+{
+    FLUSH_IDLE,
+    FLUSH_BLOCKED,
+    FLUSH_MORE
+} flush_result_t;
+
+typedef struct outbox_frame
+{
+    struct outbox_frame *next;
+    size_t length;
+    char data[];
+} outbox_frame_t;
+
+typedef struct
+{
+    // frames addressed to this client only, guarded by the client's outbox mutex
+    outbox_frame_t *outbox_head;
+    outbox_frame_t *outbox_tail;
+    // position in the lane's room log, owned by the room writer thread (also reset under the list's writer lock)
+    uint64_t log_cursor;
+    // frames sent from higher lanes while this one had frames waiting
+    unsigned int waited;
+} client_lane_t;
+
 typedef struct client_node
 {
     user_info_t client_info;
+    // room log frames are only delivered once the client has authenticated
+    int authenticated;
+    // pull delivery state, owned by the room writer thread
+    size_t frame_offset;
+    frame_source_t frame_source;
+    // a frame that is partly sent is finished before any other lane is looked at
+    frame_lane_t frame_lane;
+    int send_failed;
+    // set by kick_client, the writer shuts the socket down once the outbox (with the kick notice) is flushed
+    int disconnect_pending;
+    // set by the writer once a closing room has queued the disconnect notice, the notice is shut down after the same way
+    int close_notice_queued;
+    // assigned on authentication and kept across renames, broadcast frames name the sender by it
+    uint32_t member_id;
+    // set for a transfer connection, it never authenticates as a member and doesn't count as pending auth
+    int transfer;
+    // set by the connection's reader while it is parked for a hot upgrade, the input is what it read past the last whole frame
+    int handoff_ready;
+    const char *handoff_input;
+    size_t handoff_input_length;
+    // set while the member wants typing indicators, it gets the room's latest typing set whenever it has nothing else to read.
+    // a set replaced before the client got to it is never sent
+    int typing_subscribed;
+    uint64_t typing_generation;
+    // copied under the room logs' locks, the writer sends from here without them and a log that wraps meanwhile doesn't matter
+    char frame_copy[MAX_BUFFER_SIZE];
+    size_t frame_copy_length;
+    mutex_t outbox_mutex;
+    client_lane_t lanes[FRAME_LANE_COUNT];
+    // what the lanes' outbox frames take, charged to MEMORY_OUTBOX and guarded by the outbox mutex
+    size_t outbox_bytes;
     struct client_node *next;
 } client_node_t;
 
+// the frames of one connection, run on the worker pool one at a time and in order
+typedef struct
+{
+    socket_t client_socket;
+    void (*callback_error_func)(const char *, int);
+    // written under the mutex by the strand's task, read without it by that same task
+    char username[USERNAME_BUFFER_SIZE];
+    // only touched by the strand's task
+    uint32_t member_id;
+    // the lanes the member's alias went out in since it last changed its name
+    unsigned int alias_lanes;
+    mutex_t mutex;
+    cond_t cond;
+    outbox_frame_t *inbox_head;
+    outbox_frame_t *inbox_tail;
+    size_t pending;
+    // what the inbox frames take, charged to MEMORY_INBOX
+    size_t pending_bytes;
+    // set while the strand is queued on or running in the pool
+    int scheduled;
+    int closing;
+} client_strand_t;
+
+// the host UI as a room member: frames are handed over in memory and delivered to the callbacks by one thread
+typedef struct
+{
+    char username[USERNAME_BUFFER_SIZE];
+    void (*callback_error_func)(const char *, int);
+    void (*callback_message_func)(const char *, const char *);
+    void (*callback_presence_func)(presence_op_t, const char *, const char *);
+    void (*callback_attachment_func)(const char *, const char *, uint64_t, const char *);
+    void (*callback_search_func)(const char *, const char *, uint64_t);
+    void (*callback_typing_func)(const char **, size_t);
+    void (*callback_direct_func)(const char *, const char **, size_t, const char *);
+    void (*callback_direct_ack_func)(uint32_t, char, const char *);
+    uint32_t member_id;
+    // numbers the host's direct messages, their acks carry it back
+    atomic_uint next_direct_sequence;
+    unsigned int alias_lanes;
+    // owned by the member's thread
+    member_table_t members;
+    mutex_t mutex;
+    cond_t cond;
+    outbox_frame_t *inbox_head;
+    outbox_frame_t *inbox_tail;
+    size_t pending;
+    int running;
+    thread_t thread;
+} local_member_t;
+
+// the hits of one search, collected under the index's lock and sent after it
+typedef struct
+{
+    outbox_frame_t *head;
+    outbox_frame_t *tail;
+    size_t count;
+} search_reply_t;
+
 typedef struct
 {
     socket_t *listening_socket;
@@ -24,24 +224,86 @@ typedef struct
 {
     socket_t client_socket;
     void (*callback_error_func)(const char *, int);
+    // a connection taken over from the previous server, owned by the thread, NULL for a new one
+    upgrade_connection_t *inherited;
 } handle_client_thread_args_t;
 
+typedef struct
+{
+    void (*callback_error_func)(const char *, int);
+} room_writer_thread_args_t;
 
-int start_chat_room(const char *admin_username, char *local_ip, error_t *error, void (*callback_error_func)(const char *, int));
-int close_chat_room(error_t *error);
+int start_chat_room(const char *admin_username, char *local_ip, error_list_t *error, void (*callback_error_func)(const char *, int));
+// stops accepting at once, sends every client what is queued for it and a NOTIFICATION_DISCONNECT, then closes
+// the connections. returns once the room is torn down, see ROOM_CLOSE_DRAIN_TIMEOUT_MS
+int close_chat_room(error_list_t *error);
 thread_ret_t THREAD_CALL accept_client_thread(void *arg);
 thread_ret_t THREAD_CALL handle_client_thread(void *arg);
-void broadcast_message(const char *message, const char *sender_username, error_t *error, void (*callback_error_func)(const char *, int));
-int add_client(user_info_t *client_info, error_t *error);
-void update_client_info(socket_t client_socket, const char *username, user_type_t user_type);
-void remove_client(socket_t client_socket, error_t *error);
-void remove_all_clients(error_t *error);
+int admit_client(socket_t client_socket, struct sockaddr_in *client_addr, error_list_t *error, void (*callback_error_func)(const char *, int));
+void shed_client(socket_t client_socket, const char *reason, error_list_t *error);
+thread_ret_t THREAD_CALL room_writer_thread(void *arg);
+thread_ret_t THREAD_CALL local_member_thread(void *arg);
+thread_ret_t THREAD_CALL upgrade_listener_thread(void *arg);
+void client_strand_init(client_strand_t *strand, socket_t client_socket, void (*callback_error_func)(const char *, int));
+void client_strand_destroy(client_strand_t *strand);
+void client_strand_enqueue(client_strand_t *strand, const char *frame, size_t length);
+void client_strand_close(client_strand_t *strand);
+void run_client_strand(void *arg);
+void process_client_frame(client_strand_t *strand, char *frame, error_list_t *error);
+void serve_transfer(socket_t client_socket, char *frame, const char *received, size_t received_length, void (*callback_error_func)(const char *, int));
+void set_worker_pool_size(size_t worker_count);
+void set_admission_limits(int max_connections, int max_pending_auth, int auth_deadline_ms);
+void set_delivery_mode(delivery_mode_t mode);
+// the connections' memory by category against the budget, and what one connection costs on average.
+// returns the report's length, the totals are also logged every MEMORY_REPORT_INTERVAL_MS while the room runs
+size_t format_memory_report(char *buffer, size_t buffer_size);
+void wake_room_writer(void);
+// stage_client_frames runs under the list's reader lock and the room logs' reader locks and picks the client's next frames,
+// send_staged_frames sends them after those locks are released
+flush_result_t stage_client_frames(client_node_t *client, error_list_t *error);
+flush_result_t send_staged_frames(client_node_t *client, error_list_t *error);
+int enqueue_direct_frame(socket_t client_socket, frame_lane_t lane, const char *frame, size_t length, error_list_t *error);
+void broadcast_frame(frame_lane_t lane, const char *frame, size_t frame_length);
+outbox_frame_t *build_presence_snapshot(void);
+void broadcast_attachment(const char *hash_hex, uint64_t size, const char *name, uint32_t sender_member_id);
+void broadcast_member_alias(frame_lane_t lane, uint32_t member_id, const char *username, unsigned int *alias_lanes);
+void broadcast_message(const char *message, const char *sender_username, uint32_t sender_member_id, error_list_t *error, void (*callback_error_func)(const char *, int));
+int add_client(user_info_t *client_info, error_list_t *error);
+// the member's ID, 0 when the name is empty or held by another member, or the connection is gone
+uint32_t update_client_info(socket_t client_socket, const char *username, user_type_t user_type, error_list_t *error);
+void remove_client(socket_t client_socket, error_list_t *error);
+void remove_all_clients(error_list_t *error);
+void mark_transfer_client(socket_t client_socket);
+void route_direct_message(const char *sender_username, uint32_t sequence, char recipients[][USERNAME_BUFFER_SIZE], size_t recipient_count, const char *encoded_message, error_list_t *error, void (*callback_error_func)(const char *, int));
+void set_typing_subscription(socket_t client_socket, int subscribed);
+int kick_client(const char *username, notification_type_t notification_type, error_list_t *error);
+int join_chat_room_locally(const char *username, error_list_t *error, void (*callback_error_func)(const char *, int), void (*callback_message_func)(const char *, const char *), void (*callback_presence_func)(presence_op_t, const char *, const char *), void (*callback_attachment_func)(const char *, const char *, uint64_t, const char *), void (*callback_search_func)(const char *, const char *, uint64_t), void (*callback_typing_func)(const char **, size_t), void (*callback_direct_func)(const char *, const char **, size_t, const char *), void (*callback_direct_ack_func)(uint32_t, char, const char *));
+void leave_chat_room_locally(void);
+void send_local_message(const char *message, error_list_t *error, void (*callback_error_func)(const char *, int));
+int share_local_attachment(const char *path, const char *name, error_list_t *error, void (*callback_error_func)(const char *, int));
+void send_local_typing(int typing);
+uint32_t send_local_direct_message(const char **recipients, size_t recipient_count, const char *message, error_list_t *error, void (*callback_error_func)(const char *, int));
+void search_local_history(const char *query, uint64_t since, uint64_t until, error_list_t *error, void (*callback_error_func)(const char *, int));
+void send_search_results(socket_t client_socket, const char *query, uint64_t since, uint64_t until, error_list_t *error, void (*callback_error_func)(const char *, int));
+void local_member_enqueue(const char *frame, size_t length);
+int set_banned_addresses(const char *list);
+int set_content_filter_rules(const char *rules, error_list_t *error);
+int set_blob_directory(const char *directory);
+int set_upgrade_socket_path(const char *path);
+// clients on this machine may connect through the path instead of TCP, an empty path turns it off
+int set_local_transport_path(const char *path);
+// SOCKET_PROFILE_FANOUT_SERVER unless set before the room starts
+void set_listener_socket_profile(socket_profile_t profile);
 int is_username_taken(const char *username);
 void generate_secret_key(char *key_buffer, size_t buffer_size);
 const char *get_secret_key(void);
+int set_secret_key(const char *secret_key);
+int set_server_port(const char *port);
+const char *get_server_port(void);
+void set_federation_config(const federation_config_t *config);
 int get_local_ip(char *ip_buffer, size_t buffer_size);
 
-void send_error(socket_t client_socket, error_type_t error_type, const char *error_message, error_t *error, void (*callback_error_func)(const char *, int));
-void send_notification(socket_t client_socket, notification_type_t notification_type, const char *notification_message, const char *receiver_username, error_t *error, void (*callback_error_func)(const char *, int));
+void send_error(socket_t client_socket, error_type_t error_type, const char *error_message, error_list_t *error, void (*callback_error_func)(const char *, int));
+void send_notification(socket_t client_socket, notification_type_t notification_type, const char *notification_message, const char *receiver_username, error_list_t *error, void (*callback_error_func)(const char *, int));
 
 #endif
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef SOCKETS_H
 #define SOCKETS_H
 
+#include <stdint.h>
+#include <stdatomic.h>
 #include "errors.h"
 
 #ifdef _WIN32
@@ -10,42 +12,132 @@
 #include <iphlpapi.h>
 #include <minwindef.h>
 typedef SOCKET socket_t;
+typedef WSAPOLLFD pollfd_t;
 #define SOCKET_ERR SOCKET_ERROR
 #define INVALID_SOCK INVALID_SOCKET
+// winsock has no per-call non-blocking flag, a send after POLLOUT may still block for large frames
+#define SOCKET_SEND_NONBLOCKING 0
+#define SOCKET_SHUTDOWN_BOTH SD_BOTH
 #else
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <ifaddrs.h>
+#include <netdb.h>
+#include <poll.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <netinet/tcp.h>
 typedef int socket_t;
+typedef struct pollfd pollfd_t;
 #define SOCKET_ERR (-1)
 #define INVALID_SOCK (-1)
+#define SOCKET_SEND_NONBLOCKING (MSG_DONTWAIT | MSG_NOSIGNAL)
+#define SOCKET_SHUTDOWN_BOTH SHUT_RDWR
 #endif
 
+// socket_connect_with_backoff defaults, see connect_options_init
+#define CONNECT_ATTEMPT_TIMEOUT_MS 2000
+#define CONNECT_DEADLINE_MS 5000
+#define CONNECT_BACKOFF_BASE_MS 100
+#define CONNECT_BACKOFF_MAX_MS 2000
+// how often a pending connect or backoff wakes up to check the deadline and the cancel flag
+#define CONNECT_WAIT_SLICE_MS 50
+
+// a profile is a set of socket options for one kind of traffic, applied when a socket is created or accepted.
+// SOCKET_PROFILE_NONE leaves every option at the system default
+typedef enum
+{
+    SOCKET_PROFILE_NONE,
+    // small frames both ways that should leave at once, Nagle off and ACKs sent right away
+    SOCKET_PROFILE_INTERACTIVE,
+    // attachment transfers, large buffers and Nagle left on
+    SOCKET_PROFILE_BULK,
+    // a room's listener, small frames to many clients: Nagle off, a large send buffer for bursts
+    // and a low unsent mark so a backed up client's frames wait in its outbox instead of the kernel
+    SOCKET_PROFILE_FANOUT_SERVER,
+    SOCKET_PROFILE_COUNT
+} socket_profile_t;
+
+// the options a profile sets, and what socket_read_tuning found on a socket. 0 leaves an option alone,
+// a fixed buffer size turns the kernel's autotuning off for that buffer
+typedef struct
+{
+    int nodelay;
+    int quickack;
+    int send_buffer;
+    int receive_buffer;
+    int keepalive;
+    int keepalive_idle_s;
+    int keepalive_interval_s;
+    int keepalive_count;
+    int user_timeout_ms;
+    int busy_poll_us;
+    int notsent_lowat;
+} socket_tuning_t;
+
+#define SOCKET_TUNING_REPORT_SIZE 256
+
+typedef struct
+{
+    int attempt_timeout_ms;
+    int deadline_ms;
+    int backoff_base_ms;
+    int backoff_max_ms;
+    // the connect gives up as soon as this becomes non-zero, may be NULL
+    atomic_int *cancel;
+    socket_profile_t profile;
+} connect_options_t;
+
 typedef enum
 {
     CONTEXT_CLIENT,
     CONTEXT_SERVER
 } context_t;
 
-int socket_init(error_t *error);
-int socket_cleanup(error_t *error);
+int socket_init(error_list_t *error);
+int socket_cleanup(error_list_t *error);
+
+// a listener's profile also sizes the window its connections offer during the handshake, accepted sockets get it again
+socket_t socket_create(int domain, int type, int protocol, socket_profile_t profile, error_list_t *error);
+int socket_bind(socket_t sock, const struct sockaddr *addr, socklen_t addrlen, error_list_t *error);
+int socket_listen(socket_t sock, error_list_t *error);
+socket_t socket_accept(socket_t sock, struct sockaddr *addr, socket_profile_t profile, error_list_t *error);
+socket_t socket_accept_nonblocking(socket_t sock, struct sockaddr *addr, socket_profile_t profile, error_list_t *error);
+int socket_connect(socket_t sock, const struct sockaddr *addr, socklen_t addrlen, error_list_t *error);
+void connect_options_init(connect_options_t *options);
+socket_t socket_connect_with_backoff(const struct addrinfo *address, const connect_options_t *options, error_list_t *error);
+int socket_set_nonblocking(socket_t sock, int nonblocking, error_list_t *error);
+// every option is best effort, an option the platform lacks or refuses (a busy poll needs CAP_NET_ADMIN
+// past the system's value) is skipped. returns how many were refused
+int socket_apply_profile(socket_t sock, socket_profile_t profile);
+void socket_profile_values(socket_profile_t profile, socket_tuning_t *tuning);
+// the values in effect on the socket, Linux reports buffers at twice the size asked for since it counts its bookkeeping
+void socket_read_tuning(socket_t sock, socket_tuning_t *tuning);
+// "nodelay=1 quickack=1 sndbuf=...", for the log
+void socket_format_tuning(const socket_tuning_t *tuning, char *buffer, size_t buffer_size);
+const char *socket_profile_name(socket_profile_t profile);
+// "none", "interactive", "bulk" or "fanout-server"
+int socket_parse_profile(const char *name, socket_profile_t *profile);
+int socket_send(socket_t sock, const void *buf, size_t len, int flags, const char *client_username, context_t context, error_severity_t severity, error_list_t *error);
+int socket_recv(socket_t sock, void *buf, size_t len, int flags, const char *client_username, context_t context, error_list_t *error);
+int socket_close(socket_t sock, error_list_t *error);
+int socket_shutdown(socket_t sock, error_list_t *error);
 
-socket_t socket_create(int domain, int type, int protocol, error_t *error);
-int socket_bind(socket_t sock, const struct sockaddr *addr, socklen_t addrlen, error_t *error);
-int socket_listen(socket_t sock, error_t *error);
-socket_t socket_accept(socket_t sock, struct sockaddr *addr, error_t *error);
-int socket_connect(socket_t sock, const struct sockaddr *addr, socklen_t addrlen, error_t *error);
-int socket_send(socket_t sock, const void *buf, size_t len, int flags, const char *client_username, context_t context, error_severity_t severity, error_t *error);
-int socket_recv(socket_t sock, void *buf, size_t len, int flags, const char *client_username, context_t context, error_t *error);
-int socket_close(socket_t sock, error_t *error);
+int socket_poll(pollfd_t *fds, size_t count, int timeout_ms, error_list_t *error);
+int socket_send_nonblocking(socket_t sock, const void *buf, size_t len, error_list_t *error);
+// the whole buffer or nothing usable: waits for the socket to take the rest until timeout_ms has passed.
+// 0 once everything is sent, SOCKET_ERR when the socket failed or the time ran out, a frame may then be cut off
+int socket_send_all(socket_t sock, const void *buf, size_t len, int timeout_ms, error_list_t *error);
 
 int get_last_socket_error();
-const char *map_platform_error(int platform_error);
+error_code_t map_platform_error(int platform_error);
 
 void cross_platform_sleep(int seconds);
+void cross_platform_sleep_ms(int milliseconds);
+uint64_t cross_platform_monotonic_ms(void);
 
 #endif
\ No newline at end of file
@@ -1,12 +1,19 @@
 #ifndef THREADS_H
 #define THREADS_H
 
+#include <stddef.h>
+
+// THREAD_STACK_SIZE: stack reserved for every thread thread_create starts. the deepest call chains (a frame handled
+// on a worker, a JNI callback) use a few tens of KB, the system default of several MB per connection is mostly address space
+#define THREAD_STACK_SIZE (512 * 1024)
+// THREAD_MIN_STACK_SIZE: a smaller configured size is raised to this, a JNI callback needs the JVM's guard pages below it
+#define THREAD_MIN_STACK_SIZE (128 * 1024)
+
 #ifdef _WIN32
 #include <windows.h>
 typedef HANDLE thread_t;
 typedef DWORD thread_ret_t;
 #define THREAD_CALL __stdcall
-#define thread_create(thr, func, arg) ((*(thr) = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)(func), (arg), 0, NULL)) == NULL ? -1 : 0)
 #define thread_join(thr) WaitForSingleObject((thr), INFINITE)
 #define thread_detach(thr) CloseHandle((thr))
 
@@ -17,12 +24,33 @@ typedef SRWLOCK rwlock_t;
 #define rwlock_readerunlock(lock) ReleaseSRWLockShared(lock)
 #define rwlock_writerunlock(lock) ReleaseSRWLockExclusive(lock)
 
+typedef CRITICAL_SECTION mutex_t;
+#define mutex_init(mutex) InitializeCriticalSection(mutex)
+#define mutex_lock(mutex) EnterCriticalSection(mutex)
+#define mutex_unlock(mutex) LeaveCriticalSection(mutex)
+#define mutex_destroy(mutex) DeleteCriticalSection(mutex)
+
+typedef INIT_ONCE thread_once_t;
+#define THREAD_ONCE_INIT INIT_ONCE_STATIC_INIT
+
+// a fiber local slot, its callback also runs when a thread the JVM started exits
+typedef DWORD thread_key_t;
+#define THREAD_KEY_CALL WINAPI
+
+typedef CONDITION_VARIABLE cond_t;
+#define cond_init(cond) InitializeConditionVariable(cond)
+#define cond_wait(cond, mutex) SleepConditionVariableCS((cond), (mutex), INFINITE)
+#define cond_timedwait(cond, mutex, timeout_ms) SleepConditionVariableCS((cond), (mutex), (DWORD)(timeout_ms))
+#define cond_signal(cond) WakeConditionVariable(cond)
+#define cond_broadcast(cond) WakeAllConditionVariable(cond)
+#define cond_destroy(cond) ((void)(cond))
+
 #else
 #include <pthread.h>
+#include <time.h>
 typedef pthread_t thread_t;
 typedef void *thread_ret_t;
 #define THREAD_CALL
-#define thread_create(thr, func, arg) pthread_create((thr), NULL, (func), (arg))
 #define thread_join(thr) pthread_join((thr), NULL)
 #define thread_detach(thr) pthread_detach((thr))
 
@@ -33,6 +61,54 @@ typedef pthread_rwlock_t rwlock_t;
 #define rwlock_readerunlock(lock) pthread_rwlock_unlock(lock)
 #define rwlock_writerunlock(lock) pthread_rwlock_unlock(lock)
 
+typedef pthread_mutex_t mutex_t;
+#define mutex_init(mutex) pthread_mutex_init(mutex, NULL)
+#define mutex_lock(mutex) pthread_mutex_lock(mutex)
+#define mutex_unlock(mutex) pthread_mutex_unlock(mutex)
+#define mutex_destroy(mutex) pthread_mutex_destroy(mutex)
+
+typedef pthread_once_t thread_once_t;
+#define THREAD_ONCE_INIT PTHREAD_ONCE_INIT
+
+typedef pthread_key_t thread_key_t;
+#define THREAD_KEY_CALL
+
+typedef pthread_cond_t cond_t;
+#define cond_init(cond) pthread_cond_init(cond, NULL)
+#define cond_wait(cond, mutex) pthread_cond_wait(cond, mutex)
+#define cond_signal(cond) pthread_cond_signal(cond)
+#define cond_broadcast(cond) pthread_cond_broadcast(cond)
+#define cond_destroy(cond) pthread_cond_destroy(cond)
+
+// pthread_cond_timedwait takes an absolute deadline, SleepConditionVariableCS a relative timeout
+static inline int cond_timedwait(cond_t *cond, mutex_t *mutex, long timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    return pthread_cond_timedwait(cond, mutex, &deadline);
+}
+
 #endif
 
+// 0 when the thread started, the thread gets thread_get_stack_size() bytes of stack
+int thread_create(thread_t *thread, thread_ret_t (THREAD_CALL *func)(void *), void *arg);
+// runs func exactly once per flag, a thread that gets there while another runs it sleeps until it is done
+void thread_once(thread_once_t *once, void (*func)(void));
+// 0 when the key exists, destructor gets a thread's value when that thread exits with one set
+int thread_key_create(thread_key_t *key, void (THREAD_KEY_CALL *destructor)(void *));
+void thread_key_set(thread_key_t key, void *value);
+// set before the threads it should apply to are started, 0 goes back to the system default
+void thread_set_stack_size(size_t stack_size);
+// the stack each new thread reserves, the system default when none is set
+size_t thread_get_stack_size(void);
+
 #endif
\ No newline at end of file
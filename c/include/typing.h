@@ -0,0 +1,25 @@
+#ifndef TYPING_H
+#define TYPING_H
+
+#include "common.h"
+#include "threads.h"
+
+// changes within this window are merged, a member that starts and stops within it is never announced
+#define TYPING_COALESCE_WINDOW_MS 250
+// TYPING_TIMEOUT_MS: a member that sent no refresh for this long is taken off the set, its client may have gone quiet mid-word
+#define TYPING_TIMEOUT_MS (2 * TYPING_REFRESH_MS)
+
+typedef struct
+{
+    uint32_t member_id;
+    uint64_t expires_ms;
+} typing_entry_t;
+
+// the set of members typing, published whole (see TYPING_FRAME_BUFFER_SIZE) at most once per window and only when it changed
+int typing_start(void (*publish_frame_func)(const char *, size_t), error_list_t *error);
+void typing_stop(void);
+void typing_record(uint32_t member_id, int typing);
+
+thread_ret_t THREAD_CALL typing_flush_thread(void *arg);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef UPGRADE_H
+#define UPGRADE_H
+
+#include <stdint.h>
+#include "common.h"
+
+// a handoff is only accepted between builds that agree on the layout below, bump the version when it changes
+#define UPGRADE_MAGIC 0x50554843u
+#define UPGRADE_VERSION 4
+// UPGRADE_PATH_BUFFER_SIZE: the longest path a Unix domain socket address holds
+#define UPGRADE_PATH_BUFFER_SIZE 108
+// UPGRADE_IO_TIMEOUT_MS: a peer that stops reading or writing on the channel for this long fails the handoff
+#define UPGRADE_IO_TIMEOUT_MS 5000
+
+// a connection as it moves from the running process to its replacement
+typedef struct
+{
+    socket_t socket;
+    struct sockaddr_in address;
+    // empty while the connection has not authenticated
+    char username[USERNAME_BUFFER_SIZE];
+    user_type_t user_type;
+    uint32_t member_id;
+    int typing_subscribed;
+    // bytes read from the client that don't make up a whole frame yet
+    char *input;
+    size_t input_length;
+    // bytes the client is owed before anything new: the rest of a half sent frame, then its queued frames
+    char *output;
+    size_t output_length;
+} upgrade_connection_t;
+
+typedef struct
+{
+    socket_t listening_socket;
+    char secret_key[SECRET_KEY_BUFFER_SIZE];
+    uint32_t next_member_id;
+    // "a.b.c.d/n,..." as ban_filter_add_list takes it, NULL without bans
+    char *banned_addresses;
+    // the content filter's rules as content_filter_load takes them, NULL without a filter
+    char *content_filter_rules;
+    upgrade_connection_t *connections;
+    size_t connection_count;
+} upgrade_state_t;
+
+// the running process listens on the channel, a new process connects to it to take the room over:
+// hello (new -> old), state with the listening socket and every connection attached (old -> new), ack (new -> old),
+// commit (old -> new). the old process lets go of the connections once the commit is sent, the new one serves them
+// only once it has it, so a handoff that breaks off anywhere leaves the room with at most one owner
+socket_t upgrade_channel_listen(const char *path, error_list_t *error);
+socket_t upgrade_channel_accept(socket_t channel_listener, error_list_t *error);
+socket_t upgrade_channel_connect(const char *path, error_list_t *error);
+void upgrade_channel_close(socket_t channel);
+
+int upgrade_receive_hello(socket_t channel, error_list_t *error);
+int upgrade_send_state(socket_t channel, const upgrade_state_t *state, error_list_t *error);
+int upgrade_receive_state(socket_t channel, upgrade_state_t *state, error_list_t *error);
+
+void upgrade_state_init(upgrade_state_t *state);
+void upgrade_state_free(upgrade_state_t *state, int close_sockets);
+
+#endif
\ No newline at end of file
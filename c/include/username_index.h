@@ -0,0 +1,35 @@
+#ifndef USERNAME_INDEX_H
+#define USERNAME_INDEX_H
+
+#include <stdint.h>
+#include "common.h"
+
+// USERNAME_INDEX_INITIAL_CAPACITY: open addressing slots (must be a power of two), it doubles at half load
+#define USERNAME_INDEX_INITIAL_CAPACITY 64
+
+struct client_node;
+
+typedef struct
+{
+    // NULL marks an empty slot
+    struct client_node *client;
+    uint32_t hash;
+    char username[USERNAME_BUFFER_SIZE];
+} username_index_entry_t;
+
+// the room's members by name, one lookup per name however many are in the room.
+// it has no lock of its own, the server changes it under the client list's writer lock and reads it under either lock
+typedef struct
+{
+    username_index_entry_t *entries;
+    size_t capacity;
+    size_t count;
+} username_index_t;
+
+int username_index_init(username_index_t *index, error_list_t *error);
+void username_index_destroy(username_index_t *index);
+int username_index_insert(username_index_t *index, const char *username, struct client_node *client, error_list_t *error);
+void username_index_remove(username_index_t *index, const char *username);
+struct client_node *username_index_find(const username_index_t *index, const char *username);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stdint.h>
+#include "common.h"
+
+// U+FFFD, stands in for bytes that don't decode when text is converted
+#define UTF8_REPLACEMENT_CHARACTER 0xFFFD
+
+typedef enum
+{
+    UTF8_VALID,
+    UTF8_MALFORMED,
+    UTF8_TOO_LONG
+} utf8_status_t;
+
+// checks length bytes against RFC 3629 (no overlong forms, no surrogates, nothing past U+10FFFF) and counts
+// their code points, 16 bytes at a time on CPUs with SSSE3. returns nonzero for malformed input
+int utf8_validate(const char *data, size_t length, size_t *code_points);
+// a null terminated name, message or query, valid and at most max_code_points long
+utf8_status_t utf8_check_text(const char *text, size_t max_code_points);
+
+// the Java side keeps strings as UTF-16, JNI's own "UTF" is a modified encoding that
+// standard UTF-8 above U+FFFF is not valid in. both conversions turn malformed input into U+FFFD.
+// output holds at least strlen(input) units, returns the units written
+size_t utf8_to_utf16(const char *input, uint16_t *output);
+// output holds at least length * 3 + 1 bytes, is null terminated, returns the bytes written before the terminator
+size_t utf16_to_utf8(const uint16_t *input, size_t length, char *output);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "common.h"
+#include "threads.h"
+#include "logger.h"
+
+#define WORKER_POOL_MAX_WORKERS 64
+#define WORKER_DEQUE_INITIAL_CAPACITY 256
+#define WORKER_IDLE_TIMEOUT_MS 100
+
+typedef struct
+{
+    void (*run)(void *arg);
+    void *arg;
+} worker_task_t;
+
+// a worker takes its own newest task first and steals the oldest task of another worker
+typedef struct
+{
+    mutex_t mutex;
+    worker_task_t *tasks;
+    size_t capacity;
+    size_t top;
+    size_t bottom;
+} worker_deque_t;
+
+typedef struct
+{
+    size_t worker_index;
+} worker_thread_args_t;
+
+size_t worker_pool_default_size(void);
+int worker_pool_start(size_t worker_count, error_list_t *error);
+void worker_pool_stop(void);
+int worker_pool_is_running(void);
+int worker_pool_submit(void (*run)(void *arg), void *arg);
+
+thread_ret_t THREAD_CALL worker_thread(void *arg);
+
+#endif
\ No newline at end of file
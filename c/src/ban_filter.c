@@ -0,0 +1,258 @@
+#include "../include/ban_filter.h"
+
+static uint64_t ban_key(uint32_t address, int prefix_length)
+{
+    uint32_t mask = prefix_length == 0 ? 0 : 0xFFFFFFFFu << (32 - prefix_length);
+    return ((uint64_t)(prefix_length + 1) << 32) | (address & mask);
+}
+
+// splitmix64 finalizer, the two halves feed the bloom filter and the low bits pick the slot
+static uint64_t ban_hash(uint64_t key)
+{
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBULL;
+    key ^= key >> 31;
+    return key;
+}
+
+static void bloom_set(ban_filter_t *filter, uint64_t hash)
+{
+    uint32_t first = (uint32_t)(hash >> 32) & (BAN_FILTER_BLOOM_BITS - 1);
+    uint32_t second = (uint32_t)(hash >> 48 | hash << 16) & (BAN_FILTER_BLOOM_BITS - 1);
+    filter->bloom[first >> 6] |= 1ULL << (first & 63);
+    filter->bloom[second >> 6] |= 1ULL << (second & 63);
+}
+
+static int bloom_test(const ban_filter_t *filter, uint64_t hash)
+{
+    uint32_t first = (uint32_t)(hash >> 32) & (BAN_FILTER_BLOOM_BITS - 1);
+    uint32_t second = (uint32_t)(hash >> 48 | hash << 16) & (BAN_FILTER_BLOOM_BITS - 1);
+    return (filter->bloom[first >> 6] >> (first & 63)) & (filter->bloom[second >> 6] >> (second & 63)) & 1;
+}
+
+// returns the slot holding the key or the empty slot where it belongs
+static size_t find_slot(const uint64_t *keys, size_t capacity, uint64_t key, uint64_t hash)
+{
+    size_t slot = (size_t)hash & (capacity - 1);
+    while (keys[slot] != 0 && keys[slot] != key)
+    {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return slot;
+}
+
+int ban_filter_init(ban_filter_t *filter, error_list_t *error)
+{
+    filter->keys = (uint64_t *)calloc(BAN_FILTER_INITIAL_CAPACITY, sizeof(uint64_t));
+    if (filter->keys == NULL)
+    {
+        add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for the ban filter", "ban_filter_init");
+        return 1;
+    }
+
+    filter->capacity = BAN_FILTER_INITIAL_CAPACITY;
+    filter->count = 0;
+    filter->prefix_lengths = 0;
+    memset(filter->bloom, 0, sizeof(filter->bloom));
+    atomic_store(&filter->entries, 0);
+    rwlock_init(&filter->rwlock);
+
+    return 0;
+}
+
+void ban_filter_destroy(ban_filter_t *filter)
+{
+    atomic_store(&filter->entries, 0);
+    free(filter->keys);
+    filter->keys = NULL;
+    filter->capacity = 0;
+    filter->count = 0;
+}
+
+int ban_filter_add(ban_filter_t *filter, uint32_t address, int prefix_length, error_list_t *error)
+{
+    if (prefix_length < 0 || prefix_length > 32)
+    {
+        add_error(error, ERR_BAN_ENTRY_INVALID, NON_CRITICAL_ERROR, "Ban prefix length must be between 0 and 32", "ban_filter_add");
+        return 1;
+    }
+
+    uint64_t key = ban_key(address, prefix_length);
+    uint64_t hash = ban_hash(key);
+
+    rwlock_writerlock(&filter->rwlock);
+
+    // grow at half load so probe sequences stay short
+    if ((filter->count + 1) * 2 > filter->capacity)
+    {
+        size_t new_capacity = filter->capacity * 2;
+        uint64_t *new_keys = (uint64_t *)calloc(new_capacity, sizeof(uint64_t));
+        if (new_keys == NULL)
+        {
+            rwlock_writerunlock(&filter->rwlock);
+            add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to grow the ban filter, the ban was not added", "ban_filter_add");
+            return 1;
+        }
+
+        for (size_t i = 0; i < filter->capacity; i++)
+        {
+            if (filter->keys[i] != 0)
+            {
+                new_keys[find_slot(new_keys, new_capacity, filter->keys[i], ban_hash(filter->keys[i]))] = filter->keys[i];
+            }
+        }
+
+        free(filter->keys);
+        filter->keys = new_keys;
+        filter->capacity = new_capacity;
+    }
+
+    size_t slot = find_slot(filter->keys, filter->capacity, key, hash);
+    if (filter->keys[slot] == 0)
+    {
+        filter->keys[slot] = key;
+        filter->count++;
+        filter->prefix_lengths |= 1ULL << prefix_length;
+        bloom_set(filter, hash);
+        atomic_store(&filter->entries, (int)filter->count);
+    }
+
+    rwlock_writerunlock(&filter->rwlock);
+
+    return 0;
+}
+
+int ban_filter_contains(ban_filter_t *filter, uint32_t address)
+{
+    if (atomic_load(&filter->entries) == 0)
+    {
+        return 0;
+    }
+
+    int banned = 0;
+
+    rwlock_readerlock(&filter->rwlock);
+
+    // most specific prefix first, exact bans are the common entry
+    uint64_t prefix_lengths = filter->prefix_lengths;
+    for (int prefix_length = 32; prefix_length >= 0 && !banned; prefix_length--)
+    {
+        if (!(prefix_lengths >> prefix_length & 1))
+        {
+            continue;
+        }
+
+        uint64_t key = ban_key(address, prefix_length);
+        uint64_t hash = ban_hash(key);
+
+        // a clear bit proves the network was never banned, only bloom hits touch the table
+        if (bloom_test(filter, hash))
+        {
+            banned = filter->keys[find_slot(filter->keys, filter->capacity, key, hash)] == key;
+        }
+    }
+
+    rwlock_readerunlock(&filter->rwlock);
+
+    return banned;
+}
+
+int ban_filter_parse_entry(const char *entry, size_t length, uint32_t *address, int *prefix_length)
+{
+    char buffer[BAN_ENTRY_BUFFER_SIZE];
+    if (length == 0 || length >= sizeof(buffer))
+    {
+        return 1;
+    }
+
+    memcpy(buffer, entry, length);
+    buffer[length] = '\0';
+
+    *prefix_length = 32;
+    char *slash = strchr(buffer, '/');
+    if (slash != NULL)
+    {
+        char *end;
+        long parsed = strtol(slash + 1, &end, 10);
+        if (end == slash + 1 || *end != '\0' || parsed < 0 || parsed > 32)
+        {
+            return 1;
+        }
+        *prefix_length = (int)parsed;
+        *slash = '\0';
+    }
+
+    struct in_addr parsed_address;
+    if (inet_pton(AF_INET, buffer, &parsed_address) != 1)
+    {
+        return 1;
+    }
+
+    *address = ntohl(parsed_address.s_addr);
+
+    return 0;
+}
+
+int ban_filter_add_list(ban_filter_t *filter, const char *list, error_list_t *error)
+{
+    // "a.b.c.d,a.b.c.d/n,...", entries are added up to the first malformed one
+    const char *entry = list;
+    while (*entry != '\0')
+    {
+        const char *entry_end = strchr(entry, ',');
+        size_t length = entry_end == NULL ? strlen(entry) : (size_t)(entry_end - entry);
+
+        uint32_t address;
+        int prefix_length;
+        if (ban_filter_parse_entry(entry, length, &address, &prefix_length) != 0)
+        {
+            add_error(error, ERR_BAN_ENTRY_INVALID, NON_CRITICAL_ERROR, "Malformed ban list entry, expected a.b.c.d or a.b.c.d/n", "ban_filter_add_list");
+            return 1;
+        }
+
+        if (ban_filter_add(filter, address, prefix_length, error) != 0)
+        {
+            return 1;
+        }
+
+        if (entry_end == NULL)
+        {
+            break;
+        }
+        entry = entry_end + 1;
+    }
+
+    return 0;
+}
+char *ban_filter_format_list(ban_filter_t *filter)
+{
+    // the inverse of ban_filter_add_list, NULL when there are no bans or no memory
+    char *list = NULL;
+
+    rwlock_readerlock(&filter->rwlock);
+
+    // every entry takes at most BAN_ENTRY_BUFFER_SIZE with its separator, the first one's spare byte holds the terminator
+    if (filter->count > 0 && (list = (char *)malloc(filter->count * BAN_ENTRY_BUFFER_SIZE)) != NULL)
+    {
+        size_t length = 0;
+        for (size_t i = 0; i < filter->capacity; i++)
+        {
+            uint64_t key = filter->keys[i];
+            if (key == 0)
+            {
+                continue;
+            }
+
+            uint32_t network = (uint32_t)key;
+            int prefix_length = (int)(key >> 32) - 1;
+            length += (size_t)sprintf(list + length, "%s%u.%u.%u.%u/%d", length > 0 ? "," : "",
+                                      network >> 24, (network >> 16) & 0xFF, (network >> 8) & 0xFF, network & 0xFF, prefix_length);
+        }
+    }
+
+    rwlock_readerunlock(&filter->rwlock);
+
+    return list;
+}
\ No newline at end of file
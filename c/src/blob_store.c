@@ -0,0 +1,935 @@
+#include "../include/blob_store.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <direct.h>
+#include <process.h>
+typedef struct _stat64 blob_stat_t;
+#define blob_stat _stat64
+#define blob_fstat _fstat64
+#define blob_lseek _lseeki64
+#define blob_mkdir(path) _mkdir(path)
+#define blob_getpid _getpid
+#define BLOB_OPEN_FLAGS O_BINARY
+#define BLOB_SEND_FLAGS 0
+#else
+#include <sys/mman.h>
+#include <dirent.h>
+typedef struct stat blob_stat_t;
+#define blob_stat stat
+#define blob_fstat fstat
+#define blob_lseek lseek
+#define blob_mkdir(path) mkdir(path, 0700)
+#define blob_getpid getpid
+#define BLOB_OPEN_FLAGS O_CLOEXEC
+#define BLOB_SEND_FLAGS MSG_NOSIGNAL
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#define BLOB_UPLOAD_PREFIX ".upload-"
+
+static char blob_directory[BLOB_DIRECTORY_BUFFER_SIZE] = BLOB_STORE_DIRECTORY;
+static atomic_int upload_counter = ATOMIC_VAR_INIT(0);
+static atomic_ullong blob_quota = ATOMIC_VAR_INIT(BLOB_STORE_DEFAULT_QUOTA);
+// bytes of the quota taken by this room's new blobs and the uploads still coming in
+static atomic_ullong blob_reserved = ATOMIC_VAR_INIT(0);
+
+static const uint32_t sha256_round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_transform(sha256_t *context, const unsigned char *block)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = SHA256_ROTR(w[i - 15], 7) ^ SHA256_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = SHA256_ROTR(w[i - 2], 17) ^ SHA256_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = context->state[0], b = context->state[1], c = context->state[2], d = context->state[3];
+    uint32_t e = context->state[4], f = context->state[5], g = context->state[6], h = context->state[7];
+
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t s1 = SHA256_ROTR(e, 6) ^ SHA256_ROTR(e, 11) ^ SHA256_ROTR(e, 25);
+        uint32_t choice = (e & f) ^ (~e & g);
+        uint32_t temp1 = h + s1 + choice + sha256_round_constants[i] + w[i];
+        uint32_t s0 = SHA256_ROTR(a, 2) ^ SHA256_ROTR(a, 13) ^ SHA256_ROTR(a, 22);
+        uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t temp2 = s0 + majority;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + temp1;
+        d = c;
+        c = b;
+        b = a;
+        a = temp1 + temp2;
+    }
+
+    context->state[0] += a;
+    context->state[1] += b;
+    context->state[2] += c;
+    context->state[3] += d;
+    context->state[4] += e;
+    context->state[5] += f;
+    context->state[6] += g;
+    context->state[7] += h;
+}
+
+void sha256_init(sha256_t *context)
+{
+    static const uint32_t initial_state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(context->state, initial_state, sizeof(initial_state));
+    context->length = 0;
+    context->block_length = 0;
+}
+
+void sha256_update(sha256_t *context, const void *data, size_t length)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    context->length += length;
+
+    if (context->block_length > 0)
+    {
+        size_t needed = sizeof(context->block) - context->block_length;
+        size_t taken = length < needed ? length : needed;
+        memcpy(context->block + context->block_length, bytes, taken);
+        context->block_length += taken;
+        bytes += taken;
+        length -= taken;
+
+        if (context->block_length < sizeof(context->block))
+        {
+            return;
+        }
+        sha256_transform(context, context->block);
+        context->block_length = 0;
+    }
+
+    // whole blocks are hashed straight from the caller's memory (a mapped blob), only the tail is buffered
+    while (length >= sizeof(context->block))
+    {
+        sha256_transform(context, bytes);
+        bytes += sizeof(context->block);
+        length -= sizeof(context->block);
+    }
+
+    memcpy(context->block, bytes, length);
+    context->block_length = length;
+}
+
+void sha256_final(sha256_t *context, unsigned char digest[BLOB_HASH_SIZE])
+{
+    uint64_t bit_length = context->length * 8;
+
+    context->block[context->block_length++] = 0x80;
+    if (context->block_length > 56)
+    {
+        memset(context->block + context->block_length, 0, sizeof(context->block) - context->block_length);
+        sha256_transform(context, context->block);
+        context->block_length = 0;
+    }
+    memset(context->block + context->block_length, 0, 56 - context->block_length);
+    for (int i = 0; i < 8; i++)
+    {
+        context->block[56 + i] = (unsigned char)(bit_length >> (56 - 8 * i));
+    }
+    sha256_transform(context, context->block);
+
+    for (int i = 0; i < 8; i++)
+    {
+        digest[i * 4] = (unsigned char)(context->state[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(context->state[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(context->state[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)context->state[i];
+    }
+}
+
+// an upload in progress writes at least every BLOB_IO_TIMEOUT_MS, so only files of dropped transfers and
+// crashed processes are old enough. another process's live uploads in a shared directory are left alone
+static void sweep_stale_uploads(void)
+{
+    time_t now = time(NULL);
+    char path[BLOB_PATH_BUFFER_SIZE];
+
+#ifdef _WIN32
+    snprintf(path, sizeof(path), "%s/%s*", blob_directory, BLOB_UPLOAD_PREFIX);
+
+    struct __finddata64_t entry;
+    intptr_t handle = _findfirst64(path, &entry);
+    if (handle == -1)
+    {
+        return;
+    }
+
+    do
+    {
+        if (strlen(entry.name) <= BLOB_HASH_HEX_LENGTH && (now - entry.time_write) * 1000 >= BLOB_UPLOAD_STALE_MS)
+        {
+            snprintf(path, sizeof(path), "%s/%.*s", blob_directory, BLOB_HASH_HEX_LENGTH, entry.name);
+            remove(path);
+        }
+    } while (_findnext64(handle, &entry) == 0);
+
+    _findclose(handle);
+#else
+    DIR *directory = opendir(blob_directory);
+    if (directory == NULL)
+    {
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL)
+    {
+        if (strncmp(entry->d_name, BLOB_UPLOAD_PREFIX, strlen(BLOB_UPLOAD_PREFIX)) != 0 || strlen(entry->d_name) > BLOB_HASH_HEX_LENGTH)
+        {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%.*s", blob_directory, BLOB_HASH_HEX_LENGTH, entry->d_name);
+        blob_stat_t upload_info;
+        if (blob_stat(path, &upload_info) == 0 && (now - upload_info.st_mtime) * 1000 >= BLOB_UPLOAD_STALE_MS)
+        {
+            remove(path);
+        }
+    }
+
+    closedir(directory);
+#endif
+}
+
+int blob_store_init(const char *directory, error_list_t *error)
+{
+    if (directory != NULL && directory[0] != '\0')
+    {
+        if (strlen(directory) >= sizeof(blob_directory))
+        {
+            add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Blob store directory path is too long, keeping the default", "blob_store_init");
+        }
+        else
+        {
+            strcpy(blob_directory, directory);
+        }
+    }
+
+    atomic_store(&blob_reserved, 0);
+
+    blob_stat_t directory_stat;
+    if (blob_stat(blob_directory, &directory_stat) == 0)
+    {
+        sweep_stale_uploads();
+        return 0;
+    }
+
+    if (blob_mkdir(blob_directory) != 0)
+    {
+        add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to create the blob store directory, attachments are disabled", "blob_store_init");
+        return 1;
+    }
+
+    return 0;
+}
+
+void blob_store_set_quota(uint64_t quota)
+{
+    atomic_store(&blob_quota, quota);
+}
+
+int blob_store_reserve(uint64_t size, error_list_t *error)
+{
+    unsigned long long quota = atomic_load(&blob_quota);
+    unsigned long long reserved = atomic_load(&blob_reserved);
+
+    do
+    {
+        if (quota != 0 && (reserved > quota || size > quota - reserved))
+        {
+            add_error(error, ERR_BLOB_QUOTA, NON_CRITICAL_ERROR, "The room has no space left for attachments", "blob_store_reserve");
+            return 1;
+        }
+    } while (!atomic_compare_exchange_weak(&blob_reserved, &reserved, reserved + size));
+
+    return 0;
+}
+
+void blob_store_unreserve(uint64_t size)
+{
+    atomic_fetch_sub(&blob_reserved, size);
+}
+
+static void blob_path(char *path, const char *hash_hex)
+{
+    snprintf(path, BLOB_PATH_BUFFER_SIZE, "%s/%s", blob_directory, hash_hex);
+}
+
+int blob_store_stat(const char *hash_hex, uint64_t *size)
+{
+    if (!blob_hash_is_valid(hash_hex))
+    {
+        return 1;
+    }
+
+    char path[BLOB_PATH_BUFFER_SIZE];
+    blob_path(path, hash_hex);
+
+    blob_stat_t blob_info;
+    if (blob_stat(path, &blob_info) != 0)
+    {
+        return 1;
+    }
+
+    *size = (uint64_t)blob_info.st_size;
+    return 0;
+}
+
+int blob_file_open(const char *path, int writable, uint64_t offset)
+{
+    int flags = writable ? (O_WRONLY | O_CREAT | (offset == 0 ? O_TRUNC : 0)) : O_RDONLY;
+    int fd = open(path, flags | BLOB_OPEN_FLAGS, 0644);
+
+    if (fd >= 0 && offset > 0 && blob_lseek(fd, offset, SEEK_SET) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int blob_file_close(int fd)
+{
+    return close(fd);
+}
+
+int blob_file_size(int fd, uint64_t *size)
+{
+    blob_stat_t file_info;
+    if (blob_fstat(fd, &file_info) != 0)
+    {
+        return 1;
+    }
+
+    *size = (uint64_t)file_info.st_size;
+    return 0;
+}
+
+// a blocked socket is waited on, a peer that stays silent for BLOB_IO_TIMEOUT_MS ends the transfer
+static int wait_for_socket(socket_t sock, short events, error_list_t *error)
+{
+    pollfd_t transfer_fd;
+    transfer_fd.fd = sock;
+    transfer_fd.events = events;
+    transfer_fd.revents = 0;
+
+    int ready = socket_poll(&transfer_fd, 1, BLOB_IO_TIMEOUT_MS, error);
+    if (ready == 0)
+    {
+        add_error(error, ERR_TRANSFER_STALLED, NON_CRITICAL_ERROR, "The other side of a transfer stopped making progress", "wait_for_socket");
+        return 1;
+    }
+
+    return ready == SOCKET_ERR;
+}
+
+int blob_file_write(int fd, const char *data, size_t length, error_list_t *error)
+{
+    while (length > 0)
+    {
+        int written = (int)write(fd, data, (unsigned int)length);
+        if (written <= 0)
+        {
+            add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to write a blob file", "blob_file_write");
+            return 1;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+
+    return 0;
+}
+
+// read and write through a buffer, for platforms (and descriptors) the zero-copy calls don't cover
+static int copy_to_socket(socket_t sock, int fd, uint64_t offset, uint64_t length, error_list_t *error)
+{
+    if (blob_lseek(fd, offset, SEEK_SET) < 0)
+    {
+        add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to seek in a blob file", "copy_to_socket");
+        return 1;
+    }
+
+    char *buffer = (char *)malloc(BLOB_CHUNK_SIZE);
+    if (buffer == NULL)
+    {
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for a transfer buffer", "copy_to_socket");
+        return 1;
+    }
+
+    int result = 0;
+    while (length > 0 && result == 0)
+    {
+        unsigned int chunk = length < BLOB_CHUNK_SIZE ? (unsigned int)length : BLOB_CHUNK_SIZE;
+        int bytes_read = (int)read(fd, buffer, chunk);
+        if (bytes_read <= 0)
+        {
+            add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "A blob file ended before the requested range", "copy_to_socket");
+            result = 1;
+            break;
+        }
+
+        int sent_total = 0;
+        while (sent_total < bytes_read)
+        {
+            int sent = send(sock, buffer + sent_total, bytes_read - sent_total, BLOB_SEND_FLAGS);
+            if (sent > 0)
+            {
+                sent_total += sent;
+                continue;
+            }
+
+            error_code_t err = map_platform_error(get_last_socket_error());
+            if (err == SOCKET_EINTR)
+            {
+                continue;
+            }
+            if (err == SOCKET_EWOULDBLOCK && wait_for_socket(sock, POLLOUT, error) == 0)
+            {
+                continue;
+            }
+            if (err != SOCKET_EWOULDBLOCK)
+            {
+                add_error(error, err, NON_CRITICAL_ERROR, "Failed to send a blob", "copy_to_socket");
+            }
+            result = 1;
+            break;
+        }
+
+        length -= (uint64_t)bytes_read;
+    }
+
+    free(buffer);
+    return result;
+}
+
+static int copy_from_socket(socket_t sock, int fd, uint64_t length, error_list_t *error)
+{
+    char *buffer = (char *)malloc(BLOB_CHUNK_SIZE);
+    if (buffer == NULL)
+    {
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for a transfer buffer", "copy_from_socket");
+        return 1;
+    }
+
+    int result = 0;
+    while (length > 0)
+    {
+        int chunk = length < BLOB_CHUNK_SIZE ? (int)length : BLOB_CHUNK_SIZE;
+        int received = recv(sock, buffer, chunk, 0);
+        if (received == 0)
+        {
+            add_error(error, SOCKET_ECONNRESET, NON_CRITICAL_ERROR, "The connection closed in the middle of a transfer", "copy_from_socket");
+            result = 1;
+            break;
+        }
+        if (received < 0)
+        {
+            error_code_t err = map_platform_error(get_last_socket_error());
+            if (err == SOCKET_EINTR)
+            {
+                continue;
+            }
+            if (err == SOCKET_EWOULDBLOCK && wait_for_socket(sock, POLLIN, error) == 0)
+            {
+                continue;
+            }
+            if (err != SOCKET_EWOULDBLOCK)
+            {
+                add_error(error, err, NON_CRITICAL_ERROR, "Failed to receive a blob", "copy_from_socket");
+            }
+            result = 1;
+            break;
+        }
+
+        if (blob_file_write(fd, buffer, (size_t)received, error) != 0)
+        {
+            result = 1;
+            break;
+        }
+        length -= (uint64_t)received;
+    }
+
+    free(buffer);
+    return result;
+}
+
+int blob_send_range(socket_t sock, int fd, uint64_t offset, uint64_t length, error_list_t *error)
+{
+#ifdef __linux__
+    // the page cache feeds the socket directly, the bytes never pass through this process
+    off_t file_offset = (off_t)offset;
+    while (length > 0)
+    {
+        size_t chunk = length < BLOB_CHUNK_SIZE ? (size_t)length : BLOB_CHUNK_SIZE;
+        ssize_t sent = sendfile(sock, fd, &file_offset, chunk);
+        if (sent > 0)
+        {
+            length -= (uint64_t)sent;
+            continue;
+        }
+        if (sent == 0)
+        {
+            add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "A blob file ended before the requested range", "blob_send_range");
+            return 1;
+        }
+
+        error_code_t err = map_platform_error(errno);
+        if (err == SOCKET_EINTR)
+        {
+            continue;
+        }
+        if (err == SOCKET_EWOULDBLOCK)
+        {
+            if (wait_for_socket(sock, POLLOUT, error) != 0)
+            {
+                return 1;
+            }
+            continue;
+        }
+        if (errno == EINVAL || errno == ENOSYS)
+        {
+            // this descriptor pair can't be used with sendfile
+            return copy_to_socket(sock, fd, (uint64_t)file_offset, length, error);
+        }
+
+        add_error(error, err, NON_CRITICAL_ERROR, "Failed to send a blob", "blob_send_range");
+        return 1;
+    }
+
+    return 0;
+#else
+    return copy_to_socket(sock, fd, offset, length, error);
+#endif
+}
+
+int blob_recv_range(socket_t sock, int fd, uint64_t length, error_list_t *error)
+{
+#ifdef __linux__
+    // socket -> pipe -> file moves page references, the pipe is drained after every chunk so it never fills up
+    int pipe_fds[2];
+    if (length == 0 || pipe(pipe_fds) != 0)
+    {
+        return length == 0 ? 0 : copy_from_socket(sock, fd, length, error);
+    }
+
+    int result = 0;
+    int moved_any = 0;
+    while (length > 0)
+    {
+        size_t chunk = length < BLOB_CHUNK_SIZE ? (size_t)length : BLOB_CHUNK_SIZE;
+        ssize_t moved = splice(sock, NULL, pipe_fds[1], NULL, chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (moved == 0)
+        {
+            add_error(error, SOCKET_ECONNRESET, NON_CRITICAL_ERROR, "The connection closed in the middle of a transfer", "blob_recv_range");
+            result = 1;
+            break;
+        }
+        if (moved < 0)
+        {
+            error_code_t err = map_platform_error(errno);
+            if (err == SOCKET_EINTR)
+            {
+                continue;
+            }
+            if (err == SOCKET_EWOULDBLOCK)
+            {
+                if (wait_for_socket(sock, POLLIN, error) != 0)
+                {
+                    result = 1;
+                    break;
+                }
+                continue;
+            }
+            if (errno == EINVAL && !moved_any)
+            {
+                result = copy_from_socket(sock, fd, length, error);
+                break;
+            }
+
+            add_error(error, err, NON_CRITICAL_ERROR, "Failed to receive a blob", "blob_recv_range");
+            result = 1;
+            break;
+        }
+
+        moved_any = 1;
+        while (moved > 0)
+        {
+            ssize_t written = splice(pipe_fds[0], NULL, fd, NULL, (size_t)moved, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to write a blob file", "blob_recv_range");
+                result = 1;
+                break;
+            }
+            moved -= written;
+            length -= (uint64_t)written;
+        }
+        if (result != 0)
+        {
+            break;
+        }
+    }
+
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+
+    return result;
+#else
+    return copy_from_socket(sock, fd, length, error);
+#endif
+}
+
+static int copy_between_files(int out_fd, int in_fd, uint64_t length, error_list_t *error)
+{
+#ifdef __linux__
+    while (length > 0)
+    {
+        size_t chunk = length < BLOB_CHUNK_SIZE ? (size_t)length : BLOB_CHUNK_SIZE;
+        ssize_t copied = sendfile(out_fd, in_fd, NULL, chunk);
+        if (copied < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (copied <= 0)
+        {
+            add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to copy a blob file", "copy_between_files");
+            return 1;
+        }
+        length -= (uint64_t)copied;
+    }
+
+    return 0;
+#else
+    char *buffer = (char *)malloc(BLOB_CHUNK_SIZE);
+    if (buffer == NULL)
+    {
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for a copy buffer", "copy_between_files");
+        return 1;
+    }
+
+    int result = 0;
+    while (length > 0)
+    {
+        unsigned int chunk = length < BLOB_CHUNK_SIZE ? (unsigned int)length : BLOB_CHUNK_SIZE;
+        int bytes_read = (int)read(in_fd, buffer, chunk);
+        if (bytes_read <= 0)
+        {
+            add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to copy a blob file", "copy_between_files");
+            result = 1;
+            break;
+        }
+        if (blob_file_write(out_fd, buffer, (size_t)bytes_read, error) != 0)
+        {
+            result = 1;
+            break;
+        }
+        length -= (uint64_t)bytes_read;
+    }
+
+    free(buffer);
+    return result;
+#endif
+}
+
+static int hash_file(int fd, uint64_t size, char *hash_hex, error_list_t *error)
+{
+    sha256_t context;
+    sha256_init(&context);
+
+#ifdef _WIN32
+    if (blob_lseek(fd, 0, SEEK_SET) < 0)
+    {
+        add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to hash a blob file", "hash_file");
+        return 1;
+    }
+
+    char *buffer = (char *)malloc(BLOB_CHUNK_SIZE);
+    if (buffer == NULL)
+    {
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for a hash buffer", "hash_file");
+        return 1;
+    }
+
+    uint64_t remaining = size;
+    while (remaining > 0)
+    {
+        unsigned int chunk = remaining < BLOB_CHUNK_SIZE ? (unsigned int)remaining : BLOB_CHUNK_SIZE;
+        int bytes_read = (int)read(fd, buffer, chunk);
+        if (bytes_read <= 0)
+        {
+            free(buffer);
+            add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to hash a blob file", "hash_file");
+            return 1;
+        }
+        sha256_update(&context, buffer, (size_t)bytes_read);
+        remaining -= (uint64_t)bytes_read;
+    }
+
+    free(buffer);
+#else
+    // the hash reads the page cache in place instead of copying the blob out
+    if (size > 0)
+    {
+        void *mapping = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to map a blob file for hashing", "hash_file");
+            return 1;
+        }
+        sha256_update(&context, mapping, (size_t)size);
+        munmap(mapping, (size_t)size);
+    }
+#endif
+
+    unsigned char digest[BLOB_HASH_SIZE];
+    sha256_final(&context, digest);
+
+    static const char hex_digits[] = "0123456789abcdef";
+    for (int i = 0; i < BLOB_HASH_SIZE; i++)
+    {
+        hash_hex[i * 2] = hex_digits[digest[i] >> 4];
+        hash_hex[i * 2 + 1] = hex_digits[digest[i] & 0x0F];
+    }
+    hash_hex[BLOB_HASH_HEX_LENGTH] = '\0';
+
+    return 0;
+}
+
+// opens a fresh temporary file in the store, the blob is renamed to its hash once complete
+static int create_upload_file(char *path)
+{
+    unsigned int upload_id = (unsigned int)atomic_fetch_add(&upload_counter, 1);
+    snprintf(path, BLOB_PATH_BUFFER_SIZE, "%s/%s%d-%u", blob_directory, BLOB_UPLOAD_PREFIX, (int)blob_getpid(), upload_id);
+
+    return open(path, O_RDWR | O_CREAT | O_EXCL | BLOB_OPEN_FLAGS, 0600);
+}
+
+// hashes the finished upload and moves it into place, a blob that is already stored is kept and the upload dropped.
+// stored tells whether the upload became a new blob
+static int commit_upload(int fd, const char *upload_path, uint64_t size, char *hash_hex, int *stored, error_list_t *error)
+{
+    *stored = 0;
+
+    int result = hash_file(fd, size, hash_hex, error);
+    close(fd);
+
+    if (result != 0)
+    {
+        remove(upload_path);
+        return 1;
+    }
+
+    char path[BLOB_PATH_BUFFER_SIZE];
+    blob_path(path, hash_hex);
+
+    uint64_t stored_size;
+    if (blob_store_stat(hash_hex, &stored_size) == 0)
+    {
+        remove(upload_path);
+        return 0;
+    }
+
+    if (rename(upload_path, path) != 0)
+    {
+        // a concurrent upload of the same content may have won the rename (windows doesn't replace)
+        remove(upload_path);
+        if (blob_store_stat(hash_hex, &stored_size) != 0)
+        {
+            add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to move an upload into the blob store", "commit_upload");
+            return 1;
+        }
+        return 0;
+    }
+
+    *stored = 1;
+    return 0;
+}
+
+int blob_store_receive(socket_t sock, uint64_t size, const char *received, size_t received_length, char *hash_hex, error_list_t *error)
+{
+    if (size > BLOB_MAX_SIZE)
+    {
+        add_error(error, ERR_BLOB_TOO_LARGE, NON_CRITICAL_ERROR, "Attachment exceeds the maximum size", "blob_store_receive");
+        blob_store_unreserve(size);
+        return 1;
+    }
+
+    char upload_path[BLOB_PATH_BUFFER_SIZE];
+    int fd = create_upload_file(upload_path);
+    if (fd < 0)
+    {
+        add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to create an upload file", "blob_store_receive");
+        blob_store_unreserve(size);
+        return 1;
+    }
+
+    // bytes the frame reader pulled in together with the transfer header
+    if (received_length > size)
+    {
+        received_length = (size_t)size;
+    }
+
+    if (blob_file_write(fd, received, received_length, error) != 0 || blob_recv_range(sock, fd, size - received_length, error) != 0)
+    {
+        close(fd);
+        remove(upload_path);
+        blob_store_unreserve(size);
+        // a failed transfer is when leftovers of earlier ones are looked for too
+        sweep_stale_uploads();
+        return 1;
+    }
+
+    int stored;
+    int result = commit_upload(fd, upload_path, size, hash_hex, &stored, error);
+    if (!stored)
+    {
+        blob_store_unreserve(size);
+    }
+
+    return result;
+}
+
+int blob_store_send(socket_t sock, const char *hash_hex, uint64_t offset, uint64_t length, error_list_t *error)
+{
+    char path[BLOB_PATH_BUFFER_SIZE];
+    blob_path(path, hash_hex);
+
+    int fd = blob_file_open(path, 0, 0);
+    if (fd < 0)
+    {
+        add_error(error, ERR_BLOB_NOT_FOUND, NON_CRITICAL_ERROR, "The requested attachment is not in the blob store", "blob_store_send");
+        return 1;
+    }
+
+    int result = blob_send_range(sock, fd, offset, length, error);
+    close(fd);
+
+    return result;
+}
+
+int blob_store_put_file(const char *path, char *hash_hex, uint64_t *size, error_list_t *error)
+{
+    int source_fd = blob_file_open(path, 0, 0);
+    if (source_fd < 0)
+    {
+        add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to open the file to attach", "blob_store_put_file");
+        return 1;
+    }
+
+    if (blob_file_size(source_fd, size) != 0)
+    {
+        close(source_fd);
+        add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to read the size of the file to attach", "blob_store_put_file");
+        return 1;
+    }
+
+    if (*size > BLOB_MAX_SIZE)
+    {
+        close(source_fd);
+        add_error(error, ERR_BLOB_TOO_LARGE, NON_CRITICAL_ERROR, "Attachment exceeds the maximum size", "blob_store_put_file");
+        return 1;
+    }
+
+    if (blob_store_reserve(*size, error) != 0)
+    {
+        close(source_fd);
+        return 1;
+    }
+
+    char upload_path[BLOB_PATH_BUFFER_SIZE];
+    int fd = create_upload_file(upload_path);
+    if (fd < 0)
+    {
+        close(source_fd);
+        blob_store_unreserve(*size);
+        add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to create an upload file", "blob_store_put_file");
+        return 1;
+    }
+
+    int result = copy_between_files(fd, source_fd, *size, error);
+    close(source_fd);
+
+    if (result != 0)
+    {
+        close(fd);
+        remove(upload_path);
+        blob_store_unreserve(*size);
+        return 1;
+    }
+
+    int stored;
+    result = commit_upload(fd, upload_path, *size, hash_hex, &stored, error);
+    if (!stored)
+    {
+        blob_store_unreserve(*size);
+    }
+
+    return result;
+}
+
+int blob_store_copy_out(const char *hash_hex, const char *path, error_list_t *error)
+{
+    uint64_t size;
+    if (blob_store_stat(hash_hex, &size) != 0)
+    {
+        add_error(error, ERR_BLOB_NOT_FOUND, NON_CRITICAL_ERROR, "The requested attachment is not in the blob store", "blob_store_copy_out");
+        return 1;
+    }
+
+    char stored_path[BLOB_PATH_BUFFER_SIZE];
+    blob_path(stored_path, hash_hex);
+
+    int source_fd = blob_file_open(stored_path, 0, 0);
+    int fd = blob_file_open(path, 1, 0);
+    if (source_fd < 0 || fd < 0)
+    {
+        if (source_fd >= 0)
+        {
+            close(source_fd);
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to open the attachment or its destination", "blob_store_copy_out");
+        return 1;
+    }
+
+    int result = copy_between_files(fd, source_fd, size, error);
+    close(source_fd);
+    close(fd);
+
+    return result;
+}
\ No newline at end of file
@@ -1,13 +1,62 @@
 #include "../include/server.h"
 #include "../include/client.h"
+#include "../include/public_ip.h"
+#include "../include/logger.h"
 #include "../include/jni_Bridge.h"
 
 static JavaVM *java_vm = NULL;
+static atomic_int hosting_room = ATOMIC_VAR_INIT(0);
+// looked up once, a local reference made on a network thread would live as long as the thread stays attached
+static jclass controller_class = NULL;
+static jclass string_class = NULL;
+
+static jclass find_global_class(JNIEnv *env, const char *name)
+{
+    jclass local_class = (*env)->FindClass(env, name);
+    if (local_class == NULL)
+    {
+        return NULL;
+    }
+
+    jclass global_class = (jclass)(*env)->NewGlobalRef(env, local_class);
+    (*env)->DeleteLocalRef(env, local_class);
+
+    return global_class;
+}
 
 jint JNI_OnLoad(JavaVM *vm, void *reserved)
 {
     java_vm = vm;
 
+    JNIEnv *env;
+    if ((*vm)->GetEnv(vm, (void **)&env, JNI_VERSION_21) != JNI_OK)
+    {
+        return JNI_ERR;
+    }
+
+    controller_class = find_global_class(env, "controller/Controller");
+    string_class = find_global_class(env, "java/lang/String");
+    if (controller_class == NULL || string_class == NULL)
+    {
+        printf("Failed to find the Java classes the callbacks use\n");
+        return JNI_ERR;
+    }
+
+    // bytes, every native thread started from here on reserves this much stack, see THREAD_STACK_SIZE
+    const char *thread_stack_size = getenv("CHAT_THREAD_STACK_SIZE");
+    if (thread_stack_size != NULL)
+    {
+        thread_set_stack_size((size_t)strtoull(thread_stack_size, NULL, 10));
+    }
+
+    // diagnostics are written by the logger's writer thread, so network threads never wait on stdout
+    error_list_t logger_error;
+    init_error(&logger_error);
+    if (logger_start(LOG_LEVEL_INFO, &logger_error) != 0)
+    {
+        printf("Failed to start the logger, diagnostics are written synchronously\n");
+    }
+
     return JNI_VERSION_21;
 }
 
@@ -24,64 +73,255 @@ JNIEnv *getJNIEnv()
     return env;
 }
 
+// JNI's own "UTF" strings are modified UTF-8, where a character past U+FFFF is two encoded surrogates the room rejects
+// and four byte sequences from the room are invalid. text is converted through UTF-16 instead, which Java uses itself
+static char *get_utf8_string(JNIEnv *env, jstring string)
+{
+    jsize length = (*env)->GetStringLength(env, string);
+    char *utf8 = (char *)malloc((size_t)length * 3 + 1);
+    const jchar *chars = (*env)->GetStringChars(env, string, NULL);
+    if (utf8 == NULL || chars == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "get_utf8_string", "Failed to convert a string from Java");
+        free(utf8);
+        if (chars != NULL)
+        {
+            (*env)->ReleaseStringChars(env, string, chars);
+        }
+        return NULL;
+    }
+
+    utf16_to_utf8((const uint16_t *)chars, (size_t)length, utf8);
+    (*env)->ReleaseStringChars(env, string, chars);
+
+    return utf8;
+}
+
+static jstring new_java_string(JNIEnv *env, const char *utf8)
+{
+    size_t length = strlen(utf8);
+    jchar *chars = (jchar *)malloc((length > 0 ? length : 1) * sizeof(jchar));
+    if (chars == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "new_java_string", "Failed to convert a string for Java");
+        return NULL;
+    }
+
+    jstring string = (*env)->NewString(env, chars, (jsize)utf8_to_utf16(utf8, (uint16_t *)chars));
+    free(chars);
+
+    return string;
+}
+
+// a room can be started as one node of a federation:
+// CHAT_PORT, CHAT_SECRET_KEY, CHAT_BANNED_IPS ("a.b.c.d,a.b.c.d/n"), CHAT_BLOB_DIR, CHAT_UPGRADE_SOCKET, CHAT_SOCKET_PROFILE, CHAT_FEDERATION_NODE_ID, CHAT_FEDERATION_ADDRESS, CHAT_FEDERATION_PORT, CHAT_FEDERATION_PEERS ("host:port,host:port")
+static void load_room_config(void)
+{
+    const char *port = getenv("CHAT_PORT");
+    if (port != NULL && set_server_port(port) != 0)
+    {
+        log_event(LOG_LEVEL_WARNING, "load_room_config", "Ignoring invalid CHAT_PORT");
+    }
+
+    const char *secret_key = getenv("CHAT_SECRET_KEY");
+    if (secret_key != NULL && set_secret_key(secret_key) != 0)
+    {
+        log_event(LOG_LEVEL_WARNING, "load_room_config", "Ignoring CHAT_SECRET_KEY, it must be %d characters long", SECRET_KEY_LENGTH);
+    }
+
+    const char *workers = getenv("CHAT_WORKERS");
+    if (workers != NULL)
+    {
+        set_worker_pool_size((size_t)strtoul(workers, NULL, 10));
+    }
+
+    // bytes the connections may hold between them, 0 for no limit
+    const char *memory_budget = getenv("CHAT_MEMORY_BUDGET");
+    if (memory_budget != NULL)
+    {
+        memory_budget_set((size_t)strtoull(memory_budget, NULL, 10));
+    }
+
+    // unset or invalid limits keep the defaults from server.h
+    const char *max_connections = getenv("CHAT_MAX_CONNECTIONS");
+    const char *max_pending_auth = getenv("CHAT_MAX_PENDING_AUTH");
+    const char *auth_deadline = getenv("CHAT_AUTH_DEADLINE_MS");
+    set_admission_limits(max_connections != NULL ? atoi(max_connections) : 0,
+                         max_pending_auth != NULL ? atoi(max_pending_auth) : 0,
+                         auth_deadline != NULL ? atoi(auth_deadline) : 0);
+
+    const char *banned_ips = getenv("CHAT_BANNED_IPS");
+    if (banned_ips != NULL && set_banned_addresses(banned_ips) != 0)
+    {
+        log_event(LOG_LEVEL_WARNING, "load_room_config", "Ignoring CHAT_BANNED_IPS, out of memory");
+    }
+
+    // bytes of new attachments the room stores, 0 for no limit
+    const char *attachment_quota = getenv("CHAT_ATTACHMENT_QUOTA");
+    if (attachment_quota != NULL)
+    {
+        blob_store_set_quota((uint64_t)strtoull(attachment_quota, NULL, 10));
+    }
+
+    const char *blob_directory = getenv("CHAT_BLOB_DIR");
+    if (blob_directory != NULL && set_blob_directory(blob_directory) != 0)
+    {
+        log_event(LOG_LEVEL_WARNING, "load_room_config", "Ignoring CHAT_BLOB_DIR, out of memory");
+    }
+
+    // a room started with the path of a running room's upgrade socket takes that room over
+    const char *upgrade_socket = getenv("CHAT_UPGRADE_SOCKET");
+    if (upgrade_socket != NULL && set_upgrade_socket_path(upgrade_socket) != 0)
+    {
+        log_event(LOG_LEVEL_WARNING, "load_room_config", "Ignoring CHAT_UPGRADE_SOCKET, the path is too long");
+    }
+
+    // "interactive", "bulk", "fanout-server" or "none" for the system defaults
+    socket_profile_t profile;
+    const char *socket_profile = getenv("CHAT_SOCKET_PROFILE");
+    if (socket_profile != NULL)
+    {
+        if (socket_parse_profile(socket_profile, &profile) != 0)
+        {
+            log_event(LOG_LEVEL_WARNING, "load_room_config", "Ignoring unknown CHAT_SOCKET_PROFILE %s", socket_profile);
+        }
+        else
+        {
+            set_listener_socket_profile(profile);
+        }
+    }
+
+    const char *public_ip_providers = getenv("CHAT_PUBLIC_IP_PROVIDERS");
+    if (public_ip_providers != NULL && set_public_ip_providers(public_ip_providers) != 0)
+    {
+        log_event(LOG_LEVEL_WARNING, "load_room_config", "Ignoring malformed CHAT_PUBLIC_IP_PROVIDERS");
+    }
+
+    const char *node_id = getenv("CHAT_FEDERATION_NODE_ID");
+    const char *federation_port = getenv("CHAT_FEDERATION_PORT");
+    if (node_id == NULL || federation_port == NULL)
+    {
+        return;
+    }
+
+    federation_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.node_id = strtoul(node_id, NULL, 10);
+    strncpy(config.listen_port, federation_port, sizeof(config.listen_port) - 1);
+
+    // other nodes on other machines need an address they can reach, loopback is the default
+    const char *federation_address = getenv("CHAT_FEDERATION_ADDRESS");
+    if (federation_address != NULL)
+    {
+        strncpy(config.listen_address, federation_address, sizeof(config.listen_address) - 1);
+    }
+
+    if (federation_parse_peers(getenv("CHAT_FEDERATION_PEERS"), &config) != 0)
+    {
+        log_event(LOG_LEVEL_WARNING, "load_room_config", "Ignoring federation config, CHAT_FEDERATION_PEERS is malformed");
+        return;
+    }
+
+    set_federation_config(&config);
+}
+
+// CHAT_CLIENT_SOCKET_PROFILE picks the chat connection's socket profile, see CHAT_SOCKET_PROFILE
+static void load_client_config(void)
+{
+    socket_profile_t profile;
+    const char *socket_profile = getenv("CHAT_CLIENT_SOCKET_PROFILE");
+    if (socket_profile == NULL)
+    {
+        return;
+    }
+
+    if (socket_parse_profile(socket_profile, &profile) != 0)
+    {
+        log_event(LOG_LEVEL_WARNING, "load_client_config", "Ignoring unknown CHAT_CLIENT_SOCKET_PROFILE %s", socket_profile);
+        return;
+    }
+
+    set_client_socket_profile(profile);
+}
+
 JNIEXPORT jint JNICALL Java_jni_Bridge_startChatRoom(JNIEnv *env, jclass clazz, jstring username)
 {
-    const char *admin_username = (*env)->GetStringUTFChars(env, username, 0);
+    char *admin_username = get_utf8_string(env, username);
+    if (admin_username == NULL)
+    {
+        return 1;
+    }
 
-    error_t main_thread_error;
+    error_list_t main_thread_error;
     init_error(&main_thread_error);
 
     char public_ip[INET_ADDRSTRLEN];
     char local_ip[INET_ADDRSTRLEN];
-    const char *port = PORT;
+    load_room_config();
+    const char *port = get_server_port();
+
+    // the lookup runs while the room starts up, by the time it is needed the answer is usually in
+    start_public_ip_discovery();
 
     if (start_chat_room(admin_username, local_ip, &main_thread_error, callback_error) != 0)
     {
-        (*env)->ReleaseStringUTFChars(env, username, admin_username);
+        free(admin_username);
         report_errors(&main_thread_error, callback_error);
         return 1;
     }
 
-    if (join_chat_room(local_ip, port, "", admin_username, USER_TYPE_ADMIN, &main_thread_error, callback_error, callback_message, callback_server_error, callback_notification) != 0)
+    // the host's UI is a member of its own room without a socket, frames reach it through an in-memory queue
+    if (join_chat_room_locally(admin_username, &main_thread_error, callback_error, callback_message, callback_presence, callback_attachment, callback_search, callback_typing, callback_direct, callback_direct_ack) != 0)
     {
-        (*env)->ReleaseStringUTFChars(env, username, admin_username);
+        free(admin_username);
         report_errors(&main_thread_error, callback_error);
+
+        // nothing could close the room later, it would keep the port until the process exits
+        init_error(&main_thread_error);
+        if (close_chat_room(&main_thread_error) != 0)
+        {
+            report_errors(&main_thread_error, callback_error);
+        }
         return 1;
     }
 
-    (*env)->ReleaseStringUTFChars(env, username, admin_username);
+    free(admin_username);
+    atomic_store(&hosting_room, 1);
 
+    // the room is already up, without a public IP it is still reachable on the local network
     if (get_public_ip(public_ip, sizeof(public_ip), &main_thread_error) != 0)
     {
-        (*env)->ReleaseStringUTFChars(env, username, admin_username);
         report_errors(&main_thread_error, callback_error);
-        return 1;
+        strcpy(public_ip, local_ip);
     }
 
-    const char *secret_key = get_secret_key();
-
-    // callback Java with IP, Port and Secret Key
-    printf("IP: %s\nPort: %s\nSecret: %s", public_ip, port, secret_key);
+    // the secret key stays out of the log file
+    log_event(LOG_LEVEL_INFO, "Java_jni_Bridge_startChatRoom", "IP: %s\nPort: %s", public_ip, port);
 
     return 0;
 }
 
 JNIEXPORT void JNICALL Java_jni_Bridge_joinChatRoom(JNIEnv *env, jclass clazz, jstring ip_address, jstring port, jstring secret_key, jstring username)
 {
+    char *client_username = get_utf8_string(env, username);
+    if (client_username == NULL)
+    {
+        return;
+    }
     const char *server_ip_address = (*env)->GetStringUTFChars(env, ip_address, 0);
     const char *server_port = (*env)->GetStringUTFChars(env, port, 0);
     const char *server_secret_key = (*env)->GetStringUTFChars(env, secret_key, 0);
-    const char *client_username = (*env)->GetStringUTFChars(env, username, 0);
 
-    error_t main_thread_error;
+    error_list_t main_thread_error;
     init_error(&main_thread_error);
+    load_client_config();
 
-    if (join_chat_room(server_ip_address, server_port, server_secret_key, client_username, USER_TYPE_REGULAR, &main_thread_error, callback_error, callback_message, callback_server_error, callback_notification) != 0)
+    if (join_chat_room(server_ip_address, server_port, server_secret_key, client_username, USER_TYPE_REGULAR, &main_thread_error, callback_error, callback_message, callback_server_error, callback_notification, callback_presence, callback_attachment, callback_search, callback_typing, callback_direct, callback_direct_ack) != 0)
     {
         (*env)->ReleaseStringUTFChars(env, ip_address, server_ip_address);
         (*env)->ReleaseStringUTFChars(env, port, server_port);
         (*env)->ReleaseStringUTFChars(env, secret_key, server_secret_key);
-        (*env)->ReleaseStringUTFChars(env, username, client_username);
+        free(client_username);
         report_errors(&main_thread_error, callback_error);
         return;
     }
@@ -89,34 +329,338 @@ JNIEXPORT void JNICALL Java_jni_Bridge_joinChatRoom(JNIEnv *env, jclass clazz, j
     (*env)->ReleaseStringUTFChars(env, ip_address, server_ip_address);
     (*env)->ReleaseStringUTFChars(env, port, server_port);
     (*env)->ReleaseStringUTFChars(env, secret_key, server_secret_key);
-    (*env)->ReleaseStringUTFChars(env, username, client_username);
+    free(client_username);
+}
+
+JNIEXPORT void JNICALL Java_jni_Bridge_joinChatRoomAsync(JNIEnv *env, jclass clazz, jstring ip_address, jstring port, jstring secret_key, jstring username)
+{
+    char *client_username = get_utf8_string(env, username);
+    if (client_username == NULL)
+    {
+        callback_join(1);
+        return;
+    }
+    const char *server_ip_address = (*env)->GetStringUTFChars(env, ip_address, 0);
+    const char *server_port = (*env)->GetStringUTFChars(env, port, 0);
+    const char *server_secret_key = (*env)->GetStringUTFChars(env, secret_key, 0);
+
+    error_list_t main_thread_error;
+    init_error(&main_thread_error);
+    load_client_config();
+
+    // the join thread copies everything it needs, the strings are released right away
+    if (join_chat_room_async(server_ip_address, server_port, server_secret_key, client_username, USER_TYPE_REGULAR, &main_thread_error, callback_error, callback_message, callback_server_error, callback_notification, callback_presence, callback_attachment, callback_search, callback_typing, callback_direct, callback_direct_ack, callback_join) != 0)
+    {
+        report_errors(&main_thread_error, callback_error);
+        callback_join(1);
+    }
+
+    (*env)->ReleaseStringUTFChars(env, ip_address, server_ip_address);
+    (*env)->ReleaseStringUTFChars(env, port, server_port);
+    (*env)->ReleaseStringUTFChars(env, secret_key, server_secret_key);
+    free(client_username);
+}
+
+JNIEXPORT void JNICALL Java_jni_Bridge_cancelConnect(JNIEnv *env, jclass clazz)
+{
+    cancel_client_connect();
 }
 
 JNIEXPORT void JNICALL Java_jni_Bridge_sendMessage(JNIEnv *env, jclass clazz, jstring message)
 {
-    const char *client_message = (*env)->GetStringUTFChars(env, message, 0);
+    char *client_message = get_utf8_string(env, message);
+    if (client_message == NULL)
+    {
+        return;
+    }
 
-    error_t main_thread_error;
+    error_list_t main_thread_error;
     init_error(&main_thread_error);
 
-    send_regular_message(client_message, &main_thread_error, callback_error);
+    if (atomic_load(&hosting_room))
+    {
+        send_local_message(client_message, &main_thread_error, callback_error);
+    }
+    else
+    {
+        send_regular_message(client_message, &main_thread_error, callback_error);
+    }
 
-    (*env)->ReleaseStringUTFChars(env, message, client_message);
+    free(client_message);
 }
 
-void callback_error(const char *aggregated_message, int max_severity)
+JNIEXPORT jlong JNICALL Java_jni_Bridge_sendMessageAsync(JNIEnv *env, jclass clazz, jstring message)
 {
-    JNIEnv *env = getJNIEnv();
-    if (env == NULL)
+    char *client_message = get_utf8_string(env, message);
+    if (client_message == NULL)
     {
-        printf("Failed to get JNIEnv\n");
+        return 0;
+    }
+
+    error_list_t main_thread_error;
+    init_error(&main_thread_error);
+
+    // the host's message goes into the room's own log, there is no network in the way and nothing to track
+    uint64_t request_id = 0;
+    if (atomic_load(&hosting_room))
+    {
+        send_local_message(client_message, &main_thread_error, callback_error);
+    }
+    else
+    {
+        request_id = queue_regular_message(client_message, callback_send, &main_thread_error, callback_error);
+    }
+
+    free(client_message);
+
+    return (jlong)request_id;
+}
+
+JNIEXPORT jboolean JNICALL Java_jni_Bridge_cancelSend(JNIEnv *env, jclass clazz, jlong request_id)
+{
+    return cancel_queued_send((uint64_t)request_id) == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL Java_jni_Bridge_sendAttachment(JNIEnv *env, jclass clazz, jstring path, jstring name)
+{
+    const char *attachment_path = (*env)->GetStringUTFChars(env, path, 0);
+    char *attachment_name = get_utf8_string(env, name);
+    if (attachment_name == NULL)
+    {
+        (*env)->ReleaseStringUTFChars(env, path, attachment_path);
         return;
     }
 
-    jclass controller_class = (*env)->FindClass(env, "controller/Controller");
-    if (controller_class == NULL)
+    error_list_t main_thread_error;
+    init_error(&main_thread_error);
+
+    // errors are reported by the calls themselves
+    if (atomic_load(&hosting_room))
+    {
+        share_local_attachment(attachment_path, attachment_name, &main_thread_error, callback_error);
+    }
+    else
+    {
+        upload_attachment(attachment_path, attachment_name, &main_thread_error, callback_error);
+    }
+
+    (*env)->ReleaseStringUTFChars(env, path, attachment_path);
+    free(attachment_name);
+}
+
+JNIEXPORT void JNICALL Java_jni_Bridge_searchHistory(JNIEnv *env, jclass clazz, jstring query, jlong since, jlong until)
+{
+    char *search_query = get_utf8_string(env, query);
+    if (search_query == NULL)
     {
-        printf("Failed to find Controller class\n");
+        return;
+    }
+
+    error_list_t main_thread_error;
+    init_error(&main_thread_error);
+
+    // the results arrive through callback_search, not as a return value
+    if (atomic_load(&hosting_room))
+    {
+        search_local_history(search_query, (uint64_t)since, (uint64_t)until, &main_thread_error, callback_error);
+    }
+    else
+    {
+        send_search_request(search_query, (uint64_t)since, (uint64_t)until, &main_thread_error, callback_error);
+    }
+
+    free(search_query);
+}
+
+JNIEXPORT void JNICALL Java_jni_Bridge_sendTyping(JNIEnv *env, jclass clazz, jboolean typing)
+{
+    error_list_t main_thread_error;
+    init_error(&main_thread_error);
+
+    if (atomic_load(&hosting_room))
+    {
+        send_local_typing(typing == JNI_TRUE);
+    }
+    else
+    {
+        send_typing_state(typing == JNI_TRUE, &main_thread_error, callback_error);
+    }
+}
+
+JNIEXPORT jlong JNICALL Java_jni_Bridge_sendDirectMessage(JNIEnv *env, jclass clazz, jobjectArray recipients, jstring message)
+{
+    jsize recipient_count = (*env)->GetArrayLength(env, recipients);
+    if (recipient_count > DIRECT_MAX_RECIPIENTS)
+    {
+        recipient_count = DIRECT_MAX_RECIPIENTS + 1;
+    }
+
+    // one past the limit is enough for the room code to reject the message, the rest aren't converted
+    char *recipient_names[DIRECT_MAX_RECIPIENTS + 1];
+    jsize converted = 0;
+    for (; converted < recipient_count; converted++)
+    {
+        jstring jrecipient = (jstring)(*env)->GetObjectArrayElement(env, recipients, converted);
+        recipient_names[converted] = jrecipient != NULL ? get_utf8_string(env, jrecipient) : NULL;
+        (*env)->DeleteLocalRef(env, jrecipient);
+        if (recipient_names[converted] == NULL)
+        {
+            break;
+        }
+    }
+
+    char *direct_message = converted == recipient_count ? get_utf8_string(env, message) : NULL;
+
+    uint32_t sequence = 0;
+    if (direct_message != NULL)
+    {
+        error_list_t main_thread_error;
+        init_error(&main_thread_error);
+
+        // the outcome for each recipient arrives through callback_direct_ack with the returned sequence
+        if (atomic_load(&hosting_room))
+        {
+            sequence = send_local_direct_message((const char **)recipient_names, (size_t)recipient_count, direct_message, &main_thread_error, callback_error);
+        }
+        else
+        {
+            sequence = send_direct_message((const char **)recipient_names, (size_t)recipient_count, direct_message, &main_thread_error, callback_error);
+        }
+    }
+
+    for (jsize i = 0; i < converted; i++)
+    {
+        free(recipient_names[i]);
+    }
+    free(direct_message);
+
+    return (jlong)sequence;
+}
+
+JNIEXPORT jint JNICALL Java_jni_Bridge_downloadAttachment(JNIEnv *env, jclass clazz, jstring hash, jstring path)
+{
+    const char *hash_hex = (*env)->GetStringUTFChars(env, hash, 0);
+    const char *destination_path = (*env)->GetStringUTFChars(env, path, 0);
+
+    error_list_t main_thread_error;
+    init_error(&main_thread_error);
+
+    int result;
+    if (atomic_load(&hosting_room))
+    {
+        // the host's blob store is on this machine
+        result = blob_store_copy_out(hash_hex, destination_path, &main_thread_error);
+        if (result != 0)
+        {
+            report_errors(&main_thread_error, callback_error);
+        }
+    }
+    else
+    {
+        result = download_attachment(hash_hex, 0, 0, destination_path, &main_thread_error, callback_error);
+    }
+
+    (*env)->ReleaseStringUTFChars(env, hash, hash_hex);
+    (*env)->ReleaseStringUTFChars(env, path, destination_path);
+
+    return result;
+}
+
+JNIEXPORT void JNICALL Java_jni_Bridge_kickUser(JNIEnv *env, jclass clazz, jstring username)
+{
+    char *kicked_username = get_utf8_string(env, username);
+    if (kicked_username == NULL)
+    {
+        return;
+    }
+
+    error_list_t main_thread_error;
+    init_error(&main_thread_error);
+
+    if (kick_client(kicked_username, NOTIFICATION_KICK, &main_thread_error) != 0)
+    {
+        report_errors(&main_thread_error, callback_error);
+    }
+
+    free(kicked_username);
+}
+
+JNIEXPORT void JNICALL Java_jni_Bridge_banUser(JNIEnv *env, jclass clazz, jstring username)
+{
+    char *banned_username = get_utf8_string(env, username);
+    if (banned_username == NULL)
+    {
+        return;
+    }
+
+    error_list_t main_thread_error;
+    init_error(&main_thread_error);
+
+    if (kick_client(banned_username, NOTIFICATION_BAN, &main_thread_error) != 0)
+    {
+        report_errors(&main_thread_error, callback_error);
+    }
+
+    free(banned_username);
+}
+
+JNIEXPORT jint JNICALL Java_jni_Bridge_setContentFilter(JNIEnv *env, jclass clazz, jstring rules)
+{
+    char *filter_rules = get_utf8_string(env, rules);
+    if (filter_rules == NULL)
+    {
+        return 1;
+    }
+
+    error_list_t main_thread_error;
+    init_error(&main_thread_error);
+
+    // compiled on this thread, the room keeps filtering with the old rules until the new ones are swapped in
+    int result = set_content_filter_rules(filter_rules, &main_thread_error);
+    if (result != 0)
+    {
+        report_errors(&main_thread_error, callback_error);
+    }
+
+    free(filter_rules);
+
+    return result;
+}
+
+JNIEXPORT void JNICALL Java_jni_Bridge_closeChatRoom(JNIEnv *env, jclass clazz)
+{
+    if (!atomic_load(&hosting_room))
+    {
+        return;
+    }
+
+    error_list_t main_thread_error;
+    init_error(&main_thread_error);
+
+    // blocks until the clients got their notice or ran out of time, see ROOM_CLOSE_DRAIN_TIMEOUT_MS
+    if (close_chat_room(&main_thread_error) != 0)
+    {
+        report_errors(&main_thread_error, callback_error);
+    }
+
+    atomic_store(&hosting_room, 0);
+}
+
+JNIEXPORT jstring JNICALL Java_jni_Bridge_getMemoryReport(JNIEnv *env, jclass clazz)
+{
+    // plain ASCII, modified UTF-8 reads it the same
+    char report[MEMORY_REPORT_BUFFER_SIZE];
+    format_memory_report(report, sizeof(report));
+
+    return (*env)->NewStringUTF(env, report);
+}
+
+void callback_error(const char *aggregated_message, int max_severity)
+{
+    JNIEnv *env = getJNIEnv();
+    if (env == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_error", "Failed to get JNIEnv");
         return;
     }
 
@@ -125,11 +669,11 @@ void callback_error(const char *aggregated_message, int max_severity)
         jmethodID show_popup_method = (*env)->GetStaticMethodID(env, controller_class, "showCriticalError", "(Ljava/lang/String;)V");
         if (show_popup_method == NULL)
         {
-            printf("Failed to find showCriticalError method\n");
+            log_event(LOG_LEVEL_ERROR, "callback_error", "Failed to find showCriticalError method");
             return;
         }
 
-        jstring jmessage = (*env)->NewStringUTF(env, aggregated_message);
+        jstring jmessage = new_java_string(env, aggregated_message);
         (*env)->CallStaticVoidMethod(env, controller_class, show_popup_method, jmessage);
         (*env)->DeleteLocalRef(env, jmessage);
     }
@@ -138,11 +682,11 @@ void callback_error(const char *aggregated_message, int max_severity)
         jmethodID log_error_method = (*env)->GetStaticMethodID(env, controller_class, "logNonCriticalError", "(Ljava/lang/String;)V");
         if (log_error_method == NULL)
         {
-            printf("Failed to find logNonCriticalError method\n");
+            log_event(LOG_LEVEL_ERROR, "callback_error", "Failed to find logNonCriticalError method");
             return;
         }
 
-        jstring jmessage = (*env)->NewStringUTF(env, aggregated_message);
+        jstring jmessage = new_java_string(env, aggregated_message);
         (*env)->CallStaticVoidMethod(env, controller_class, log_error_method, jmessage);
         (*env)->DeleteLocalRef(env, jmessage);
     }
@@ -153,26 +697,19 @@ void callback_message(const char *username, const char *message)
     JNIEnv *env = getJNIEnv();
     if (env == NULL)
     {
-        printf("Failed to get JNIEnv\n");
-        return;
-    }
-
-    jclass controller_class = (*env)->FindClass(env, "controller/Controller");
-    if (controller_class == NULL)
-    {
-        printf("Failed to find Controller class\n");
+        log_event(LOG_LEVEL_ERROR, "callback_message", "Failed to get JNIEnv");
         return;
     }
 
     jmethodID display_message_method = (*env)->GetStaticMethodID(env, controller_class, "displayMessage", "(Ljava/lang/String;Ljava/lang/String;)V");
     if (display_message_method == NULL)
     {
-        printf("Failed to find displayMessage method\n");
+        log_event(LOG_LEVEL_ERROR, "callback_message", "Failed to find displayMessage method");
         return;
     }
 
-    jstring jusername = (*env)->NewStringUTF(env, username);
-    jstring jmessage = (*env)->NewStringUTF(env, message);
+    jstring jusername = new_java_string(env, username);
+    jstring jmessage = new_java_string(env, message);
 
     (*env)->CallStaticVoidMethod(env, controller_class, display_message_method, jusername, jmessage);
 
@@ -185,14 +722,7 @@ void callback_server_error(error_type_t error_type, const char *message)
     JNIEnv *env = getJNIEnv();
     if (env == NULL)
     {
-        printf("Failed to get JNIEnv\n");
-        return;
-    }
-
-    jclass controller_class = (*env)->FindClass(env, "controller/Controller");
-    if (controller_class == NULL)
-    {
-        printf("Failed to find Controller class\n");
+        log_event(LOG_LEVEL_ERROR, "callback_server_error", "Failed to get JNIEnv");
         return;
     }
 
@@ -208,13 +738,13 @@ void callback_server_error(error_type_t error_type, const char *message)
 
     if (show_error_method != NULL)
     {
-        jstring jmessage = (*env)->NewStringUTF(env, message);
+        jstring jmessage = new_java_string(env, message);
         (*env)->CallStaticVoidMethod(env, controller_class, show_error_method, jmessage);
         (*env)->DeleteLocalRef(env, jmessage);
     }
     else
     {
-        printf("Error %d: %s\n", error_type, message);
+        log_event(LOG_LEVEL_INFO, "callback_server_error", "Error %d: %s", error_type, message);
     }
 }
 
@@ -223,14 +753,7 @@ void callback_notification(notification_type_t notification_type, const char *me
     JNIEnv *env = getJNIEnv();
     if (env == NULL)
     {
-        printf("Failed to get JNIEnv\n");
-        return;
-    }
-
-    jclass controller_class = (*env)->FindClass(env, "controller/Controller");
-    if (controller_class == NULL)
-    {
-        printf("Failed to find Controller class\n");
+        log_event(LOG_LEVEL_ERROR, "callback_notification", "Failed to get JNIEnv");
         return;
     }
 
@@ -239,14 +762,255 @@ void callback_notification(notification_type_t notification_type, const char *me
         jmethodID switch_to_main_panel = (*env)->GetStaticMethodID(env, controller_class, "switchToMainPanel", "()V");
         if (switch_to_main_panel == NULL)
         {
-            printf("Failed to find switchToMainPanel method\n");
+            log_event(LOG_LEVEL_ERROR, "callback_notification", "Failed to find switchToMainPanel method");
             return;
         }
 
         (*env)->CallStaticVoidMethod(env, controller_class, switch_to_main_panel);
     }
+    else if (notification_type == NOTIFICATION_KICK || notification_type == NOTIFICATION_BAN || notification_type == NOTIFICATION_DISCONNECT)
+    {
+        jmethodID show_removed_method = (*env)->GetStaticMethodID(env, controller_class, "showRemovedFromRoom", "(Ljava/lang/String;)V");
+        if (show_removed_method == NULL)
+        {
+            log_event(LOG_LEVEL_ERROR, "callback_notification", "Failed to find showRemovedFromRoom method");
+            return;
+        }
+
+        jstring jmessage = new_java_string(env, message);
+        (*env)->CallStaticVoidMethod(env, controller_class, show_removed_method, jmessage);
+        (*env)->DeleteLocalRef(env, jmessage);
+    }
     else
     {
-        printf("Notification %d: %s\n", notification_type, message);
+        log_event(LOG_LEVEL_INFO, "callback_notification", "Notification %d: %s", notification_type, message);
     }
+}
+
+void callback_presence(presence_op_t presence_op, const char *username, const char *new_username)
+{
+    JNIEnv *env = getJNIEnv();
+    if (env == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_presence", "Failed to get JNIEnv");
+        return;
+    }
+
+    jmethodID apply_presence_method = (*env)->GetStaticMethodID(env, controller_class, "applyPresence", "(ILjava/lang/String;Ljava/lang/String;)V");
+    if (apply_presence_method == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_presence", "Failed to find applyPresence method");
+        return;
+    }
+
+    jstring jusername = new_java_string(env, username);
+    jstring jnew_username = new_java_string(env, new_username);
+
+    (*env)->CallStaticVoidMethod(env, controller_class, apply_presence_method, (jint)presence_op, jusername, jnew_username);
+
+    (*env)->DeleteLocalRef(env, jusername);
+    (*env)->DeleteLocalRef(env, jnew_username);
+}
+
+void callback_attachment(const char *username, const char *hash_hex, uint64_t size, const char *name)
+{
+    JNIEnv *env = getJNIEnv();
+    if (env == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_attachment", "Failed to get JNIEnv");
+        return;
+    }
+
+    jmethodID display_attachment_method = (*env)->GetStaticMethodID(env, controller_class, "displayAttachment", "(Ljava/lang/String;Ljava/lang/String;JLjava/lang/String;)V");
+    if (display_attachment_method == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_attachment", "Failed to find displayAttachment method");
+        return;
+    }
+
+    jstring jusername = new_java_string(env, username);
+    jstring jhash = new_java_string(env, hash_hex);
+    jstring jname = new_java_string(env, name);
+
+    (*env)->CallStaticVoidMethod(env, controller_class, display_attachment_method, jusername, jhash, (jlong)size, jname);
+
+    (*env)->DeleteLocalRef(env, jusername);
+    (*env)->DeleteLocalRef(env, jhash);
+    (*env)->DeleteLocalRef(env, jname);
+}
+
+void callback_search(const char *username, const char *message, uint64_t timestamp)
+{
+    JNIEnv *env = getJNIEnv();
+    if (env == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_search", "Failed to get JNIEnv");
+        return;
+    }
+
+    // without a sender this is the end of the results and the timestamp is the number of hits
+    if (username == NULL)
+    {
+        jmethodID display_search_done_method = (*env)->GetStaticMethodID(env, controller_class, "displaySearchDone", "(J)V");
+        if (display_search_done_method == NULL)
+        {
+            log_event(LOG_LEVEL_ERROR, "callback_search", "Failed to find displaySearchDone method");
+            return;
+        }
+
+        (*env)->CallStaticVoidMethod(env, controller_class, display_search_done_method, (jlong)timestamp);
+        return;
+    }
+
+    jmethodID display_search_result_method = (*env)->GetStaticMethodID(env, controller_class, "displaySearchResult", "(Ljava/lang/String;Ljava/lang/String;J)V");
+    if (display_search_result_method == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_search", "Failed to find displaySearchResult method");
+        return;
+    }
+
+    jstring jusername = new_java_string(env, username);
+    jstring jmessage = new_java_string(env, message);
+
+    (*env)->CallStaticVoidMethod(env, controller_class, display_search_result_method, jusername, jmessage, (jlong)timestamp);
+
+    (*env)->DeleteLocalRef(env, jusername);
+    (*env)->DeleteLocalRef(env, jmessage);
+}
+
+void callback_typing(const char **usernames, size_t count)
+{
+    JNIEnv *env = getJNIEnv();
+    if (env == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_typing", "Failed to get JNIEnv");
+        return;
+    }
+
+    jmethodID display_typing_method = (*env)->GetStaticMethodID(env, controller_class, "displayTyping", "([Ljava/lang/String;)V");
+    if (display_typing_method == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_typing", "Failed to find displayTyping method");
+        return;
+    }
+
+    jobjectArray jusernames = (*env)->NewObjectArray(env, (jsize)count, string_class, NULL);
+    if (jusernames == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_typing", "Failed to allocate the typing array");
+        return;
+    }
+
+    // the whole set every time, the UI replaces what it showed
+    for (size_t i = 0; i < count; i++)
+    {
+        jstring jusername = new_java_string(env, usernames[i]);
+        (*env)->SetObjectArrayElement(env, jusernames, (jsize)i, jusername);
+        (*env)->DeleteLocalRef(env, jusername);
+    }
+
+    (*env)->CallStaticVoidMethod(env, controller_class, display_typing_method, jusernames);
+
+    (*env)->DeleteLocalRef(env, jusernames);
+}
+
+void callback_direct(const char *sender_username, const char **recipients, size_t recipient_count, const char *message)
+{
+    JNIEnv *env = getJNIEnv();
+    if (env == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_direct", "Failed to get JNIEnv");
+        return;
+    }
+
+    jmethodID display_direct_method = (*env)->GetStaticMethodID(env, controller_class, "displayDirectMessage", "(Ljava/lang/String;[Ljava/lang/String;Ljava/lang/String;)V");
+    if (display_direct_method == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_direct", "Failed to find displayDirectMessage method");
+        return;
+    }
+
+    jobjectArray jrecipients = (*env)->NewObjectArray(env, (jsize)recipient_count, string_class, NULL);
+    if (jrecipients == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_direct", "Failed to allocate the recipient array");
+        return;
+    }
+
+    for (size_t i = 0; i < recipient_count; i++)
+    {
+        jstring jrecipient = new_java_string(env, recipients[i]);
+        (*env)->SetObjectArrayElement(env, jrecipients, (jsize)i, jrecipient);
+        (*env)->DeleteLocalRef(env, jrecipient);
+    }
+
+    jstring jsender = new_java_string(env, sender_username);
+    jstring jmessage = new_java_string(env, message);
+
+    (*env)->CallStaticVoidMethod(env, controller_class, display_direct_method, jsender, jrecipients, jmessage);
+
+    (*env)->DeleteLocalRef(env, jsender);
+    (*env)->DeleteLocalRef(env, jmessage);
+    (*env)->DeleteLocalRef(env, jrecipients);
+}
+
+void callback_direct_ack(uint32_t sequence, char status, const char *recipient)
+{
+    JNIEnv *env = getJNIEnv();
+    if (env == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_direct_ack", "Failed to get JNIEnv");
+        return;
+    }
+
+    jmethodID display_direct_ack_method = (*env)->GetStaticMethodID(env, controller_class, "displayDirectAck", "(JZLjava/lang/String;)V");
+    if (display_direct_ack_method == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_direct_ack", "Failed to find displayDirectAck method");
+        return;
+    }
+
+    jstring jrecipient = new_java_string(env, recipient);
+
+    (*env)->CallStaticVoidMethod(env, controller_class, display_direct_ack_method, (jlong)sequence, status == DIRECT_STATUS_DELIVERED ? JNI_TRUE : JNI_FALSE, jrecipient);
+
+    (*env)->DeleteLocalRef(env, jrecipient);
+}
+
+void callback_send(uint64_t request_id, send_status_t status)
+{
+    JNIEnv *env = getJNIEnv();
+    if (env == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_send", "Failed to get JNIEnv");
+        return;
+    }
+
+    jmethodID send_completed_method = (*env)->GetStaticMethodID(env, controller_class, "sendCompleted", "(JI)V");
+    if (send_completed_method == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_send", "Failed to find sendCompleted method");
+        return;
+    }
+
+    (*env)->CallStaticVoidMethod(env, controller_class, send_completed_method, (jlong)request_id, (jint)status);
+}
+
+void callback_join(int result)
+{
+    JNIEnv *env = getJNIEnv();
+    if (env == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_join", "Failed to get JNIEnv");
+        return;
+    }
+
+    jmethodID join_completed_method = (*env)->GetStaticMethodID(env, controller_class, "joinCompleted", "(Z)V");
+    if (join_completed_method == NULL)
+    {
+        log_event(LOG_LEVEL_ERROR, "callback_join", "Failed to find joinCompleted method");
+        return;
+    }
+
+    (*env)->CallStaticVoidMethod(env, controller_class, join_completed_method, result == 0 ? JNI_TRUE : JNI_FALSE);
 }
\ No newline at end of file
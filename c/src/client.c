@@ -2,12 +2,165 @@
 
 static socket_t *client_socket = NULL;
 static atomic_int client_running = ATOMIC_VAR_INIT(0);
+static atomic_int connect_cancelled = ATOMIC_VAR_INIT(0);
+// the chat connection's profile, attachment transfers always go bulk
+static socket_profile_t client_socket_profile = SOCKET_PROFILE_INTERACTIVE;
+// numbers direct messages, the server's acks carry it back
+static atomic_uint next_direct_sequence = ATOMIC_VAR_INIT(1);
+// where the chat connection went, attachments travel over separate connections to the same room
+static char transfer_address[TRANSFER_ADDRESS_BUFFER_SIZE];
+static char transfer_port[TRANSFER_PORT_BUFFER_SIZE];
+static char transfer_secret_key[SECRET_KEY_BUFFER_SIZE];
+// frames on their way to the server. callers only queue, the send thread takes everything queued at once and writes it
+// with as few sends as it fits in, so a burst of messages goes out back to back and nobody waits on the network
+static mutex_t send_queue_mutex;
+static cond_t send_queue_cond;
+static atomic_int send_queue_ready = ATOMIC_VAR_INIT(0);
+// the rest is guarded by send_queue_mutex, send_queue_open is set while a send thread drains the queue
+static client_send_request_t *send_queue_head = NULL;
+static client_send_request_t *send_queue_tail = NULL;
+static size_t send_queue_length = 0;
+static int send_queue_open = 0;
+static uint64_t next_send_request_id = 1;
+static thread_t send_thread;
+static void (*send_error_func)(const char *, int) = NULL;
+
+// queues a frame for the send thread, returns the request's ID or 0 when nothing was queued
+static uint64_t queue_frame(const char *frame, size_t frame_length, void (*callback_send_func)(uint64_t, send_status_t), error_severity_t severity, error_list_t *error)
+{
+    if (!atomic_load(&send_queue_ready))
+    {
+        add_error(error, SERVER_DISCONNECTED, severity, "Join a room before sending to it", "queue_frame");
+        return 0;
+    }
+
+    client_send_request_t *request = (client_send_request_t *)malloc(sizeof(client_send_request_t) + frame_length);
+    if (request == NULL)
+    {
+        add_error(error, MALLOC_ERROR, severity, "Failed to allocate memory for a queued frame", "queue_frame");
+        return 0;
+    }
+
+    request->next = NULL;
+    request->callback_send_func = callback_send_func;
+    request->length = frame_length;
+    memcpy(request->frame, frame, frame_length);
+
+    mutex_lock(&send_queue_mutex);
+
+    if (!send_queue_open)
+    {
+        mutex_unlock(&send_queue_mutex);
+        free(request);
+        add_error(error, SERVER_DISCONNECTED, severity, "Not connected to a room", "queue_frame");
+        return 0;
+    }
+
+    if (send_queue_length >= CLIENT_SEND_QUEUE_LIMIT)
+    {
+        mutex_unlock(&send_queue_mutex);
+        free(request);
+        add_error(error, ERR_SEND_QUEUE_FULL, severity, "Too many messages are waiting to be sent, try again shortly", "queue_frame");
+        return 0;
+    }
+
+    request->request_id = next_send_request_id++;
+    uint64_t request_id = request->request_id;
+
+    if (send_queue_tail == NULL)
+    {
+        send_queue_head = request;
+    }
+    else
+    {
+        send_queue_tail->next = request;
+    }
+    send_queue_tail = request;
+    send_queue_length++;
+
+    cond_signal(&send_queue_cond);
+    mutex_unlock(&send_queue_mutex);
+
+    return request_id;
+}
+
+// opens the queue for a new connection and starts its send thread
+static int start_send_queue(socket_t *client_socket, void (*callback_error_func)(const char *, int), error_list_t *error)
+{
+    if (!atomic_load(&send_queue_ready))
+    {
+        mutex_init(&send_queue_mutex);
+        cond_init(&send_queue_cond);
+        atomic_store(&send_queue_ready, 1);
+    }
+
+    mutex_lock(&send_queue_mutex);
+    send_queue_open = 1;
+    send_error_func = callback_error_func;
+    mutex_unlock(&send_queue_mutex);
+
+    if (thread_create(&send_thread, client_send_thread, client_socket) != 0)
+    {
+        mutex_lock(&send_queue_mutex);
+        send_queue_open = 0;
+        mutex_unlock(&send_queue_mutex);
+        add_error(error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create client send thread", "start_send_queue");
+        return 1;
+    }
 
-int join_chat_room(const char *ip_address, const char *port, const char *secret_key, const char *username, user_type_t user_type, error_t *main_error, void (*callback_error_func)(const char *, int), void (*callback_message_func)(const char *, const char *), void (*callback_server_error_func)(error_type_t, const char *), void (*callback_notification_func)(notification_type_t, const char *))
+    return 0;
+}
+
+// closes the queue and waits for the send thread, which fails whatever is still queued on its way out
+static void stop_send_queue(void)
+{
+    mutex_lock(&send_queue_mutex);
+    send_queue_open = 0;
+    cond_signal(&send_queue_cond);
+    mutex_unlock(&send_queue_mutex);
+
+    thread_join(send_thread);
+}
+
+// completes and frees the requests from first up to, but not including, last
+static void complete_send_requests(client_send_request_t *first, client_send_request_t *last, send_status_t status)
+{
+    while (first != last)
+    {
+        client_send_request_t *next = first->next;
+        if (first->callback_send_func != NULL)
+        {
+            first->callback_send_func(first->request_id, status);
+        }
+        free(first);
+        first = next;
+    }
+}
+
+// a blocking send can still take only part of a batch
+static int send_batch(socket_t client_socket, const char *batch, size_t batch_length, error_list_t *error)
+{
+    size_t sent = 0;
+
+    while (sent < batch_length)
+    {
+        int result_code = socket_send(client_socket, batch + sent, batch_length - sent, 0, "", CONTEXT_CLIENT, NON_CRITICAL_ERROR, error);
+        if (result_code == SOCKET_ERR)
+        {
+            return 1;
+        }
+        sent += (size_t)result_code;
+    }
+
+    return 0;
+}
+
+// join_chat_room without clearing a cancel that came in since the join started
+static int connect_chat_room(const char *ip_address, const char *port, const char *secret_key, const char *username, user_type_t user_type, error_list_t *main_error, void (*callback_error_func)(const char *, int), void (*callback_message_func)(const char *, const char *), void (*callback_server_error_func)(error_type_t, const char *), void (*callback_notification_func)(notification_type_t, const char *), void (*callback_presence_func)(presence_op_t, const char *, const char *), void (*callback_attachment_func)(const char *, const char *, uint64_t, const char *), void (*callback_search_func)(const char *, const char *, uint64_t), void (*callback_typing_func)(const char **, size_t), void (*callback_direct_func)(const char *, const char **, size_t, const char *), void (*callback_direct_ack_func)(uint32_t, char, const char *))
 {
     if (atomic_load(&client_running))
     {
-        send_auth_message(*client_socket, user_type, secret_key, username, main_error, callback_error_func);
+        send_auth_message(user_type, secret_key, username, main_error, callback_error_func);
         if (main_error->count > 0)
         {
             atomic_store(&client_running, 0);
@@ -24,15 +177,19 @@ int join_chat_room(const char *ip_address, const char *port, const char *secret_
             return 1;
         }
 
-        if (strlen(username) >= USERNAME_BUFFER_SIZE)
+        if (utf8_check_text(username, USERNAME_MAX_CHARACTERS) != UTF8_VALID)
         {
-            callback_server_error_func(ERROR_USERNAME, "Username exceeds buffer size");
+            callback_server_error_func(ERROR_USERNAME, "Username must be valid UTF-8 of at most 20 characters");
             return 1;
         }
     }
 
     int result_code;
 
+    snprintf(transfer_address, sizeof(transfer_address), "%s", ip_address);
+    snprintf(transfer_port, sizeof(transfer_port), "%s", port);
+    snprintf(transfer_secret_key, sizeof(transfer_secret_key), "%s", secret_key);
+
     client_socket = (socket_t *)malloc(sizeof(socket_t));
     if (client_socket == NULL)
     {
@@ -51,7 +208,21 @@ int join_chat_room(const char *ip_address, const char *port, const char *secret_
         }
     }
 
-    result_code = create_and_connect_client_socket(ip_address, port, client_socket, main_error);
+    // a path instead of an address reaches a room on this machine through shared memory, attachments still go over TCP
+    if (ip_address[0] == '/')
+    {
+        *client_socket = local_transport_connect(ip_address, transfer_port, sizeof(transfer_port), main_error);
+        snprintf(transfer_address, sizeof(transfer_address), "%s", "127.0.0.1");
+        result_code = *client_socket == INVALID_SOCK;
+        if (result_code != 0)
+        {
+            socket_cleanup(main_error);
+        }
+    }
+    else
+    {
+        result_code = create_and_connect_client_socket(ip_address, port, client_socket_profile, client_socket, main_error);
+    }
     if (result_code != 0)
     {
         free(client_socket);
@@ -75,8 +246,24 @@ int join_chat_room(const char *ip_address, const char *port, const char *secret_
     thread_args->callback_message_func = callback_message_func;
     thread_args->callback_server_error_func = callback_server_error_func;
     thread_args->callback_notification_func = callback_notification_func;
+    thread_args->callback_presence_func = callback_presence_func;
+    thread_args->callback_attachment_func = callback_attachment_func;
+    thread_args->callback_search_func = callback_search_func;
+    thread_args->callback_typing_func = callback_typing_func;
+    thread_args->callback_direct_func = callback_direct_func;
+    thread_args->callback_direct_ack_func = callback_direct_ack_func;
     thread_args->user_type = user_type;
 
+    if (start_send_queue(client_socket, callback_error_func, main_error) != 0)
+    {
+        socket_close(*client_socket, main_error);
+        socket_cleanup(main_error);
+        free(client_socket);
+        client_socket = NULL;
+        free(thread_args);
+        return 1;
+    }
+
     atomic_store(&client_running, 1);
 
     thread_t recv_thread;
@@ -84,6 +271,7 @@ int join_chat_room(const char *ip_address, const char *port, const char *secret_
     {
         atomic_store(&client_running, 0);
         add_error(main_error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create client receive thread", "join_chat_room");
+        stop_send_queue();
         socket_close(*client_socket, main_error);
         socket_cleanup(main_error);
         free(client_socket);
@@ -94,16 +282,35 @@ int join_chat_room(const char *ip_address, const char *port, const char *secret_
 
     thread_detach(recv_thread);
 
-    send_auth_message(*client_socket, user_type, secret_key, username, main_error, callback_error_func);
+    send_auth_message(user_type, secret_key, username, main_error, callback_error_func);
     if (main_error->count > 0)
     {
         atomic_store(&client_running, 0);
         return 1;
     }
 
+    // typing sets are only sent to members that ask for them, a retried auth keeps the subscription
+    if (callback_typing_func != NULL)
+    {
+        char frame[MAX_BUFFER_SIZE];
+        size_t frame_length = format_typing_request_frame(frame, sizeof(frame), TYPING_OP_SUBSCRIBE);
+        if (queue_frame(frame, frame_length, NULL, NON_CRITICAL_ERROR, main_error) == 0)
+        {
+            report_errors(main_error, callback_error_func);
+            init_error(main_error);
+        }
+    }
+
     return 0;
 }
 
+int join_chat_room(const char *ip_address, const char *port, const char *secret_key, const char *username, user_type_t user_type, error_list_t *main_error, void (*callback_error_func)(const char *, int), void (*callback_message_func)(const char *, const char *), void (*callback_server_error_func)(error_type_t, const char *), void (*callback_notification_func)(notification_type_t, const char *), void (*callback_presence_func)(presence_op_t, const char *, const char *), void (*callback_attachment_func)(const char *, const char *, uint64_t, const char *), void (*callback_search_func)(const char *, const char *, uint64_t), void (*callback_typing_func)(const char **, size_t), void (*callback_direct_func)(const char *, const char **, size_t, const char *), void (*callback_direct_ack_func)(uint32_t, char, const char *))
+{
+    atomic_store(&connect_cancelled, 0);
+
+    return connect_chat_room(ip_address, port, secret_key, username, user_type, main_error, callback_error_func, callback_message_func, callback_server_error_func, callback_notification_func, callback_presence_func, callback_attachment_func, callback_search_func, callback_typing_func, callback_direct_func, callback_direct_ack_func);
+}
+
 thread_ret_t THREAD_CALL client_receive_thread(void *arg)
 {
     client_receive_thread_args_t *thread_args = (client_receive_thread_args_t *)arg;
@@ -112,26 +319,54 @@ thread_ret_t THREAD_CALL client_receive_thread(void *arg)
     void (*callback_message_func)(const char *, const char *) = thread_args->callback_message_func;
     void (*callback_server_error_func)(error_type_t, const char *) = thread_args->callback_server_error_func;
     void (*callback_notification_func)(notification_type_t, const char *) = thread_args->callback_notification_func;
+    void (*callback_presence_func)(presence_op_t, const char *, const char *) = thread_args->callback_presence_func;
+    void (*callback_attachment_func)(const char *, const char *, uint64_t, const char *) = thread_args->callback_attachment_func;
+    void (*callback_search_func)(const char *, const char *, uint64_t) = thread_args->callback_search_func;
+    void (*callback_typing_func)(const char **, size_t) = thread_args->callback_typing_func;
+    void (*callback_direct_func)(const char *, const char **, size_t, const char *) = thread_args->callback_direct_func;
+    void (*callback_direct_ack_func)(uint32_t, char, const char *) = thread_args->callback_direct_ack_func;
     user_type_t user_type = thread_args->user_type;
 
-    while (atomic_load(&client_running))
+    frame_reader_t *frame_reader = (frame_reader_t *)malloc(sizeof(frame_reader_t));
+    if (frame_reader == NULL)
+    {
+        error_list_t allocation_error;
+        init_error(&allocation_error);
+        add_error(&allocation_error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for frame reader", "client_receive_thread");
+        report_errors(&allocation_error, callback_error_func);
+    }
+    else
+    {
+        frame_reader_init(frame_reader);
+    }
+
+    // member message frames carry only the sender's ID, presence frames tell us whose it is
+    member_table_t members;
+    if (member_table_init(&members) != 0)
     {
-        error_t error_struct;
-        init_error(&error_struct);
+        error_list_t allocation_error;
+        init_error(&allocation_error);
+        add_error(&allocation_error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for the member table, senders will be shown by ID", "client_receive_thread");
+        report_errors(&allocation_error, callback_error_func);
+    }
 
-        char message_buffer[MAX_BUFFER_SIZE];
-        int bytes_received;
+    int removed_from_room = 0;
+
+    while (frame_reader != NULL && !removed_from_room && atomic_load(&client_running))
+    {
+        error_list_t *error_struct = thread_error_context();
 
-        bytes_received = socket_recv(*client_socket, message_buffer, sizeof(message_buffer), 0, "", CONTEXT_CLIENT, &error_struct);
+        int bytes_received = frame_reader_recv(frame_reader, *client_socket, "", CONTEXT_CLIENT, error_struct);
 
         if (bytes_received == SOCKET_ERR)
         {
             // for now, we don't have non-critical errors for socket_recv on the client side so in case of an error, we disconnect
-            report_errors(&error_struct, callback_error_func);
+            report_errors(error_struct, callback_error_func);
             if (user_type != USER_TYPE_ADMIN)
             {
                 break;
             }
+            continue;
         }
         else if (bytes_received == 0)
         {
@@ -139,32 +374,58 @@ thread_ret_t THREAD_CALL client_receive_thread(void *arg)
             // ??? maybe call it back up to java a different way ???
             if (user_type != USER_TYPE_ADMIN)
             {
-                add_error(&error_struct, SERVER_DISCONNECTED, CRITICAL_ERROR, "The server has disconnected", "client_receive_thread");
-                report_errors(&error_struct, callback_error_func);
+                add_error(error_struct, SERVER_DISCONNECTED, CRITICAL_ERROR, "The server has disconnected", "client_receive_thread");
+                report_errors(error_struct, callback_error_func);
             }
             break;
         }
-        else
-        {
-            message_buffer[bytes_received] = '\0';
 
+        char *message_buffer;
+        while ((message_buffer = frame_reader_next(frame_reader)) != NULL)
+        {
             int msg_type;
-            sscanf(message_buffer, "%d:", &msg_type);
+            if (sscanf(message_buffer, "%d:", &msg_type) != 1)
+            {
+                continue;
+            }
 
-            if (msg_type == MSG_TYPE_MESSAGE)
+            if (msg_type == MSG_TYPE_MESSAGE || msg_type == MSG_TYPE_MEMBER_MESSAGE)
             {
                 char received_username[USERNAME_BUFFER_SIZE];
-                char received_encoded_message[ENCODED_MESSAGE_BUFFER_SIZE];
-
-                sscanf(message_buffer, "%*d:%80[^:]:%3000[^:]", received_username, received_encoded_message);
-
-                received_username[USERNAME_BUFFER_SIZE - 1] = '\0';
-                received_encoded_message[ENCODED_MESSAGE_BUFFER_SIZE - 1] = '\0';
-
                 char decoded_message[MESSAGE_BUFFER_SIZE];
-                decode_message(received_encoded_message, decoded_message, sizeof(decoded_message));
 
-                callback_message_func(received_username, decoded_message);
+                if (parse_message_frame(message_buffer, &members, received_username, sizeof(received_username), decoded_message, sizeof(decoded_message)) == 0)
+                {
+                    callback_message_func(received_username, decoded_message);
+                }
+            }
+            else if (msg_type == MSG_TYPE_PRESENCE)
+            {
+                handle_presence_frame(message_buffer, &members, callback_presence_func);
+            }
+            else if (msg_type == MSG_TYPE_ATTACHMENT)
+            {
+                char received_username[USERNAME_BUFFER_SIZE];
+                char hash_hex[BLOB_HASH_HEX_BUFFER_SIZE];
+                char name[ATTACHMENT_NAME_BUFFER_SIZE];
+                uint64_t size;
+
+                if (parse_attachment_frame(message_buffer, &members, received_username, sizeof(received_username), hash_hex, &size, name, sizeof(name)) == 0)
+                {
+                    callback_attachment_func(received_username, hash_hex, size, name);
+                }
+            }
+            else if (msg_type == MSG_TYPE_SEARCH)
+            {
+                handle_search_frame(message_buffer, callback_search_func);
+            }
+            else if (msg_type == MSG_TYPE_TYPING)
+            {
+                handle_typing_frame(message_buffer, &members, callback_typing_func);
+            }
+            else if (msg_type == MSG_TYPE_DIRECT)
+            {
+                handle_direct_frame(message_buffer, callback_direct_func, callback_direct_ack_func);
             }
             else if (user_type != USER_TYPE_ADMIN)
             {
@@ -172,8 +433,9 @@ thread_ret_t THREAD_CALL client_receive_thread(void *arg)
                 {
                     error_type_t error_type;
                     char error_message[ERROR_NOTIFICATION_BUFFER_SIZE];
+                    error_message[0] = '\0';
 
-                    sscanf(message_buffer, "%*d:%d:%250[^:]", &error_type, error_message);
+                    sscanf(message_buffer, "%*d:%d:%250[^:]", (int *)&error_type, error_message);
 
                     error_message[ERROR_NOTIFICATION_BUFFER_SIZE - 1] = '\0';
 
@@ -183,18 +445,35 @@ thread_ret_t THREAD_CALL client_receive_thread(void *arg)
                 {
                     notification_type_t notification_type;
                     char notification_message[ERROR_NOTIFICATION_BUFFER_SIZE];
+                    notification_message[0] = '\0';
 
-                    sscanf(message_buffer, "%*d:%d:%250[^:]", &notification_type, notification_message);
+                    sscanf(message_buffer, "%*d:%d:%250[^:]", (int *)&notification_type, notification_message);
 
                     notification_message[ERROR_NOTIFICATION_BUFFER_SIZE - 1] = '\0';
 
                     callback_notification_func(notification_type, notification_message);
+
+                    // the server closes the connection right after a kick, a ban or closing the room, that is not a server failure
+                    if (notification_type == NOTIFICATION_KICK || notification_type == NOTIFICATION_BAN || notification_type == NOTIFICATION_DISCONNECT)
+                    {
+                        removed_from_room = 1;
+                        break;
+                    }
                 }
             }
         }
     }
 
-    error_t disconnection_error;
+    free(frame_reader);
+    member_table_destroy(&members);
+
+    // shutting the socket down first unblocks a send stuck on a full buffer, the server may already be gone
+    error_list_t shutdown_error;
+    init_error(&shutdown_error);
+    socket_shutdown(*client_socket, &shutdown_error);
+    stop_send_queue();
+
+    error_list_t disconnection_error;
     init_error(&disconnection_error);
     socket_close(*client_socket, &disconnection_error);
     socket_cleanup(&disconnection_error);
@@ -206,6 +485,7 @@ thread_ret_t THREAD_CALL client_receive_thread(void *arg)
         report_errors(&disconnection_error, callback_error_func);
     }
 
+    logger_thread_detach();
     free(thread_args);
 
 #ifdef _WIN32
@@ -215,7 +495,172 @@ thread_ret_t THREAD_CALL client_receive_thread(void *arg)
 #endif
 }
 
-int create_and_connect_client_socket(const char *server_address, const char *port, socket_t *socket, error_t *main_error)
+thread_ret_t THREAD_CALL client_send_thread(void *arg)
+{
+    socket_t *client_socket = (socket_t *)arg;
+    char *batch = (char *)malloc(CLIENT_SEND_BATCH_SIZE);
+    int failed = 0;
+    void (*callback_error_func)(const char *, int) = NULL;
+
+    error_list_t send_error;
+    init_error(&send_error);
+
+    if (batch == NULL)
+    {
+        add_error(&send_error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for the send batch, nothing will be sent", "client_send_thread");
+        failed = 1;
+    }
+
+    mutex_lock(&send_queue_mutex);
+
+    for (;;)
+    {
+        while (send_queue_head == NULL && send_queue_open)
+        {
+            cond_wait(&send_queue_cond, &send_queue_mutex);
+        }
+
+        if (send_queue_head == NULL)
+        {
+            break;
+        }
+
+        client_send_request_t *requests = send_queue_head;
+        send_queue_head = NULL;
+        send_queue_tail = NULL;
+        send_queue_length = 0;
+        callback_error_func = send_error_func;
+
+        mutex_unlock(&send_queue_mutex);
+
+        // frames are copied one after another until the next one does not fit, then the batch goes out in one send
+        client_send_request_t *batch_first = requests;
+        size_t batch_length = 0;
+
+        for (client_send_request_t *request = requests; request != NULL; request = request->next)
+        {
+            if (!failed && batch_length + request->length > CLIENT_SEND_BATCH_SIZE)
+            {
+                failed = send_batch(*client_socket, batch, batch_length, &send_error);
+                complete_send_requests(batch_first, request, failed ? SEND_STATUS_FAILED : SEND_STATUS_COMPLETED);
+                batch_first = request;
+                batch_length = 0;
+            }
+
+            if (!failed)
+            {
+                memcpy(batch + batch_length, request->frame, request->length);
+                batch_length += request->length;
+            }
+        }
+
+        if (!failed && batch_length > 0)
+        {
+            failed = send_batch(*client_socket, batch, batch_length, &send_error);
+        }
+        complete_send_requests(batch_first, NULL, failed ? SEND_STATUS_FAILED : SEND_STATUS_COMPLETED);
+
+        // the receive thread notices the lost connection and tears it down, until then every frame fails
+        if (send_error.count > 0)
+        {
+            report_errors(&send_error, callback_error_func);
+            init_error(&send_error);
+        }
+
+        mutex_lock(&send_queue_mutex);
+    }
+
+    callback_error_func = send_error_func;
+    mutex_unlock(&send_queue_mutex);
+
+    if (send_error.count > 0)
+    {
+        report_errors(&send_error, callback_error_func);
+    }
+
+    free(batch);
+    logger_thread_detach();
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+int join_chat_room_async(const char *ip_address, const char *port, const char *secret_key, const char *username, user_type_t user_type, error_list_t *error, void (*callback_error_func)(const char *, int), void (*callback_message_func)(const char *, const char *), void (*callback_server_error_func)(error_type_t, const char *), void (*callback_notification_func)(notification_type_t, const char *), void (*callback_presence_func)(presence_op_t, const char *, const char *), void (*callback_attachment_func)(const char *, const char *, uint64_t, const char *), void (*callback_search_func)(const char *, const char *, uint64_t), void (*callback_typing_func)(const char **, size_t), void (*callback_direct_func)(const char *, const char **, size_t, const char *), void (*callback_direct_ack_func)(uint32_t, char, const char *), void (*callback_join_func)(int))
+{
+    client_join_thread_args_t *thread_args = (client_join_thread_args_t *)malloc(sizeof(client_join_thread_args_t));
+    if (thread_args == NULL)
+    {
+        add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for client join thread args", "join_chat_room_async");
+        return 1;
+    }
+
+    snprintf(thread_args->ip_address, sizeof(thread_args->ip_address), "%s", ip_address);
+    snprintf(thread_args->port, sizeof(thread_args->port), "%s", port);
+    snprintf(thread_args->secret_key, sizeof(thread_args->secret_key), "%s", secret_key);
+    snprintf(thread_args->username, sizeof(thread_args->username), "%s", username);
+    thread_args->receive_args.client_socket = NULL;
+    thread_args->receive_args.callback_error_func = callback_error_func;
+    thread_args->receive_args.callback_message_func = callback_message_func;
+    thread_args->receive_args.callback_server_error_func = callback_server_error_func;
+    thread_args->receive_args.callback_notification_func = callback_notification_func;
+    thread_args->receive_args.callback_presence_func = callback_presence_func;
+    thread_args->receive_args.callback_attachment_func = callback_attachment_func;
+    thread_args->receive_args.callback_search_func = callback_search_func;
+    thread_args->receive_args.callback_typing_func = callback_typing_func;
+    thread_args->receive_args.callback_direct_func = callback_direct_func;
+    thread_args->receive_args.callback_direct_ack_func = callback_direct_ack_func;
+    thread_args->receive_args.user_type = user_type;
+    thread_args->callback_join_func = callback_join_func;
+
+    // cleared before the thread exists so a cancel made right after this returns still counts
+    atomic_store(&connect_cancelled, 0);
+
+    thread_t join_thread;
+    if (thread_create(&join_thread, client_join_thread, thread_args) != 0)
+    {
+        add_error(error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create client join thread", "join_chat_room_async");
+        free(thread_args);
+        return 1;
+    }
+
+    thread_detach(join_thread);
+
+    return 0;
+}
+
+thread_ret_t THREAD_CALL client_join_thread(void *arg)
+{
+    client_join_thread_args_t *thread_args = (client_join_thread_args_t *)arg;
+    client_receive_thread_args_t *receive_args = &thread_args->receive_args;
+
+    error_list_t join_error;
+    init_error(&join_error);
+
+    int result_code = connect_chat_room(thread_args->ip_address, thread_args->port, thread_args->secret_key, thread_args->username, receive_args->user_type, &join_error, receive_args->callback_error_func, receive_args->callback_message_func, receive_args->callback_server_error_func, receive_args->callback_notification_func, receive_args->callback_presence_func, receive_args->callback_attachment_func, receive_args->callback_search_func, receive_args->callback_typing_func, receive_args->callback_direct_func, receive_args->callback_direct_ack_func);
+    if (result_code != 0)
+    {
+        report_errors(&join_error, receive_args->callback_error_func);
+    }
+
+    if (thread_args->callback_join_func != NULL)
+    {
+        thread_args->callback_join_func(result_code);
+    }
+
+    free(thread_args);
+    logger_thread_detach();
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+static int connect_client_socket(const char *server_address, const char *port, socket_profile_t profile, atomic_int *cancel, socket_t *socket, error_list_t *main_error)
 {
     struct addrinfo hints, *address;
     int result_code;
@@ -228,12 +673,17 @@ int create_and_connect_client_socket(const char *server_address, const char *por
     result_code = getaddrinfo(server_address, port, &hints, &address);
     if (result_code != 0)
     {
-        add_error(main_error, GETADDRINFOERROR, CRITICAL_ERROR, "getaddrinfo failed", "create_and_connect_client_socket");
+        add_error(main_error, GETADDRINFOERROR, CRITICAL_ERROR, "getaddrinfo failed", "connect_client_socket");
         socket_cleanup(main_error);
         return 1;
     }
 
-    *socket = socket_create(address->ai_family, address->ai_socktype, address->ai_protocol, main_error);
+    connect_options_t connect_options;
+    connect_options_init(&connect_options);
+    connect_options.cancel = cancel;
+    connect_options.profile = profile;
+
+    *socket = socket_connect_with_backoff(address, &connect_options, main_error);
     if (*socket == INVALID_SOCK)
     {
         freeaddrinfo(address);
@@ -241,111 +691,411 @@ int create_and_connect_client_socket(const char *server_address, const char *por
         return 1;
     }
 
-    result_code = socket_connect(*socket, address->ai_addr, address->ai_addrlen, main_error);
-    if (result_code != 0)
+    freeaddrinfo(address);
+
+    socket_tuning_t tuning;
+    char tuning_report[SOCKET_TUNING_REPORT_SIZE];
+    socket_read_tuning(*socket, &tuning);
+    socket_format_tuning(&tuning, tuning_report, sizeof(tuning_report));
+    log_event(LOG_LEVEL_INFO, "connect_client_socket", "Connected with the %s socket profile: %s", socket_profile_name(profile), tuning_report);
+
+    return 0;
+}
+
+int create_and_connect_client_socket(const char *server_address, const char *port, socket_profile_t profile, socket_t *socket, error_list_t *main_error)
+{
+    return connect_client_socket(server_address, port, profile, &connect_cancelled, socket, main_error);
+}
+
+void cancel_client_connect(void)
+{
+    atomic_store(&connect_cancelled, 1);
+}
+
+void set_client_socket_profile(socket_profile_t profile)
+{
+    client_socket_profile = profile;
+}
+
+void send_auth_message(user_type_t user_type, const char *secret_key, const char *username, error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    char buffer[AUTH_MESSAGE_BUFFER_SIZE];
+
+    if (user_type == USER_TYPE_ADMIN)
     {
-        freeaddrinfo(address);
-        socket_close(*socket, main_error);
-        socket_cleanup(main_error);
-        return 1;
+        snprintf(buffer, sizeof(buffer), "%d:%d:ADMIN:%s", MSG_TYPE_AUTH, user_type, username);
     }
+    else
+    {
+        char encoded_secret_key[ENCODED_SECRET_KEY_BUFFER_SIZE];
+        encode_message(secret_key, encoded_secret_key, sizeof(encoded_secret_key));
 
-    freeaddrinfo(address);
+        snprintf(buffer, sizeof(buffer), "%d:%d:%s:%s", MSG_TYPE_AUTH, user_type, encoded_secret_key, username);
+    }
 
-    return 0;
+    if (queue_frame(buffer, strlen(buffer) + 1, NULL, CRITICAL_ERROR, error) == 0)
+    {
+        report_errors(error, callback_error_func);
+    }
 }
 
-int get_public_ip(char *ip_buffer, size_t buffer_size, error_t *main_error)
+void send_regular_message(const char *message, error_list_t *error, void (*callback_error_func)(const char *, int))
 {
-    const char *services[] = {PUBLIC_IP_SERVICE_ONE, PUBLIC_IP_SERVICE_TWO, PUBLIC_IP_SERVICE_THREE};
-    const char *requests[] = {HTTP_GET_REQUEST_ONE, HTTP_GET_REQUEST_TWO, HTTP_GET_REQUEST_THREE};
+    queue_regular_message(message, NULL, error, callback_error_func);
+}
 
-    socket_t ip_socket = INVALID_SOCK;
+uint64_t queue_regular_message(const char *message, void (*callback_send_func)(uint64_t, send_status_t), error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    char encoded_message[ENCODED_MESSAGE_BUFFER_SIZE];
+    encode_message(message, encoded_message, sizeof(encoded_message));
+
+    char frame[MAX_BUFFER_SIZE];
+    size_t frame_length = format_message_frame(frame, sizeof(frame), encoded_message, "", CONTEXT_CLIENT);
 
-    for (int i = 0; i < 3; i++)
+    uint64_t request_id = queue_frame(frame, frame_length, callback_send_func, NON_CRITICAL_ERROR, error);
+    if (request_id == 0)
     {
-        const char *http_request = requests[i];
+        report_errors(error, callback_error_func);
+    }
+
+    return request_id;
+}
 
-        if (create_and_connect_client_socket(services[i], HTTP_PORT, &ip_socket, main_error) != 0)
+int cancel_queued_send(uint64_t request_id)
+{
+    if (!atomic_load(&send_queue_ready))
+    {
+        return 1;
+    }
+
+    mutex_lock(&send_queue_mutex);
+
+    client_send_request_t *previous = NULL;
+    client_send_request_t *request = send_queue_head;
+    while (request != NULL && request->request_id != request_id)
+    {
+        previous = request;
+        request = request->next;
+    }
+
+    if (request != NULL)
+    {
+        if (previous == NULL)
         {
-            continue;
+            send_queue_head = request->next;
         }
-
-        if (socket_send(ip_socket, http_request, strlen(http_request), 0, "", CONTEXT_CLIENT, 1, main_error) == SOCKET_ERR)
+        else
         {
-            socket_close(ip_socket, main_error);
-            continue;
+            previous->next = request->next;
         }
+        if (send_queue_tail == request)
+        {
+            send_queue_tail = previous;
+        }
+        send_queue_length--;
+    }
+
+    mutex_unlock(&send_queue_mutex);
+
+    if (request == NULL)
+    {
+        return 1;
+    }
+
+    request->next = NULL;
+    complete_send_requests(request, NULL, SEND_STATUS_CANCELLED);
+
+    return 0;
+}
+
+void send_typing_state(int typing, error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    if (client_socket == NULL)
+    {
+        return;
+    }
+
+    char frame[MAX_BUFFER_SIZE];
+    size_t frame_length = format_typing_request_frame(frame, sizeof(frame), typing ? TYPING_OP_ACTIVE : TYPING_OP_STOPPED);
+
+    if (queue_frame(frame, frame_length, NULL, NON_CRITICAL_ERROR, error) == 0)
+    {
+        report_errors(error, callback_error_func);
+    }
+}
+
+uint32_t send_direct_message(const char **recipients, size_t recipient_count, const char *message, error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    if (client_socket == NULL)
+    {
+        add_error(error, SERVER_DISCONNECTED, NON_CRITICAL_ERROR, "Join a room before sending a direct message", "send_direct_message");
+        report_errors(error, callback_error_func);
+        return 0;
+    }
+
+    // the server would reject either one, checking here saves the round trip
+    if (utf8_check_text(message, MESSAGE_MAX_CHARACTERS) != UTF8_VALID)
+    {
+        add_error(error, ERR_INVALID_TEXT, NON_CRITICAL_ERROR, "Messages must be valid UTF-8 of at most 250 characters", "send_direct_message");
+        report_errors(error, callback_error_func);
+        return 0;
+    }
+
+    if (recipient_count == 0 || recipient_count > DIRECT_MAX_RECIPIENTS)
+    {
+        add_error(error, ERR_USER_NOT_FOUND, NON_CRITICAL_ERROR, "A direct message names between 1 and 8 members", "send_direct_message");
+        report_errors(error, callback_error_func);
+        return 0;
+    }
+
+    uint32_t sequence = atomic_fetch_add(&next_direct_sequence, 1);
+
+    char frame[DIRECT_MESSAGE_BUFFER_SIZE];
+    size_t frame_length = format_direct_request_frame(frame, sizeof(frame), sequence, recipients, recipient_count, message);
+    if (frame_length == 1)
+    {
+        add_error(error, ERR_USERNAME_TOO_LONG, NON_CRITICAL_ERROR, "A recipient's name is longer than any member's", "send_direct_message");
+        report_errors(error, callback_error_func);
+        return 0;
+    }
+
+    if (queue_frame(frame, frame_length, NULL, NON_CRITICAL_ERROR, error) == 0)
+    {
+        report_errors(error, callback_error_func);
+        return 0;
+    }
+
+    return sequence;
+}
+
+void send_search_request(const char *query, uint64_t since, uint64_t until, error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    if (client_socket == NULL)
+    {
+        add_error(error, SERVER_DISCONNECTED, NON_CRITICAL_ERROR, "Join a room before searching it", "send_search_request");
+        report_errors(error, callback_error_func);
+        return;
+    }
+
+    char frame[MAX_BUFFER_SIZE];
+    size_t frame_length = format_search_request_frame(frame, sizeof(frame), query, since, until);
+
+    if (queue_frame(frame, frame_length, NULL, NON_CRITICAL_ERROR, error) == 0)
+    {
+        report_errors(error, callback_error_func);
+    }
+}
+
+// connects a transfer connection and sends its request, the caller closes the socket
+static int open_transfer(socket_t *transfer_socket, const char *request_format, const char *arguments, error_list_t *error)
+{
+    if (client_socket == NULL)
+    {
+        add_error(error, SERVER_DISCONNECTED, NON_CRITICAL_ERROR, "Join a room before transferring attachments", "open_transfer");
+        return 1;
+    }
+
+    if (socket_init(error) != 0)
+    {
+        return 1;
+    }
+
+    // a transfer isn't part of joining, cancelling a join must not stop it
+    if (connect_client_socket(transfer_address, transfer_port, SOCKET_PROFILE_BULK, NULL, transfer_socket, error) != 0)
+    {
+        return 1;
+    }
+
+    char encoded_secret_key[ENCODED_SECRET_KEY_BUFFER_SIZE];
+    encode_message(transfer_secret_key, encoded_secret_key, sizeof(encoded_secret_key));
+
+    char request[AUTH_MESSAGE_BUFFER_SIZE + BLOB_HASH_HEX_BUFFER_SIZE + 42];
+    int request_length = snprintf(request, sizeof(request), request_format, MSG_TYPE_TRANSFER, encoded_secret_key, arguments);
+
+    if (socket_send(*transfer_socket, request, (size_t)request_length + 1, 0, "", CONTEXT_CLIENT, NON_CRITICAL_ERROR, error) == SOCKET_ERR)
+    {
+        socket_close(*transfer_socket, error);
+        socket_cleanup(error);
+        return 1;
+    }
 
-        char response[MESSAGE_BUFFER_SIZE];
+    return 0;
+}
 
-        int bytes_received = socket_recv(ip_socket, response, sizeof(response), 0, "", CONTEXT_CLIENT, main_error);
+static void close_transfer(socket_t transfer_socket, error_list_t *error)
+{
+    socket_close(transfer_socket, error);
+    socket_cleanup(error);
+}
 
+// waits for the server's next reply frame, an error frame from the server fails the transfer
+static char *read_transfer_reply(socket_t transfer_socket, frame_reader_t *reader, error_list_t *error)
+{
+    char *frame;
+    while ((frame = frame_reader_next(reader)) == NULL)
+    {
+        int bytes_received = frame_reader_recv(reader, transfer_socket, "", CONTEXT_CLIENT, error);
+        if (bytes_received == 0)
+        {
+            add_error(error, SERVER_DISCONNECTED, NON_CRITICAL_ERROR, "The server closed the transfer connection", "read_transfer_reply");
+            return NULL;
+        }
         if (bytes_received == SOCKET_ERR)
         {
-            socket_close(ip_socket, main_error);
-            continue;
+            return NULL;
         }
+    }
 
-        response[bytes_received] = '\0';
-        socket_close(ip_socket, main_error);
+    if (atoi(frame) != MSG_TYPE_TRANSFER)
+    {
+        char reason[ERROR_NOTIFICATION_BUFFER_SIZE];
+        reason[0] = '\0';
+        sscanf(frame, "%*d:%*d:%250[^:]", reason);
+        add_error_with_subject(error, ERR_TRANSFER_REJECTED, NON_CRITICAL_ERROR, "The server refused the transfer: %s", reason, "read_transfer_reply");
+        return NULL;
+    }
+
+    return frame;
+}
+
+int upload_attachment(const char *path, const char *name, error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    int fd = blob_file_open(path, 0, 0);
+    if (fd < 0)
+    {
+        add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to open the file to attach", "upload_attachment");
+        report_errors(error, callback_error_func);
+        return 1;
+    }
+
+    uint64_t size;
+    if (blob_file_size(fd, &size) != 0 || size > BLOB_MAX_SIZE)
+    {
+        blob_file_close(fd);
+        add_error(error, ERR_BLOB_TOO_LARGE, NON_CRITICAL_ERROR, "Attachment exceeds the maximum size", "upload_attachment");
+        report_errors(error, callback_error_func);
+        return 1;
+    }
 
-        char *ip_start = strstr(response, "\r\n\r\n");
-        // if there is no response body
-        if (ip_start == NULL)
+    frame_reader_t *reader = (frame_reader_t *)malloc(sizeof(frame_reader_t));
+    if (reader == NULL)
+    {
+        blob_file_close(fd);
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for frame reader", "upload_attachment");
+        report_errors(error, callback_error_func);
+        return 1;
+    }
+    frame_reader_init(reader);
+
+    char size_argument[21];
+    snprintf(size_argument, sizeof(size_argument), "%llu", (unsigned long long)size);
+
+    socket_t transfer_socket;
+    int result = 1;
+    char hash_hex[BLOB_HASH_HEX_BUFFER_SIZE];
+    hash_hex[0] = '\0';
+
+    if (open_transfer(&transfer_socket, "%d:%s:U:%s", size_argument, error) == 0)
+    {
+        // the body only goes out once the server has accepted the request
+        char *reply = read_transfer_reply(transfer_socket, reader, error);
+        if (reply != NULL && reply[2] == 'R' && blob_send_range(transfer_socket, fd, 0, size, error) == 0)
         {
-            add_error(main_error, ERR_NO_RESPONSE_BODY, CRITICAL_ERROR, "No response body in HTTP response", "get_public_ip");
-            continue;
+            reply = read_transfer_reply(transfer_socket, reader, error);
+            if (reply != NULL && sscanf(reply, "%*d:%64[0-9a-f]", hash_hex) == 1)
+            {
+                result = 0;
+            }
         }
+        close_transfer(transfer_socket, error);
+    }
 
-        // move into the response body
-        ip_start += 4;
+    blob_file_close(fd);
+    free(reader);
 
-        size_t ip_length = strlen(ip_start);
-        if (ip_length >= buffer_size)
+    if (result == 0)
+    {
+        // the room only sees the reference, members fetch the bytes when they want them
+        char frame[MAX_BUFFER_SIZE];
+        size_t frame_length = format_attachment_frame(frame, sizeof(frame), hash_hex, size, name, 0);
+        if (queue_frame(frame, frame_length, NULL, NON_CRITICAL_ERROR, error) == 0)
         {
-            add_error(main_error, ERR_IP_TOO_LONG, CRITICAL_ERROR, "Received IP is too long", "get_public_ip");
-            continue;
+            result = 1;
         }
+    }
 
-        strncpy(ip_buffer, ip_start, buffer_size - 1);
-        ip_buffer[buffer_size - 1] = '\0';
-
-        return 0;
+    if (error->count > 0)
+    {
+        report_errors(error, callback_error_func);
     }
 
-    return 1;
+    return result;
 }
 
-void send_auth_message(socket_t client_socket, user_type_t user_type, const char *secret_key, const char *username, error_t *error, void (*callback_error_func)(const char *, int))
+int download_attachment(const char *hash_hex, uint64_t offset, uint64_t length, const char *path, error_list_t *error, void (*callback_error_func)(const char *, int))
 {
-    char buffer[AUTH_MESSAGE_BUFFER_SIZE];
-    int result_code;
+    if (!blob_hash_is_valid(hash_hex))
+    {
+        add_error(error, ERR_BLOB_NOT_FOUND, NON_CRITICAL_ERROR, "Malformed attachment reference", "download_attachment");
+        report_errors(error, callback_error_func);
+        return 1;
+    }
 
-    if (user_type == USER_TYPE_ADMIN)
+    frame_reader_t *reader = (frame_reader_t *)malloc(sizeof(frame_reader_t));
+    if (reader == NULL)
     {
-        snprintf(buffer, sizeof(buffer), "%d:%d:ADMIN:%s", MSG_TYPE_AUTH, user_type, username);
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for frame reader", "download_attachment");
+        report_errors(error, callback_error_func);
+        return 1;
     }
-    else
+    frame_reader_init(reader);
+
+    char range_argument[BLOB_HASH_HEX_BUFFER_SIZE + 42];
+    snprintf(range_argument, sizeof(range_argument), "%s:%llu:%llu", hash_hex, (unsigned long long)offset, (unsigned long long)length);
+
+    socket_t transfer_socket;
+    int result = 1;
+
+    if (open_transfer(&transfer_socket, "%d:%s:D:%s", range_argument, error) == 0)
     {
-        char encoded_secret_key[ENCODED_SECRET_KEY_BUFFER_SIZE];
-        encode_message(secret_key, encoded_secret_key, sizeof(encoded_secret_key));
+        char *reply = read_transfer_reply(transfer_socket, reader, error);
+        unsigned long long reply_offset;
+        unsigned long long reply_length;
 
-        snprintf(buffer, sizeof(buffer), "%d:%d:%s:%s", MSG_TYPE_AUTH, user_type, encoded_secret_key, username);
+        if (reply != NULL && sscanf(reply, "%*d:%*64[0-9a-f]:%llu:%llu", &reply_offset, &reply_length) == 2)
+        {
+            // a range that starts past 0 resumes an earlier download into the same file
+            int fd = blob_file_open(path, 1, reply_offset);
+            if (fd < 0)
+            {
+                add_error(error, ERR_BLOB_STORE, NON_CRITICAL_ERROR, "Failed to open the download destination", "download_attachment");
+            }
+            else
+            {
+                // the first bytes of the body may have arrived together with the reply
+                size_t buffered = reader->length - reader->offset;
+                if (buffered > reply_length)
+                {
+                    buffered = (size_t)reply_length;
+                }
+
+                if (blob_file_write(fd, reader->buffer + reader->offset, buffered, error) == 0 &&
+                    blob_recv_range(transfer_socket, fd, reply_length - buffered, error) == 0)
+                {
+                    result = 0;
+                }
+                blob_file_close(fd);
+            }
+        }
+        close_transfer(transfer_socket, error);
     }
 
-    result_code = socket_send(client_socket, buffer, strlen(buffer), 0, "", CONTEXT_CLIENT, CRITICAL_ERROR, error);
+    free(reader);
 
-    if (result_code == SOCKET_ERR)
+    if (error->count > 0)
     {
         report_errors(error, callback_error_func);
     }
-}
-
-void send_regular_message(const char *message, error_t *error, void (*callback_error_func)(const char *, int))
-{
-    char encoded_message[ENCODED_MESSAGE_BUFFER_SIZE];
-    encode_message(message, encoded_message, sizeof(encoded_message));
 
-    send_message(*client_socket, encoded_message, "", "", CONTEXT_CLIENT, error, callback_error_func);
-}
+    return result;
+}
\ No newline at end of file
@@ -1,25 +1,68 @@
 #include "../include/common.h"
 
-void send_message(socket_t client_socket, const char *message, const char *sender_username, const char *receiver_username, context_t context, error_t *error, void (*callback_error_func)(const char *, int))
+void send_message(socket_t client_socket, const char *message, const char *sender_username, const char *receiver_username, context_t context, error_list_t *error, void (*callback_error_func)(const char *, int))
 {
     char buffer[MAX_BUFFER_SIZE];
     int result_code;
 
+    size_t frame_length = format_message_frame(buffer, sizeof(buffer), message, sender_username, context);
+
+    result_code = socket_send(client_socket, buffer, frame_length, 0, receiver_username, context, NON_CRITICAL_ERROR, error);
+
+    if (result_code == SOCKET_ERR)
+    {
+        report_errors(error, callback_error_func);
+    }
+}
+
+size_t format_message_frame(char *buffer, size_t buffer_size, const char *message, const char *sender_username, context_t context)
+{
+    int length;
+
     if (context == CONTEXT_SERVER)
     {
-        snprintf(buffer, sizeof(buffer), "%d:%s:%s", MSG_TYPE_MESSAGE, sender_username, message);
+        length = snprintf(buffer, buffer_size, "%d:%s:%s", MSG_TYPE_MESSAGE, sender_username, message);
     }
     else
     {
-        snprintf(buffer, sizeof(buffer), "%d:%s", MSG_TYPE_MESSAGE, message);
+        length = snprintf(buffer, buffer_size, "%d:%s", MSG_TYPE_MESSAGE, message);
     }
 
-    result_code = socket_send(client_socket, buffer, strlen(buffer), 0, receiver_username, context, NON_CRITICAL_ERROR, error);
+    if (length < 0)
+    {
+        buffer[0] = FRAME_DELIMITER;
+        return 1;
+    }
 
-    if (result_code == SOCKET_ERR)
+    if ((size_t)length >= buffer_size)
     {
-        report_errors(error, callback_error_func);
+        length = (int)buffer_size - 1;
     }
+
+    // the null terminator written by snprintf doubles as the frame delimiter
+    return (size_t)length + 1;
+}
+
+size_t append_presence_entry(char *frame, size_t frame_length, size_t frame_size, char op, const char *username)
+{
+    char encoded_username[(USERNAME_BUFFER_SIZE - 1) * 3 + 1];
+    encode_message(username, encoded_username, sizeof(encoded_username));
+
+    size_t encoded_length = strlen(encoded_username);
+
+    // ':' + op + name, and the null terminator still has to fit after it
+    if (frame_length + 2 + encoded_length + 1 > frame_size)
+    {
+        return 0;
+    }
+
+    frame[frame_length++] = ':';
+    frame[frame_length++] = op;
+    memcpy(frame + frame_length, encoded_username, encoded_length);
+    frame_length += encoded_length;
+    frame[frame_length] = '\0';
+
+    return frame_length;
 }
 
 void encode_message(const char *input, char *output, size_t output_size)
@@ -64,4 +107,844 @@ void decode_message(const char *input, char *output, size_t output_size)
         }
     }
     output[j] = '\0';
+}
+
+size_t append_member_id_entry(char *frame, size_t frame_length, size_t frame_size, uint32_t member_id)
+{
+    char decimal_id[MEMBER_ID_DECIMAL_BUFFER_SIZE];
+    snprintf(decimal_id, sizeof(decimal_id), "%lu", (unsigned long)member_id);
+
+    return append_presence_entry(frame, frame_length, frame_size, PRESENCE_OP_MEMBER_ID, decimal_id);
+}
+
+void handle_presence_frame(char *frame, member_table_t *members, void (*callback_presence_func)(presence_op_t, const char *, const char *))
+{
+    char username[USERNAME_BUFFER_SIZE];
+    char renamed_from[USERNAME_BUFFER_SIZE];
+    renamed_from[0] = '\0';
+    uint32_t pending_member_id = 0;
+
+    // skip the message type, every entry starts right after a ':'
+    char *entry = strchr(frame, ':');
+
+    while (entry != NULL)
+    {
+        entry++;
+
+        char *next_entry = strchr(entry, ':');
+        if (next_entry != NULL)
+        {
+            *next_entry = '\0';
+        }
+
+        char op = entry[0];
+        if (op != '\0')
+        {
+            decode_message(entry + 1, username, sizeof(username));
+        }
+
+        switch (op)
+        {
+        case PRESENCE_OP_SNAPSHOT:
+            if (members != NULL)
+            {
+                member_table_clear(members);
+            }
+            callback_presence_func(PRESENCE_SNAPSHOT, "", "");
+            break;
+        case PRESENCE_OP_MEMBER_ID:
+            pending_member_id = (uint32_t)strtoul(entry + 1, NULL, 10);
+            // the ID belongs to the next entry only
+            entry = next_entry;
+            continue;
+        case PRESENCE_OP_ALIAS:
+            if (members != NULL && pending_member_id != 0)
+            {
+                member_table_set(members, pending_member_id, username);
+            }
+            break;
+        case PRESENCE_OP_JOIN:
+            if (members != NULL && pending_member_id != 0)
+            {
+                member_table_set(members, pending_member_id, username);
+            }
+            callback_presence_func(PRESENCE_JOIN, username, "");
+            break;
+        case PRESENCE_OP_LEAVE:
+            if (members != NULL && pending_member_id != 0)
+            {
+                member_table_depart(members, pending_member_id);
+            }
+            callback_presence_func(PRESENCE_LEAVE, username, "");
+            break;
+        case PRESENCE_OP_RENAME_FROM:
+            strcpy(renamed_from, username);
+            break;
+        case PRESENCE_OP_RENAME_TO:
+            if (members != NULL && pending_member_id != 0)
+            {
+                member_table_set(members, pending_member_id, username);
+            }
+            if (renamed_from[0] != '\0')
+            {
+                callback_presence_func(PRESENCE_RENAME, renamed_from, username);
+                renamed_from[0] = '\0';
+            }
+            break;
+        default:
+            break;
+        }
+
+        pending_member_id = 0;
+        entry = next_entry;
+    }
+}
+
+size_t encode_member_id(uint32_t member_id, char *output)
+{
+    size_t length = 0;
+    do
+    {
+        unsigned char byte = member_id & 0x7F;
+        member_id >>= 7;
+        if (member_id != 0)
+        {
+            byte |= 0x80;
+        }
+        output[length++] = (char)byte;
+    } while (member_id != 0);
+
+    return length;
+}
+
+size_t decode_member_id(const char *input, uint32_t *member_id)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < MEMBER_ID_VARINT_MAX_SIZE; i++)
+    {
+        unsigned char byte = (unsigned char)input[i];
+        value |= (uint32_t)(byte & 0x7F) << (7 * i);
+        if (!(byte & 0x80))
+        {
+            *member_id = value;
+            // a 0 byte is the frame delimiter, it can't end a varint of a valid ID
+            return value == 0 ? 0 : i + 1;
+        }
+    }
+
+    return 0;
+}
+
+size_t format_member_message_frame(char *buffer, size_t buffer_size, const char *message, uint32_t member_id)
+{
+    int prefix_length = snprintf(buffer, buffer_size, "%d:", MSG_TYPE_MEMBER_MESSAGE);
+    size_t length = (size_t)prefix_length;
+
+    if (prefix_length < 0 || length + MEMBER_ID_VARINT_MAX_SIZE + 1 > buffer_size)
+    {
+        buffer[0] = FRAME_DELIMITER;
+        return 1;
+    }
+
+    length += encode_member_id(member_id, buffer + length);
+
+    size_t message_length = strlen(message);
+    if (length + message_length >= buffer_size)
+    {
+        message_length = buffer_size - length - 1;
+    }
+    memcpy(buffer + length, message, message_length);
+    length += message_length;
+
+    // the delimiter is sent along, like the null terminator of the other frames
+    buffer[length] = FRAME_DELIMITER;
+    return length + 1;
+}
+
+int parse_message_frame(const char *frame, const member_table_t *members, char *username, size_t username_size, char *message, size_t message_size)
+{
+    int msg_type;
+    if (sscanf(frame, "%d:", &msg_type) != 1)
+    {
+        return 1;
+    }
+
+    char encoded_message[ENCODED_MESSAGE_BUFFER_SIZE];
+    encoded_message[0] = '\0';
+
+    if (msg_type == MSG_TYPE_MESSAGE)
+    {
+        char received_username[USERNAME_BUFFER_SIZE];
+        received_username[0] = '\0';
+
+        sscanf(frame, "%*d:%80[^:]:%3000[^:]", received_username, encoded_message);
+
+        snprintf(username, username_size, "%s", received_username);
+    }
+    else if (msg_type == MSG_TYPE_MEMBER_MESSAGE)
+    {
+        const char *varint = strchr(frame, ':') + 1;
+        uint32_t member_id;
+        size_t varint_length = decode_member_id(varint, &member_id);
+        if (varint_length == 0)
+        {
+            return 1;
+        }
+
+        const char *member_username = members != NULL ? member_table_find(members, member_id) : NULL;
+        if (member_username != NULL)
+        {
+            snprintf(username, username_size, "%s", member_username);
+        }
+        else
+        {
+            // only possible if a presence frame was lost, the message is still worth showing
+            snprintf(username, username_size, "#%lu", (unsigned long)member_id);
+        }
+
+        snprintf(encoded_message, sizeof(encoded_message), "%s", varint + varint_length);
+    }
+    else
+    {
+        return 1;
+    }
+
+    decode_message(encoded_message, message, message_size);
+
+    return 0;
+}
+
+size_t format_attachment_frame(char *buffer, size_t buffer_size, const char *hash_hex, uint64_t size, const char *name, uint32_t member_id)
+{
+    char encoded_name[ENCODED_ATTACHMENT_NAME_BUFFER_SIZE];
+    encode_message(name, encoded_name, sizeof(encoded_name));
+
+    size_t length = (size_t)snprintf(buffer, buffer_size, "%d:", MSG_TYPE_ATTACHMENT);
+
+    // a client names no sender, the server puts the sender's ID in front of the reference
+    if (member_id != 0)
+    {
+        length += encode_member_id(member_id, buffer + length);
+    }
+
+    int reference_length = snprintf(buffer + length, buffer_size - length, "%s:%llu:%s", hash_hex, (unsigned long long)size, encoded_name);
+    if (reference_length < 0 || length + (size_t)reference_length >= buffer_size)
+    {
+        buffer[0] = FRAME_DELIMITER;
+        return 1;
+    }
+
+    return length + (size_t)reference_length + 1;
+}
+
+int blob_hash_is_valid(const char *hash_hex)
+{
+    for (size_t i = 0; i < BLOB_HASH_HEX_LENGTH; i++)
+    {
+        char c = hash_hex[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+        {
+            return 0;
+        }
+    }
+
+    return hash_hex[BLOB_HASH_HEX_LENGTH] == '\0' || hash_hex[BLOB_HASH_HEX_LENGTH] == ':';
+}
+
+int parse_attachment_reference(const char *reference, char *hash_hex, uint64_t *size, char *name, size_t name_size)
+{
+    if (!blob_hash_is_valid(reference) || reference[BLOB_HASH_HEX_LENGTH] != ':')
+    {
+        return 1;
+    }
+
+    memcpy(hash_hex, reference, BLOB_HASH_HEX_LENGTH);
+    hash_hex[BLOB_HASH_HEX_LENGTH] = '\0';
+
+    char *size_end;
+    *size = strtoull(reference + BLOB_HASH_HEX_LENGTH + 1, &size_end, 10);
+    if (size_end == reference + BLOB_HASH_HEX_LENGTH + 1 || *size_end != ':')
+    {
+        return 1;
+    }
+
+    decode_message(size_end + 1, name, name_size);
+
+    return 0;
+}
+
+int parse_attachment_frame(const char *frame, const member_table_t *members, char *username, size_t username_size, char *hash_hex, uint64_t *size, char *name, size_t name_size)
+{
+    const char *varint = strchr(frame, ':');
+    if (varint == NULL)
+    {
+        return 1;
+    }
+    varint++;
+
+    uint32_t member_id;
+    size_t varint_length = decode_member_id(varint, &member_id);
+    if (varint_length == 0)
+    {
+        return 1;
+    }
+
+    const char *member_username = members != NULL ? member_table_find(members, member_id) : NULL;
+    if (member_username != NULL)
+    {
+        snprintf(username, username_size, "%s", member_username);
+    }
+    else
+    {
+        snprintf(username, username_size, "#%lu", (unsigned long)member_id);
+    }
+
+    return parse_attachment_reference(varint + varint_length, hash_hex, size, name, name_size);
+}
+
+size_t format_search_request_frame(char *buffer, size_t buffer_size, const char *query, uint64_t since, uint64_t until)
+{
+    char encoded_query[ENCODED_SEARCH_QUERY_BUFFER_SIZE];
+    encode_message(query, encoded_query, sizeof(encoded_query));
+
+    int length = snprintf(buffer, buffer_size, "%d:%llu:%llu:%s", MSG_TYPE_SEARCH, (unsigned long long)since, (unsigned long long)until, encoded_query);
+    if (length < 0 || (size_t)length >= buffer_size)
+    {
+        buffer[0] = FRAME_DELIMITER;
+        return 1;
+    }
+
+    return (size_t)length + 1;
+}
+
+int parse_search_request_frame(const char *frame, char *query, size_t query_size, uint64_t *since, uint64_t *until)
+{
+    const char *field = strchr(frame, ':');
+    if (field == NULL)
+    {
+        return 1;
+    }
+
+    char *field_end;
+    *since = strtoull(field + 1, &field_end, 10);
+    if (field_end == field + 1 || *field_end != ':')
+    {
+        return 1;
+    }
+
+    field = field_end;
+    *until = strtoull(field + 1, &field_end, 10);
+    if (field_end == field + 1 || *field_end != ':')
+    {
+        return 1;
+    }
+
+    decode_message(field_end + 1, query, query_size);
+
+    return 0;
+}
+
+size_t format_search_result_frame(char *buffer, size_t buffer_size, uint64_t timestamp, const char *sender_username, const char *message)
+{
+    char encoded_username[(USERNAME_BUFFER_SIZE - 1) * 3 + 1];
+    char encoded_message[ENCODED_MESSAGE_BUFFER_SIZE];
+    encode_message(sender_username, encoded_username, sizeof(encoded_username));
+    encode_message(message, encoded_message, sizeof(encoded_message));
+
+    int length = snprintf(buffer, buffer_size, "%d:%llu:%s:%s", MSG_TYPE_SEARCH, (unsigned long long)timestamp, encoded_username, encoded_message);
+    if (length < 0 || (size_t)length >= buffer_size)
+    {
+        buffer[0] = FRAME_DELIMITER;
+        return 1;
+    }
+
+    return (size_t)length + 1;
+}
+
+size_t format_search_end_frame(char *buffer, size_t buffer_size, size_t hits)
+{
+    int length = snprintf(buffer, buffer_size, "%d:%c:%lu", MSG_TYPE_SEARCH, SEARCH_RESULT_END, (unsigned long)hits);
+    if (length < 0 || (size_t)length >= buffer_size)
+    {
+        buffer[0] = FRAME_DELIMITER;
+        return 1;
+    }
+
+    return (size_t)length + 1;
+}
+
+void handle_search_frame(const char *frame, void (*callback_search_func)(const char *, const char *, uint64_t))
+{
+    const char *field = strchr(frame, ':');
+    if (field == NULL)
+    {
+        return;
+    }
+    field++;
+
+    // the end of the results carries the number of hits in place of a timestamp, with no sender
+    if (field[0] == SEARCH_RESULT_END)
+    {
+        callback_search_func(NULL, NULL, field[1] == ':' ? strtoull(field + 2, NULL, 10) : 0);
+        return;
+    }
+
+    char *field_end;
+    uint64_t timestamp = strtoull(field, &field_end, 10);
+    if (field_end == field || *field_end != ':')
+    {
+        return;
+    }
+
+    const char *encoded_username = field_end + 1;
+    const char *encoded_message = strchr(encoded_username, ':');
+    if (encoded_message == NULL || (size_t)(encoded_message - encoded_username) >= (USERNAME_BUFFER_SIZE - 1) * 3 + 1)
+    {
+        return;
+    }
+
+    char encoded_username_copy[(USERNAME_BUFFER_SIZE - 1) * 3 + 1];
+    memcpy(encoded_username_copy, encoded_username, (size_t)(encoded_message - encoded_username));
+    encoded_username_copy[encoded_message - encoded_username] = '\0';
+
+    char username[USERNAME_BUFFER_SIZE];
+    char message[MESSAGE_BUFFER_SIZE];
+    decode_message(encoded_username_copy, username, sizeof(username));
+    decode_message(encoded_message + 1, message, sizeof(message));
+
+    callback_search_func(username, message, timestamp);
+}
+
+size_t format_typing_request_frame(char *buffer, size_t buffer_size, char op)
+{
+    int length = snprintf(buffer, buffer_size, "%d:%c", MSG_TYPE_TYPING, op);
+    if (length < 0 || (size_t)length >= buffer_size)
+    {
+        buffer[0] = FRAME_DELIMITER;
+        return 1;
+    }
+
+    return (size_t)length + 1;
+}
+
+size_t format_typing_frame(char *buffer, size_t buffer_size, const uint32_t *member_ids, size_t count)
+{
+    int prefix_length = snprintf(buffer, buffer_size, "%d:", MSG_TYPE_TYPING);
+    if (prefix_length < 0 || (size_t)prefix_length >= buffer_size)
+    {
+        buffer[0] = FRAME_DELIMITER;
+        return 1;
+    }
+
+    size_t length = (size_t)prefix_length;
+    for (size_t i = 0; i < count && length + MEMBER_ID_VARINT_MAX_SIZE + 1 <= buffer_size; i++)
+    {
+        length += encode_member_id(member_ids[i], buffer + length);
+    }
+    buffer[length] = '\0';
+
+    return length + 1;
+}
+
+void handle_typing_frame(const char *frame, const member_table_t *members, void (*callback_typing_func)(const char **, size_t))
+{
+    const char *entry = strchr(frame, ':');
+    if (entry == NULL || callback_typing_func == NULL)
+    {
+        return;
+    }
+    entry++;
+
+    // the names point into the member table, which only this thread changes
+    const char *usernames[TYPING_MAX_MEMBERS];
+    size_t count = 0;
+
+    while (*entry != '\0' && count < TYPING_MAX_MEMBERS)
+    {
+        uint32_t member_id;
+        size_t id_length = decode_member_id(entry, &member_id);
+        if (id_length == 0)
+        {
+            break;
+        }
+        entry += id_length;
+
+        // a member whose join hasn't reached this receiver yet shows up in the next frame instead
+        const char *username = members != NULL ? member_table_find(members, member_id) : NULL;
+        if (username != NULL)
+        {
+            usernames[count++] = username;
+        }
+    }
+
+    callback_typing_func(usernames, count);
+}
+
+// appends ':' and the text, encoded unless it already is. returns the new length, or 0 if it doesn't fit with a terminator
+static size_t append_direct_field(char *buffer, size_t buffer_size, size_t length, const char *text, int encode)
+{
+    char encoded_text[ENCODED_MESSAGE_BUFFER_SIZE];
+    if (encode)
+    {
+        encode_message(text, encoded_text, sizeof(encoded_text));
+        text = encoded_text;
+    }
+
+    size_t text_length = strlen(text);
+    if (length == 0 || length + 1 + text_length + 1 > buffer_size)
+    {
+        return 0;
+    }
+
+    buffer[length++] = ':';
+    memcpy(buffer + length, text, text_length);
+    length += text_length;
+    buffer[length] = '\0';
+
+    return length;
+}
+
+size_t format_direct_request_frame(char *buffer, size_t buffer_size, uint32_t sequence, const char **recipients, size_t recipient_count, const char *message)
+{
+    int prefix_length = snprintf(buffer, buffer_size, "%d:%lu:%lu", MSG_TYPE_DIRECT, (unsigned long)sequence, (unsigned long)recipient_count);
+    size_t length = prefix_length < 0 || (size_t)prefix_length >= buffer_size ? 0 : (size_t)prefix_length;
+
+    for (size_t i = 0; i < recipient_count; i++)
+    {
+        length = append_direct_field(buffer, buffer_size, length, recipients[i], 1);
+    }
+    length = append_direct_field(buffer, buffer_size, length, message, 1);
+
+    if (length == 0)
+    {
+        buffer[0] = FRAME_DELIMITER;
+        return 1;
+    }
+
+    return length + 1;
+}
+
+// reads "<n>:<recipient 1>:...:<recipient n>:" and returns what follows it, NULL if it is malformed
+static const char *parse_direct_recipients(const char *field, char recipients[][USERNAME_BUFFER_SIZE], size_t *recipient_count)
+{
+    char *field_end;
+    unsigned long count = strtoul(field, &field_end, 10);
+    if (field_end == field || *field_end != ':' || count == 0 || count > DIRECT_MAX_RECIPIENTS)
+    {
+        return NULL;
+    }
+
+    field = field_end + 1;
+    for (unsigned long i = 0; i < count; i++)
+    {
+        const char *next_field = strchr(field, ':');
+        if (next_field == NULL || (size_t)(next_field - field) >= (USERNAME_BUFFER_SIZE - 1) * 3 + 1)
+        {
+            return NULL;
+        }
+
+        char encoded_username[(USERNAME_BUFFER_SIZE - 1) * 3 + 1];
+        memcpy(encoded_username, field, (size_t)(next_field - field));
+        encoded_username[next_field - field] = '\0';
+        decode_message(encoded_username, recipients[i], USERNAME_BUFFER_SIZE);
+
+        field = next_field + 1;
+    }
+
+    *recipient_count = (size_t)count;
+
+    return field;
+}
+
+int parse_direct_request_frame(const char *frame, uint32_t *sequence, char recipients[][USERNAME_BUFFER_SIZE], size_t *recipient_count, char *encoded_message, size_t encoded_message_size)
+{
+    const char *field = strchr(frame, ':');
+    if (field == NULL)
+    {
+        return 1;
+    }
+
+    char *field_end;
+    *sequence = (uint32_t)strtoul(field + 1, &field_end, 10);
+    if (field_end == field + 1 || *field_end != ':')
+    {
+        return 1;
+    }
+
+    field = parse_direct_recipients(field_end + 1, recipients, recipient_count);
+    if (field == NULL)
+    {
+        return 1;
+    }
+
+    // an encoded message has no ':' of its own, anything past one isn't part of it
+    size_t length = strcspn(field, ":");
+    if (length >= encoded_message_size)
+    {
+        length = encoded_message_size - 1;
+    }
+    memcpy(encoded_message, field, length);
+    encoded_message[length] = '\0';
+
+    return 0;
+}
+
+size_t format_direct_delivery_frame(char *buffer, size_t buffer_size, const char *sender_username, char recipients[][USERNAME_BUFFER_SIZE], size_t recipient_count, const char *encoded_message)
+{
+    int prefix_length = snprintf(buffer, buffer_size, "%d:%c", MSG_TYPE_DIRECT, DIRECT_DELIVERY);
+    size_t length = prefix_length < 0 || (size_t)prefix_length >= buffer_size ? 0 : (size_t)prefix_length;
+
+    char count[4];
+    snprintf(count, sizeof(count), "%lu", (unsigned long)recipient_count);
+
+    length = append_direct_field(buffer, buffer_size, length, sender_username, 1);
+    length = append_direct_field(buffer, buffer_size, length, count, 0);
+    for (size_t i = 0; i < recipient_count; i++)
+    {
+        length = append_direct_field(buffer, buffer_size, length, recipients[i], 1);
+    }
+    length = append_direct_field(buffer, buffer_size, length, encoded_message, 0);
+
+    if (length == 0)
+    {
+        buffer[0] = FRAME_DELIMITER;
+        return 1;
+    }
+
+    return length + 1;
+}
+
+size_t format_direct_ack_frame(char *buffer, size_t buffer_size, uint32_t sequence, char status, const char *recipient)
+{
+    char encoded_recipient[(USERNAME_BUFFER_SIZE - 1) * 3 + 1];
+    encode_message(recipient, encoded_recipient, sizeof(encoded_recipient));
+
+    int length = snprintf(buffer, buffer_size, "%d:%lu:%c:%s", MSG_TYPE_DIRECT, (unsigned long)sequence, status, encoded_recipient);
+    if (length < 0 || (size_t)length >= buffer_size)
+    {
+        buffer[0] = FRAME_DELIMITER;
+        return 1;
+    }
+
+    return (size_t)length + 1;
+}
+
+void handle_direct_frame(const char *frame, void (*callback_direct_func)(const char *, const char **, size_t, const char *), void (*callback_direct_ack_func)(uint32_t, char, const char *))
+{
+    const char *field = strchr(frame, ':');
+    if (field == NULL)
+    {
+        return;
+    }
+    field++;
+
+    if (field[0] == DIRECT_DELIVERY && field[1] == ':')
+    {
+        const char *encoded_sender = field + 2;
+        const char *sender_end = strchr(encoded_sender, ':');
+        if (sender_end == NULL || (size_t)(sender_end - encoded_sender) >= (USERNAME_BUFFER_SIZE - 1) * 3 + 1 || callback_direct_func == NULL)
+        {
+            return;
+        }
+
+        char encoded_sender_copy[(USERNAME_BUFFER_SIZE - 1) * 3 + 1];
+        memcpy(encoded_sender_copy, encoded_sender, (size_t)(sender_end - encoded_sender));
+        encoded_sender_copy[sender_end - encoded_sender] = '\0';
+
+        char recipients[DIRECT_MAX_RECIPIENTS][USERNAME_BUFFER_SIZE];
+        size_t recipient_count;
+        const char *encoded_message = parse_direct_recipients(sender_end + 1, recipients, &recipient_count);
+        if (encoded_message == NULL)
+        {
+            return;
+        }
+
+        char sender_username[USERNAME_BUFFER_SIZE];
+        char message[MESSAGE_BUFFER_SIZE];
+        decode_message(encoded_sender_copy, sender_username, sizeof(sender_username));
+        decode_message(encoded_message, message, sizeof(message));
+
+        const char *recipient_names[DIRECT_MAX_RECIPIENTS];
+        for (size_t i = 0; i < recipient_count; i++)
+        {
+            recipient_names[i] = recipients[i];
+        }
+
+        callback_direct_func(sender_username, recipient_names, recipient_count, message);
+        return;
+    }
+
+    char *field_end;
+    uint32_t sequence = (uint32_t)strtoul(field, &field_end, 10);
+    if (field_end == field || field_end[0] != ':' || field_end[1] == '\0' || field_end[2] != ':' || callback_direct_ack_func == NULL)
+    {
+        return;
+    }
+
+    char recipient[USERNAME_BUFFER_SIZE];
+    decode_message(field_end + 3, recipient, sizeof(recipient));
+
+    callback_direct_ack_func(sequence, field_end[1], recipient);
+}
+
+static size_t member_slot(const member_table_t *table, uint32_t member_id)
+{
+    // Fibonacci hashing spreads the sequential IDs over the table
+    size_t slot = (size_t)((member_id * 2654435761u) & (table->capacity - 1));
+    while (table->entries[slot].member_id != 0 && table->entries[slot].member_id != member_id)
+    {
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    return slot;
+}
+
+int member_table_init(member_table_t *table)
+{
+    table->entries = (member_entry_t *)calloc(MEMBER_TABLE_INITIAL_CAPACITY, sizeof(member_entry_t));
+    table->capacity = table->entries != NULL ? MEMBER_TABLE_INITIAL_CAPACITY : 0;
+    table->count = 0;
+
+    return table->entries == NULL;
+}
+
+void member_table_destroy(member_table_t *table)
+{
+    free(table->entries);
+    table->entries = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+void member_table_clear(member_table_t *table)
+{
+    if (table->entries != NULL)
+    {
+        memset(table->entries, 0, table->capacity * sizeof(member_entry_t));
+    }
+    table->count = 0;
+}
+
+int member_table_set(member_table_t *table, uint32_t member_id, const char *username)
+{
+    if (table->entries == NULL || member_id == 0)
+    {
+        return 1;
+    }
+
+    // rebuild at half load so probe sequences stay short, departed members are left out
+    if ((table->count + 1) * 2 > table->capacity)
+    {
+        size_t present = 0;
+        for (size_t i = 0; i < table->capacity; i++)
+        {
+            if (table->entries[i].member_id != 0 && !table->entries[i].departed)
+            {
+                present++;
+            }
+        }
+
+        member_table_t grown;
+        grown.capacity = (present + 1) * 4 > table->capacity ? table->capacity * 2 : table->capacity;
+        grown.count = present;
+        grown.entries = (member_entry_t *)calloc(grown.capacity, sizeof(member_entry_t));
+        if (grown.entries == NULL)
+        {
+            return 1;
+        }
+
+        for (size_t i = 0; i < table->capacity; i++)
+        {
+            if (table->entries[i].member_id != 0 && !table->entries[i].departed)
+            {
+                grown.entries[member_slot(&grown, table->entries[i].member_id)] = table->entries[i];
+            }
+        }
+
+        free(table->entries);
+        *table = grown;
+    }
+
+    member_entry_t *entry = &table->entries[member_slot(table, member_id)];
+    if (entry->member_id == 0)
+    {
+        entry->member_id = member_id;
+        table->count++;
+    }
+    entry->departed = 0;
+    snprintf(entry->username, sizeof(entry->username), "%s", username);
+
+    return 0;
+}
+
+void member_table_depart(member_table_t *table, uint32_t member_id)
+{
+    if (table->entries == NULL || member_id == 0)
+    {
+        return;
+    }
+
+    // the name stays resolvable until the table is next rebuilt, IDs are never reused
+    member_entry_t *entry = &table->entries[member_slot(table, member_id)];
+    if (entry->member_id == member_id)
+    {
+        entry->departed = 1;
+    }
+}
+
+const char *member_table_find(const member_table_t *table, uint32_t member_id)
+{
+    if (table->entries == NULL || member_id == 0)
+    {
+        return NULL;
+    }
+
+    const member_entry_t *entry = &table->entries[member_slot(table, member_id)];
+    return entry->member_id == member_id ? entry->username : NULL;
+}
+
+void frame_reader_init(frame_reader_t *reader)
+{
+    reader->length = 0;
+    reader->offset = 0;
+}
+
+int frame_reader_recv(frame_reader_t *reader, socket_t sock, const char *client_username, context_t context, error_list_t *error)
+{
+    // move the unconsumed tail to the front so the free space is contiguous
+    if (reader->offset > 0)
+    {
+        memmove(reader->buffer, reader->buffer + reader->offset, reader->length - reader->offset);
+        reader->length -= reader->offset;
+        reader->offset = 0;
+    }
+
+    // a full buffer without a single delimiter can only come from a misbehaving peer
+    if (reader->length == sizeof(reader->buffer))
+    {
+        reader->length = 0;
+    }
+
+    int bytes_received = socket_recv(sock, reader->buffer + reader->length, sizeof(reader->buffer) - reader->length, 0, client_username, context, error);
+
+    if (bytes_received > 0)
+    {
+        reader->length += (size_t)bytes_received;
+    }
+
+    return bytes_received;
+}
+
+char *frame_reader_next(frame_reader_t *reader)
+{
+    char *frame_start = reader->buffer + reader->offset;
+    char *frame_end = memchr(frame_start, FRAME_DELIMITER, reader->length - reader->offset);
+
+    if (frame_end == NULL)
+    {
+        return NULL;
+    }
+
+    reader->offset = (size_t)(frame_end - reader->buffer) + 1;
+
+    return frame_start;
 }
\ No newline at end of file
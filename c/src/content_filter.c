@@ -0,0 +1,455 @@
+#include "../include/content_filter.h"
+
+typedef struct
+{
+    uint32_t offset;
+    uint8_t length;
+    uint8_t action;
+} content_rule_t;
+
+// the patterns as a trie with sibling lists, only kept while the automaton is built
+typedef struct
+{
+    uint32_t first_child;
+    uint32_t next_sibling;
+    uint8_t byte_class;
+    uint8_t actions;
+    uint8_t depth;
+} trie_node_t;
+
+static unsigned char fold_byte(unsigned char byte)
+{
+    return byte >= 'A' && byte <= 'Z' ? (unsigned char)(byte - 'A' + 'a') : byte;
+}
+
+// the patterns are folded one after another into patterns, parsed points into it
+static int parse_rules(const char *rules, content_rule_t *parsed, size_t *rule_count, unsigned char *patterns, error_list_t *error)
+{
+    size_t count = 0;
+    size_t patterns_length = 0;
+
+    const char *line = rules;
+    while (*line != '\0')
+    {
+        const char *line_end = strchr(line, '\n');
+        size_t length = line_end == NULL ? strlen(line) : (size_t)(line_end - line);
+        if (length > 0 && line[length - 1] == '\r')
+        {
+            length--;
+        }
+
+        if (length > 0 && line[0] != '#')
+        {
+            uint8_t action;
+            size_t keyword_length;
+            if (length > 5 && strncmp(line, "flag ", 5) == 0)
+            {
+                action = CONTENT_ACTION_FLAG;
+                keyword_length = 5;
+            }
+            else if (length > 5 && strncmp(line, "mask ", 5) == 0)
+            {
+                action = CONTENT_ACTION_MASK;
+                keyword_length = 5;
+            }
+            else if (length > 6 && strncmp(line, "block ", 6) == 0)
+            {
+                action = CONTENT_ACTION_BLOCK;
+                keyword_length = 6;
+            }
+            else
+            {
+                add_error(error, ERR_FILTER_RULE_INVALID, NON_CRITICAL_ERROR, "Filter rules are \"block\", \"mask\" or \"flag\" followed by a pattern", "content_filter_load");
+                return 1;
+            }
+
+            const char *pattern = line + keyword_length;
+            size_t pattern_length = length - keyword_length;
+            size_t code_points;
+            if (pattern_length > CONTENT_FILTER_MAX_PATTERN_LENGTH || utf8_validate(pattern, pattern_length, &code_points) != 0)
+            {
+                add_error(error, ERR_FILTER_RULE_INVALID, NON_CRITICAL_ERROR, "Filter patterns must be valid UTF-8 of at most 64 bytes", "content_filter_load");
+                return 1;
+            }
+
+            if (count == CONTENT_FILTER_MAX_PATTERNS)
+            {
+                add_error(error, ERR_FILTER_RULE_INVALID, NON_CRITICAL_ERROR, "A filter holds at most 65536 patterns", "content_filter_load");
+                return 1;
+            }
+
+            for (size_t i = 0; i < pattern_length; i++)
+            {
+                patterns[patterns_length + i] = fold_byte((unsigned char)pattern[i]);
+            }
+            parsed[count].offset = (uint32_t)patterns_length;
+            parsed[count].length = (uint8_t)pattern_length;
+            parsed[count].action = action;
+            patterns_length += pattern_length;
+            count++;
+        }
+
+        if (line_end == NULL)
+        {
+            break;
+        }
+        line = line_end + 1;
+    }
+
+    *rule_count = count;
+
+    return 0;
+}
+
+// nodes holds a node per pattern byte plus the root, returns the nodes used
+static uint32_t build_trie(const content_rule_t *parsed, size_t rule_count, const unsigned char *patterns, const uint8_t *byte_class, trie_node_t *nodes)
+{
+    memset(&nodes[0], 0, sizeof(trie_node_t));
+    uint32_t node_count = 1;
+
+    for (size_t i = 0; i < rule_count; i++)
+    {
+        uint32_t node = 0;
+        for (size_t j = 0; j < parsed[i].length; j++)
+        {
+            uint8_t next_class = byte_class[patterns[parsed[i].offset + j]];
+
+            uint32_t child = nodes[node].first_child;
+            while (child != 0 && nodes[child].byte_class != next_class)
+            {
+                child = nodes[child].next_sibling;
+            }
+
+            if (child == 0)
+            {
+                child = node_count++;
+                nodes[child].first_child = 0;
+                nodes[child].next_sibling = nodes[node].first_child;
+                nodes[child].byte_class = next_class;
+                nodes[child].actions = 0;
+                nodes[child].depth = (uint8_t)(nodes[node].depth + 1);
+                nodes[node].first_child = child;
+            }
+            node = child;
+        }
+
+        // the same pattern listed twice does both
+        nodes[node].actions |= parsed[i].action;
+    }
+
+    return node_count;
+}
+
+static void free_automaton(content_automaton_t *automaton)
+{
+    if (automaton != NULL)
+    {
+        free(automaton->transitions);
+        free(automaton->states);
+        free(automaton);
+    }
+}
+
+static content_automaton_t *build_automaton(const trie_node_t *nodes, uint32_t node_count, content_automaton_t *automaton, error_list_t *error)
+{
+    uint32_t class_count = automaton->class_count;
+    if ((uint64_t)node_count * class_count > CONTENT_FILTER_MAX_TRANSITIONS)
+    {
+        add_error(error, ERR_FILTER_RULE_INVALID, NON_CRITICAL_ERROR, "The filter rules need too large an automaton, use fewer or shorter patterns", "content_filter_load");
+        free_automaton(automaton);
+        return NULL;
+    }
+
+    // order is the breadth first queue of trie nodes, a node's position in it is its state
+    uint32_t *order = (uint32_t *)malloc(node_count * sizeof(uint32_t));
+    uint32_t *state_of = (uint32_t *)malloc(node_count * sizeof(uint32_t));
+    uint32_t *failure = (uint32_t *)malloc(node_count * sizeof(uint32_t));
+    automaton->transitions = (uint32_t *)calloc((size_t)node_count * class_count, sizeof(uint32_t));
+    automaton->states = (content_state_t *)calloc(node_count, sizeof(content_state_t));
+    if (order == NULL || state_of == NULL || failure == NULL || automaton->transitions == NULL || automaton->states == NULL)
+    {
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for the content filter", "content_filter_load");
+        free(order);
+        free(state_of);
+        free(failure);
+        free_automaton(automaton);
+        return NULL;
+    }
+    automaton->state_count = node_count;
+
+    uint32_t head = 0;
+    uint32_t tail = 1;
+    order[0] = 0;
+    state_of[0] = 0;
+    while (head < tail)
+    {
+        for (uint32_t child = nodes[order[head]].first_child; child != 0; child = nodes[child].next_sibling)
+        {
+            state_of[child] = tail;
+            order[tail++] = child;
+        }
+        head++;
+    }
+
+    // a failure state is shallower, so its row and its output links are complete before any state that falls back on it
+    failure[0] = 0;
+    for (uint32_t state = 0; state < node_count; state++)
+    {
+        const trie_node_t *node = &nodes[order[state]];
+        uint32_t *row = &automaton->transitions[(size_t)state * class_count];
+        content_state_t *state_info = &automaton->states[state];
+
+        state_info->actions = node->actions;
+        state_info->depth = node->depth;
+        if (state != 0)
+        {
+            const content_state_t *failure_info = &automaton->states[failure[state]];
+            memcpy(row, &automaton->transitions[(size_t)failure[state] * class_count], class_count * sizeof(uint32_t));
+            state_info->output_link = failure_info->actions != 0 ? failure[state] : failure_info->output_link;
+            state_info->chain_actions = (uint8_t)(node->actions | failure_info->chain_actions);
+        }
+
+        for (uint32_t child = node->first_child; child != 0; child = nodes[child].next_sibling)
+        {
+            // until the child overwrites it, the entry is where the failure state goes on that byte: the child's failure state
+            failure[state_of[child]] = state == 0 ? 0 : row[nodes[child].byte_class];
+            row[nodes[child].byte_class] = state_of[child];
+        }
+    }
+
+    free(order);
+    free(state_of);
+    free(failure);
+
+    return automaton;
+}
+
+// automaton is left NULL when the list has no rules
+static int compile_rules(const char *rules, content_automaton_t **compiled, error_list_t *error)
+{
+    *compiled = NULL;
+
+    size_t rules_length = strlen(rules);
+    size_t line_count = 1;
+    for (const char *c = rules; *c != '\0'; c++)
+    {
+        line_count += *c == '\n';
+    }
+
+    content_rule_t *parsed = (content_rule_t *)malloc(line_count * sizeof(content_rule_t));
+    unsigned char *patterns = (unsigned char *)malloc(rules_length + 1);
+    trie_node_t *nodes = (trie_node_t *)malloc((rules_length + 1) * sizeof(trie_node_t));
+    content_automaton_t *automaton = (content_automaton_t *)calloc(1, sizeof(content_automaton_t));
+    if (parsed == NULL || patterns == NULL || nodes == NULL || automaton == NULL)
+    {
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for the content filter", "content_filter_load");
+        free(parsed);
+        free(patterns);
+        free(nodes);
+        free(automaton);
+        return 1;
+    }
+
+    size_t rule_count = 0;
+    int result = parse_rules(rules, parsed, &rule_count, patterns, error);
+    if (result != 0 || rule_count == 0)
+    {
+        free(parsed);
+        free(patterns);
+        free(nodes);
+        free(automaton);
+        return result;
+    }
+
+    // only bytes some pattern uses get their own column, a word list needs a few dozen instead of 256
+    for (size_t i = 0; i < rule_count; i++)
+    {
+        for (size_t j = 0; j < parsed[i].length; j++)
+        {
+            automaton->byte_class[patterns[parsed[i].offset + j]] = 1;
+        }
+    }
+    automaton->class_count = 1;
+    for (int byte = 0; byte < 256; byte++)
+    {
+        if (automaton->byte_class[byte] != 0)
+        {
+            automaton->byte_class[byte] = (uint8_t)automaton->class_count++;
+        }
+    }
+    // folding costs nothing while scanning, an upper case letter is in its lower case letter's class
+    for (int byte = 'A'; byte <= 'Z'; byte++)
+    {
+        automaton->byte_class[byte] = automaton->byte_class[fold_byte((unsigned char)byte)];
+    }
+
+    uint32_t node_count = build_trie(parsed, rule_count, patterns, automaton->byte_class, nodes);
+    automaton = build_automaton(nodes, node_count, automaton, error);
+
+    if (automaton == NULL)
+    {
+        result = 1;
+    }
+    else
+    {
+        log_event(LOG_LEVEL_INFO, "content_filter_load", "Content filter compiled, %d patterns in %d states of %d classes",
+                  (int)rule_count, (int)automaton->state_count, (int)automaton->class_count);
+    }
+
+    free(parsed);
+    free(patterns);
+    free(nodes);
+
+    *compiled = automaton;
+
+    return result;
+}
+
+void content_filter_init(content_filter_t *filter)
+{
+    filter->automaton = NULL;
+    filter->rules = NULL;
+    atomic_store(&filter->loaded, 0);
+    rwlock_init(&filter->rwlock);
+}
+
+void content_filter_destroy(content_filter_t *filter)
+{
+    atomic_store(&filter->loaded, 0);
+    free_automaton(filter->automaton);
+    free(filter->rules);
+    filter->automaton = NULL;
+    filter->rules = NULL;
+}
+
+int content_filter_load(content_filter_t *filter, const char *rules, error_list_t *error)
+{
+    content_automaton_t *automaton;
+    if (compile_rules(rules, &automaton, error) != 0)
+    {
+        return 1;
+    }
+
+    char *rules_copy = NULL;
+    if (automaton != NULL)
+    {
+        rules_copy = (char *)malloc(strlen(rules) + 1);
+        if (rules_copy == NULL)
+        {
+            add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for the content filter", "content_filter_load");
+            free_automaton(automaton);
+            return 1;
+        }
+        strcpy(rules_copy, rules);
+    }
+
+    rwlock_writerlock(&filter->rwlock);
+    content_automaton_t *previous_automaton = filter->automaton;
+    char *previous_rules = filter->rules;
+    filter->automaton = automaton;
+    filter->rules = rules_copy;
+    atomic_store(&filter->loaded, automaton != NULL);
+    rwlock_writerunlock(&filter->rwlock);
+
+    free_automaton(previous_automaton);
+    free(previous_rules);
+
+    return 0;
+}
+
+unsigned int content_filter_apply(content_filter_t *filter, char *text)
+{
+    if (atomic_load(&filter->loaded) == 0)
+    {
+        return 0;
+    }
+
+    unsigned int actions = 0;
+    // set for every byte a masked pattern covers, only cleared once the first one matches
+    unsigned char masked[ENCODED_MESSAGE_BUFFER_SIZE];
+    int masking = 0;
+    size_t length = strlen(text);
+    if (length >= sizeof(masked))
+    {
+        length = sizeof(masked) - 1;
+    }
+
+    rwlock_readerlock(&filter->rwlock);
+
+    const content_automaton_t *automaton = filter->automaton;
+    if (automaton != NULL)
+    {
+        const uint32_t *transitions = automaton->transitions;
+        const content_state_t *states = automaton->states;
+        uint32_t class_count = automaton->class_count;
+
+        uint32_t state = 0;
+        for (size_t i = 0; i < length; i++)
+        {
+            state = transitions[(size_t)state * class_count + automaton->byte_class[(unsigned char)text[i]]];
+
+            // nearly every state ends no pattern, that is the one test most bytes take
+            unsigned int chain_actions = states[state].chain_actions;
+            if (chain_actions == 0)
+            {
+                continue;
+            }
+            actions |= chain_actions;
+
+            if (!(chain_actions & CONTENT_ACTION_MASK))
+            {
+                continue;
+            }
+
+            for (uint32_t match = states[state].actions != 0 ? state : states[state].output_link; match != 0; match = states[match].output_link)
+            {
+                if (states[match].actions & CONTENT_ACTION_MASK)
+                {
+                    if (!masking)
+                    {
+                        memset(masked, 0, length);
+                        masking = 1;
+                    }
+                    memset(masked + i + 1 - states[match].depth, 1, states[match].depth);
+                }
+            }
+        }
+    }
+
+    rwlock_readerunlock(&filter->rwlock);
+
+    // a pattern is valid UTF-8 so a match starts and ends on whole characters,
+    // each one becomes a single mask character whatever its encoded length
+    if (masking && !(actions & CONTENT_ACTION_BLOCK))
+    {
+        size_t masked_length = 0;
+        for (size_t i = 0; i < length; i++)
+        {
+            if (!masked[i])
+            {
+                text[masked_length++] = text[i];
+            }
+            else if (((unsigned char)text[i] & 0xC0) != 0x80)
+            {
+                text[masked_length++] = CONTENT_MASK_CHARACTER;
+            }
+        }
+        text[masked_length] = '\0';
+    }
+
+    return actions;
+}
+
+char *content_filter_format_rules(content_filter_t *filter)
+{
+    char *rules = NULL;
+
+    rwlock_readerlock(&filter->rwlock);
+    if (filter->rules != NULL && (rules = (char *)malloc(strlen(filter->rules) + 1)) != NULL)
+    {
+        strcpy(rules, filter->rules);
+    }
+    rwlock_readerunlock(&filter->rwlock);
+
+    return rules;
+}
\ No newline at end of file
@@ -1,44 +1,193 @@
 #include "../include/errors.h"
+#include "../include/logger.h"
 
-void init_error(error_t *error)
+static const char *error_code_names[ERROR_CODE_COUNT] = {
+    [ERR_OK] = "ERR_OK",
+    [MALLOC_ERROR] = "MALLOC_ERROR",
+    [THREAD_CREATE_ERROR] = "THREAD_CREATE_ERROR",
+    [SERVER_DISCONNECTED] = "SERVER_DISCONNECTED",
+    [ERR_SECRET_KEY_LENGTH] = "ERR_SECRET_KEY_LENGTH",
+    [ERR_USERNAME_TOO_LONG] = "ERR_USERNAME_TOO_LONG",
+    [ERR_SLOW_CLIENT] = "ERR_SLOW_CLIENT",
+    [ERR_SERVER_FULL] = "ERR_SERVER_FULL",
+    [ERR_AUTH_DEADLINE] = "ERR_AUTH_DEADLINE",
+    [ERR_SERVER_NOT_RUNNING] = "ERR_SERVER_NOT_RUNNING",
+    [ERR_USER_NOT_FOUND] = "ERR_USER_NOT_FOUND",
+    [ERR_KICK_ADMIN] = "ERR_KICK_ADMIN",
+    [ERR_BAN_ENTRY_INVALID] = "ERR_BAN_ENTRY_INVALID",
+    [ERR_BLOB_STORE] = "ERR_BLOB_STORE",
+    [ERR_BLOB_NOT_FOUND] = "ERR_BLOB_NOT_FOUND",
+    [ERR_BLOB_TOO_LARGE] = "ERR_BLOB_TOO_LARGE",
+    [ERR_TRANSFER_REJECTED] = "ERR_TRANSFER_REJECTED",
+    [ERR_TRANSFER_STALLED] = "ERR_TRANSFER_STALLED",
+    [ERR_UPGRADE_UNSUPPORTED] = "ERR_UPGRADE_UNSUPPORTED",
+    [ERR_UPGRADE_FAILED] = "ERR_UPGRADE_FAILED",
+    [ERR_INVALID_TEXT] = "ERR_INVALID_TEXT",
+    [ERR_FILTER_RULE_INVALID] = "ERR_FILTER_RULE_INVALID",
+    [ERR_MESSAGE_BLOCKED] = "ERR_MESSAGE_BLOCKED",
+    [ERR_SEND_QUEUE_FULL] = "ERR_SEND_QUEUE_FULL",
+    [ERR_LOCAL_TRANSPORT] = "ERR_LOCAL_TRANSPORT",
+    [ERR_MEMORY_BUDGET] = "ERR_MEMORY_BUDGET",
+    [ERR_BLOB_QUOTA] = "ERR_BLOB_QUOTA",
+    [ERR_FEDERATION_BAD_KEY] = "ERR_FEDERATION_BAD_KEY",
+    [ERR_BAN_LOOPBACK] = "ERR_BAN_LOOPBACK",
+    [ERR_FRAME_TOO_LONG] = "ERR_FRAME_TOO_LONG",
+    [ERR_LOCAL_IP_FAILURE] = "ERR_LOCAL_IP_FAILURE",
+    [ERR_NO_RESPONSE_BODY] = "ERR_NO_RESPONSE_BODY",
+    [ERR_IP_TOO_LONG] = "ERR_IP_TOO_LONG",
+    [ERR_PUBLIC_IP_UNAVAILABLE] = "ERR_PUBLIC_IP_UNAVAILABLE",
+    [SOCKET_WSASYSNOTREADY] = "SOCKET_WSASYSNOTREADY",
+    [SOCKET_WSAVERNOTSUPPORTED] = "SOCKET_WSAVERNOTSUPPORTED",
+    [SOCKET_WSAVERSIONUNUSABLE] = "SOCKET_WSAVERSIONUNUSABLE",
+    [GETADDRINFOERROR] = "GETADDRINFOERROR",
+    [SOCKET_ECONNRESET] = "SOCKET_ECONNRESET",
+    [SOCKET_EINTR] = "SOCKET_EINTR",
+    [SOCKET_EADDRINUSE] = "SOCKET_EADDRINUSE",
+    [SOCKET_EADDRNOTAVAIL] = "SOCKET_EADDRNOTAVAIL",
+    [SOCKET_ENETDOWN] = "SOCKET_ENETDOWN",
+    [SOCKET_ENETUNREACH] = "SOCKET_ENETUNREACH",
+    [SOCKET_ETIMEDOUT] = "SOCKET_ETIMEDOUT",
+    [SOCKET_ECONNREFUSED] = "SOCKET_ECONNREFUSED",
+    [SOCKET_EHOSTUNREACH] = "SOCKET_EHOSTUNREACH",
+    [SOCKET_EWOULDBLOCK] = "SOCKET_EWOULDBLOCK",
+    [SOCKET_ECANCELED] = "SOCKET_ECANCELED",
+    [SOCKET_ECONNABORTED] = "SOCKET_ECONNABORTED",
+    [SOCKET_EMFILE] = "SOCKET_EMFILE",
+    [SOCKET_ENOBUFS] = "SOCKET_ENOBUFS",
+    [SOCKET_UNKNOWN_ERROR] = "SOCKET_UNKNOWN_ERROR",
+};
+
+static THREAD_LOCAL error_list_t thread_error;
+
+void init_error(error_list_t *error)
 {
+    // entries past count are never read, so resetting the counters is enough
     error->count = 0;
     error->max_severity = NON_CRITICAL_ERROR;
-    for (int i = 0; i < MAX_ERRORS; i++)
-    {
-        error->errors[i].code = NULL;
-        error->errors[i].severity = 0;
-        error->errors[i].message = NULL;
-        error->errors[i].location = NULL;
-    }
-    error->aggregated_message[0] = '\0';
+    error->subjects_length = 0;
 }
 
-void add_error(error_t *error, const char *err_code, error_severity_t severity, const char *message, const char *location)
+void add_error(error_list_t *error, error_code_t err_code, error_severity_t severity, const char *message, const char *location)
 {
     if (error->count < MAX_ERRORS)
     {
-        error->errors[error->count].code = err_code;
-        error->errors[error->count].severity = severity;
-        error->errors[error->count].message = message;
-        error->errors[error->count].location = location;
-        error->count++;
+        error_detail_t *detail = &error->errors[error->count++];
+        detail->code = err_code;
+        detail->severity = severity;
+        detail->message = message;
+        detail->location = location;
+        detail->subject_offset = -1;
+    }
 
-        if (severity == CRITICAL_ERROR)
+    if (severity == CRITICAL_ERROR)
+    {
+        error->max_severity = CRITICAL_ERROR;
+    }
+}
+
+void add_error_with_subject(error_list_t *error, error_code_t err_code, error_severity_t severity, const char *message_format, const char *subject, const char *location)
+{
+    int index = error->count;
+
+    add_error(error, err_code, severity, message_format, location);
+
+    // the subject usually lives in a buffer that is gone by the time the error gets reported,
+    // a list out of room for it keeps the error without the subject
+    size_t available = sizeof(error->subjects) - error->subjects_length;
+    if (index < MAX_ERRORS && available > 1)
+    {
+        char *copy = error->subjects + error->subjects_length;
+        size_t length = strnlen(subject, ERROR_SUBJECT_SIZE - 1);
+        if (length > available - 1)
         {
-            error->max_severity = CRITICAL_ERROR;
+            length = available - 1;
         }
 
-        snprintf(error->aggregated_message + strlen(error->aggregated_message),
-                 sizeof(error->aggregated_message) - strlen(error->aggregated_message),
-                 "Error in %s: %s (Code: %s)\n", location, message, err_code);
+        memcpy(copy, subject, length);
+        copy[length] = '\0';
+        error->errors[index].subject_offset = (int)error->subjects_length;
+        error->subjects_length += length + 1;
+    }
+}
+
+error_code_t last_error_code(const error_list_t *error)
+{
+    return error->count > 0 ? error->errors[error->count - 1].code : ERR_OK;
+}
+
+const char *error_subject(const error_list_t *error, const error_detail_t *detail)
+{
+    return detail->subject_offset >= 0 ? error->subjects + detail->subject_offset : "";
+}
+
+void format_error_message(const char *message, const char *subject, char *buffer, size_t buffer_size)
+{
+    const char *placeholder = strstr(message, "%s");
+    if (placeholder == NULL)
+    {
+        snprintf(buffer, buffer_size, "%s", message);
+        return;
+    }
+
+    snprintf(buffer, buffer_size, "%.*s%s%s", (int)(placeholder - message), message, subject, placeholder + 2);
+}
+
+const char *error_code_name(error_code_t err_code)
+{
+    if (err_code < 0 || err_code >= ERROR_CODE_COUNT || error_code_names[err_code] == NULL)
+    {
+        return "UNKNOWN_ERROR_CODE";
     }
+
+    return error_code_names[err_code];
 }
 
-void report_errors(error_t *error, void (*callback)(const char *, int))
+size_t format_errors(const error_list_t *error, char *buffer, size_t buffer_size)
 {
-    if (callback != NULL)
+    size_t length = 0;
+    buffer[0] = '\0';
+
+    for (int i = 0; i < error->count && length < buffer_size; i++)
     {
-        callback(error->aggregated_message, error->max_severity);
+        const error_detail_t *detail = &error->errors[i];
+        char message[AGGREGATED_ERROR_SIZE];
+        format_error_message(detail->message, error_subject(error, detail), message, sizeof(message));
+
+        int written = snprintf(buffer + length, buffer_size - length, "Error in %s: %s (Code: %s)\n", detail->location, message, error_code_name(detail->code));
+        if (written < 0)
+        {
+            break;
+        }
+        length += (size_t)written;
     }
+
+    return length < buffer_size ? length : buffer_size - 1;
+}
+
+void report_errors(error_list_t *error, void (*callback)(const char *, int))
+{
+    if (error->count == 0)
+    {
+        return;
+    }
+
+    // the log line is written on the logger's thread, the callback runs right here where the JNI callers expect it
+    log_errors(error);
+
+    if (callback == NULL)
+    {
+        return;
+    }
+
+    // the text is only built here, the paths that add errors never format anything
+    char aggregated_message[AGGREGATED_ERROR_SIZE];
+    format_errors(error, aggregated_message, sizeof(aggregated_message));
+
+    callback(aggregated_message, error->max_severity);
+}
+
+error_list_t *thread_error_context(void)
+{
+    init_error(&thread_error);
+    return &thread_error;
 }
\ No newline at end of file
@@ -0,0 +1,727 @@
+#include "../include/federation.h"
+
+static federation_config_t federation_config;
+static atomic_int federation_running = ATOMIC_VAR_INIT(0);
+static atomic_int federation_connect_cancelled = ATOMIC_VAR_INIT(0);
+static room_log_t federation_log;
+static uint64_t federation_epoch = 0;
+static char federation_secret_key[SECRET_KEY_BUFFER_SIZE];
+static void (*federation_deliver_frame)(const char *, size_t) = NULL;
+
+static socket_t federation_listener = INVALID_SOCK;
+static thread_t listener_thread;
+static thread_t sender_threads[FEDERATION_MAX_PEERS];
+static size_t sender_thread_count = 0;
+
+// wakes sender threads when a local message is published
+static mutex_t publish_mutex;
+static cond_t publish_cond;
+static unsigned long publish_generation = 0;
+
+// tracks every open link so federation_stop can unblock the threads using them
+static mutex_t link_mutex;
+static cond_t link_cond;
+static socket_t sender_sockets[FEDERATION_MAX_PEERS];
+static socket_t receiver_sockets[FEDERATION_MAX_PEERS * 2];
+static int active_receivers = 0;
+
+static mutex_t origins_mutex;
+static federation_origin_t origins[FEDERATION_MAX_PEERS * 2];
+static size_t origin_count = 0;
+
+int federation_parse_peers(const char *peer_list, federation_config_t *config)
+{
+    config->peer_count = 0;
+
+    if (peer_list == NULL)
+    {
+        return 0;
+    }
+
+    const char *peer_start = peer_list;
+    while (*peer_start != '\0' && config->peer_count < FEDERATION_MAX_PEERS)
+    {
+        const char *peer_end = strchr(peer_start, ',');
+        size_t peer_length = peer_end != NULL ? (size_t)(peer_end - peer_start) : strlen(peer_start);
+
+        // the port follows the last colon, "host:port"
+        const char *port_separator = NULL;
+        for (const char *c = peer_start; c < peer_start + peer_length; ++c)
+        {
+            if (*c == ':')
+            {
+                port_separator = c;
+            }
+        }
+
+        if (port_separator == NULL)
+        {
+            return 1;
+        }
+
+        size_t host_length = (size_t)(port_separator - peer_start);
+        size_t port_length = peer_length - host_length - 1;
+        if (host_length == 0 || host_length >= FEDERATION_HOST_BUFFER_SIZE || port_length == 0 || port_length >= FEDERATION_PORT_BUFFER_SIZE)
+        {
+            return 1;
+        }
+
+        federation_peer_address_t *peer = &config->peers[config->peer_count++];
+        memcpy(peer->host, peer_start, host_length);
+        peer->host[host_length] = '\0';
+        memcpy(peer->port, port_separator + 1, port_length);
+        peer->port[port_length] = '\0';
+
+        if (peer_end == NULL)
+        {
+            break;
+        }
+        peer_start = peer_end + 1;
+    }
+
+    return 0;
+}
+
+int federation_is_running(void)
+{
+    return atomic_load(&federation_running);
+}
+
+static int create_federation_listener(const char *bind_ip, const char *port, error_list_t *error)
+{
+    struct addrinfo *address = NULL, hints;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    if (getaddrinfo(bind_ip, port, &hints, &address) != 0)
+    {
+        add_error(error, GETADDRINFOERROR, CRITICAL_ERROR, "getaddrinfo failed for the federation port", "create_federation_listener");
+        return 1;
+    }
+
+    federation_listener = socket_create(address->ai_family, address->ai_socktype, address->ai_protocol, SOCKET_PROFILE_INTERACTIVE, error);
+    if (federation_listener == INVALID_SOCK)
+    {
+        freeaddrinfo(address);
+        return 1;
+    }
+
+    if (socket_bind(federation_listener, address->ai_addr, (int)address->ai_addrlen, error) == SOCKET_ERR ||
+        socket_listen(federation_listener, error) == SOCKET_ERR)
+    {
+        freeaddrinfo(address);
+        socket_close(federation_listener, error);
+        federation_listener = INVALID_SOCK;
+        return 1;
+    }
+
+    freeaddrinfo(address);
+    return 0;
+}
+
+int federation_start(const federation_config_t *config, const char *secret_key, void (*deliver_frame_func)(const char *, size_t), error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    federation_config = *config;
+    federation_deliver_frame = deliver_frame_func;
+    strncpy(federation_secret_key, secret_key, sizeof(federation_secret_key) - 1);
+    federation_secret_key[sizeof(federation_secret_key) - 1] = '\0';
+
+    // a restarted node starts counting from zero again, the epoch tells peers to reset their dedup state
+    federation_epoch = ((uint64_t)time(NULL) << 16) ^ (uint64_t)(rand() & 0xFFFF);
+
+    origin_count = 0;
+    active_receivers = 0;
+    sender_thread_count = 0;
+    for (size_t i = 0; i < FEDERATION_MAX_PEERS; i++)
+    {
+        sender_sockets[i] = INVALID_SOCK;
+    }
+    for (size_t i = 0; i < FEDERATION_MAX_PEERS * 2; i++)
+    {
+        receiver_sockets[i] = INVALID_SOCK;
+    }
+
+    if (room_log_init(&federation_log, ROOM_LOG_CAPACITY, error) != 0)
+    {
+        return 1;
+    }
+
+    // the bus carries the room's traffic, it is only reachable from other machines when an address is configured
+    if (federation_config.listen_address[0] == '\0')
+    {
+        strcpy(federation_config.listen_address, FEDERATION_DEFAULT_LISTEN_ADDRESS);
+    }
+
+    if (create_federation_listener(federation_config.listen_address, federation_config.listen_port, error) != 0)
+    {
+        room_log_destroy(&federation_log);
+        return 1;
+    }
+
+    mutex_init(&publish_mutex);
+    cond_init(&publish_cond);
+    mutex_init(&link_mutex);
+    cond_init(&link_cond);
+    mutex_init(&origins_mutex);
+
+    atomic_store(&federation_connect_cancelled, 0);
+    atomic_store(&federation_running, 1);
+
+    federation_receiver_thread_args_t *listener_args = (federation_receiver_thread_args_t *)malloc(sizeof(federation_receiver_thread_args_t));
+    if (listener_args == NULL)
+    {
+        add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for federation listener args", "federation_start");
+        federation_stop();
+        return 1;
+    }
+
+    listener_args->peer_socket = federation_listener;
+    listener_args->callback_error_func = callback_error_func;
+
+    if (thread_create(&listener_thread, federation_listener_thread, listener_args) != 0)
+    {
+        add_error(error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create federation listener thread", "federation_start");
+        free(listener_args);
+        // the listener thread handle is not valid, keep federation_stop from joining it
+        socket_close(federation_listener, error);
+        federation_listener = INVALID_SOCK;
+        atomic_store(&federation_running, 0);
+        room_log_destroy(&federation_log);
+        return 1;
+    }
+
+    for (size_t i = 0; i < federation_config.peer_count; i++)
+    {
+        federation_sender_thread_args_t *sender_args = (federation_sender_thread_args_t *)malloc(sizeof(federation_sender_thread_args_t));
+        if (sender_args == NULL)
+        {
+            add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for federation sender args", "federation_start");
+            federation_stop();
+            return 1;
+        }
+
+        sender_args->peer_index = i;
+        sender_args->callback_error_func = callback_error_func;
+
+        if (thread_create(&sender_threads[sender_thread_count], federation_sender_thread, sender_args) != 0)
+        {
+            add_error(error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create federation sender thread", "federation_start");
+            free(sender_args);
+            federation_stop();
+            return 1;
+        }
+        sender_thread_count++;
+    }
+
+    return 0;
+}
+
+void federation_stop(void)
+{
+    if (!atomic_load(&federation_running))
+    {
+        return;
+    }
+
+    error_list_t stop_error;
+    init_error(&stop_error);
+
+    atomic_store(&federation_running, 0);
+    atomic_store(&federation_connect_cancelled, 1);
+
+    mutex_lock(&publish_mutex);
+    publish_generation++;
+    cond_broadcast(&publish_cond);
+    mutex_unlock(&publish_mutex);
+
+    // unblock accept, connect and recv calls in the federation threads
+    socket_shutdown(federation_listener, &stop_error);
+
+    mutex_lock(&link_mutex);
+    cond_broadcast(&link_cond);
+    for (size_t i = 0; i < FEDERATION_MAX_PEERS; i++)
+    {
+        if (sender_sockets[i] != INVALID_SOCK)
+        {
+            socket_shutdown(sender_sockets[i], &stop_error);
+        }
+    }
+    for (size_t i = 0; i < FEDERATION_MAX_PEERS * 2; i++)
+    {
+        if (receiver_sockets[i] != INVALID_SOCK)
+        {
+            socket_shutdown(receiver_sockets[i], &stop_error);
+        }
+    }
+    mutex_unlock(&link_mutex);
+
+    thread_join(listener_thread);
+    socket_close(federation_listener, &stop_error);
+    federation_listener = INVALID_SOCK;
+
+    for (size_t i = 0; i < sender_thread_count; i++)
+    {
+        thread_join(sender_threads[i]);
+    }
+    sender_thread_count = 0;
+
+    // receiver threads are detached, wait until the last one is done delivering
+    mutex_lock(&link_mutex);
+    while (active_receivers > 0)
+    {
+        cond_timedwait(&link_cond, &link_mutex, FEDERATION_IDLE_TIMEOUT_MS);
+    }
+    mutex_unlock(&link_mutex);
+
+    room_log_destroy(&federation_log);
+}
+
+int federation_publish(const char *frame, size_t frame_length, error_list_t *error)
+{
+    if (!atomic_load(&federation_running))
+    {
+        return 0;
+    }
+
+    if (room_log_append(&federation_log, frame, frame_length, error) != 0)
+    {
+        return 1;
+    }
+
+    mutex_lock(&publish_mutex);
+    publish_generation++;
+    cond_broadcast(&publish_cond);
+    mutex_unlock(&publish_mutex);
+
+    return 0;
+}
+
+thread_ret_t THREAD_CALL federation_listener_thread(void *arg)
+{
+    federation_receiver_thread_args_t *thread_args = (federation_receiver_thread_args_t *)arg;
+    socket_t listener = thread_args->peer_socket;
+    void (*callback_error_func)(const char *, int) = thread_args->callback_error_func;
+
+    while (atomic_load(&federation_running))
+    {
+        error_list_t accept_error;
+        init_error(&accept_error);
+
+        struct sockaddr_in peer_addr;
+        socket_t peer_socket = socket_accept(listener, (struct sockaddr *)&peer_addr, SOCKET_PROFILE_INTERACTIVE, &accept_error);
+        if (peer_socket == INVALID_SOCK)
+        {
+            if (atomic_load(&federation_running))
+            {
+                report_errors(&accept_error, callback_error_func);
+            }
+            continue;
+        }
+
+        federation_receiver_thread_args_t *receiver_args = (federation_receiver_thread_args_t *)malloc(sizeof(federation_receiver_thread_args_t));
+        if (receiver_args == NULL)
+        {
+            add_error(&accept_error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for federation receiver args", "federation_listener_thread");
+            report_errors(&accept_error, callback_error_func);
+            socket_close(peer_socket, &accept_error);
+            continue;
+        }
+
+        receiver_args->peer_socket = peer_socket;
+        receiver_args->callback_error_func = callback_error_func;
+
+        mutex_lock(&link_mutex);
+        active_receivers++;
+        mutex_unlock(&link_mutex);
+
+        thread_t receiver_thread;
+        if (thread_create(&receiver_thread, federation_receiver_thread, receiver_args) != 0)
+        {
+            mutex_lock(&link_mutex);
+            active_receivers--;
+            mutex_unlock(&link_mutex);
+
+            add_error(&accept_error, THREAD_CREATE_ERROR, NON_CRITICAL_ERROR, "Failed to create federation receiver thread", "federation_listener_thread");
+            report_errors(&accept_error, callback_error_func);
+            socket_close(peer_socket, &accept_error);
+            free(receiver_args);
+            continue;
+        }
+
+        thread_detach(receiver_thread);
+    }
+
+    free(thread_args);
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+static federation_origin_t *find_origin(unsigned long node_id)
+{
+    // the caller holds origins_mutex
+    for (size_t i = 0; i < origin_count; i++)
+    {
+        if (origins[i].node_id == node_id)
+        {
+            return &origins[i];
+        }
+    }
+
+    if (origin_count == sizeof(origins) / sizeof(origins[0]))
+    {
+        return NULL;
+    }
+
+    federation_origin_t *origin = &origins[origin_count++];
+    origin->node_id = node_id;
+    origin->epoch = 0;
+    origin->next_sequence = 0;
+    mutex_init(&origin->deliver_mutex);
+
+    return origin;
+}
+
+thread_ret_t THREAD_CALL federation_receiver_thread(void *arg)
+{
+    federation_receiver_thread_args_t *thread_args = (federation_receiver_thread_args_t *)arg;
+    socket_t peer_socket = thread_args->peer_socket;
+    void (*callback_error_func)(const char *, int) = thread_args->callback_error_func;
+
+    error_list_t receiver_error;
+    init_error(&receiver_error);
+
+    int registered_slot = -1;
+    mutex_lock(&link_mutex);
+    for (size_t i = 0; i < FEDERATION_MAX_PEERS * 2; i++)
+    {
+        if (receiver_sockets[i] == INVALID_SOCK)
+        {
+            receiver_sockets[i] = peer_socket;
+            registered_slot = (int)i;
+            break;
+        }
+    }
+    mutex_unlock(&link_mutex);
+
+    frame_reader_t *frame_reader = registered_slot >= 0 ? (frame_reader_t *)malloc(sizeof(frame_reader_t)) : NULL;
+    if (frame_reader != NULL)
+    {
+        frame_reader_init(frame_reader);
+    }
+
+    unsigned long peer_node_id = 0;
+    int handshake_done = 0;
+
+    while (frame_reader != NULL && atomic_load(&federation_running))
+    {
+        init_error(&receiver_error);
+
+        int bytes_received = frame_reader_recv(frame_reader, peer_socket, "", CONTEXT_SERVER, &receiver_error);
+        if (bytes_received <= 0)
+        {
+            break;
+        }
+
+        char *frame;
+        while ((frame = frame_reader_next(frame_reader)) != NULL)
+        {
+            char *cursor;
+            unsigned long msg_type = strtoul(frame, &cursor, 10);
+            if (*cursor != ':')
+            {
+                continue;
+            }
+
+            if (msg_type == FEDERATION_MSG_HELLO)
+            {
+                char encoded_key[ENCODED_SECRET_KEY_BUFFER_SIZE];
+                char decoded_key[SECRET_KEY_BUFFER_SIZE];
+                unsigned long long epoch;
+                encoded_key[0] = '\0';
+
+                if (sscanf(cursor, ":%lu:%llu:%72[^:]", &peer_node_id, &epoch, encoded_key) != 3)
+                {
+                    goto disconnect;
+                }
+
+                decode_message(encoded_key, decoded_key, sizeof(decoded_key));
+                if (strcmp(decoded_key, federation_secret_key) != 0)
+                {
+                    add_error(&receiver_error, ERR_FEDERATION_BAD_KEY, NON_CRITICAL_ERROR, "A federation peer presented the wrong secret key", "federation_receiver_thread");
+                    report_errors(&receiver_error, callback_error_func);
+                    goto disconnect;
+                }
+
+                uint64_t next_sequence = 0;
+
+                mutex_lock(&origins_mutex);
+                federation_origin_t *origin = find_origin(peer_node_id);
+                if (origin != NULL)
+                {
+                    if (origin->epoch != (uint64_t)epoch)
+                    {
+                        origin->epoch = (uint64_t)epoch;
+                        origin->next_sequence = 0;
+                    }
+                    next_sequence = origin->next_sequence;
+                }
+                mutex_unlock(&origins_mutex);
+
+                if (origin == NULL)
+                {
+                    goto disconnect;
+                }
+
+                char resume_frame[64];
+                int resume_length = snprintf(resume_frame, sizeof(resume_frame), "%d:%lu:%llu", FEDERATION_MSG_RESUME, federation_config.node_id, (unsigned long long)next_sequence);
+                if (socket_send(peer_socket, resume_frame, (size_t)resume_length + 1, 0, "", CONTEXT_SERVER, NON_CRITICAL_ERROR, &receiver_error) == SOCKET_ERR)
+                {
+                    goto disconnect;
+                }
+
+                handshake_done = 1;
+            }
+            else if (msg_type == FEDERATION_MSG_FORWARD && handshake_done)
+            {
+                unsigned long origin_node_id = strtoul(cursor + 1, &cursor, 10);
+                if (*cursor != ':')
+                {
+                    continue;
+                }
+                uint64_t epoch = strtoull(cursor + 1, &cursor, 10);
+                if (*cursor != ':')
+                {
+                    continue;
+                }
+                uint64_t sequence = strtoull(cursor + 1, &cursor, 10);
+                if (*cursor != ':' || origin_node_id != peer_node_id)
+                {
+                    continue;
+                }
+
+                char *room_frame = cursor + 1;
+
+                // the origin's delivery lock is taken before origins_mutex is released, so frames stay in order
+                // while the delivery itself, which may send to every member, doesn't hold up the other links
+                mutex_lock(&origins_mutex);
+                federation_origin_t *origin = find_origin(origin_node_id);
+                int deliver = origin != NULL && origin->epoch == epoch && sequence >= origin->next_sequence;
+                if (deliver)
+                {
+                    origin->next_sequence = sequence + 1;
+                    mutex_lock(&origin->deliver_mutex);
+                }
+                mutex_unlock(&origins_mutex);
+
+                if (deliver)
+                {
+                    federation_deliver_frame(room_frame, strlen(room_frame) + 1);
+                    mutex_unlock(&origin->deliver_mutex);
+                }
+            }
+        }
+    }
+
+disconnect:
+    free(frame_reader);
+
+    mutex_lock(&link_mutex);
+    if (registered_slot >= 0)
+    {
+        receiver_sockets[registered_slot] = INVALID_SOCK;
+    }
+    mutex_unlock(&link_mutex);
+
+    init_error(&receiver_error);
+    socket_close(peer_socket, &receiver_error);
+
+    logger_thread_detach();
+    free(thread_args);
+
+    mutex_lock(&link_mutex);
+    active_receivers--;
+    cond_broadcast(&link_cond);
+    mutex_unlock(&link_mutex);
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+static socket_t connect_to_peer(const federation_peer_address_t *peer, error_list_t *error)
+{
+    struct addrinfo *address = NULL, hints;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    if (getaddrinfo(peer->host, peer->port, &hints, &address) != 0)
+    {
+        add_error(error, GETADDRINFOERROR, NON_CRITICAL_ERROR, "getaddrinfo failed for a federation peer", "connect_to_peer");
+        return INVALID_SOCK;
+    }
+
+    connect_options_t connect_options;
+    connect_options_init(&connect_options);
+    connect_options.cancel = &federation_connect_cancelled;
+    // a link relays single chat frames between two nodes
+    connect_options.profile = SOCKET_PROFILE_INTERACTIVE;
+
+    socket_t peer_socket = socket_connect_with_backoff(address, &connect_options, error);
+
+    freeaddrinfo(address);
+    return peer_socket;
+}
+
+static void wait_for_reconnect(void)
+{
+    mutex_lock(&link_mutex);
+    if (atomic_load(&federation_running))
+    {
+        cond_timedwait(&link_cond, &link_mutex, FEDERATION_RECONNECT_INTERVAL_MS);
+    }
+    mutex_unlock(&link_mutex);
+}
+
+thread_ret_t THREAD_CALL federation_sender_thread(void *arg)
+{
+    federation_sender_thread_args_t *thread_args = (federation_sender_thread_args_t *)arg;
+    size_t peer_index = thread_args->peer_index;
+    void (*callback_error_func)(const char *, int) = thread_args->callback_error_func;
+    const federation_peer_address_t *peer = &federation_config.peers[peer_index];
+
+    char *frame = (char *)malloc(FEDERATION_FRAME_BUFFER_SIZE);
+    frame_reader_t *frame_reader = (frame_reader_t *)malloc(sizeof(frame_reader_t));
+
+    while (frame != NULL && frame_reader != NULL && atomic_load(&federation_running))
+    {
+        error_list_t sender_error;
+        init_error(&sender_error);
+
+        socket_t peer_socket = connect_to_peer(peer, &sender_error);
+        if (peer_socket == INVALID_SOCK)
+        {
+            // peers come and go, only the retry matters
+            wait_for_reconnect();
+            continue;
+        }
+
+        mutex_lock(&link_mutex);
+        sender_sockets[peer_index] = peer_socket;
+        mutex_unlock(&link_mutex);
+
+        char encoded_key[ENCODED_SECRET_KEY_BUFFER_SIZE];
+        encode_message(federation_secret_key, encoded_key, sizeof(encoded_key));
+
+        int hello_length = snprintf(frame, FEDERATION_FRAME_BUFFER_SIZE, "%d:%lu:%llu:%s", FEDERATION_MSG_HELLO, federation_config.node_id, (unsigned long long)federation_epoch, encoded_key);
+
+        uint64_t cursor = 0;
+        int resumed = 0;
+
+        if (socket_send(peer_socket, frame, (size_t)hello_length + 1, 0, "", CONTEXT_SERVER, NON_CRITICAL_ERROR, &sender_error) != SOCKET_ERR)
+        {
+            frame_reader_init(frame_reader);
+
+            while (!resumed && frame_reader_recv(frame_reader, peer_socket, "", CONTEXT_SERVER, &sender_error) > 0)
+            {
+                char *resume_frame;
+                while ((resume_frame = frame_reader_next(frame_reader)) != NULL)
+                {
+                    unsigned long peer_node_id;
+                    unsigned long long next_sequence;
+                    if (sscanf(resume_frame, "1:%lu:%llu", &peer_node_id, &next_sequence) == 2)
+                    {
+                        cursor = (uint64_t)next_sequence;
+                        resumed = 1;
+                        break;
+                    }
+                }
+            }
+        }
+
+        while (resumed && atomic_load(&federation_running))
+        {
+            mutex_lock(&publish_mutex);
+            unsigned long generation = publish_generation;
+            mutex_unlock(&publish_mutex);
+
+            if (cursor >= room_log_head(&federation_log))
+            {
+                mutex_lock(&publish_mutex);
+                if (generation == publish_generation && atomic_load(&federation_running))
+                {
+                    cond_timedwait(&publish_cond, &publish_mutex, FEDERATION_IDLE_TIMEOUT_MS);
+                }
+                mutex_unlock(&publish_mutex);
+                continue;
+            }
+
+            int frame_length = 0;
+
+            room_log_read_lock(&federation_log);
+            uint64_t tail = room_log_tail(&federation_log);
+            if (cursor < tail)
+            {
+                add_error(&sender_error, ERR_SLOW_CLIENT, NON_CRITICAL_ERROR, "A federation peer missed messages that left the replay log", "federation_sender_thread");
+                cursor = tail;
+            }
+            const room_log_entry_t *entry = room_log_get(&federation_log, cursor);
+            if (entry != NULL)
+            {
+                frame_length = snprintf(frame, FEDERATION_FRAME_BUFFER_SIZE, "%d:%lu:%llu:%llu:", FEDERATION_MSG_FORWARD, federation_config.node_id, (unsigned long long)federation_epoch, (unsigned long long)cursor);
+                memcpy(frame + frame_length, entry->data, entry->length);
+                frame_length += (int)entry->length;
+            }
+            room_log_read_unlock(&federation_log);
+
+            if (sender_error.count > 0)
+            {
+                report_errors(&sender_error, callback_error_func);
+                init_error(&sender_error);
+            }
+
+            if (frame_length == 0)
+            {
+                continue;
+            }
+
+            // a short send would leave the peer with half a frame that the next one is glued onto
+            if (socket_send_all(peer_socket, frame, (size_t)frame_length, FEDERATION_SEND_TIMEOUT_MS, &sender_error) != 0)
+            {
+                break;
+            }
+
+            cursor++;
+        }
+
+        mutex_lock(&link_mutex);
+        sender_sockets[peer_index] = INVALID_SOCK;
+        mutex_unlock(&link_mutex);
+
+        init_error(&sender_error);
+        socket_close(peer_socket, &sender_error);
+
+        wait_for_reconnect();
+    }
+
+    free(frame);
+    free(frame_reader);
+    free(thread_args);
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
\ No newline at end of file
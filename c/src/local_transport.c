@@ -0,0 +1,844 @@
+#include "../include/local_transport.h"
+
+#ifdef __linux__
+#include <stdlib.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#endif
+
+#ifndef __linux__
+
+// memfd and eventfd are Linux's, elsewhere every connection stays on TCP
+static void add_unsupported_error(error_list_t *error, const char *function_name)
+{
+    add_error(error, ERR_LOCAL_TRANSPORT, NON_CRITICAL_ERROR, "The shared memory transport needs memfd and eventfd, which only Linux has", function_name);
+}
+
+socket_t local_transport_listen(const char *path, error_list_t *error)
+{
+    (void)path;
+    add_unsupported_error(error, "local_transport_listen");
+    return INVALID_SOCK;
+}
+
+socket_t local_transport_accept(socket_t listener, const char *port, error_list_t *error)
+{
+    (void)listener;
+    (void)port;
+    add_unsupported_error(error, "local_transport_accept");
+    return INVALID_SOCK;
+}
+
+socket_t local_transport_connect(const char *path, char *port, size_t port_size, error_list_t *error)
+{
+    (void)path;
+    (void)port;
+    (void)port_size;
+    add_unsupported_error(error, "local_transport_connect");
+    return INVALID_SOCK;
+}
+
+void local_transport_close_listener(socket_t listener)
+{
+    (void)listener;
+}
+
+int local_transport_owns(socket_t sock)
+{
+    (void)sock;
+    return 0;
+}
+
+int local_transport_active(void)
+{
+    return 0;
+}
+
+int local_transport_send(socket_t sock, const void *buf, size_t len, int flags)
+{
+    (void)sock;
+    (void)buf;
+    (void)len;
+    (void)flags;
+    return SOCKET_ERR;
+}
+
+int local_transport_recv(socket_t sock, void *buf, size_t len, int flags)
+{
+    (void)sock;
+    (void)buf;
+    (void)len;
+    (void)flags;
+    return SOCKET_ERR;
+}
+
+int local_transport_poll(pollfd_t *fds, size_t count, int timeout_ms)
+{
+    (void)fds;
+    (void)count;
+    (void)timeout_ms;
+    return SOCKET_ERR;
+}
+
+void local_transport_set_nonblocking(socket_t sock, int nonblocking)
+{
+    (void)sock;
+    (void)nonblocking;
+}
+
+void local_transport_shutdown(socket_t sock)
+{
+    (void)sock;
+}
+
+int local_transport_close(socket_t sock)
+{
+    (void)sock;
+    return SOCKET_ERR;
+}
+
+#else
+
+// LOCAL_POLL_STACK_ENTRIES: poll sets up to this size are expanded on the stack, a local entry takes up to three
+#define LOCAL_POLL_STACK_ENTRIES 64
+
+// the handshake's only message, the descriptors ride along with it
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t region_size;
+} local_hello_t;
+
+// written when a connection is set up or torn down, which the descriptor's owner does before anyone else can use it
+static local_channel_t *local_channels[LOCAL_TRANSPORT_MAX_DESCRIPTOR];
+static atomic_int local_channel_count = ATOMIC_VAR_INIT(0);
+
+static local_channel_t *find_channel(socket_t sock)
+{
+    if (atomic_load_explicit(&local_channel_count, memory_order_relaxed) == 0 || sock < 0 || sock >= LOCAL_TRANSPORT_MAX_DESCRIPTOR)
+    {
+        return NULL;
+    }
+
+    return local_channels[sock];
+}
+
+int local_transport_owns(socket_t sock)
+{
+    return find_channel(sock) != NULL;
+}
+
+int local_transport_active(void)
+{
+    return atomic_load_explicit(&local_channel_count, memory_order_relaxed) > 0;
+}
+
+static void ring_doorbell(int doorbell)
+{
+    uint64_t one = 1;
+    ssize_t written = write(doorbell, &one, sizeof(one));
+    (void)written;
+}
+
+static void drain_doorbell(int doorbell)
+{
+    uint64_t count;
+    ssize_t received = read(doorbell, &count, sizeof(count));
+    (void)received;
+}
+
+static int is_peer_gone(local_channel_t *channel)
+{
+    return atomic_load(&channel->hung_up) || atomic_load(&channel->rx->producer_closed) || atomic_load(&channel->tx->consumer_closed);
+}
+
+// our own shutdown ends both directions for us as well
+static int is_closed(local_channel_t *channel)
+{
+    return is_peer_gone(channel) || atomic_load(&channel->tx->producer_closed);
+}
+
+static size_t ring_readable(local_ring_t *ring)
+{
+    return (size_t)(atomic_load_explicit(&ring->head, memory_order_acquire) - atomic_load_explicit(&ring->tail, memory_order_relaxed));
+}
+
+static size_t ring_writable(local_ring_t *ring)
+{
+    return LOCAL_TRANSPORT_RING_SIZE - (size_t)(atomic_load_explicit(&ring->head, memory_order_relaxed) - atomic_load_explicit(&ring->tail, memory_order_acquire));
+}
+
+// the peer is only woken when it said it is about to sleep, so a busy peer never costs a system call
+static size_t ring_write(local_channel_t *channel, const char *data, size_t length)
+{
+    local_ring_t *ring = channel->tx;
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    size_t space = ring_writable(ring);
+    if (length > space)
+    {
+        length = space;
+    }
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    size_t offset = head & (LOCAL_TRANSPORT_RING_SIZE - 1);
+    size_t first = LOCAL_TRANSPORT_RING_SIZE - offset < length ? LOCAL_TRANSPORT_RING_SIZE - offset : length;
+    memcpy(ring->data + offset, data, first);
+    memcpy(ring->data, data + first, length - first);
+
+    // sequentially consistent with the consumer's flag, either it sees the new head or we see it waiting
+    atomic_store(&ring->head, head + (uint32_t)length);
+    if (atomic_exchange(&ring->consumer_waiting, 0))
+    {
+        ring_doorbell(channel->tx_data_doorbell);
+    }
+
+    return length;
+}
+
+static size_t ring_read(local_channel_t *channel, char *data, size_t length)
+{
+    local_ring_t *ring = channel->rx;
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    size_t available = ring_readable(ring);
+    if (length > available)
+    {
+        length = available;
+    }
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    size_t offset = tail & (LOCAL_TRANSPORT_RING_SIZE - 1);
+    size_t first = LOCAL_TRANSPORT_RING_SIZE - offset < length ? LOCAL_TRANSPORT_RING_SIZE - offset : length;
+    memcpy(data, ring->data + offset, first);
+    memcpy(data + first, ring->data, length - first);
+
+    atomic_store(&ring->tail, tail + (uint32_t)length);
+    if (atomic_exchange(&ring->producer_waiting, 0))
+    {
+        ring_doorbell(channel->rx_space_doorbell);
+    }
+
+    return length;
+}
+
+// sleeps until the doorbell rings, the peer hangs up or the slice passes
+static void wait_for_doorbell(local_channel_t *channel, int doorbell, int timeout_ms)
+{
+    struct pollfd fds[2];
+    fds[0].fd = doorbell;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    // no events asked for, a hang up is reported anyway
+    fds[1].fd = channel->socket;
+    fds[1].events = 0;
+    fds[1].revents = 0;
+
+    if (poll(fds, 2, timeout_ms) > 0)
+    {
+        if (fds[0].revents & POLLIN)
+        {
+            drain_doorbell(doorbell);
+        }
+        if (fds[1].revents & (POLLHUP | POLLERR))
+        {
+            atomic_store(&channel->hung_up, 1);
+        }
+    }
+}
+
+int local_transport_send(socket_t sock, const void *buf, size_t len, int flags)
+{
+    local_channel_t *channel = find_channel(sock);
+    if (channel == NULL)
+    {
+        errno = EBADF;
+        return SOCKET_ERR;
+    }
+
+    int nonblocking = atomic_load(&channel->nonblocking) || (flags & MSG_DONTWAIT);
+    const char *data = (const char *)buf;
+    size_t sent = 0;
+
+    mutex_lock(&channel->send_mutex);
+
+    while (sent < len)
+    {
+        if (is_closed(channel))
+        {
+            mutex_unlock(&channel->send_mutex);
+            errno = EPIPE;
+            return SOCKET_ERR;
+        }
+
+        sent += ring_write(channel, data + sent, len - sent);
+        if (sent == len || nonblocking)
+        {
+            break;
+        }
+
+        // the flag goes up before the last look, a consumer that frees room after it rings the doorbell
+        atomic_store(&channel->tx->producer_waiting, 1);
+        if (ring_writable(channel->tx) == 0 && !is_closed(channel))
+        {
+            wait_for_doorbell(channel, channel->tx_space_doorbell, LOCAL_TRANSPORT_WAIT_SLICE_MS);
+        }
+    }
+
+    mutex_unlock(&channel->send_mutex);
+
+    if (sent == 0 && len > 0)
+    {
+        errno = EAGAIN;
+        return SOCKET_ERR;
+    }
+
+    return (int)sent;
+}
+
+int local_transport_recv(socket_t sock, void *buf, size_t len, int flags)
+{
+    local_channel_t *channel = find_channel(sock);
+    if (channel == NULL)
+    {
+        errno = EBADF;
+        return SOCKET_ERR;
+    }
+
+    int nonblocking = atomic_load(&channel->nonblocking) || (flags & MSG_DONTWAIT);
+
+    for (;;)
+    {
+        size_t received = ring_read(channel, (char *)buf, len);
+        if (received > 0 || len == 0)
+        {
+            return (int)received;
+        }
+
+        // whatever the peer wrote before closing has been read, this is the end of the stream
+        if (is_closed(channel))
+        {
+            return 0;
+        }
+
+        if (nonblocking)
+        {
+            errno = EAGAIN;
+            return SOCKET_ERR;
+        }
+
+        atomic_store(&channel->rx->consumer_waiting, 1);
+        if (ring_readable(channel->rx) == 0 && !is_closed(channel))
+        {
+            wait_for_doorbell(channel, channel->rx_data_doorbell, LOCAL_TRANSPORT_WAIT_SLICE_MS);
+        }
+    }
+}
+
+static short local_revents(local_channel_t *channel, short events)
+{
+    short revents = 0;
+    int closed = is_closed(channel);
+
+    if ((events & POLLIN) && (closed || ring_readable(channel->rx) > 0))
+    {
+        revents |= POLLIN;
+    }
+    if ((events & POLLOUT) && (closed || ring_writable(channel->tx) > 0))
+    {
+        revents |= POLLOUT;
+    }
+    if (is_peer_gone(channel))
+    {
+        revents |= POLLHUP;
+    }
+
+    return revents;
+}
+
+int local_transport_poll(pollfd_t *fds, size_t count, int timeout_ms)
+{
+    // a local entry the rings can't answer yet is replaced by the doorbells it waits on and its socket, for hang ups
+    struct pollfd stack_entries[LOCAL_POLL_STACK_ENTRIES];
+    struct pollfd *entries = stack_entries;
+    if (count * 3 > LOCAL_POLL_STACK_ENTRIES)
+    {
+        entries = (struct pollfd *)malloc(count * 3 * sizeof(struct pollfd));
+        if (entries == NULL)
+        {
+            errno = ENOMEM;
+            return SOCKET_ERR;
+        }
+    }
+
+    int ready = 0;
+    size_t entry_count = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        local_channel_t *channel = find_channel(fds[i].fd);
+        fds[i].revents = 0;
+
+        if (channel == NULL)
+        {
+            entries[entry_count++] = fds[i];
+            continue;
+        }
+
+        if (fds[i].events & POLLIN)
+        {
+            atomic_store(&channel->rx->consumer_waiting, 1);
+        }
+        if (fds[i].events & POLLOUT)
+        {
+            atomic_store(&channel->tx->producer_waiting, 1);
+        }
+
+        fds[i].revents = local_revents(channel, fds[i].events);
+        if (fds[i].revents != 0)
+        {
+            ready++;
+            continue;
+        }
+
+        if (fds[i].events & POLLIN)
+        {
+            entries[entry_count].fd = channel->rx_data_doorbell;
+            entries[entry_count].events = POLLIN;
+            entries[entry_count++].revents = 0;
+        }
+        if (fds[i].events & POLLOUT)
+        {
+            entries[entry_count].fd = channel->tx_space_doorbell;
+            entries[entry_count].events = POLLIN;
+            entries[entry_count++].revents = 0;
+        }
+        entries[entry_count].fd = channel->socket;
+        entries[entry_count].events = 0;
+        entries[entry_count++].revents = 0;
+    }
+
+    // entries the rings already answered don't wait for the others
+    int result = poll(entries, (nfds_t)entry_count, ready > 0 ? 0 : timeout_ms);
+    if (result == SOCKET_ERR)
+    {
+        if (entries != stack_entries)
+        {
+            free(entries);
+        }
+        return ready > 0 ? ready : SOCKET_ERR;
+    }
+
+    size_t entry = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        local_channel_t *channel = find_channel(fds[i].fd);
+
+        if (channel == NULL)
+        {
+            fds[i].revents = entries[entry++].revents;
+            if (fds[i].revents != 0)
+            {
+                ready++;
+            }
+            continue;
+        }
+
+        if (fds[i].revents != 0)
+        {
+            continue;
+        }
+
+        if (fds[i].events & POLLIN)
+        {
+            if (entries[entry++].revents & POLLIN)
+            {
+                drain_doorbell(channel->rx_data_doorbell);
+            }
+        }
+        if (fds[i].events & POLLOUT)
+        {
+            if (entries[entry++].revents & POLLIN)
+            {
+                drain_doorbell(channel->tx_space_doorbell);
+            }
+        }
+        if (entries[entry++].revents & (POLLHUP | POLLERR))
+        {
+            atomic_store(&channel->hung_up, 1);
+        }
+
+        // a wakeup only says to look again, the rings have the answer
+        fds[i].revents = local_revents(channel, fds[i].events);
+        if (fds[i].revents != 0)
+        {
+            ready++;
+        }
+    }
+
+    if (entries != stack_entries)
+    {
+        free(entries);
+    }
+
+    return ready;
+}
+
+void local_transport_set_nonblocking(socket_t sock, int nonblocking)
+{
+    local_channel_t *channel = find_channel(sock);
+    if (channel != NULL)
+    {
+        atomic_store(&channel->nonblocking, nonblocking);
+    }
+}
+
+void local_transport_shutdown(socket_t sock)
+{
+    local_channel_t *channel = find_channel(sock);
+    if (channel == NULL)
+    {
+        return;
+    }
+
+    atomic_store(&channel->tx->producer_closed, 1);
+    atomic_store(&channel->rx->consumer_closed, 1);
+
+    // the peer's waiters and our own, a thread blocked on this connection returns like it would after a TCP shutdown
+    ring_doorbell(channel->tx_data_doorbell);
+    ring_doorbell(channel->rx_space_doorbell);
+    ring_doorbell(channel->rx_data_doorbell);
+    ring_doorbell(channel->tx_space_doorbell);
+    shutdown(channel->socket, SHUT_RDWR);
+}
+
+static void free_channel(local_channel_t *channel)
+{
+    munmap(channel->region, sizeof(local_region_t));
+    close(channel->rx_data_doorbell);
+    close(channel->tx_space_doorbell);
+    close(channel->tx_data_doorbell);
+    close(channel->rx_space_doorbell);
+    mutex_destroy(&channel->send_mutex);
+    free(channel);
+}
+
+int local_transport_close(socket_t sock)
+{
+    local_channel_t *channel = find_channel(sock);
+    if (channel == NULL)
+    {
+        errno = EBADF;
+        return SOCKET_ERR;
+    }
+
+    local_transport_shutdown(sock);
+
+    local_channels[sock] = NULL;
+    atomic_fetch_sub(&local_channel_count, 1);
+    free_channel(channel);
+
+    return close(sock);
+}
+
+// the descriptors are [region, server data, client data, server space, client space]
+static local_channel_t *create_channel(socket_t sock, local_region_t *region, const int *descriptors, int server_side)
+{
+    local_channel_t *channel = (local_channel_t *)malloc(sizeof(local_channel_t));
+    if (channel == NULL)
+    {
+        return NULL;
+    }
+
+    channel->socket = sock;
+    channel->region = region;
+    channel->rx = server_side ? &region->to_server : &region->to_client;
+    channel->tx = server_side ? &region->to_client : &region->to_server;
+    channel->rx_data_doorbell = descriptors[server_side ? 1 : 2];
+    channel->tx_data_doorbell = descriptors[server_side ? 2 : 1];
+    channel->tx_space_doorbell = descriptors[server_side ? 3 : 4];
+    channel->rx_space_doorbell = descriptors[server_side ? 4 : 3];
+    atomic_init(&channel->hung_up, 0);
+    atomic_init(&channel->nonblocking, server_side);
+    mutex_init(&channel->send_mutex);
+
+    local_channels[sock] = channel;
+    atomic_fetch_add(&local_channel_count, 1);
+
+    return channel;
+}
+
+static void close_descriptors(int *descriptors, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (descriptors[i] >= 0)
+        {
+            close(descriptors[i]);
+        }
+    }
+}
+
+static int set_local_address(struct sockaddr_un *address, const char *path, error_list_t *error, const char *function_name)
+{
+    if (strlen(path) >= sizeof(address->sun_path))
+    {
+        add_error(error, ERR_LOCAL_TRANSPORT, NON_CRITICAL_ERROR, "Local transport socket path is too long", function_name);
+        return 1;
+    }
+
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, path);
+
+    return 0;
+}
+
+socket_t local_transport_listen(const char *path, error_list_t *error)
+{
+    struct sockaddr_un address;
+    if (set_local_address(&address, path, error, "local_transport_listen") != 0)
+    {
+        return INVALID_SOCK;
+    }
+
+    socket_t listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener == INVALID_SOCK)
+    {
+        add_error(error, map_platform_error(errno), NON_CRITICAL_ERROR, "Failed to create the local transport socket", "local_transport_listen");
+        return INVALID_SOCK;
+    }
+
+    // a room that ran before left its file behind, or one that is handing over to us still listens on it
+    unlink(path);
+
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+    {
+        add_error(error, map_platform_error(errno), NON_CRITICAL_ERROR, "Failed to listen on the local transport socket", "local_transport_listen");
+        close(listener);
+        return INVALID_SOCK;
+    }
+
+    return listener;
+}
+
+void local_transport_close_listener(socket_t listener)
+{
+    if (listener != INVALID_SOCK)
+    {
+        close(listener);
+    }
+}
+
+socket_t local_transport_accept(socket_t listener, const char *port, error_list_t *error)
+{
+    socket_t sock = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+    if (sock == INVALID_SOCK)
+    {
+        // nothing was waiting after all
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            add_error(error, map_platform_error(errno), NON_CRITICAL_ERROR, "Failed to accept a local connection", "local_transport_accept");
+        }
+        return INVALID_SOCK;
+    }
+
+    if (sock >= LOCAL_TRANSPORT_MAX_DESCRIPTOR)
+    {
+        add_error(error, ERR_LOCAL_TRANSPORT, NON_CRITICAL_ERROR, "Too many descriptors are open to take another local connection", "local_transport_accept");
+        close(sock);
+        return INVALID_SOCK;
+    }
+
+    int descriptors[LOCAL_TRANSPORT_DESCRIPTOR_COUNT] = {-1, -1, -1, -1, -1};
+    local_region_t *region = MAP_FAILED;
+
+    descriptors[0] = memfd_create("chat-local-transport", MFD_CLOEXEC);
+    int failed = descriptors[0] < 0 || ftruncate(descriptors[0], sizeof(local_region_t)) != 0;
+    for (int i = 1; i < LOCAL_TRANSPORT_DESCRIPTOR_COUNT && !failed; i++)
+    {
+        descriptors[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        failed = descriptors[i] < 0;
+    }
+    if (!failed)
+    {
+        region = (local_region_t *)mmap(NULL, sizeof(local_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, descriptors[0], 0);
+        failed = region == MAP_FAILED;
+    }
+
+    if (failed)
+    {
+        add_error(error, map_platform_error(errno), NON_CRITICAL_ERROR, "Failed to set up shared memory for a local connection", "local_transport_accept");
+        close_descriptors(descriptors, LOCAL_TRANSPORT_DESCRIPTOR_COUNT);
+        close(sock);
+        return INVALID_SOCK;
+    }
+
+    // the memfd starts zeroed, so both rings are already empty and open
+    region->magic = LOCAL_TRANSPORT_MAGIC;
+    region->version = LOCAL_TRANSPORT_VERSION;
+    region->ring_size = LOCAL_TRANSPORT_RING_SIZE;
+    snprintf(region->port, sizeof(region->port), "%s", port);
+
+    local_hello_t hello;
+    hello.magic = LOCAL_TRANSPORT_MAGIC;
+    hello.version = LOCAL_TRANSPORT_VERSION;
+    hello.region_size = (uint32_t)sizeof(local_region_t);
+
+    struct iovec iov;
+    iov.iov_base = &hello;
+    iov.iov_len = sizeof(hello);
+
+    union
+    {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(descriptors))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(descriptors));
+    memcpy(CMSG_DATA(header), descriptors, sizeof(descriptors));
+
+    // a fresh socket's buffer always takes the hello, a client that isn't reading yet doesn't hold up the accept loop
+    if (sendmsg(sock, &message, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)sizeof(hello))
+    {
+        add_error(error, map_platform_error(errno), NON_CRITICAL_ERROR, "Failed to hand a local connection its shared memory", "local_transport_accept");
+        munmap(region, sizeof(local_region_t));
+        close_descriptors(descriptors, LOCAL_TRANSPORT_DESCRIPTOR_COUNT);
+        close(sock);
+        return INVALID_SOCK;
+    }
+
+    // the mapping keeps the region alive, the memfd itself is the client's now
+    close(descriptors[0]);
+
+    if (create_channel(sock, region, descriptors, 1) == NULL)
+    {
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for a local connection", "local_transport_accept");
+        munmap(region, sizeof(local_region_t));
+        close_descriptors(descriptors + 1, LOCAL_TRANSPORT_DESCRIPTOR_COUNT - 1);
+        close(sock);
+        return INVALID_SOCK;
+    }
+
+    return sock;
+}
+
+socket_t local_transport_connect(const char *path, char *port, size_t port_size, error_list_t *error)
+{
+    struct sockaddr_un address;
+    if (set_local_address(&address, path, error, "local_transport_connect") != 0)
+    {
+        return INVALID_SOCK;
+    }
+
+    socket_t sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == INVALID_SOCK)
+    {
+        add_error(error, map_platform_error(errno), CRITICAL_ERROR, "Failed to create the local transport socket", "local_transport_connect");
+        return INVALID_SOCK;
+    }
+
+    if (connect(sock, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        add_error(error, map_platform_error(errno), CRITICAL_ERROR, "Failed to reach the room over its local transport socket", "local_transport_connect");
+        close(sock);
+        return INVALID_SOCK;
+    }
+
+    if (sock >= LOCAL_TRANSPORT_MAX_DESCRIPTOR)
+    {
+        add_error(error, ERR_LOCAL_TRANSPORT, CRITICAL_ERROR, "Too many descriptors are open for a local connection", "local_transport_connect");
+        close(sock);
+        return INVALID_SOCK;
+    }
+
+    struct pollfd hello_fd;
+    hello_fd.fd = sock;
+    hello_fd.events = POLLIN;
+    hello_fd.revents = 0;
+
+    local_hello_t hello;
+    int descriptors[LOCAL_TRANSPORT_DESCRIPTOR_COUNT] = {-1, -1, -1, -1, -1};
+
+    struct iovec iov;
+    iov.iov_base = &hello;
+    iov.iov_len = sizeof(hello);
+
+    union
+    {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(descriptors))];
+    } control;
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    ssize_t received = -1;
+    if (poll(&hello_fd, 1, LOCAL_TRANSPORT_HANDSHAKE_TIMEOUT_MS) == 1)
+    {
+        received = recvmsg(sock, &message, MSG_CMSG_CLOEXEC);
+    }
+
+    struct cmsghdr *header = received == (ssize_t)sizeof(hello) ? CMSG_FIRSTHDR(&message) : NULL;
+    if (header != NULL && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS && header->cmsg_len == CMSG_LEN(sizeof(descriptors)))
+    {
+        memcpy(descriptors, CMSG_DATA(header), sizeof(descriptors));
+    }
+
+    if (descriptors[0] < 0 || hello.magic != LOCAL_TRANSPORT_MAGIC || hello.version != LOCAL_TRANSPORT_VERSION || hello.region_size != sizeof(local_region_t))
+    {
+        add_error(error, ERR_LOCAL_TRANSPORT, CRITICAL_ERROR, "The room's local transport handshake failed or comes from a different build", "local_transport_connect");
+        close_descriptors(descriptors, LOCAL_TRANSPORT_DESCRIPTOR_COUNT);
+        close(sock);
+        return INVALID_SOCK;
+    }
+
+    local_region_t *region = (local_region_t *)mmap(NULL, sizeof(local_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, descriptors[0], 0);
+    close(descriptors[0]);
+    if (region == MAP_FAILED)
+    {
+        add_error(error, map_platform_error(errno), CRITICAL_ERROR, "Failed to map the room's shared memory", "local_transport_connect");
+        close_descriptors(descriptors + 1, LOCAL_TRANSPORT_DESCRIPTOR_COUNT - 1);
+        close(sock);
+        return INVALID_SOCK;
+    }
+
+    snprintf(port, port_size, "%s", region->port);
+
+    if (create_channel(sock, region, descriptors, 0) == NULL)
+    {
+        add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for a local connection", "local_transport_connect");
+        munmap(region, sizeof(local_region_t));
+        close_descriptors(descriptors + 1, LOCAL_TRANSPORT_DESCRIPTOR_COUNT - 1);
+        close(sock);
+        return INVALID_SOCK;
+    }
+
+    return sock;
+}
+
+#endif
\ No newline at end of file
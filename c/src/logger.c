@@ -0,0 +1,554 @@
+#include "../include/logger.h"
+
+static atomic_int logger_running = ATOMIC_VAR_INIT(0);
+static atomic_int logger_min_level = ATOMIC_VAR_INIT(LOG_LEVEL_INFO);
+static atomic_ullong dropped_records = ATOMIC_VAR_INIT(0);
+
+static log_ring_t *_Atomic rings[LOG_MAX_RINGS];
+static atomic_int ring_count = ATOMIC_VAR_INIT(0);
+static THREAD_LOCAL log_ring_t *thread_ring = NULL;
+// hands a thread's ring back when the thread exits, JVM threads never get to call logger_thread_detach
+static thread_once_t ring_key_once = THREAD_ONCE_INIT;
+static thread_key_t ring_key;
+static int ring_key_ready = 0;
+
+static thread_t writer_thread;
+static mutex_t writer_mutex;
+static cond_t writer_cond;
+static uint64_t logger_started_ms = 0;
+
+// only touched by the writer thread
+static log_rate_slot_t rate_slots[LOG_RATE_LIMIT_SLOTS];
+
+static const char *log_level_names[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+
+int logger_start(log_level_t min_level, error_list_t *error)
+{
+    if (atomic_load(&logger_running))
+    {
+        return 0;
+    }
+
+    atomic_store(&logger_min_level, min_level);
+    logger_started_ms = cross_platform_monotonic_ms();
+    memset(rate_slots, 0, sizeof(rate_slots));
+
+    mutex_init(&writer_mutex);
+    cond_init(&writer_cond);
+
+    atomic_store(&logger_running, 1);
+
+    if (thread_create(&writer_thread, logger_writer_thread, NULL) != 0)
+    {
+        atomic_store(&logger_running, 0);
+        add_error(error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create logger writer thread", "logger_start");
+        return 1;
+    }
+
+    return 0;
+}
+
+void logger_stop(void)
+{
+    if (!atomic_load(&logger_running))
+    {
+        return;
+    }
+
+    atomic_store(&logger_running, 0);
+
+    mutex_lock(&writer_mutex);
+    cond_signal(&writer_cond);
+    mutex_unlock(&writer_mutex);
+
+    // the writer drains every ring before it exits, the rings themselves stay around for threads still holding one
+    thread_join(writer_thread);
+}
+
+int logger_is_running(void)
+{
+    return atomic_load(&logger_running);
+}
+
+void logger_set_level(log_level_t min_level)
+{
+    atomic_store(&logger_min_level, min_level);
+}
+
+uint64_t logger_dropped_count(void)
+{
+    return atomic_load(&dropped_records);
+}
+
+static void THREAD_KEY_CALL release_thread_ring(void *ring)
+{
+    atomic_store(&((log_ring_t *)ring)->in_use, 0);
+    thread_ring = NULL;
+}
+
+static void create_ring_key(void)
+{
+    ring_key_ready = thread_key_create(&ring_key, release_thread_ring) == 0;
+}
+
+static log_ring_t *claim_ring(log_ring_t *ring)
+{
+    thread_ring = ring;
+    if (ring_key_ready)
+    {
+        thread_key_set(ring_key, ring);
+    }
+    return ring;
+}
+
+static log_ring_t *acquire_thread_ring(void)
+{
+    if (thread_ring != NULL)
+    {
+        return thread_ring;
+    }
+
+    thread_once(&ring_key_once, create_ring_key);
+
+    // reuse a ring left behind by a finished thread before allocating a new one
+    int count = atomic_load(&ring_count);
+    for (int i = 0; i < count && i < LOG_MAX_RINGS; i++)
+    {
+        log_ring_t *ring = atomic_load(&rings[i]);
+        int expected = 0;
+        if (ring != NULL && atomic_compare_exchange_strong(&ring->in_use, &expected, 1))
+        {
+            return claim_ring(ring);
+        }
+    }
+
+    int index = atomic_fetch_add(&ring_count, 1);
+    if (index >= LOG_MAX_RINGS)
+    {
+        atomic_fetch_sub(&ring_count, 1);
+        return NULL;
+    }
+
+    log_ring_t *ring = (log_ring_t *)calloc(1, sizeof(log_ring_t));
+    if (ring == NULL)
+    {
+        return NULL;
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->in_use, 1);
+    atomic_store(&rings[index], ring);
+
+    return claim_ring(ring);
+}
+
+void logger_thread_detach(void)
+{
+    if (thread_ring != NULL)
+    {
+        if (ring_key_ready)
+        {
+            thread_key_set(ring_key, NULL);
+        }
+        release_thread_ring(thread_ring);
+    }
+}
+
+static log_record_t *reserve_records(log_ring_t *ring, size_t count, size_t *tail)
+{
+    *tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (LOG_RING_CAPACITY - (*tail - head) < count)
+    {
+        return NULL;
+    }
+
+    return &ring->records[*tail & (LOG_RING_CAPACITY - 1)];
+}
+
+static void publish_records(log_ring_t *ring, size_t tail, size_t count)
+{
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+}
+
+static void capture_event_args(log_record_t *record, va_list args)
+{
+    record->arg_count = 0;
+    record->args_length = 0;
+
+    // only the arguments are copied here, turning them into text is left to the writer thread
+    for (const char *c = record->format; *c != '\0' && record->arg_count < LOG_MAX_ARGS; c++)
+    {
+        if (*c != '%')
+        {
+            continue;
+        }
+
+        c++;
+        if (*c == 's')
+        {
+            const char *value = va_arg(args, const char *);
+            size_t space = LOG_ARGS_SIZE - record->args_length;
+            size_t length = strlen(value);
+            if (space == 0)
+            {
+                break;
+            }
+            if (length >= space)
+            {
+                length = space - 1;
+            }
+
+            memcpy(record->payload.args + record->args_length, value, length);
+            record->payload.args[record->args_length + length] = '\0';
+            record->args_length += length + 1;
+            record->arg_types[record->arg_count++] = LOG_ARG_STRING;
+        }
+        else if (*c == 'd')
+        {
+            long long value = va_arg(args, int);
+            if (LOG_ARGS_SIZE - record->args_length < sizeof(value))
+            {
+                break;
+            }
+
+            memcpy(record->payload.args + record->args_length, &value, sizeof(value));
+            record->args_length += sizeof(value);
+            record->arg_types[record->arg_count++] = LOG_ARG_INT;
+        }
+        else if (*c == '\0')
+        {
+            break;
+        }
+    }
+}
+
+static size_t render_event(const log_record_t *record, char *buffer, size_t buffer_size)
+{
+    size_t length = 0;
+    size_t args_offset = 0;
+    int arg_index = 0;
+
+    for (const char *c = record->format; *c != '\0' && length < buffer_size - 1; c++)
+    {
+        if (*c == '%' && (c[1] == 's' || c[1] == 'd') && arg_index < record->arg_count)
+        {
+            c++;
+            if (record->arg_types[arg_index] == LOG_ARG_STRING)
+            {
+                const char *value = record->payload.args + args_offset;
+                size_t value_length = strlen(value);
+                args_offset += value_length + 1;
+
+                int written = snprintf(buffer + length, buffer_size - length, "%s", value);
+                length += (size_t)written < buffer_size - length ? (size_t)written : buffer_size - 1 - length;
+            }
+            else
+            {
+                long long value;
+                memcpy(&value, record->payload.args + args_offset, sizeof(value));
+                args_offset += sizeof(value);
+
+                int written = snprintf(buffer + length, buffer_size - length, "%lld", value);
+                length += (size_t)written < buffer_size - length ? (size_t)written : buffer_size - 1 - length;
+            }
+            arg_index++;
+            continue;
+        }
+
+        if (*c == '%' && c[1] == '%')
+        {
+            c++;
+        }
+
+        buffer[length++] = *c;
+    }
+
+    buffer[length] = '\0';
+    return length;
+}
+
+static void write_line(uint64_t timestamp_ms, log_level_t level, const char *location, const char *text)
+{
+    uint64_t elapsed_ms = timestamp_ms - logger_started_ms;
+    fprintf(stdout, "[%llu.%03llu] %s %s: %s\n", (unsigned long long)(elapsed_ms / 1000), (unsigned long long)(elapsed_ms % 1000), log_level_names[level], location, text);
+}
+
+void log_event(log_level_t level, const char *location, const char *format, ...)
+{
+    if (level < (log_level_t)atomic_load(&logger_min_level))
+    {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+
+    if (!atomic_load(&logger_running))
+    {
+        // nothing to hand the event to, format it right here
+        log_record_t record;
+        char text[LOG_LINE_SIZE];
+
+        record.format = format;
+        capture_event_args(&record, args);
+        render_event(&record, text, sizeof(text));
+        fprintf(stdout, "%s %s: %s\n", log_level_names[level], location, text);
+        fflush(stdout);
+
+        va_end(args);
+        return;
+    }
+
+    log_ring_t *ring = acquire_thread_ring();
+    size_t tail;
+    log_record_t *record = ring != NULL ? reserve_records(ring, 1, &tail) : NULL;
+    if (record == NULL)
+    {
+        // logging never waits for the writer, a full ring costs the event
+        atomic_fetch_add(&dropped_records, 1);
+        va_end(args);
+        return;
+    }
+
+    record->timestamp_ms = cross_platform_monotonic_ms();
+    record->level = level;
+    record->kind = LOG_RECORD_EVENT;
+    record->location = location;
+    record->format = format;
+    record->batch_remaining = 0;
+    capture_event_args(record, args);
+
+    publish_records(ring, tail, 1);
+
+    va_end(args);
+}
+
+void log_errors(const error_list_t *error)
+{
+    if (!atomic_load(&logger_running) || error->count == 0)
+    {
+        return;
+    }
+
+    size_t count = (size_t)error->count;
+    log_ring_t *ring = acquire_thread_ring();
+    size_t tail = 0;
+    log_record_t *first = ring != NULL ? reserve_records(ring, count, &tail) : NULL;
+
+    if (first == NULL)
+    {
+        // only the log line is lost, the callback still got the report
+        atomic_fetch_add(&dropped_records, count);
+        return;
+    }
+
+    uint64_t timestamp_ms = cross_platform_monotonic_ms();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        log_record_t *record = &ring->records[(tail + i) & (LOG_RING_CAPACITY - 1)];
+
+        record->timestamp_ms = timestamp_ms;
+        record->level = error->errors[i].severity == CRITICAL_ERROR ? LOG_LEVEL_ERROR : LOG_LEVEL_WARNING;
+        record->kind = LOG_RECORD_ERROR;
+        record->location = error->errors[i].location;
+        record->format = error->errors[i].message;
+        record->batch_remaining = (int)(count - 1 - i);
+        record->arg_count = 0;
+        record->args_length = 0;
+        record->payload.error.detail = error->errors[i];
+        snprintf(record->payload.error.subject, sizeof(record->payload.error.subject), "%s", error_subject(error, &error->errors[i]));
+    }
+
+    publish_records(ring, tail, count);
+}
+
+static void write_suppressed_summary(log_rate_slot_t *slot, uint64_t now_ms)
+{
+    char text[128];
+    snprintf(text, sizeof(text), "suppressed %d repeats in the last %llu ms", slot->suppressed, (unsigned long long)(now_ms - slot->window_start_ms));
+    write_line(now_ms, slot->level, slot->key_location, text);
+    slot->suppressed = 0;
+}
+
+static int rate_limit_allows(const char *location, const void *format, int code, log_level_t level, uint64_t now_ms)
+{
+    uintptr_t hash = ((uintptr_t)location * 31u) ^ ((uintptr_t)format * 17u) ^ (uintptr_t)code;
+    log_rate_slot_t *slot = &rate_slots[(hash >> 3) % LOG_RATE_LIMIT_SLOTS];
+
+    if (slot->key_location != location || slot->key_format != format || slot->key_code != code)
+    {
+        if (slot->suppressed > 0)
+        {
+            write_suppressed_summary(slot, now_ms);
+        }
+
+        slot->key_location = location;
+        slot->key_format = format;
+        slot->key_code = code;
+        slot->level = level;
+        slot->window_start_ms = now_ms;
+        slot->count = 0;
+    }
+    else if (now_ms - slot->window_start_ms >= LOG_RATE_LIMIT_WINDOW_MS)
+    {
+        if (slot->suppressed > 0)
+        {
+            write_suppressed_summary(slot, now_ms);
+        }
+
+        slot->window_start_ms = now_ms;
+        slot->count = 0;
+    }
+
+    if (slot->count < LOG_RATE_LIMIT_BURST)
+    {
+        slot->count++;
+        return 1;
+    }
+
+    slot->suppressed++;
+    return 0;
+}
+
+static void flush_rate_limit_windows(uint64_t now_ms)
+{
+    for (size_t i = 0; i < LOG_RATE_LIMIT_SLOTS; i++)
+    {
+        log_rate_slot_t *slot = &rate_slots[i];
+        if (slot->suppressed > 0 && now_ms - slot->window_start_ms >= LOG_RATE_LIMIT_WINDOW_MS)
+        {
+            write_suppressed_summary(slot, now_ms);
+            slot->window_start_ms = now_ms;
+            slot->count = 0;
+        }
+    }
+}
+
+static void write_error_batch(const log_ring_t *ring, size_t head, size_t count)
+{
+    const log_record_t *first = &ring->records[head & (LOG_RING_CAPACITY - 1)];
+    int critical = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        critical |= ring->records[(head + i) & (LOG_RING_CAPACITY - 1)].level == LOG_LEVEL_ERROR;
+    }
+
+    // only the log output is limited, the callback already got every report on the raising thread.
+    // critical errors are always written
+    if (!critical &&
+        !rate_limit_allows(first->location, first->format, first->payload.error.detail.code, first->level, cross_platform_monotonic_ms()))
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const log_record_t *record = &ring->records[(head + i) & (LOG_RING_CAPACITY - 1)];
+        const error_detail_t *detail = &record->payload.error.detail;
+        char text[LOG_LINE_SIZE];
+
+        format_error_message(detail->message, record->payload.error.subject, text, sizeof(text));
+        size_t length = strlen(text);
+        snprintf(text + length, sizeof(text) - length, " (Code: %s)", error_code_name(detail->code));
+        write_line(record->timestamp_ms, record->level, record->location, text);
+    }
+}
+
+static size_t drain_ring(log_ring_t *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t drained = tail - head;
+
+    while (head != tail)
+    {
+        const log_record_t *record = &ring->records[head & (LOG_RING_CAPACITY - 1)];
+
+        if (record->kind == LOG_RECORD_ERROR)
+        {
+            // a batch is published in one go, all of it is already in the ring
+            size_t count = (size_t)record->batch_remaining + 1;
+            write_error_batch(ring, head, count);
+            head += count;
+        }
+        else
+        {
+            if (rate_limit_allows(record->location, record->format, -1, record->level, record->timestamp_ms))
+            {
+                char text[LOG_LINE_SIZE];
+                render_event(record, text, sizeof(text));
+                write_line(record->timestamp_ms, record->level, record->location, text);
+            }
+            head++;
+        }
+
+        // hand the slots back as soon as possible so producers don't hit a full ring
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+    }
+
+    return drained;
+}
+
+thread_ret_t THREAD_CALL logger_writer_thread(void *arg)
+{
+    (void)arg;
+    uint64_t reported_drops = 0;
+
+    while (1)
+    {
+        int running = atomic_load(&logger_running);
+        size_t drained = 0;
+
+        int count = atomic_load(&ring_count);
+        for (int i = 0; i < count && i < LOG_MAX_RINGS; i++)
+        {
+            log_ring_t *ring = atomic_load(&rings[i]);
+            if (ring != NULL)
+            {
+                drained += drain_ring(ring);
+            }
+        }
+
+        uint64_t now_ms = cross_platform_monotonic_ms();
+        flush_rate_limit_windows(now_ms);
+
+        uint64_t drops = atomic_load(&dropped_records);
+        if (drops != reported_drops)
+        {
+            char text[64];
+            snprintf(text, sizeof(text), "dropped %llu records, the rings were full", (unsigned long long)(drops - reported_drops));
+            write_line(now_ms, LOG_LEVEL_WARNING, "logger_writer_thread", text);
+            reported_drops = drops;
+        }
+
+        if (drained > 0)
+        {
+            fflush(stdout);
+            continue;
+        }
+
+        if (!running)
+        {
+            break;
+        }
+
+        mutex_lock(&writer_mutex);
+        if (atomic_load(&logger_running))
+        {
+            cond_timedwait(&writer_cond, &writer_mutex, LOG_FLUSH_INTERVAL_MS);
+        }
+        mutex_unlock(&writer_mutex);
+    }
+
+    fflush(stdout);
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
\ No newline at end of file
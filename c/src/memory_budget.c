@@ -0,0 +1,67 @@
+#include "../include/memory_budget.h"
+
+static atomic_size_t memory_budget = ATOMIC_VAR_INIT(MEMORY_BUDGET_DEFAULT);
+static atomic_size_t memory_total = ATOMIC_VAR_INIT(0);
+static atomic_size_t memory_used[MEMORY_CATEGORY_COUNT];
+
+static const char *memory_category_names[MEMORY_CATEGORY_COUNT] = {
+    [MEMORY_CONNECTION] = "connection_state",
+    [MEMORY_STACK] = "stacks",
+    [MEMORY_OUTBOX] = "outboxes",
+    [MEMORY_INBOX] = "inboxes",
+};
+
+void memory_budget_set(size_t budget)
+{
+    atomic_store(&memory_budget, budget);
+}
+
+size_t memory_budget_get(void)
+{
+    return atomic_load(&memory_budget);
+}
+
+int memory_budget_try_charge(memory_category_t category, size_t bytes)
+{
+    size_t budget = atomic_load(&memory_budget);
+    size_t total = atomic_load(&memory_total);
+
+    // the check and the charge are one step, two connections can't both take the last of the budget
+    do
+    {
+        if (budget != 0 && (total > budget || bytes > budget - total))
+        {
+            return 1;
+        }
+    } while (!atomic_compare_exchange_weak(&memory_total, &total, total + bytes));
+
+    atomic_fetch_add(&memory_used[category], bytes);
+    return 0;
+}
+
+void memory_budget_charge(memory_category_t category, size_t bytes)
+{
+    atomic_fetch_add(&memory_total, bytes);
+    atomic_fetch_add(&memory_used[category], bytes);
+}
+
+void memory_budget_release(memory_category_t category, size_t bytes)
+{
+    atomic_fetch_sub(&memory_used[category], bytes);
+    atomic_fetch_sub(&memory_total, bytes);
+}
+
+size_t memory_budget_used(memory_category_t category)
+{
+    return atomic_load(&memory_used[category]);
+}
+
+size_t memory_budget_total(void)
+{
+    return atomic_load(&memory_total);
+}
+
+const char *memory_budget_category_name(memory_category_t category)
+{
+    return memory_category_names[category];
+}
\ No newline at end of file
@@ -0,0 +1,376 @@
+#include "../include/presence.h"
+
+static presence_table_t presence_tables[2];
+static presence_table_t *active_table = &presence_tables[0];
+static presence_table_t *flushing_table = &presence_tables[1];
+static mutex_t presence_mutex;
+static mutex_t presence_flush_mutex;
+static cond_t presence_cond;
+static atomic_int presence_running = ATOMIC_VAR_INIT(0);
+static thread_t presence_thread;
+static void (*presence_broadcast_frame)(const char *, size_t) = NULL;
+
+static unsigned long hash_username(const char *username)
+{
+    // FNV-1a
+    unsigned long hash = 2166136261UL;
+    for (const unsigned char *c = (const unsigned char *)username; *c != '\0'; ++c)
+    {
+        hash ^= *c;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+static presence_entry_t *find_entry(presence_table_t *table, const char *username)
+{
+    size_t slot = hash_username(username) & (PRESENCE_TABLE_SIZE - 1);
+
+    while (table->entries[slot].in_use)
+    {
+        if (strcmp(table->entries[slot].username, username) == 0)
+        {
+            return &table->entries[slot];
+        }
+        slot = (slot + 1) & (PRESENCE_TABLE_SIZE - 1);
+    }
+
+    return NULL;
+}
+
+static presence_entry_t *find_or_insert_entry(presence_table_t *table, const char *username, int was_present)
+{
+    size_t slot = hash_username(username) & (PRESENCE_TABLE_SIZE - 1);
+
+    while (table->entries[slot].in_use)
+    {
+        if (strcmp(table->entries[slot].username, username) == 0)
+        {
+            return &table->entries[slot];
+        }
+        slot = (slot + 1) & (PRESENCE_TABLE_SIZE - 1);
+    }
+
+    presence_entry_t *entry = &table->entries[slot];
+    strncpy(entry->username, username, sizeof(entry->username) - 1);
+    entry->username[sizeof(entry->username) - 1] = '\0';
+    entry->previous_username[0] = '\0';
+    entry->member_id = 0;
+    entry->previous_member_id = 0;
+    entry->in_use = 1;
+    entry->consumed = 0;
+    entry->was_present = was_present;
+    entry->is_present = was_present;
+
+    table->order[table->count++] = slot;
+
+    return entry;
+}
+
+// returns with presence_mutex held and room for at least two more names in the active table
+static void lock_active_table(void)
+{
+    mutex_lock(&presence_mutex);
+
+    while (active_table->count + 2 > PRESENCE_TABLE_SIZE / 2)
+    {
+        mutex_unlock(&presence_mutex);
+        presence_flush();
+        mutex_lock(&presence_mutex);
+    }
+
+    if (active_table->count == 0)
+    {
+        cond_signal(&presence_cond);
+    }
+}
+
+int presence_start(void (*broadcast_frame_func)(const char *, size_t), error_list_t *error)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        presence_tables[i].entries = (presence_entry_t *)calloc(PRESENCE_TABLE_SIZE, sizeof(presence_entry_t));
+        presence_tables[i].order = (size_t *)malloc(PRESENCE_TABLE_SIZE * sizeof(size_t));
+        presence_tables[i].count = 0;
+
+        if (presence_tables[i].entries == NULL || presence_tables[i].order == NULL)
+        {
+            add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for presence tables", "presence_start");
+            for (int j = 0; j <= i; j++)
+            {
+                free(presence_tables[j].entries);
+                free(presence_tables[j].order);
+                presence_tables[j].entries = NULL;
+                presence_tables[j].order = NULL;
+            }
+            return 1;
+        }
+    }
+
+    active_table = &presence_tables[0];
+    flushing_table = &presence_tables[1];
+    presence_broadcast_frame = broadcast_frame_func;
+
+    mutex_init(&presence_mutex);
+    mutex_init(&presence_flush_mutex);
+    cond_init(&presence_cond);
+
+    atomic_store(&presence_running, 1);
+
+    if (thread_create(&presence_thread, presence_flush_thread, NULL) != 0)
+    {
+        atomic_store(&presence_running, 0);
+        add_error(error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create presence flush thread", "presence_start");
+        for (int i = 0; i < 2; i++)
+        {
+            free(presence_tables[i].entries);
+            free(presence_tables[i].order);
+            presence_tables[i].entries = NULL;
+            presence_tables[i].order = NULL;
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+void presence_stop(void)
+{
+    if (!atomic_load(&presence_running))
+    {
+        return;
+    }
+
+    mutex_lock(&presence_mutex);
+    atomic_store(&presence_running, 0);
+    cond_broadcast(&presence_cond);
+    mutex_unlock(&presence_mutex);
+
+    thread_join(presence_thread);
+
+    for (int i = 0; i < 2; i++)
+    {
+        free(presence_tables[i].entries);
+        free(presence_tables[i].order);
+        presence_tables[i].entries = NULL;
+        presence_tables[i].order = NULL;
+        presence_tables[i].count = 0;
+    }
+}
+
+static void record_departure(presence_entry_t *entry, uint32_t member_id)
+{
+    entry->is_present = 0;
+    if (entry->was_present && entry->previous_member_id == 0)
+    {
+        entry->previous_member_id = member_id;
+    }
+}
+
+void presence_record_join(const char *username, uint32_t member_id)
+{
+    if (!atomic_load(&presence_running))
+    {
+        return;
+    }
+
+    lock_active_table();
+    presence_entry_t *entry = find_or_insert_entry(active_table, username, 0);
+    entry->is_present = 1;
+    entry->member_id = member_id;
+    mutex_unlock(&presence_mutex);
+}
+
+void presence_record_leave(const char *username, uint32_t member_id)
+{
+    if (!atomic_load(&presence_running))
+    {
+        return;
+    }
+
+    lock_active_table();
+    record_departure(find_or_insert_entry(active_table, username, 1), member_id);
+    mutex_unlock(&presence_mutex);
+}
+
+void presence_record_rename(const char *old_username, const char *new_username, uint32_t member_id)
+{
+    if (!atomic_load(&presence_running))
+    {
+        return;
+    }
+
+    lock_active_table();
+
+    record_departure(find_or_insert_entry(active_table, old_username, 1), member_id);
+
+    presence_entry_t *entry = find_or_insert_entry(active_table, new_username, 0);
+    entry->is_present = 1;
+    entry->member_id = member_id;
+    strncpy(entry->previous_username, old_username, sizeof(entry->previous_username) - 1);
+    entry->previous_username[sizeof(entry->previous_username) - 1] = '\0';
+
+    mutex_unlock(&presence_mutex);
+}
+
+static void emit_frame(char *frame, size_t *frame_length)
+{
+    if (*frame_length > 1)
+    {
+        presence_broadcast_frame(frame, *frame_length + 1);
+    }
+
+    snprintf(frame, MAX_BUFFER_SIZE, "%d", MSG_TYPE_PRESENCE);
+    *frame_length = strlen(frame);
+}
+
+// an ID entry and the entry it belongs to, or nothing if both don't fit
+static size_t append_entries(char *frame, size_t frame_length, uint32_t member_id, char op, const char *username)
+{
+    if (member_id != 0)
+    {
+        frame_length = append_member_id_entry(frame, frame_length, MAX_BUFFER_SIZE, member_id);
+        if (frame_length == 0)
+        {
+            return 0;
+        }
+    }
+
+    return append_presence_entry(frame, frame_length, MAX_BUFFER_SIZE, op, username);
+}
+
+static void append_entry(char *frame, size_t *frame_length, uint32_t member_id, char op, const char *username)
+{
+    size_t new_length = append_entries(frame, *frame_length, member_id, op, username);
+
+    if (new_length == 0)
+    {
+        frame[*frame_length] = '\0';
+        emit_frame(frame, frame_length);
+        new_length = append_entries(frame, *frame_length, member_id, op, username);
+    }
+
+    *frame_length = new_length;
+}
+
+void presence_flush(void)
+{
+    // the tables only exist while presence runs, a hot upgrade flushes whether it does or not
+    if (!atomic_load(&presence_running))
+    {
+        return;
+    }
+
+    mutex_lock(&presence_flush_mutex);
+
+    mutex_lock(&presence_mutex);
+    presence_table_t *table = active_table;
+    active_table = flushing_table;
+    flushing_table = table;
+    mutex_unlock(&presence_mutex);
+
+    if (table->count == 0)
+    {
+        mutex_unlock(&presence_flush_mutex);
+        return;
+    }
+
+    char frame[MAX_BUFFER_SIZE];
+    size_t frame_length = 0;
+    emit_frame(frame, &frame_length);
+
+    // renames first, so the old name isn't announced as a separate leave
+    for (size_t i = 0; i < table->count; i++)
+    {
+        presence_entry_t *entry = &table->entries[table->order[i]];
+        if (entry->previous_username[0] == '\0' || entry->was_present || !entry->is_present)
+        {
+            continue;
+        }
+
+        presence_entry_t *previous_entry = find_entry(table, entry->previous_username);
+        if (previous_entry == NULL || previous_entry->consumed || !previous_entry->was_present || previous_entry->is_present)
+        {
+            continue;
+        }
+
+        // both halves of a rename (and the ID between them) have to land in the same frame
+        size_t pair_length = append_presence_entry(frame, frame_length, MAX_BUFFER_SIZE, PRESENCE_OP_RENAME_FROM, previous_entry->username);
+        if (pair_length != 0)
+        {
+            pair_length = append_entries(frame, pair_length, entry->member_id, PRESENCE_OP_RENAME_TO, entry->username);
+        }
+        if (pair_length == 0)
+        {
+            frame[frame_length] = '\0';
+            emit_frame(frame, &frame_length);
+            pair_length = append_presence_entry(frame, frame_length, MAX_BUFFER_SIZE, PRESENCE_OP_RENAME_FROM, previous_entry->username);
+            pair_length = append_entries(frame, pair_length, entry->member_id, PRESENCE_OP_RENAME_TO, entry->username);
+        }
+        frame_length = pair_length;
+
+        entry->consumed = 1;
+        previous_entry->consumed = 1;
+    }
+
+    for (size_t i = 0; i < table->count; i++)
+    {
+        presence_entry_t *entry = &table->entries[table->order[i]];
+        if (entry->consumed)
+        {
+            continue;
+        }
+
+        if (entry->was_present != entry->is_present)
+        {
+            append_entry(frame, &frame_length, entry->is_present ? entry->member_id : entry->previous_member_id, entry->is_present ? PRESENCE_OP_JOIN : PRESENCE_OP_LEAVE, entry->username);
+        }
+        else if (entry->is_present && entry->member_id != 0 && entry->member_id != entry->previous_member_id)
+        {
+            // left and came back under the same name within the window, the list is unchanged but the ID is new
+            append_entry(frame, &frame_length, entry->member_id, PRESENCE_OP_ALIAS, entry->username);
+        }
+    }
+
+    emit_frame(frame, &frame_length);
+
+    for (size_t i = 0; i < table->count; i++)
+    {
+        table->entries[table->order[i]].in_use = 0;
+    }
+    table->count = 0;
+
+    mutex_unlock(&presence_flush_mutex);
+}
+
+thread_ret_t THREAD_CALL presence_flush_thread(void *arg)
+{
+    (void)arg;
+
+    while (atomic_load(&presence_running))
+    {
+        mutex_lock(&presence_mutex);
+        while (active_table->count == 0 && atomic_load(&presence_running))
+        {
+            cond_timedwait(&presence_cond, &presence_mutex, 1000);
+        }
+
+        // give the rest of a burst the chance to land in the same batch
+        if (atomic_load(&presence_running))
+        {
+            cond_timedwait(&presence_cond, &presence_mutex, PRESENCE_COALESCE_WINDOW_MS);
+        }
+        mutex_unlock(&presence_mutex);
+
+        if (atomic_load(&presence_running))
+        {
+            presence_flush();
+        }
+    }
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,369 @@
+#include "../include/public_ip.h"
+
+static thread_once_t public_ip_once = THREAD_ONCE_INIT;
+static mutex_t public_ip_mutex;
+static cond_t public_ip_cond;
+
+static public_ip_provider_t providers[PUBLIC_IP_MAX_PROVIDERS];
+static size_t provider_count = 0;
+
+static char cached_ip[INET_ADDRSTRLEN];
+static int cache_valid = 0;
+static uint64_t cached_at_ms = 0;
+
+// every discovery is a round, answers from an older round's stragglers are ignored
+static unsigned long discovery_round = 0;
+static int discovery_in_flight = 0;
+static uint64_t discovery_started_ms = 0;
+static size_t pending_queries = 0;
+
+static int parse_public_ip_providers(const char *provider_list, public_ip_provider_t *parsed, size_t *parsed_count)
+{
+    *parsed_count = 0;
+
+    const char *entry = provider_list;
+    while (*entry != '\0' && *parsed_count < PUBLIC_IP_MAX_PROVIDERS)
+    {
+        const char *entry_end = strchr(entry, ',');
+        if (entry_end == NULL)
+        {
+            entry_end = entry + strlen(entry);
+        }
+
+        const char *path_start = memchr(entry, '/', (size_t)(entry_end - entry));
+        const char *host_end = path_start != NULL ? path_start : entry_end;
+        const char *port_start = memchr(entry, ':', (size_t)(host_end - entry));
+        if (port_start != NULL)
+        {
+            host_end = port_start++;
+        }
+
+        size_t host_length = (size_t)(host_end - entry);
+        size_t port_length = port_start != NULL ? (size_t)((path_start != NULL ? path_start : entry_end) - port_start) : 0;
+        size_t path_length = path_start != NULL ? (size_t)(entry_end - path_start) : 0;
+
+        if (host_length == 0 || host_length >= PUBLIC_IP_HOST_BUFFER_SIZE || port_length >= PUBLIC_IP_PORT_BUFFER_SIZE || path_length >= PUBLIC_IP_PATH_BUFFER_SIZE)
+        {
+            return 1;
+        }
+
+        public_ip_provider_t *provider = &parsed[(*parsed_count)++];
+        memcpy(provider->host, entry, host_length);
+        provider->host[host_length] = '\0';
+
+        if (port_length > 0)
+        {
+            memcpy(provider->port, port_start, port_length);
+            provider->port[port_length] = '\0';
+        }
+        else
+        {
+            strcpy(provider->port, PUBLIC_IP_DEFAULT_PORT);
+        }
+
+        if (path_length > 0)
+        {
+            memcpy(provider->path, path_start, path_length);
+            provider->path[path_length] = '\0';
+        }
+        else
+        {
+            strcpy(provider->path, "/");
+        }
+
+        entry = *entry_end == ',' ? entry_end + 1 : entry_end;
+    }
+
+    return *parsed_count == 0;
+}
+
+static void public_ip_init_once(void)
+{
+    mutex_init(&public_ip_mutex);
+    cond_init(&public_ip_cond);
+    parse_public_ip_providers(PUBLIC_IP_DEFAULT_PROVIDERS, providers, &provider_count);
+}
+
+static void public_ip_init(void)
+{
+    // a thread that arrives while another initializes sleeps until it is done
+    thread_once(&public_ip_once, public_ip_init_once);
+}
+
+int set_public_ip_providers(const char *provider_list)
+{
+    public_ip_provider_t parsed[PUBLIC_IP_MAX_PROVIDERS];
+    size_t parsed_count;
+
+    if (parse_public_ip_providers(provider_list, parsed, &parsed_count) != 0)
+    {
+        return 1;
+    }
+
+    public_ip_init();
+
+    mutex_lock(&public_ip_mutex);
+    memcpy(providers, parsed, sizeof(parsed));
+    provider_count = parsed_count;
+    // the cached address came from the old providers
+    cache_valid = 0;
+    mutex_unlock(&public_ip_mutex);
+
+    return 0;
+}
+
+static int is_cache_fresh(uint64_t now_ms)
+{
+    return cache_valid && now_ms - cached_at_ms < PUBLIC_IP_CACHE_TTL_MS;
+}
+
+static void finish_query(unsigned long round)
+{
+    // the caller holds public_ip_mutex
+    if (round != discovery_round || !discovery_in_flight)
+    {
+        return;
+    }
+
+    if (--pending_queries == 0)
+    {
+        discovery_in_flight = 0;
+        cond_broadcast(&public_ip_cond);
+    }
+}
+
+static void expire_round(uint64_t now_ms)
+{
+    // the caller holds public_ip_mutex. a provider stuck in name resolution ignores every timeout,
+    // its round ends at the deadline anyway and whatever it answers later belongs to an old round
+    if (discovery_in_flight && now_ms - discovery_started_ms >= PUBLIC_IP_TIMEOUT_MS)
+    {
+        discovery_in_flight = 0;
+        cond_broadcast(&public_ip_cond);
+    }
+}
+
+void start_public_ip_discovery(void)
+{
+    public_ip_init();
+
+    mutex_lock(&public_ip_mutex);
+
+    uint64_t now_ms = cross_platform_monotonic_ms();
+    expire_round(now_ms);
+    if (discovery_in_flight || is_cache_fresh(now_ms) || provider_count == 0)
+    {
+        mutex_unlock(&public_ip_mutex);
+        return;
+    }
+
+    unsigned long round = ++discovery_round;
+    discovery_in_flight = 1;
+    discovery_started_ms = now_ms;
+    pending_queries = provider_count;
+
+    public_ip_provider_t round_providers[PUBLIC_IP_MAX_PROVIDERS];
+    size_t round_provider_count = provider_count;
+    memcpy(round_providers, providers, sizeof(round_providers));
+
+    mutex_unlock(&public_ip_mutex);
+
+    // all providers are raced, the first valid answer ends the round
+    for (size_t i = 0; i < round_provider_count; i++)
+    {
+        public_ip_query_thread_args_t *thread_args = (public_ip_query_thread_args_t *)malloc(sizeof(public_ip_query_thread_args_t));
+        thread_t query_thread;
+
+        if (thread_args != NULL)
+        {
+            thread_args->provider = round_providers[i];
+            thread_args->round = round;
+
+            if (thread_create(&query_thread, public_ip_query_thread, thread_args) == 0)
+            {
+                thread_detach(query_thread);
+                continue;
+            }
+
+            free(thread_args);
+        }
+
+        mutex_lock(&public_ip_mutex);
+        finish_query(round);
+        mutex_unlock(&public_ip_mutex);
+    }
+}
+
+int get_public_ip(char *ip_buffer, size_t buffer_size, error_list_t *main_error)
+{
+    start_public_ip_discovery();
+
+    mutex_lock(&public_ip_mutex);
+
+    uint64_t deadline_ms = discovery_started_ms + PUBLIC_IP_TIMEOUT_MS;
+    uint64_t now_ms = cross_platform_monotonic_ms();
+    while (discovery_in_flight && now_ms < deadline_ms)
+    {
+        cond_timedwait(&public_ip_cond, &public_ip_mutex, (long)(deadline_ms - now_ms));
+        now_ms = cross_platform_monotonic_ms();
+    }
+    expire_round(now_ms);
+
+    // an expired address is still a better answer than none while a refresh is failing
+    int found = cache_valid;
+    if (found)
+    {
+        strncpy(ip_buffer, cached_ip, buffer_size - 1);
+        ip_buffer[buffer_size - 1] = '\0';
+    }
+
+    mutex_unlock(&public_ip_mutex);
+
+    if (!found)
+    {
+        add_error(main_error, ERR_PUBLIC_IP_UNAVAILABLE, NON_CRITICAL_ERROR, "No public IP provider answered in time", "get_public_ip");
+        return 1;
+    }
+
+    return 0;
+}
+
+int query_public_ip_provider(const public_ip_provider_t *provider, char *ip_buffer, size_t buffer_size)
+{
+    error_list_t query_error;
+    init_error(&query_error);
+
+    struct addrinfo hints, *address;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    if (getaddrinfo(provider->host, provider->port, &hints, &address) != 0)
+    {
+        return 1;
+    }
+
+    // one attempt may take the whole discovery timeout, the race already covers slow providers
+    connect_options_t connect_options;
+    connect_options_init(&connect_options);
+    connect_options.attempt_timeout_ms = PUBLIC_IP_TIMEOUT_MS;
+    connect_options.deadline_ms = PUBLIC_IP_TIMEOUT_MS;
+
+    socket_t ip_socket = socket_connect_with_backoff(address, &connect_options, &query_error);
+    if (ip_socket == INVALID_SOCK)
+    {
+        freeaddrinfo(address);
+        return 1;
+    }
+
+    freeaddrinfo(address);
+
+    // HTTP/1.0 keeps the answer unchunked and the server closes the connection after it
+    char request[PUBLIC_IP_REQUEST_BUFFER_SIZE];
+    int request_length = snprintf(request, sizeof(request), "GET %s HTTP/1.0\r\nHost: %s\r\nConnection: close\r\n\r\n", provider->path, provider->host);
+
+    if (socket_send(ip_socket, request, (size_t)request_length, 0, "", CONTEXT_CLIENT, NON_CRITICAL_ERROR, &query_error) == SOCKET_ERR)
+    {
+        socket_close(ip_socket, &query_error);
+        return 1;
+    }
+
+    char response[PUBLIC_IP_RESPONSE_BUFFER_SIZE];
+    size_t response_length = 0;
+
+    while (response_length < sizeof(response) - 1)
+    {
+        pollfd_t poll_fd;
+        poll_fd.fd = ip_socket;
+        poll_fd.events = POLLIN;
+        poll_fd.revents = 0;
+
+        // a provider that stops talking must not keep this thread around forever
+        if (socket_poll(&poll_fd, 1, PUBLIC_IP_TIMEOUT_MS, &query_error) <= 0)
+        {
+            break;
+        }
+
+        int bytes_received = socket_recv(ip_socket, response + response_length, sizeof(response) - 1 - response_length, 0, "", CONTEXT_CLIENT, &query_error);
+        if (bytes_received <= 0)
+        {
+            break;
+        }
+        response_length += (size_t)bytes_received;
+    }
+
+    socket_close(ip_socket, &query_error);
+    response[response_length] = '\0';
+
+    if (strncmp(response, "HTTP/1.", 7) != 0 || strncmp(response + 8, " 200", 4) != 0)
+    {
+        return 1;
+    }
+
+    char *ip_start = strstr(response, "\r\n\r\n");
+    if (ip_start == NULL)
+    {
+        return 1;
+    }
+
+    // move into the response body and trim the whitespace some providers put around the address
+    ip_start += 4;
+    while (*ip_start == ' ' || *ip_start == '\t' || *ip_start == '\r' || *ip_start == '\n')
+    {
+        ip_start++;
+    }
+
+    size_t ip_length = strcspn(ip_start, " \t\r\n");
+    if (ip_length == 0 || ip_length >= buffer_size)
+    {
+        return 1;
+    }
+    ip_start[ip_length] = '\0';
+
+    struct in_addr parsed_address;
+    if (inet_pton(AF_INET, ip_start, &parsed_address) != 1)
+    {
+        return 1;
+    }
+
+    strcpy(ip_buffer, ip_start);
+
+    return 0;
+}
+
+thread_ret_t THREAD_CALL public_ip_query_thread(void *arg)
+{
+    public_ip_query_thread_args_t *thread_args = (public_ip_query_thread_args_t *)arg;
+
+    char ip[INET_ADDRSTRLEN];
+    int result_code = query_public_ip_provider(&thread_args->provider, ip, sizeof(ip));
+
+    mutex_lock(&public_ip_mutex);
+
+    if (result_code == 0 && thread_args->round == discovery_round && discovery_in_flight)
+    {
+        strcpy(cached_ip, ip);
+        cache_valid = 1;
+        cached_at_ms = cross_platform_monotonic_ms();
+
+        discovery_in_flight = 0;
+        cond_broadcast(&public_ip_cond);
+    }
+    else
+    {
+        finish_query(thread_args->round);
+    }
+
+    mutex_unlock(&public_ip_mutex);
+
+    logger_thread_detach();
+    free(thread_args);
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
\ No newline at end of file
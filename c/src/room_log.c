@@ -0,0 +1,86 @@
+#include "../include/room_log.h"
+
+int room_log_init(room_log_t *log, size_t capacity, error_list_t *error)
+{
+    log->entries = (room_log_entry_t *)malloc(capacity * sizeof(room_log_entry_t));
+    if (log->entries == NULL)
+    {
+        add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for the room log", "room_log_init");
+        return 1;
+    }
+
+    log->capacity = capacity;
+    atomic_store(&log->head, 0);
+    rwlock_init(&log->rwlock);
+
+    return 0;
+}
+
+void room_log_destroy(room_log_t *log)
+{
+    free(log->entries);
+    log->entries = NULL;
+    log->capacity = 0;
+    atomic_store(&log->head, 0);
+}
+
+int room_log_append(room_log_t *log, const char *frame, size_t length, error_list_t *error)
+{
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    if (length > MAX_BUFFER_SIZE)
+    {
+        add_error(error, ERR_FRAME_TOO_LONG, NON_CRITICAL_ERROR, "A frame was too long for the room log and was dropped", "room_log_append");
+        return 1;
+    }
+
+    rwlock_writerlock(&log->rwlock);
+
+    uint64_t sequence = atomic_load(&log->head);
+    room_log_entry_t *entry = &log->entries[sequence & (log->capacity - 1)];
+
+    entry->sequence = sequence;
+    entry->length = length;
+    memcpy(entry->data, frame, length);
+
+    atomic_store(&log->head, sequence + 1);
+
+    rwlock_writerunlock(&log->rwlock);
+
+    return 0;
+}
+
+uint64_t room_log_head(room_log_t *log)
+{
+    return atomic_load(&log->head);
+}
+
+uint64_t room_log_tail(room_log_t *log)
+{
+    uint64_t head = atomic_load(&log->head);
+
+    return head > log->capacity ? head - log->capacity : 0;
+}
+
+void room_log_read_lock(room_log_t *log)
+{
+    rwlock_readerlock(&log->rwlock);
+}
+
+void room_log_read_unlock(room_log_t *log)
+{
+    rwlock_readerunlock(&log->rwlock);
+}
+
+const room_log_entry_t *room_log_get(room_log_t *log, uint64_t sequence)
+{
+    if (sequence >= atomic_load(&log->head) || sequence < room_log_tail(log))
+    {
+        return NULL;
+    }
+
+    return &log->entries[sequence & (log->capacity - 1)];
+}
\ No newline at end of file
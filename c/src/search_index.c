@@ -0,0 +1,1097 @@
+#include "../include/search_index.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SEARCH_INTERSECT_SSE2 1
+#endif
+
+// SEARCH_MAX_MESSAGE_TERMS: a term takes at least one byte and is followed by a separator
+#define SEARCH_MAX_MESSAGE_TERMS (MESSAGE_BUFFER_SIZE / 2 + 1)
+// LEB128 of a 32 bit ID
+#define SEARCH_VARINT_MAX_SIZE 5
+
+typedef struct
+{
+    char term[SEARCH_MAX_TERM_LENGTH + 1];
+    uint32_t hash;
+} search_token_t;
+
+// written by the indexer thread under the writer lock, read by queries under the reader lock
+static rwlock_t search_rwlock;
+static search_term_t *search_terms = NULL;
+static size_t search_term_capacity = 0;
+static size_t search_term_count = 0;
+static search_document_t *search_documents = NULL;
+static size_t search_document_count = 0;
+static size_t search_document_capacity = 0;
+static char *search_text = NULL;
+static size_t search_text_length = 0;
+static size_t search_text_capacity = 0;
+static uint64_t search_last_timestamp = 0;
+// the encoded postings and their block headers, counted as used rather than as reserved like the other parts
+static size_t search_posting_bytes = 0;
+
+static mutex_t search_queue_mutex;
+static cond_t search_queue_cond;
+static search_pending_t *search_queue_head = NULL;
+static search_pending_t *search_queue_tail = NULL;
+static size_t search_queue_length = 0;
+static atomic_int search_running = ATOMIC_VAR_INIT(0);
+static thread_t search_thread;
+
+static uint32_t hash_term(const char *term)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)term; *c != '\0'; ++c)
+    {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// a word is a run of ASCII letters and digits and of non-ASCII bytes, so other scripts are indexed as they are written
+static int is_term_byte(unsigned char c)
+{
+    return c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// reads the word starting at text into token, lowercased, and returns the position after it
+static const char *read_term(const char *text, search_token_t *token)
+{
+    const unsigned char *c = (const unsigned char *)text;
+    size_t length = 0;
+
+    while (is_term_byte(*c) && length < SEARCH_MAX_TERM_LENGTH)
+    {
+        token->term[length++] = (char)((*c >= 'A' && *c <= 'Z') ? *c - 'A' + 'a' : *c);
+        c++;
+    }
+
+    // a word cut in the middle of a character loses that character, queries are cut the same way
+    if ((*c & 0xC0) == 0x80)
+    {
+        while (length > 0 && ((unsigned char)token->term[length - 1] & 0xC0) == 0x80)
+        {
+            length--;
+        }
+        if (length > 0 && (unsigned char)token->term[length - 1] >= 0xC0)
+        {
+            length--;
+        }
+    }
+
+    while (is_term_byte(*c))
+    {
+        c++;
+    }
+
+    token->term[length] = '\0';
+    token->hash = hash_term(token->term);
+
+    return (const char *)c;
+}
+
+static size_t tokenize(const char *text, search_token_t *tokens, size_t max_tokens)
+{
+    size_t count = 0;
+
+    while (*text != '\0' && count < max_tokens)
+    {
+        if (!is_term_byte((unsigned char)*text))
+        {
+            text++;
+            continue;
+        }
+
+        text = read_term(text, &tokens[count]);
+        if (tokens[count].term[0] != '\0')
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static size_t write_varint(unsigned char *output, uint32_t value)
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        output[length++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    output[length++] = (unsigned char)value;
+    return length;
+}
+
+static uint32_t read_varint(const unsigned char **cursor)
+{
+    uint32_t value = 0;
+    int shift = 0;
+    unsigned char byte;
+
+    do
+    {
+        byte = *(*cursor)++;
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return value;
+}
+
+static void posting_list_free(posting_list_t *list)
+{
+    free(list->data);
+    free(list->blocks);
+}
+
+static int posting_list_add(posting_list_t *list, uint32_t document_id)
+{
+    posting_block_t *block = list->block_count > 0 ? &list->blocks[list->block_count - 1] : NULL;
+
+    if (block == NULL || block->count == SEARCH_POSTING_BLOCK_SIZE)
+    {
+        // the new block starts where the full one ends, read before the blocks can move
+        uint32_t base = block != NULL ? block->last : 0;
+
+        if (list->block_count == list->block_capacity)
+        {
+            size_t new_capacity = list->block_capacity == 0 ? 1 : list->block_capacity * 2;
+            posting_block_t *resized = (posting_block_t *)realloc(list->blocks, new_capacity * sizeof(posting_block_t));
+            if (resized == NULL)
+            {
+                return 1;
+            }
+            list->blocks = resized;
+            list->block_capacity = new_capacity;
+        }
+
+        block = &list->blocks[list->block_count++];
+        block->base = base;
+        block->last = base;
+        block->offset = (uint32_t)list->length;
+        block->count = 0;
+    }
+
+    if (list->length + SEARCH_VARINT_MAX_SIZE > list->capacity)
+    {
+        size_t new_capacity = list->capacity == 0 ? 16 : list->capacity * 2;
+        unsigned char *resized = (unsigned char *)realloc(list->data, new_capacity);
+        if (resized == NULL)
+        {
+            return 1;
+        }
+        list->data = resized;
+        list->capacity = new_capacity;
+    }
+
+    if (block->count == 0)
+    {
+        search_posting_bytes += sizeof(posting_block_t);
+    }
+
+    size_t written = write_varint(list->data + list->length, document_id - block->last);
+    list->length += written;
+    search_posting_bytes += written;
+    block->last = document_id;
+    block->count++;
+    list->count++;
+
+    return 0;
+}
+
+static size_t decode_block(const posting_list_t *list, size_t block_index, uint32_t *output)
+{
+    const posting_block_t *block = &list->blocks[block_index];
+    const unsigned char *cursor = list->data + block->offset;
+    uint32_t document_id = block->base;
+
+    for (uint32_t i = 0; i < block->count; i++)
+    {
+        document_id += read_varint(&cursor);
+        output[i] = document_id;
+    }
+
+    return block->count;
+}
+
+static search_term_t *find_term(const search_token_t *token)
+{
+    if (search_term_capacity == 0)
+    {
+        return NULL;
+    }
+
+    size_t slot = token->hash & (search_term_capacity - 1);
+    while (search_terms[slot].term[0] != '\0')
+    {
+        if (search_terms[slot].hash == token->hash && strcmp(search_terms[slot].term, token->term) == 0)
+        {
+            return &search_terms[slot];
+        }
+        slot = (slot + 1) & (search_term_capacity - 1);
+    }
+
+    return NULL;
+}
+
+static int grow_term_table(void)
+{
+    size_t new_capacity = search_term_capacity * 2;
+    search_term_t *resized = (search_term_t *)calloc(new_capacity, sizeof(search_term_t));
+    if (resized == NULL)
+    {
+        return 1;
+    }
+
+    // the posting lists move along with their entries
+    for (size_t i = 0; i < search_term_capacity; i++)
+    {
+        if (search_terms[i].term[0] == '\0')
+        {
+            continue;
+        }
+
+        size_t slot = search_terms[i].hash & (new_capacity - 1);
+        while (resized[slot].term[0] != '\0')
+        {
+            slot = (slot + 1) & (new_capacity - 1);
+        }
+        resized[slot] = search_terms[i];
+    }
+
+    free(search_terms);
+    search_terms = resized;
+    search_term_capacity = new_capacity;
+
+    return 0;
+}
+
+static search_term_t *find_or_insert_term(const search_token_t *token)
+{
+    search_term_t *entry = find_term(token);
+    if (entry != NULL)
+    {
+        return entry;
+    }
+
+    if ((search_term_count + 1) * 2 > search_term_capacity && grow_term_table() != 0)
+    {
+        return NULL;
+    }
+
+    size_t slot = token->hash & (search_term_capacity - 1);
+    while (search_terms[slot].term[0] != '\0')
+    {
+        slot = (slot + 1) & (search_term_capacity - 1);
+    }
+
+    strcpy(search_terms[slot].term, token->term);
+    search_terms[slot].hash = token->hash;
+    search_term_count++;
+
+    return &search_terms[slot];
+}
+
+static int append_text(const char *text)
+{
+    size_t length = strlen(text) + 1;
+
+    if (search_text_length + length > search_text_capacity)
+    {
+        size_t new_capacity = search_text_capacity == 0 ? 64 * 1024 : search_text_capacity;
+        while (search_text_length + length > new_capacity)
+        {
+            new_capacity *= 2;
+        }
+
+        char *resized = (char *)realloc(search_text, new_capacity);
+        if (resized == NULL)
+        {
+            return 1;
+        }
+        search_text = resized;
+        search_text_capacity = new_capacity;
+    }
+
+    memcpy(search_text + search_text_length, text, length);
+    search_text_length += length;
+
+    return 0;
+}
+
+static size_t index_bytes(void)
+{
+    // a term table is kept at most half full
+    return search_text_length + search_document_count * sizeof(search_document_t) + search_term_count * 2 * sizeof(search_term_t) + search_posting_bytes;
+}
+
+// the caller holds the writer lock. the remaining messages are renumbered from 1, so every posting list is rebuilt
+// and the terms left without any are dropped, returns 1 when the rebuilt term table can't be allocated
+static int evict_oldest_documents(size_t evicted)
+{
+    search_term_t *rebuilt = (search_term_t *)calloc(search_term_capacity, sizeof(search_term_t));
+    uint32_t *block_buffer = (uint32_t *)malloc(SEARCH_POSTING_BLOCK_SIZE * sizeof(uint32_t));
+    if (rebuilt == NULL || block_buffer == NULL)
+    {
+        free(rebuilt);
+        free(block_buffer);
+        return 1;
+    }
+
+    search_posting_bytes = 0;
+    size_t term_count = 0;
+
+    for (size_t i = 0; i < search_term_capacity; i++)
+    {
+        search_term_t *entry = &search_terms[i];
+        if (entry->term[0] == '\0')
+        {
+            continue;
+        }
+
+        // blocks ending before the cut are skipped without decoding, a failed allocation only loses postings
+        posting_list_t postings;
+        memset(&postings, 0, sizeof(postings));
+        for (size_t block_index = 0; block_index < entry->postings.block_count; block_index++)
+        {
+            if (entry->postings.blocks[block_index].last <= evicted)
+            {
+                continue;
+            }
+
+            size_t block_count = decode_block(&entry->postings, block_index, block_buffer);
+            for (size_t k = 0; k < block_count; k++)
+            {
+                if (block_buffer[k] > evicted)
+                {
+                    posting_list_add(&postings, block_buffer[k] - (uint32_t)evicted);
+                }
+            }
+        }
+        posting_list_free(&entry->postings);
+
+        if (postings.count == 0)
+        {
+            posting_list_free(&postings);
+            continue;
+        }
+
+        size_t slot = entry->hash & (search_term_capacity - 1);
+        while (rebuilt[slot].term[0] != '\0')
+        {
+            slot = (slot + 1) & (search_term_capacity - 1);
+        }
+        memcpy(rebuilt[slot].term, entry->term, sizeof(entry->term));
+        rebuilt[slot].hash = entry->hash;
+        rebuilt[slot].postings = postings;
+        term_count++;
+    }
+
+    free(block_buffer);
+    free(search_terms);
+    search_terms = rebuilt;
+    search_term_count = term_count;
+
+    // the texts are in message order too, the kept ones start where the first kept message's does
+    size_t text_start = evicted < search_document_count ? search_documents[evicted].text_offset : search_text_length;
+    memmove(search_text, search_text + text_start, search_text_length - text_start);
+    search_text_length -= text_start;
+
+    memmove(search_documents, search_documents + evicted, (search_document_count - evicted) * sizeof(search_document_t));
+    search_document_count -= evicted;
+    for (size_t i = 0; i < search_document_count; i++)
+    {
+        search_documents[i].text_offset -= text_start;
+    }
+
+    return 0;
+}
+
+// the caller holds the writer lock, tokens are the message's distinct terms
+static void index_document(uint64_t timestamp, const char *sender_username, const char *message, const search_token_t *tokens, size_t token_count)
+{
+    if (search_document_count >= SEARCH_INDEX_MAX_DOCUMENTS || index_bytes() >= SEARCH_INDEX_MAX_BYTES)
+    {
+        size_t evicted = search_document_count / SEARCH_INDEX_EVICT_DIVISOR;
+        if (evict_oldest_documents(evicted > 0 ? evicted : search_document_count) != 0)
+        {
+            return;
+        }
+    }
+
+    if (search_document_count == search_document_capacity)
+    {
+        size_t new_capacity = search_document_capacity == 0 ? 1024 : search_document_capacity * 2;
+        search_document_t *resized = (search_document_t *)realloc(search_documents, new_capacity * sizeof(search_document_t));
+        if (resized == NULL)
+        {
+            return;
+        }
+        search_documents = resized;
+        search_document_capacity = new_capacity;
+    }
+
+    size_t text_offset = search_text_length;
+    if (append_text(sender_username) != 0 || append_text(message) != 0)
+    {
+        search_text_length = text_offset;
+        return;
+    }
+
+    // the wall clock may step back, the IDs have to stay in time order for range queries
+    if (timestamp < search_last_timestamp)
+    {
+        timestamp = search_last_timestamp;
+    }
+    search_last_timestamp = timestamp;
+
+    search_documents[search_document_count].timestamp = timestamp;
+    search_documents[search_document_count].text_offset = text_offset;
+    uint32_t document_id = (uint32_t)++search_document_count;
+
+    // a term that can't be stored only makes this message harder to find
+    for (size_t i = 0; i < token_count; i++)
+    {
+        search_term_t *entry = find_or_insert_term(&tokens[i]);
+        if (entry != NULL)
+        {
+            posting_list_add(&entry->postings, document_id);
+        }
+    }
+}
+
+static size_t unique_tokens(search_token_t *tokens, size_t count)
+{
+    size_t unique_count = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t j = 0;
+        while (j < unique_count && (tokens[j].hash != tokens[i].hash || strcmp(tokens[j].term, tokens[i].term) != 0))
+        {
+            j++;
+        }
+        if (j == unique_count)
+        {
+            tokens[unique_count++] = tokens[i];
+        }
+    }
+
+    return unique_count;
+}
+
+int search_index_start(error_list_t *error)
+{
+    search_terms = (search_term_t *)calloc(SEARCH_TERM_TABLE_INITIAL_CAPACITY, sizeof(search_term_t));
+    if (search_terms == NULL)
+    {
+        add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for the search index", "search_index_start");
+        return 1;
+    }
+
+    search_term_capacity = SEARCH_TERM_TABLE_INITIAL_CAPACITY;
+    search_term_count = 0;
+    search_document_count = 0;
+    search_text_length = 0;
+    search_last_timestamp = 0;
+    search_posting_bytes = 0;
+
+    rwlock_init(&search_rwlock);
+    mutex_init(&search_queue_mutex);
+    cond_init(&search_queue_cond);
+
+    atomic_store(&search_running, 1);
+
+    if (thread_create(&search_thread, search_index_thread, NULL) != 0)
+    {
+        atomic_store(&search_running, 0);
+        add_error(error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create search index thread", "search_index_start");
+        mutex_destroy(&search_queue_mutex);
+        cond_destroy(&search_queue_cond);
+        free(search_terms);
+        search_terms = NULL;
+        search_term_capacity = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+void search_index_stop(void)
+{
+    if (!atomic_load(&search_running))
+    {
+        return;
+    }
+
+    mutex_lock(&search_queue_mutex);
+    atomic_store(&search_running, 0);
+    cond_broadcast(&search_queue_cond);
+    mutex_unlock(&search_queue_mutex);
+
+    thread_join(search_thread);
+
+    // messages nobody got to index any more
+    while (search_queue_head != NULL)
+    {
+        search_pending_t *next = search_queue_head->next;
+        free(search_queue_head);
+        search_queue_head = next;
+    }
+    search_queue_tail = NULL;
+    search_queue_length = 0;
+
+    // the history belongs to the room, the next one starts empty. a query that got past the running check
+    // before it was cleared finds the index empty once it has the lock
+    rwlock_writerlock(&search_rwlock);
+    for (size_t i = 0; i < search_term_capacity; i++)
+    {
+        posting_list_free(&search_terms[i].postings);
+    }
+    free(search_terms);
+    free(search_documents);
+    free(search_text);
+    search_terms = NULL;
+    search_documents = NULL;
+    search_text = NULL;
+    search_term_capacity = 0;
+    search_term_count = 0;
+    search_document_count = 0;
+    search_document_capacity = 0;
+    search_text_length = 0;
+    search_text_capacity = 0;
+    rwlock_writerunlock(&search_rwlock);
+
+    mutex_destroy(&search_queue_mutex);
+    cond_destroy(&search_queue_cond);
+}
+
+void search_index_submit(const char *sender_username, const char *encoded_message)
+{
+    if (!atomic_load(&search_running))
+    {
+        return;
+    }
+
+    // the broadcasting thread only copies the message, tokenizing and indexing happen on the indexer thread
+    size_t sender_length = strlen(sender_username) + 1;
+    size_t message_length = strlen(encoded_message) + 1;
+    search_pending_t *pending = (search_pending_t *)malloc(sizeof(search_pending_t) + sender_length + message_length);
+    if (pending == NULL)
+    {
+        return;
+    }
+
+    pending->next = NULL;
+    pending->timestamp = (uint64_t)time(NULL);
+    memcpy(pending->data, sender_username, sender_length);
+    memcpy(pending->data + sender_length, encoded_message, message_length);
+
+    mutex_lock(&search_queue_mutex);
+
+    if (search_queue_length >= SEARCH_INDEX_MAX_PENDING)
+    {
+        mutex_unlock(&search_queue_mutex);
+        free(pending);
+        return;
+    }
+
+    if (search_queue_tail == NULL)
+    {
+        search_queue_head = pending;
+    }
+    else
+    {
+        search_queue_tail->next = pending;
+    }
+    search_queue_tail = pending;
+    search_queue_length++;
+
+    cond_signal(&search_queue_cond);
+    mutex_unlock(&search_queue_mutex);
+}
+
+thread_ret_t THREAD_CALL search_index_thread(void *arg)
+{
+    (void)arg;
+
+    char (*messages)[MESSAGE_BUFFER_SIZE] = (char (*)[MESSAGE_BUFFER_SIZE])malloc(SEARCH_INDEX_BATCH * MESSAGE_BUFFER_SIZE);
+    size_t *token_counts = (size_t *)malloc(SEARCH_INDEX_BATCH * sizeof(size_t));
+    search_token_t **batch_tokens = (search_token_t **)malloc(SEARCH_INDEX_BATCH * sizeof(search_token_t *));
+    int scratch_ready = messages != NULL && token_counts != NULL && batch_tokens != NULL;
+
+    while (1)
+    {
+        mutex_lock(&search_queue_mutex);
+        while (atomic_load(&search_running) && search_queue_head == NULL)
+        {
+            cond_wait(&search_queue_cond, &search_queue_mutex);
+        }
+
+        if (!atomic_load(&search_running))
+        {
+            mutex_unlock(&search_queue_mutex);
+            break;
+        }
+
+        // up to one batch is taken off the queue, the rest waits for the next pass
+        search_pending_t *batch = search_queue_head;
+        search_pending_t *batch_tail = batch;
+        size_t batch_count = 1;
+        while (batch_count < SEARCH_INDEX_BATCH && batch_tail->next != NULL)
+        {
+            batch_tail = batch_tail->next;
+            batch_count++;
+        }
+        search_queue_head = batch_tail->next;
+        if (search_queue_head == NULL)
+        {
+            search_queue_tail = NULL;
+        }
+        search_queue_length -= batch_count;
+        batch_tail->next = NULL;
+
+        mutex_unlock(&search_queue_mutex);
+
+        if (scratch_ready)
+        {
+            // tokenized before taking the lock, queries only wait for the index itself to be updated
+            size_t i = 0;
+            for (search_pending_t *pending = batch; pending != NULL; pending = pending->next, i++)
+            {
+                const char *encoded_message = pending->data + strlen(pending->data) + 1;
+                decode_message(encoded_message, messages[i], MESSAGE_BUFFER_SIZE);
+                batch_tokens[i] = (search_token_t *)malloc(SEARCH_MAX_MESSAGE_TERMS * sizeof(search_token_t));
+                token_counts[i] = 0;
+                if (batch_tokens[i] != NULL)
+                {
+                    token_counts[i] = unique_tokens(batch_tokens[i], tokenize(messages[i], batch_tokens[i], SEARCH_MAX_MESSAGE_TERMS));
+                }
+            }
+
+            rwlock_writerlock(&search_rwlock);
+            i = 0;
+            for (search_pending_t *pending = batch; pending != NULL; pending = pending->next, i++)
+            {
+                if (batch_tokens[i] != NULL)
+                {
+                    index_document(pending->timestamp, pending->data, messages[i], batch_tokens[i], token_counts[i]);
+                }
+            }
+            rwlock_writerunlock(&search_rwlock);
+
+            for (i = 0; i < batch_count; i++)
+            {
+                free(batch_tokens[i]);
+            }
+        }
+
+        while (batch != NULL)
+        {
+            search_pending_t *next = batch->next;
+            free(batch);
+            batch = next;
+        }
+    }
+
+    free(messages);
+    free(token_counts);
+    free(batch_tokens);
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+// writes the values found in both ascending lists to output, which may be neither of them
+static size_t intersect_sorted(const uint32_t *a, size_t a_count, const uint32_t *b, size_t b_count, uint32_t *output)
+{
+    size_t i = 0, j = 0, count = 0;
+
+#ifdef SEARCH_INTERSECT_SSE2
+    // four values of a against four of b: b and its three rotations cover every pair,
+    // then whichever block ends lower is done, both when they end on the same value
+    while (i + 4 <= a_count && j + 4 <= b_count)
+    {
+        __m128i a_values = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i b_values = _mm_loadu_si128((const __m128i *)(b + j));
+
+        __m128i match = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(a_values, b_values),
+                                                  _mm_cmpeq_epi32(a_values, _mm_shuffle_epi32(b_values, _MM_SHUFFLE(0, 3, 2, 1)))),
+                                     _mm_or_si128(_mm_cmpeq_epi32(a_values, _mm_shuffle_epi32(b_values, _MM_SHUFFLE(1, 0, 3, 2))),
+                                                  _mm_cmpeq_epi32(a_values, _mm_shuffle_epi32(b_values, _MM_SHUFFLE(2, 1, 0, 3)))));
+
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(match));
+        for (int lane = 0; lane < 4; lane++)
+        {
+            if (mask & (1 << lane))
+            {
+                output[count++] = a[i + lane];
+            }
+        }
+
+        uint32_t a_last = a[i + 3];
+        uint32_t b_last = b[j + 3];
+        if (a_last <= b_last)
+        {
+            i += 4;
+        }
+        if (b_last <= a_last)
+        {
+            j += 4;
+        }
+    }
+#endif
+
+    while (i < a_count && j < b_count)
+    {
+        if (a[i] < b[j])
+        {
+            i++;
+        }
+        else if (a[i] > b[j])
+        {
+            j++;
+        }
+        else
+        {
+            output[count++] = a[i];
+            i++;
+            j++;
+        }
+    }
+
+    return count;
+}
+
+// keeps the candidates that are in the list too, blocks no candidate falls into are never decoded
+static size_t intersect_with_list(const uint32_t *candidates, size_t candidate_count, const posting_list_t *list, uint32_t *output, uint32_t *block_buffer)
+{
+    size_t count = 0;
+    size_t i = 0;
+    size_t block_index = 0;
+
+    while (i < candidate_count && block_index < list->block_count)
+    {
+        // the first block that reaches the next candidate
+        size_t low = block_index, high = list->block_count;
+        while (low < high)
+        {
+            size_t middle = low + (high - low) / 2;
+            if (list->blocks[middle].last < candidates[i])
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        block_index = low;
+        if (block_index == list->block_count)
+        {
+            break;
+        }
+
+        uint32_t block_last = list->blocks[block_index].last;
+        size_t end = i;
+        while (end < candidate_count && candidates[end] <= block_last)
+        {
+            end++;
+        }
+
+        if (end > i && candidates[end - 1] > list->blocks[block_index].base)
+        {
+            size_t block_count = decode_block(list, block_index, block_buffer);
+            count += intersect_sorted(candidates + i, end - i, block_buffer, block_count, output + count);
+        }
+
+        i = end;
+        block_index++;
+    }
+
+    return count;
+}
+
+typedef struct
+{
+    search_token_t tokens[SEARCH_MAX_QUERY_TERMS];
+    size_t token_count;
+    // ranges of tokens that have to follow each other in a message
+    size_t phrase_start[SEARCH_MAX_QUERY_TERMS];
+    size_t phrase_length[SEARCH_MAX_QUERY_TERMS];
+    size_t phrase_count;
+} search_query_t;
+
+static void parse_query(const char *query, search_query_t *parsed)
+{
+    parsed->token_count = 0;
+    parsed->phrase_count = 0;
+
+    int in_phrase = 0;
+    size_t phrase_start = 0;
+
+    while (*query != '\0')
+    {
+        if (*query == '"')
+        {
+            if (in_phrase && parsed->token_count - phrase_start > 1)
+            {
+                parsed->phrase_start[parsed->phrase_count] = phrase_start;
+                parsed->phrase_length[parsed->phrase_count] = parsed->token_count - phrase_start;
+                parsed->phrase_count++;
+            }
+            in_phrase = !in_phrase;
+            phrase_start = parsed->token_count;
+            query++;
+            continue;
+        }
+
+        if (!is_term_byte((unsigned char)*query))
+        {
+            query++;
+            continue;
+        }
+
+        if (parsed->token_count == SEARCH_MAX_QUERY_TERMS)
+        {
+            break;
+        }
+
+        query = read_term(query, &parsed->tokens[parsed->token_count]);
+        if (parsed->tokens[parsed->token_count].term[0] != '\0')
+        {
+            parsed->token_count++;
+        }
+    }
+
+    // an unclosed quote still makes a phrase of what follows it
+    if (in_phrase && parsed->token_count - phrase_start > 1)
+    {
+        parsed->phrase_start[parsed->phrase_count] = phrase_start;
+        parsed->phrase_length[parsed->phrase_count] = parsed->token_count - phrase_start;
+        parsed->phrase_count++;
+    }
+}
+
+// the postings only say a message has all the terms, phrases are checked against its text
+static int matches_phrases(const search_query_t *parsed, const char *message, search_token_t *message_tokens)
+{
+    if (parsed->phrase_count == 0)
+    {
+        return 1;
+    }
+
+    size_t message_token_count = tokenize(message, message_tokens, SEARCH_MAX_MESSAGE_TERMS);
+
+    for (size_t phrase = 0; phrase < parsed->phrase_count; phrase++)
+    {
+        const search_token_t *phrase_tokens = &parsed->tokens[parsed->phrase_start[phrase]];
+        size_t phrase_length = parsed->phrase_length[phrase];
+        int found = 0;
+
+        for (size_t start = 0; start + phrase_length <= message_token_count && !found; start++)
+        {
+            size_t k = 0;
+            while (k < phrase_length && message_tokens[start + k].hash == phrase_tokens[k].hash && strcmp(message_tokens[start + k].term, phrase_tokens[k].term) == 0)
+            {
+                k++;
+            }
+            found = k == phrase_length;
+        }
+
+        if (!found)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// the first ID whose message was sent at or after timestamp, IDs past the end when there is none
+static uint32_t first_document_at(uint64_t timestamp)
+{
+    size_t low = 0, high = search_document_count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (search_documents[middle].timestamp < timestamp)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return (uint32_t)low + 1;
+}
+
+static int report_hit(const search_query_t *parsed, uint32_t document_id, search_token_t *message_tokens, void (*hit_func)(uint64_t, const char *, const char *, void *), void *context)
+{
+    const search_document_t *document = &search_documents[document_id - 1];
+    const char *sender_username = search_text + document->text_offset;
+    const char *message = sender_username + strlen(sender_username) + 1;
+
+    if (!matches_phrases(parsed, message, message_tokens))
+    {
+        return 0;
+    }
+
+    hit_func(document->timestamp, sender_username, message, context);
+    return 1;
+}
+
+size_t search_index_query(const char *query, uint64_t since, uint64_t until, size_t max_hits, void (*hit_func)(uint64_t, const char *, const char *, void *), void *context)
+{
+    if (!atomic_load(&search_running) || max_hits == 0)
+    {
+        return 0;
+    }
+
+    search_query_t parsed;
+    parse_query(query, &parsed);
+
+    search_token_t lookup_tokens[SEARCH_MAX_QUERY_TERMS];
+    memcpy(lookup_tokens, parsed.tokens, parsed.token_count * sizeof(search_token_t));
+    size_t lookup_count = unique_tokens(lookup_tokens, parsed.token_count);
+    if (lookup_count == 0)
+    {
+        return 0;
+    }
+
+    search_token_t *message_tokens = NULL;
+    if (parsed.phrase_count > 0)
+    {
+        message_tokens = (search_token_t *)malloc(SEARCH_MAX_MESSAGE_TERMS * sizeof(search_token_t));
+        if (message_tokens == NULL)
+        {
+            return 0;
+        }
+    }
+
+    size_t hits = 0;
+    uint32_t *candidates = NULL;
+    uint32_t *intersected = NULL;
+
+    rwlock_readerlock(&search_rwlock);
+
+    // IDs follow time, so the range is the span of IDs between two binary searches
+    uint32_t first_id = since > 0 ? first_document_at(since) : 1;
+    uint32_t last_id = until > 0 ? first_document_at(until + 1) - 1 : (uint32_t)search_document_count;
+
+    const posting_list_t *lists[SEARCH_MAX_QUERY_TERMS];
+    int all_found = first_id <= last_id;
+    for (size_t i = 0; i < lookup_count && all_found; i++)
+    {
+        search_term_t *entry = find_term(&lookup_tokens[i]);
+        all_found = entry != NULL && entry->postings.count > 0;
+        lists[i] = all_found ? &entry->postings : NULL;
+    }
+
+    if (all_found)
+    {
+        // the rarest term decides how many candidates there can be, the others are intersected into it
+        for (size_t i = 1; i < lookup_count; i++)
+        {
+            const posting_list_t *list = lists[i];
+            size_t j = i;
+            while (j > 0 && lists[j - 1]->count > list->count)
+            {
+                lists[j] = lists[j - 1];
+                j--;
+            }
+            lists[j] = list;
+        }
+
+        uint32_t block_buffer[SEARCH_POSTING_BLOCK_SIZE];
+
+        if (lookup_count == 1)
+        {
+            // a single term walks its list from the newest block back and stops once it has enough hits
+            const posting_list_t *list = lists[0];
+            for (size_t block_index = list->block_count; block_index > 0 && hits < max_hits; block_index--)
+            {
+                const posting_block_t *block = &list->blocks[block_index - 1];
+                if (block->last < first_id)
+                {
+                    break;
+                }
+                if (block->base >= last_id)
+                {
+                    continue;
+                }
+
+                size_t block_count = decode_block(list, block_index - 1, block_buffer);
+                for (size_t k = block_count; k > 0 && hits < max_hits; k--)
+                {
+                    uint32_t document_id = block_buffer[k - 1];
+                    if (document_id >= first_id && document_id <= last_id)
+                    {
+                        hits += (size_t)report_hit(&parsed, document_id, message_tokens, hit_func, context);
+                    }
+                }
+            }
+        }
+        else
+        {
+            candidates = (uint32_t *)malloc(lists[0]->count * sizeof(uint32_t));
+            intersected = (uint32_t *)malloc(lists[0]->count * sizeof(uint32_t));
+        }
+
+        if (candidates != NULL && intersected != NULL)
+        {
+            size_t candidate_count = 0;
+            for (size_t block_index = 0; block_index < lists[0]->block_count; block_index++)
+            {
+                const posting_block_t *block = &lists[0]->blocks[block_index];
+                if (block->last < first_id)
+                {
+                    continue;
+                }
+                if (block->base >= last_id)
+                {
+                    break;
+                }
+
+                size_t block_count = decode_block(lists[0], block_index, block_buffer);
+                for (size_t k = 0; k < block_count; k++)
+                {
+                    if (block_buffer[k] >= first_id && block_buffer[k] <= last_id)
+                    {
+                        candidates[candidate_count++] = block_buffer[k];
+                    }
+                }
+            }
+
+            for (size_t i = 1; i < lookup_count && candidate_count > 0; i++)
+            {
+                candidate_count = intersect_with_list(candidates, candidate_count, lists[i], intersected, block_buffer);
+                uint32_t *swap = candidates;
+                candidates = intersected;
+                intersected = swap;
+            }
+
+            for (size_t k = candidate_count; k > 0 && hits < max_hits; k--)
+            {
+                hits += (size_t)report_hit(&parsed, candidates[k - 1], message_tokens, hit_func, context);
+            }
+        }
+    }
+
+    rwlock_readerunlock(&search_rwlock);
+
+    free(candidates);
+    free(intersected);
+    free(message_tokens);
+
+    return hits;
+}
\ No newline at end of file
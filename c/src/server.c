@@ -4,336 +4,4085 @@ static socket_t *listening_socket = NULL;
 static atomic_int server_running = ATOMIC_VAR_INIT(0);
 static client_node_t *client_list = NULL;
 static rwlock_t client_list_rwlock;
+// authenticated members by name, kept in step with client_list under its writer lock
+static username_index_t username_index;
 static char global_secret_key[SECRET_KEY_BUFFER_SIZE];
 
-int start_chat_room(const char *admin_username, char *local_ip, error_t *main_error, void (*callback_error_func)(const char *, int))
+static delivery_mode_t delivery_mode = DELIVERY_MODE_PULL;
+// one shared log per broadcast lane, the control lane has none
+static room_log_t room_logs[FRAME_LANE_COUNT];
+// the room's latest typing set, each client copies it when its generation is behind
+static char typing_frame[TYPING_FRAME_BUFFER_SIZE];
+static size_t typing_frame_length = 0;
+static uint64_t typing_generation = 0;
+static mutex_t typing_frame_mutex;
+static thread_t room_writer;
+static mutex_t room_writer_mutex;
+static cond_t room_writer_cond;
+// held by the room writer while it sends without the list's lock, a client taken off the list is only freed once it gets it
+static mutex_t room_writer_pass_mutex;
+static unsigned long room_writer_generation = 0;
+static int room_writer_running = 0;
+// stops the writer without stopping the room, a hot upgrade captures what the writer would have sent
+static atomic_int room_writer_stopping = ATOMIC_VAR_INIT(0);
+static void (*server_callback_error_func)(const char *, int) = NULL;
+
+static char server_port[FEDERATION_PORT_BUFFER_SIZE] = PORT;
+static int secret_key_preset = 0;
+static federation_config_t federation_config;
+static int federation_enabled = 0;
+static size_t worker_pool_size = 0;
+
+static int max_connections = MAX_CONNECTIONS;
+static int max_pending_auth = MAX_PENDING_AUTH;
+static int auth_deadline_ms = AUTH_DEADLINE_MS;
+// both only change under the client list's writer lock, the accept thread reads them without it
+static atomic_int connection_count = ATOMIC_VAR_INIT(0);
+static atomic_int pending_auth_count = ATOMIC_VAR_INIT(0);
+// connections charged to the memory budget: every reader thread, the host's own membership has none
+static atomic_int charged_connections = ATOMIC_VAR_INIT(0);
+
+// bans outlive a single room so a restarted room still keeps banned addresses out
+static ban_filter_t ban_filter;
+static int ban_filter_ready = 0;
+static char *banned_addresses_preset = NULL;
+static content_filter_t content_filter;
+static int content_filter_ready = 0;
+static char *blob_directory_preset = NULL;
+static int attachments_enabled = 0;
+
+static local_member_t local_member;
+// written under client_list_rwlock's writer lock, 0 is never handed out
+static uint32_t next_member_id = 1;
+static atomic_int local_member_joined = ATOMIC_VAR_INIT(0);
+
+// hot upgrade: every thread that reads from the room's sockets (the accept thread and the connection readers)
+// parks while a handoff is pending, so the connections can be captured between frames
+static char upgrade_socket_path[UPGRADE_PATH_BUFFER_SIZE] = "";
+static socket_t upgrade_listener = INVALID_SOCK;
+static thread_t upgrade_thread;
+static int upgrade_thread_running = 0;
+static atomic_int handoff_pending = ATOMIC_VAR_INIT(0);
+static mutex_t handoff_mutex;
+static cond_t handoff_cond;
+// all three only change under handoff_mutex
+static int active_threads = 0;
+static int parked_threads = 0;
+static unsigned long handoff_generation = 0;
+static int room_handed_off = 0;
+
+// only the accept thread touches the listener
+static char local_transport_path[UPGRADE_PATH_BUFFER_SIZE] = "";
+static socket_t local_listener = INVALID_SOCK;
+
+// set before the room starts, every connection the listener accepts gets the same profile
+static socket_profile_t listener_socket_profile = SOCKET_PROFILE_FANOUT_SERVER;
+
+// close_chat_room: the room keeps running while it drains, readers drop new frames and the writer says goodbye
+static atomic_int room_closing = ATOMIC_VAR_INIT(0);
+// set by the writer once every client got its notice or was cut off
+static atomic_int room_drained = ATOMIC_VAR_INIT(0);
+// the accept thread tears the room down however it ended, close_chat_room joins it.
+// whoever swaps the flag back to 0 is the one that joins
+static thread_t accept_thread;
+static atomic_int accept_thread_joinable = ATOMIC_VAR_INIT(0);
+// the listener is shut down from close_chat_room's thread, this keeps it from touching a descriptor the accept thread closed
+static mutex_t listener_mutex;
+static int listener_open = 0;
+
+static int room_logs_init(error_list_t *error)
 {
-    if (strlen(admin_username) >= USERNAME_BUFFER_SIZE)
+    for (int lane = FRAME_LANE_PRESENCE; lane < FRAME_LANE_COUNT; lane++)
     {
-        add_error(main_error, ERR_USERNAME_TOO_LONG, CRITICAL_ERROR, "Username exceeds buffer size", "start_chat_room");
-        return 1;
+        if (room_log_init(&room_logs[lane], ROOM_LOG_CAPACITY, error) != 0)
+        {
+            while (--lane >= FRAME_LANE_PRESENCE)
+            {
+                room_log_destroy(&room_logs[lane]);
+            }
+            return 1;
+        }
     }
 
-    rwlock_init(&client_list_rwlock);
+    return 0;
+}
 
-    generate_secret_key(global_secret_key, sizeof(global_secret_key));
+static void room_logs_destroy(void)
+{
+    for (int lane = FRAME_LANE_PRESENCE; lane < FRAME_LANE_COUNT; lane++)
+    {
+        room_log_destroy(&room_logs[lane]);
+    }
+}
 
-    struct addrinfo *address = NULL, hints;
-    int result_code;
+// every frame that doesn't go through the room writer (push mode, and anything sent before or without it) goes out here.
+// accepted sockets are non-blocking, so a frame is either sent whole or the client is cut off: a frame cut off midway
+// would leave it reading garbage, and a client that can't take one within CLIENT_SEND_TIMEOUT_MS is too slow to keep
+static int send_to_client(socket_t client_socket, const char *frame, size_t frame_length, error_list_t *error)
+{
+    if (socket_send_all(client_socket, frame, frame_length, CLIENT_SEND_TIMEOUT_MS, error) == 0)
+    {
+        return 0;
+    }
 
-    listening_socket = (socket_t *)malloc(sizeof(socket_t));
-    if (listening_socket == NULL)
+    // the reader sees the shutdown and removes the client
+    error_list_t shutdown_error;
+    init_error(&shutdown_error);
+    socket_shutdown(client_socket, &shutdown_error);
+
+    return SOCKET_ERR;
+}
+
+static void broadcast_presence_frame(const char *frame, size_t frame_length)
+{
+    broadcast_frame(FRAME_LANE_PRESENCE, frame, frame_length);
+}
+
+static void publish_typing_frame(const char *frame, size_t frame_length)
+{
+    // the set replaces the last one, a client that hasn't read that yet only ever gets the new one
+    if (delivery_mode == DELIVERY_MODE_PULL)
     {
-        add_error(main_error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for listening socket", "start_chat_room");
+        mutex_lock(&typing_frame_mutex);
+        memcpy(typing_frame, frame, frame_length);
+        typing_frame_length = frame_length;
+        typing_generation++;
+        mutex_unlock(&typing_frame_mutex);
+        wake_room_writer();
+        return;
+    }
+
+    error_list_t typing_error;
+    init_error(&typing_error);
+
+    rwlock_readerlock(&client_list_rwlock);
+
+    client_node_t *current_client = client_list;
+    while (current_client != NULL)
+    {
+        if (!current_client->authenticated || !current_client->typing_subscribed)
+        {
+            current_client = current_client->next;
+            continue;
+        }
+
+        if (current_client->client_info.socket == LOCAL_MEMBER_SOCKET)
+        {
+            local_member_enqueue(frame, frame_length);
+        }
+        else
+        {
+            // without a queue to put it behind, a socket that can't take the frame right now just doesn't get it
+            pollfd_t writable;
+            writable.fd = current_client->client_info.socket;
+            writable.events = POLLOUT;
+            writable.revents = 0;
+            if (socket_poll(&writable, 1, 0, &typing_error) == 1 && (writable.revents & POLLOUT))
+            {
+                send_to_client(current_client->client_info.socket, frame, frame_length, &typing_error);
+            }
+        }
+        current_client = current_client->next;
+    }
+
+    rwlock_readerunlock(&client_list_rwlock);
+
+    if (typing_error.count > 0)
+    {
+        report_errors(&typing_error, server_callback_error_func);
+    }
+}
+
+static void broadcast_federated_frame(const char *frame, size_t frame_length)
+{
+    // the linked room checked the text when its member sent it, this only keeps a faulty peer's bytes out of the room.
+    // encoding only replaces ASCII, so the encoded frame is valid exactly when the text in it is
+    size_t code_points;
+    if (utf8_validate(frame, strlen(frame), &code_points) != 0)
+    {
+        return;
+    }
+
+    // linked rooms only forward chat messages, they name their sender
+    char sender_username[USERNAME_BUFFER_SIZE];
+    char encoded_message[ENCODED_MESSAGE_BUFFER_SIZE];
+    if (sscanf(frame, "%*d:%80[^:]:%3000[^:]", sender_username, encoded_message) == 2)
+    {
+        search_index_submit(sender_username, encoded_message);
+    }
+
+    broadcast_frame(FRAME_LANE_CHAT, frame, frame_length);
+}
+
+static int start_room_writer(error_list_t *error)
+{
+    room_writer_thread_args_t *writer_args = (room_writer_thread_args_t *)malloc(sizeof(room_writer_thread_args_t));
+    if (writer_args == NULL)
+    {
+        add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for room writer thread args", "start_room_writer");
         return 1;
     }
 
-    result_code = socket_init(main_error);
-    if (result_code != 0)
+    writer_args->callback_error_func = server_callback_error_func;
+    atomic_store(&room_writer_stopping, 0);
+
+    if (thread_create(&room_writer, room_writer_thread, writer_args) != 0)
     {
-        free(listening_socket);
-        listening_socket = NULL;
+        add_error(error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create room writer thread", "start_room_writer");
+        free(writer_args);
         return 1;
     }
 
+    room_writer_running = 1;
+
+    return 0;
+}
+
+static void join_room_writer(void)
+{
+    if (!room_writer_running)
+    {
+        return;
+    }
+
+    atomic_store(&room_writer_stopping, 1);
+    wake_room_writer();
+    thread_join(room_writer);
+    room_writer_running = 0;
+}
+
+static void register_reader(void)
+{
+    mutex_lock(&handoff_mutex);
+    active_threads++;
+    mutex_unlock(&handoff_mutex);
+}
+
+static void unregister_reader(void)
+{
+    mutex_lock(&handoff_mutex);
+    active_threads--;
+    cond_broadcast(&handoff_cond);
+    mutex_unlock(&handoff_mutex);
+}
+
+// returns once the pending handoff is over, whether it went through or not
+static void park_for_handoff(void)
+{
+    mutex_lock(&handoff_mutex);
+
+    // checked under the mutex, the handoff may have ended between the caller's check and here
+    if (atomic_load(&handoff_pending))
+    {
+        unsigned long generation = handoff_generation;
+        parked_threads++;
+        cond_broadcast(&handoff_cond);
+
+        while (generation == handoff_generation)
+        {
+            cond_wait(&handoff_cond, &handoff_mutex);
+        }
+
+        parked_threads--;
+    }
+
+    mutex_unlock(&handoff_mutex);
+}
+
+static socket_t open_listening_socket(const char *local_ip, error_list_t *error)
+{
+    struct addrinfo *address = NULL, hints;
+
     memset(&hints, 0, sizeof(hints));
     hints.ai_family = AF_INET;
     hints.ai_socktype = SOCK_STREAM;
     hints.ai_protocol = IPPROTO_TCP;
 
-    if (get_local_ip(local_ip, INET_ADDRSTRLEN) != 0)
+    if (getaddrinfo(local_ip, server_port, &hints, &address) != 0)
+    {
+        add_error(error, GETADDRINFOERROR, CRITICAL_ERROR, "getaddrinfo failed", "open_listening_socket");
+        return INVALID_SOCK;
+    }
+
+    socket_t new_socket = socket_create(address->ai_family, address->ai_socktype, address->ai_protocol, listener_socket_profile, error);
+    if (new_socket == INVALID_SOCK)
+    {
+        freeaddrinfo(address);
+        return INVALID_SOCK;
+    }
+
+    // what the system actually granted, buffers are capped by its limits and some options need privileges
+    socket_tuning_t tuning;
+    char tuning_report[SOCKET_TUNING_REPORT_SIZE];
+    socket_read_tuning(new_socket, &tuning);
+    socket_format_tuning(&tuning, tuning_report, sizeof(tuning_report));
+    log_event(LOG_LEVEL_INFO, "open_listening_socket", "Listening with the %s socket profile: %s", socket_profile_name(listener_socket_profile), tuning_report);
+
+    if (socket_bind(new_socket, address->ai_addr, (int)address->ai_addrlen, error) == SOCKET_ERR)
+    {
+        socket_close(new_socket, error);
+        freeaddrinfo(address);
+        return INVALID_SOCK;
+    }
+
+    freeaddrinfo(address);
+
+    if (socket_listen(new_socket, error) == SOCKET_ERR)
+    {
+        socket_close(new_socket, error);
+        return INVALID_SOCK;
+    }
+
+    return new_socket;
+}
+
+// a server already running the room on this machine hands it over, returns 1 only when the takeover itself failed
+static int take_over_room(upgrade_state_t *inherited, error_list_t *error)
+{
+    upgrade_state_init(inherited);
+
+    if (upgrade_socket_path[0] == '\0')
+    {
+        return 0;
+    }
+
+    socket_t channel = upgrade_channel_connect(upgrade_socket_path, error);
+    if (channel == INVALID_SOCK)
+    {
+        return error->max_severity == CRITICAL_ERROR;
+    }
+
+    int result = upgrade_receive_state(channel, inherited, error);
+    upgrade_channel_close(channel);
+    if (result != 0)
     {
-        add_error(main_error, ERR_LOCAL_IP_FAILURE, CRITICAL_ERROR, "Failed to retrieve local IP address", "start_chat_room");
         return 1;
     }
 
-    result_code = getaddrinfo(local_ip, PORT, &hints, &address);
-    if (result_code != 0)
+    // the clients hold the old key and IDs, and the bans were the old server's to enforce
+    strcpy(global_secret_key, inherited->secret_key);
+    next_member_id = inherited->next_member_id;
+    if (inherited->banned_addresses != NULL && ban_filter_add_list(&ban_filter, inherited->banned_addresses, error) != 0)
     {
-        add_error(main_error, GETADDRINFOERROR, CRITICAL_ERROR, "getaddrinfo failed", "start_chat_room");
-        socket_cleanup(main_error);
-        free(listening_socket);
-        listening_socket = NULL;
+        report_errors(error, server_callback_error_func);
+        init_error(error);
+    }
+    if (inherited->content_filter_rules != NULL && set_content_filter_rules(inherited->content_filter_rules, error) != 0)
+    {
+        report_errors(error, server_callback_error_func);
+        init_error(error);
+    }
+
+    return 0;
+}
+
+// the fixed part of a connection, its reader's stack and what the reader allocates for it. its queues are charged as they grow
+static size_t connection_footprint(void)
+{
+    return sizeof(client_node_t) + sizeof(client_strand_t) + sizeof(frame_reader_t) + sizeof(handle_client_thread_args_t);
+}
+
+// charged before anything is allocated for a connection, its reader releases it on the way out
+static int charge_connection(int enforce_budget)
+{
+    if (!enforce_budget)
+    {
+        memory_budget_charge(MEMORY_CONNECTION, connection_footprint());
+        memory_budget_charge(MEMORY_STACK, thread_get_stack_size());
+    }
+    else if (memory_budget_try_charge(MEMORY_CONNECTION, connection_footprint()) != 0)
+    {
+        return 1;
+    }
+    else if (memory_budget_try_charge(MEMORY_STACK, thread_get_stack_size()) != 0)
+    {
+        memory_budget_release(MEMORY_CONNECTION, connection_footprint());
         return 1;
     }
 
-    *listening_socket = socket_create(address->ai_family, address->ai_socktype, address->ai_protocol, main_error);
-    if (*listening_socket == INVALID_SOCK)
+    atomic_fetch_add(&charged_connections, 1);
+    return 0;
+}
+
+static void release_connection(void)
+{
+    atomic_fetch_sub(&charged_connections, 1);
+    memory_budget_release(MEMORY_CONNECTION, connection_footprint());
+    memory_budget_release(MEMORY_STACK, thread_get_stack_size());
+}
+
+// the connection keeps its name, ID and place in every stream, the client never notices the new process
+static int adopt_connection(upgrade_connection_t *connection, error_list_t *error)
+{
+    upgrade_connection_t *inherited = (upgrade_connection_t *)malloc(sizeof(upgrade_connection_t));
+    handle_client_thread_args_t *client_thread_args = (handle_client_thread_args_t *)malloc(sizeof(handle_client_thread_args_t));
+    outbox_frame_t *owed = NULL;
+    if (connection->output_length > 0)
     {
-        freeaddrinfo(address);
-        socket_cleanup(main_error);
-        free(listening_socket);
-        listening_socket = NULL;
+        owed = (outbox_frame_t *)malloc(sizeof(outbox_frame_t) + connection->output_length);
+    }
+
+    if (inherited == NULL || client_thread_args == NULL || (connection->output_length > 0 && owed == NULL))
+    {
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for an inherited connection, it was dropped", "adopt_connection");
+        free(inherited);
+        free(client_thread_args);
+        free(owed);
         return 1;
     }
 
-    result_code = socket_bind(*listening_socket, address->ai_addr, (int)address->ai_addrlen, main_error);
-    if (result_code == SOCKET_ERR)
+    user_info_t client_info;
+    client_info.socket = connection->socket;
+    client_info.address = connection->address;
+    strcpy(client_info.username, connection->username);
+    client_info.user_type = connection->user_type;
+
+    // the connection was already admitted by the previous server, it is charged even past the budget
+    charge_connection(0);
+    register_reader();
+
+    if (add_client(&client_info, error) != 0)
     {
-        socket_close(*listening_socket, main_error);
-        freeaddrinfo(address);
-        socket_cleanup(main_error);
-        free(listening_socket);
-        listening_socket = NULL;
+        unregister_reader();
+        release_connection();
+        free(inherited);
+        free(client_thread_args);
+        free(owed);
         return 1;
     }
 
-    freeaddrinfo(address);
+    if (owed != NULL)
+    {
+        owed->next = NULL;
+        owed->length = connection->output_length;
+        memcpy(owed->data, connection->output, connection->output_length);
+    }
 
-    result_code = socket_listen(*listening_socket, main_error);
-    if (result_code == SOCKET_ERR)
+    rwlock_writerlock(&client_list_rwlock);
+
+    client_node_t *current_client = client_list;
+    while (current_client != NULL)
     {
-        socket_close(*listening_socket, main_error);
-        socket_cleanup(main_error);
-        free(listening_socket);
-        listening_socket = NULL;
+        if (current_client->client_info.socket == connection->socket)
+        {
+            if (connection->username[0] != '\0')
+            {
+                current_client->authenticated = 1;
+                current_client->member_id = connection->member_id;
+                atomic_fetch_sub(&pending_auth_count, 1);
+                username_index_insert(&username_index, connection->username, current_client, error);
+            }
+            current_client->typing_subscribed = connection->typing_subscribed;
+
+            // whatever the old server still owed the client goes out before anything this one sends
+            if (owed != NULL && delivery_mode == DELIVERY_MODE_PULL)
+            {
+                current_client->lanes[FRAME_LANE_CONTROL].outbox_head = owed;
+                current_client->lanes[FRAME_LANE_CONTROL].outbox_tail = owed;
+                current_client->outbox_bytes = sizeof(outbox_frame_t) + owed->length;
+                memory_budget_charge(MEMORY_OUTBOX, current_client->outbox_bytes);
+                owed = NULL;
+            }
+            break;
+        }
+        current_client = current_client->next;
+    }
+
+    rwlock_writerunlock(&client_list_rwlock);
+
+    if (delivery_mode == DELIVERY_MODE_PULL)
+    {
+        wake_room_writer();
+    }
+
+    if (owed != NULL)
+    {
+        send_to_client(connection->socket, owed->data, owed->length, error);
+        free(owed);
+    }
+
+    *inherited = *connection;
+    inherited->output = NULL;
+    inherited->output_length = 0;
+
+    client_thread_args->client_socket = connection->socket;
+    client_thread_args->callback_error_func = server_callback_error_func;
+    client_thread_args->inherited = inherited;
+
+    thread_t handle_thread;
+    if (thread_create(&handle_thread, handle_client_thread, client_thread_args) != 0)
+    {
+        unregister_reader();
+        release_connection();
+        // remove_client closes the socket
+        remove_client(connection->socket, error);
+        free(inherited);
+        free(client_thread_args);
+        connection->socket = INVALID_SOCK;
+        add_error(error, THREAD_CREATE_ERROR, NON_CRITICAL_ERROR, "Failed to create handle client thread, an inherited connection was dropped", "adopt_connection");
         return 1;
     }
 
-    accept_client_thread_args_t *thread_args = (accept_client_thread_args_t *)malloc(sizeof(accept_client_thread_args_t));
-    if (thread_args == NULL)
+    thread_detach(handle_thread);
+
+    // the thread owns the socket and the input now
+    connection->socket = INVALID_SOCK;
+    connection->input = NULL;
+
+    return 0;
+}
+
+static void start_upgrade_listener(error_list_t *error)
+{
+    upgrade_listener = upgrade_channel_listen(upgrade_socket_path, error);
+    if (upgrade_listener == INVALID_SOCK)
     {
-        add_error(main_error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for accept thread args", "start_chat_room");
-        socket_close(*listening_socket, main_error);
-        socket_cleanup(main_error);
-        free(listening_socket);
-        listening_socket = NULL;
+        return;
+    }
+
+    if (thread_create(&upgrade_thread, upgrade_listener_thread, NULL) != 0)
+    {
+        add_error(error, THREAD_CREATE_ERROR, NON_CRITICAL_ERROR, "Failed to create upgrade listener thread, the room can't be upgraded in place", "start_upgrade_listener");
+        upgrade_channel_close(upgrade_listener);
+        upgrade_listener = INVALID_SOCK;
+        return;
+    }
+
+    upgrade_thread_running = 1;
+}
+
+static void stop_upgrade_listener(void)
+{
+    // the thread sees server_running drop or the room closing within one poll, a handoff it is in the middle of runs to its end first
+    if (upgrade_thread_running)
+    {
+        thread_join(upgrade_thread);
+        upgrade_thread_running = 0;
+    }
+
+    // the socket file stays, whoever listens on the path next replaces it
+    upgrade_channel_close(upgrade_listener);
+    upgrade_listener = INVALID_SOCK;
+}
+
+int start_chat_room(const char *admin_username, char *local_ip, error_list_t *main_error, void (*callback_error_func)(const char *, int))
+{
+    if (utf8_check_text(admin_username, USERNAME_MAX_CHARACTERS) != UTF8_VALID)
+    {
+        add_error(main_error, ERR_USERNAME_TOO_LONG, CRITICAL_ERROR, "Username must be valid UTF-8 of at most 20 characters", "start_chat_room");
         return 1;
     }
 
-    thread_args->listening_socket = listening_socket;
-    thread_args->callback_error_func = callback_error_func;
+    // a room that ended on its own (handed off, or its listener failed) left its accept thread to be joined
+    if (atomic_exchange(&accept_thread_joinable, 0))
+    {
+        thread_join(accept_thread);
+    }
 
-    atomic_store(&server_running, 1);
+    rwlock_init(&client_list_rwlock);
+    mutex_init(&handoff_mutex);
+    cond_init(&handoff_cond);
+    mutex_init(&listener_mutex);
+    server_callback_error_func = callback_error_func;
+    room_handed_off = 0;
+    atomic_store(&room_closing, 0);
+    atomic_store(&room_drained, 0);
+
+    // like the ban filter it outlives the room, it is empty again once every client is removed
+    if (username_index.entries == NULL && username_index_init(&username_index, main_error) != 0)
+    {
+        return 1;
+    }
+
+    if (!ban_filter_ready)
+    {
+        if (ban_filter_init(&ban_filter, main_error) != 0)
+        {
+            return 1;
+        }
+        ban_filter_ready = 1;
+
+        // a malformed preset only loses the entries after the bad one
+        if (banned_addresses_preset != NULL && ban_filter_add_list(&ban_filter, banned_addresses_preset, main_error) != 0)
+        {
+            report_errors(main_error, callback_error_func);
+            init_error(main_error);
+        }
+    }
+
+    if (!content_filter_ready)
+    {
+        content_filter_init(&content_filter);
+        content_filter_ready = 1;
+    }
+
+    // a room without a usable blob store still chats, it only refuses attachments
+    attachments_enabled = blob_store_init(blob_directory_preset, main_error) == 0;
+    if (main_error->count > 0)
+    {
+        report_errors(main_error, callback_error_func);
+        init_error(main_error);
+    }
+
+    // federated nodes share one key so a client can join the room through any of them
+    if (!secret_key_preset)
+    {
+        generate_secret_key(global_secret_key, sizeof(global_secret_key));
+    }
+
+    int result_code;
+
+    listening_socket = (socket_t *)malloc(sizeof(socket_t));
+    if (listening_socket == NULL)
+    {
+        add_error(main_error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for listening socket", "start_chat_room");
+        return 1;
+    }
+
+    result_code = socket_init(main_error);
+    if (result_code != 0)
+    {
+        free(listening_socket);
+        listening_socket = NULL;
+        return 1;
+    }
+
+    if (get_local_ip(local_ip, INET_ADDRSTRLEN) != 0)
+    {
+        add_error(main_error, ERR_LOCAL_IP_FAILURE, CRITICAL_ERROR, "Failed to retrieve local IP address", "start_chat_room");
+        return 1;
+    }
+
+    // the previous server keeps the port bound and its clients connected until this one has taken them over
+    upgrade_state_t inherited;
+    if (take_over_room(&inherited, main_error) != 0)
+    {
+        socket_cleanup(main_error);
+        free(listening_socket);
+        listening_socket = NULL;
+        return 1;
+    }
+    if (main_error->count > 0)
+    {
+        report_errors(main_error, callback_error_func);
+        init_error(main_error);
+    }
+
+    if (inherited.listening_socket != INVALID_SOCK)
+    {
+        *listening_socket = inherited.listening_socket;
+        inherited.listening_socket = INVALID_SOCK;
+    }
+    else
+    {
+        *listening_socket = open_listening_socket(local_ip, main_error);
+    }
+
+    if (*listening_socket == INVALID_SOCK)
+    {
+        upgrade_state_free(&inherited, 1);
+        socket_cleanup(main_error);
+        free(listening_socket);
+        listening_socket = NULL;
+        return 1;
+    }
+
+    accept_client_thread_args_t *thread_args = (accept_client_thread_args_t *)malloc(sizeof(accept_client_thread_args_t));
+    if (thread_args == NULL)
+    {
+        add_error(main_error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for accept thread args", "start_chat_room");
+        upgrade_state_free(&inherited, 1);
+        socket_close(*listening_socket, main_error);
+        socket_cleanup(main_error);
+        free(listening_socket);
+        listening_socket = NULL;
+        return 1;
+    }
+
+    thread_args->listening_socket = listening_socket;
+    thread_args->callback_error_func = callback_error_func;
+
+    if (delivery_mode == DELIVERY_MODE_PULL && room_logs_init(main_error) != 0)
+    {
+        upgrade_state_free(&inherited, 1);
+        socket_close(*listening_socket, main_error);
+        socket_cleanup(main_error);
+        free(listening_socket);
+        listening_socket = NULL;
+        free(thread_args);
+        return 1;
+    }
+
+    atomic_store(&server_running, 1);
+
+    if (delivery_mode == DELIVERY_MODE_PULL)
+    {
+        mutex_init(&room_writer_mutex);
+        cond_init(&room_writer_cond);
+        mutex_init(&room_writer_pass_mutex);
+
+        if (start_room_writer(main_error) != 0)
+        {
+            atomic_store(&server_running, 0);
+            room_logs_destroy();
+            upgrade_state_free(&inherited, 1);
+            socket_close(*listening_socket, main_error);
+            socket_cleanup(main_error);
+            free(listening_socket);
+            listening_socket = NULL;
+            free(thread_args);
+            return 1;
+        }
+    }
+
+    // without presence the room still works, clients just don't get a user list
+    if (presence_start(broadcast_presence_frame, main_error) != 0)
+    {
+        report_errors(main_error, callback_error_func);
+        init_error(main_error);
+    }
+
+    // without it the room works the same, members just don't see who is typing
+    mutex_init(&typing_frame_mutex);
+    typing_frame_length = 0;
+    typing_generation = 0;
+    if (typing_start(publish_typing_frame, main_error) != 0)
+    {
+        report_errors(main_error, callback_error_func);
+        init_error(main_error);
+    }
+
+    // without the index the room just can't be searched
+    if (search_index_start(main_error) != 0)
+    {
+        report_errors(main_error, callback_error_func);
+        init_error(main_error);
+    }
+
+    // without workers every connection reader handles its own frames
+    if (worker_pool_start(worker_pool_size, main_error) != 0)
+    {
+        report_errors(main_error, callback_error_func);
+        init_error(main_error);
+    }
+
+    // a node that can't reach the bus still serves its own clients
+    if (federation_enabled && federation_start(&federation_config, global_secret_key, broadcast_federated_frame, main_error, callback_error_func) != 0)
+    {
+        report_errors(main_error, callback_error_func);
+        init_error(main_error);
+    }
+
+    // the connections are adopted before the accept thread runs, so admission sees them counted
+    for (size_t i = 0; i < inherited.connection_count; i++)
+    {
+        if (adopt_connection(&inherited.connections[i], main_error) != 0)
+        {
+            report_errors(main_error, callback_error_func);
+            init_error(main_error);
+        }
+    }
+    upgrade_state_free(&inherited, 1);
+
+    // the room keeps running without it, it just can't be upgraded in place
+    if (upgrade_socket_path[0] != '\0')
+    {
+        start_upgrade_listener(main_error);
+        if (main_error->count > 0)
+        {
+            report_errors(main_error, callback_error_func);
+            init_error(main_error);
+        }
+    }
+
+    // likewise, local clients fall back to TCP
+    if (local_transport_path[0] != '\0')
+    {
+        local_listener = local_transport_listen(local_transport_path, main_error);
+        if (main_error->count > 0)
+        {
+            report_errors(main_error, callback_error_func);
+            init_error(main_error);
+        }
+    }
+
+    listener_open = 1;
+
+    if (thread_create(&accept_thread, accept_client_thread, thread_args) != 0)
+    {
+        listener_open = 0;
+        atomic_store(&server_running, 0);
+        add_error(main_error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create accept client thread", "start_chat_room");
+        stop_upgrade_listener();
+        local_transport_close_listener(local_listener);
+        local_listener = INVALID_SOCK;
+        federation_stop();
+        worker_pool_stop();
+        search_index_stop();
+        typing_stop();
+        presence_stop();
+        if (delivery_mode == DELIVERY_MODE_PULL)
+        {
+            join_room_writer();
+            room_logs_destroy();
+        }
+        socket_close(*listening_socket, main_error);
+        socket_cleanup(main_error);
+        free(listening_socket);
+        listening_socket = NULL;
+        free(thread_args);
+        return 1;
+    }
+
+    atomic_store(&accept_thread_joinable, 1);
+
+    return 0;
+}
+
+// local connections go through the same admission as TCP ones, all of them come from the loopback address
+static void accept_local_clients(void (*callback_error_func)(const char *, int))
+{
+    struct sockaddr_in loopback_addr;
+    memset(&loopback_addr, 0, sizeof(loopback_addr));
+    loopback_addr.sin_family = AF_INET;
+    loopback_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (int accepted = 0; accepted < ACCEPT_BATCH && atomic_load(&server_running); accepted++)
+    {
+        error_list_t accept_error;
+        init_error(&accept_error);
+
+        socket_t client_socket = local_transport_accept(local_listener, server_port, &accept_error);
+        if (client_socket == INVALID_SOCK)
+        {
+            if (accept_error.count > 0)
+            {
+                report_errors(&accept_error, callback_error_func);
+            }
+            break;
+        }
+
+        if (ban_filter_contains(&ban_filter, INADDR_LOOPBACK))
+        {
+            socket_close(client_socket, &accept_error);
+            continue;
+        }
+
+        if (admit_client(client_socket, &loopback_addr, &accept_error, callback_error_func) != 0)
+        {
+            report_errors(&accept_error, callback_error_func);
+        }
+    }
+}
+
+// pull delivery leaves the goodbye to the room writer, it knows when a client has nothing queued any more.
+// push delivery has no queues, every client gets the notice right away
+static void drain_room(void)
+{
+    if (delivery_mode == DELIVERY_MODE_PULL)
+    {
+        if (!room_writer_running)
+        {
+            return;
+        }
+
+        wake_room_writer();
+
+        uint64_t drain_deadline = cross_platform_monotonic_ms() + ROOM_CLOSE_DRAIN_TIMEOUT_MS;
+        while (!atomic_load(&room_drained) && cross_platform_monotonic_ms() < drain_deadline)
+        {
+            cross_platform_sleep_ms(ROOM_CLOSE_POLL_MS);
+        }
+        return;
+    }
+
+    error_list_t drain_error;
+    init_error(&drain_error);
+
+    rwlock_readerlock(&client_list_rwlock);
+
+    for (client_node_t *current_client = client_list; current_client != NULL; current_client = current_client->next)
+    {
+        if (current_client->client_info.socket == LOCAL_MEMBER_SOCKET || current_client->transfer)
+        {
+            continue;
+        }
+
+        send_notification(current_client->client_info.socket, NOTIFICATION_DISCONNECT, "The host closed the room", current_client->client_info.username, &drain_error, server_callback_error_func);
+        init_error(&drain_error);
+        socket_shutdown(current_client->client_info.socket, &drain_error);
+        init_error(&drain_error);
+    }
+
+    rwlock_readerunlock(&client_list_rwlock);
+}
+
+// a shutdown wakes every connection's reader at once and each one removes its own client.
+// whatever is still listed after ROOM_CLOSE_EXIT_TIMEOUT_MS is closed from here, its thread finds the client gone
+static void disconnect_remaining_clients(error_list_t *error)
+{
+    error_list_t shutdown_error;
+    init_error(&shutdown_error);
+
+    rwlock_readerlock(&client_list_rwlock);
+
+    for (client_node_t *current_client = client_list; current_client != NULL; current_client = current_client->next)
+    {
+        if (current_client->client_info.socket != LOCAL_MEMBER_SOCKET)
+        {
+            // a socket the writer already shut down only fails again, nothing worth reporting
+            socket_shutdown(current_client->client_info.socket, &shutdown_error);
+            init_error(&shutdown_error);
+        }
+    }
+
+    rwlock_readerunlock(&client_list_rwlock);
+
+    uint64_t exit_deadline = cross_platform_monotonic_ms() + ROOM_CLOSE_EXIT_TIMEOUT_MS;
+    while (atomic_load(&connection_count) > 0 && cross_platform_monotonic_ms() < exit_deadline)
+    {
+        cross_platform_sleep_ms(ROOM_CLOSE_POLL_MS);
+    }
+
+    remove_all_clients(error);
+}
+
+thread_ret_t THREAD_CALL accept_client_thread(void *arg)
+{
+    accept_client_thread_args_t *thread_args = (accept_client_thread_args_t *)arg;
+
+    socket_t *listening_socket = thread_args->listening_socket;
+    void (*callback_error_func)(const char *, int) = thread_args->callback_error_func;
+
+    // accepted sockets come out non-blocking, the listener must not block either or a drained backlog stalls the batch
+    error_list_t listen_error;
+    init_error(&listen_error);
+    if (socket_set_nonblocking(*listening_socket, 1, &listen_error) != 0)
+    {
+        report_errors(&listen_error, callback_error_func);
+        atomic_store(&server_running, 0);
+    }
+
+    register_reader();
+
+    uint64_t next_memory_report_ms = cross_platform_monotonic_ms() + MEMORY_REPORT_INTERVAL_MS;
+
+    while (atomic_load(&server_running) && !atomic_load(&room_closing))
+    {
+        if (atomic_load(&handoff_pending))
+        {
+            park_for_handoff();
+            continue;
+        }
+
+        // the poll below wakes this thread at least every ACCEPT_POLL_TIMEOUT_MS. the log gets the totals in KB,
+        // format_memory_report has every category in bytes
+        if (cross_platform_monotonic_ms() >= next_memory_report_ms)
+        {
+            int connections = atomic_load(&charged_connections);
+            size_t total = memory_budget_total();
+            log_event(LOG_LEVEL_INFO, "accept_client_thread", "Memory: %d connections use %d KB of a %d KB budget (%d KB stacks, %d KB queued), %d bytes per connection",
+                      connections, (int)(total / 1024), (int)(memory_budget_get() / 1024), (int)(memory_budget_used(MEMORY_STACK) / 1024),
+                      (int)((memory_budget_used(MEMORY_OUTBOX) + memory_budget_used(MEMORY_INBOX)) / 1024), connections > 0 ? (int)(total / (size_t)connections) : 0);
+            next_memory_report_ms = cross_platform_monotonic_ms() + MEMORY_REPORT_INTERVAL_MS;
+        }
+
+        error_list_t accept_error;
+        init_error(&accept_error);
+
+        pollfd_t listen_fds[2];
+        listen_fds[0].fd = *listening_socket;
+        listen_fds[0].events = POLLIN;
+        listen_fds[0].revents = 0;
+        listen_fds[1].fd = local_listener;
+        listen_fds[1].events = POLLIN;
+        listen_fds[1].revents = 0;
+
+        int ready = socket_poll(listen_fds, local_listener == INVALID_SOCK ? 1 : 2, ACCEPT_POLL_TIMEOUT_MS, &accept_error);
+        if (ready <= 0)
+        {
+            if (ready == SOCKET_ERR)
+            {
+                report_errors(&accept_error, callback_error_func);
+                cross_platform_sleep_ms(ACCEPT_BACKOFF_MS);
+            }
+            continue;
+        }
+
+        if (listen_fds[1].revents & POLLIN)
+        {
+            accept_local_clients(callback_error_func);
+        }
+        if (!(listen_fds[0].revents & POLLIN))
+        {
+            continue;
+        }
+
+        int stop_accepting = 0;
+        for (int accepted = 0; accepted < ACCEPT_BATCH && atomic_load(&server_running) && !atomic_load(&room_closing); accepted++)
+        {
+            struct sockaddr_in client_addr;
+
+            socket_t client_socket = socket_accept_nonblocking(*listening_socket, (struct sockaddr *)&client_addr, listener_socket_profile, &accept_error);
+            if (client_socket == INVALID_SOCK)
+            {
+                error_code_t err = last_error_code(&accept_error);
+                if (accept_error.count > 0)
+                {
+                    report_errors(&accept_error, callback_error_func);
+                }
+
+                if (accept_error.max_severity == CRITICAL_ERROR)
+                {
+                    stop_accepting = 1;
+                }
+                else if (err == SOCKET_EMFILE || err == SOCKET_ENOBUFS)
+                {
+                    // accepting again right away would fail the same way, give the readers time to release descriptors
+                    cross_platform_sleep_ms(ACCEPT_BACKOFF_MS);
+                }
+                break;
+            }
+
+            // banned addresses are dropped before anything is allocated for them, reconnect spam costs one lookup and a close
+            if (ban_filter_contains(&ban_filter, ntohl(client_addr.sin_addr.s_addr)))
+            {
+                socket_close(client_socket, &accept_error);
+                continue;
+            }
+
+            if (admit_client(client_socket, &client_addr, &accept_error, callback_error_func) != 0)
+            {
+                report_errors(&accept_error, callback_error_func);
+                init_error(&accept_error);
+            }
+        }
+
+        if (stop_accepting)
+        {
+            break;
+        }
+    }
+
+    unregister_reader();
+
+    error_list_t cleanup_error;
+    init_error(&cleanup_error);
+
+    // first, a handoff still running may otherwise restart the room writer below, and it captures the listener
+    stop_upgrade_listener();
+
+    // nothing new gets in while the room drains, connections still in the backlog are refused with the listener
+    mutex_lock(&listener_mutex);
+    listener_open = 0;
+    socket_close(*listening_socket, &cleanup_error);
+    mutex_unlock(&listener_mutex);
+    // the socket file stays, whoever listens on the path next replaces it
+    local_transport_close_listener(local_listener);
+    local_listener = INVALID_SOCK;
+
+    if (atomic_load(&room_closing) && !room_handed_off)
+    {
+        drain_room();
+    }
+
+    atomic_store(&server_running, 0);
+    federation_stop();
+    typing_stop();
+    presence_stop();
+
+    if (delivery_mode == DELIVERY_MODE_PULL)
+    {
+        join_room_writer();
+    }
+
+    leave_chat_room_locally();
+    disconnect_remaining_clients(&cleanup_error);
+    worker_pool_stop();
+    // after the workers, none of them is in a query or a broadcast any more
+    search_index_stop();
+    if (delivery_mode == DELIVERY_MODE_PULL)
+    {
+        room_logs_destroy();
+    }
+    socket_cleanup(&cleanup_error);
+    free(listening_socket);
+    listening_socket = NULL;
+
+    if (cleanup_error.count > 0)
+    {
+        report_errors(&cleanup_error, callback_error_func);
+    }
+
+    free(thread_args);
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+int admit_client(socket_t client_socket, struct sockaddr_in *client_addr, error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    // only this thread adds clients, so the counts can only shrink between the check and add_client
+    if (atomic_load(&connection_count) >= max_connections)
+    {
+        shed_client(client_socket, "Server is full", error);
+        add_error(error, ERR_SERVER_FULL, NON_CRITICAL_ERROR, "Connection limit reached, a new connection was rejected", "admit_client");
+        return 1;
+    }
+
+    if (atomic_load(&pending_auth_count) >= max_pending_auth)
+    {
+        shed_client(client_socket, "Too many pending connections", error);
+        add_error(error, ERR_SERVER_FULL, NON_CRITICAL_ERROR, "Too many unauthenticated connections, a new connection was rejected", "admit_client");
+        return 1;
+    }
+
+    if (charge_connection(1) != 0)
+    {
+        shed_client(client_socket, "Server is busy", error);
+        add_error(error, ERR_MEMORY_BUDGET, NON_CRITICAL_ERROR, "The memory budget is spent, a new connection was rejected", "admit_client");
+        return 1;
+    }
+
+    user_info_t client_info;
+    client_info.socket = client_socket;
+    client_info.address = *client_addr;
+    client_info.username[0] = '\0';
+    client_info.user_type = USER_TYPE_REGULAR;
+
+    handle_client_thread_args_t *client_thread_args = (handle_client_thread_args_t *)malloc(sizeof(handle_client_thread_args_t));
+    if (client_thread_args == NULL)
+    {
+        release_connection();
+        shed_client(client_socket, "Server is busy", error);
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for client thread args, the connection was shed", "admit_client");
+        return 1;
+    }
+
+    // counted before the thread exists, a handoff starting now waits for the new reader to park as well
+    register_reader();
+
+    if (add_client(&client_info, error) != 0)
+    {
+        unregister_reader();
+        release_connection();
+        shed_client(client_socket, "Server is busy", error);
+        free(client_thread_args);
+        return 1;
+    }
+
+    client_thread_args->client_socket = client_socket;
+    client_thread_args->callback_error_func = callback_error_func;
+    client_thread_args->inherited = NULL;
+
+    thread_t handle_thread;
+    if (thread_create(&handle_thread, handle_client_thread, client_thread_args) != 0)
+    {
+        unregister_reader();
+        release_connection();
+        // remove_client closes the socket
+        remove_client(client_socket, error);
+        free(client_thread_args);
+        add_error(error, THREAD_CREATE_ERROR, NON_CRITICAL_ERROR, "Failed to create handle client thread, the connection was shed", "admit_client");
+        return 1;
+    }
+
+    thread_detach(handle_thread);
+
+    return 0;
+}
+
+void shed_client(socket_t client_socket, const char *reason, error_list_t *error)
+{
+    char buffer[ERROR_NOTIFICATION_BUFFER_SIZE];
+    int length = snprintf(buffer, sizeof(buffer), "%d:%d:%s", MSG_TYPE_ERROR, ERROR_GENERAL, reason);
+
+    // best effort, a shed client must not hold up the accept loop
+    if (length > 0 && (size_t)length < sizeof(buffer))
+    {
+        error_list_t send_error;
+        init_error(&send_error);
+        socket_send_nonblocking(client_socket, buffer, (size_t)length + 1, &send_error);
+    }
+
+    socket_close(client_socket, error);
+}
+
+static void set_handoff_input(socket_t client_socket, int ready, const char *input, size_t input_length)
+{
+    rwlock_readerlock(&client_list_rwlock);
+
+    client_node_t *current_client = client_list;
+    while (current_client != NULL)
+    {
+        if (current_client->client_info.socket == client_socket)
+        {
+            // only this connection's reader writes these, the handoff reads them once every reader is parked
+            current_client->handoff_ready = ready;
+            current_client->handoff_input = input;
+            current_client->handoff_input_length = input_length;
+            break;
+        }
+        current_client = current_client->next;
+    }
+
+    rwlock_readerunlock(&client_list_rwlock);
+}
+
+// the reader parks between frames with every frame it read handled, so the connection's state is settled for the capture
+static void park_client_reader(socket_t client_socket, client_strand_t *strand, frame_reader_t *frame_reader)
+{
+    mutex_lock(&strand->mutex);
+    while (strand->scheduled)
+    {
+        cond_wait(&strand->cond, &strand->mutex);
+    }
+    mutex_unlock(&strand->mutex);
+
+    set_handoff_input(client_socket, 1, frame_reader->buffer + frame_reader->offset, frame_reader->length - frame_reader->offset);
+    park_for_handoff();
+    // after a handoff that went through the client is no longer listed, this finds nothing
+    set_handoff_input(client_socket, 0, NULL, 0);
+}
+
+thread_ret_t THREAD_CALL handle_client_thread(void *arg)
+{
+    handle_client_thread_args_t *thread_args = (handle_client_thread_args_t *)arg;
+
+    socket_t client_socket = thread_args->client_socket;
+    void (*callback_error_func)(const char *, int) = thread_args->callback_error_func;
+
+    char client_username[USERNAME_BUFFER_SIZE];
+    client_username[0] = '\0';
+
+    frame_reader_t *frame_reader = (frame_reader_t *)malloc(sizeof(frame_reader_t));
+    client_strand_t *strand = (client_strand_t *)malloc(sizeof(client_strand_t));
+    if (frame_reader == NULL || strand == NULL)
+    {
+        error_list_t allocation_error;
+        init_error(&allocation_error);
+        add_error(&allocation_error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for frame reader", "handle_client_thread");
+        report_errors(&allocation_error, callback_error_func);
+        free(frame_reader);
+        free(strand);
+        frame_reader = NULL;
+        strand = NULL;
+    }
+    else
+    {
+        frame_reader_init(frame_reader);
+        client_strand_init(strand, client_socket, callback_error_func);
+    }
+
+    // a connection whose first frame is a transfer request carries one attachment and nothing else
+    char *transfer_frame = NULL;
+    int frames_seen = 0;
+
+    upgrade_connection_t *inherited = thread_args->inherited;
+    if (inherited != NULL)
+    {
+        if (frame_reader != NULL)
+        {
+            // the previous server's reader stopped between frames, the partial frame it had read continues here
+            if (inherited->input_length > 0)
+            {
+                memcpy(frame_reader->buffer, inherited->input, inherited->input_length);
+            }
+            frame_reader->length = inherited->input_length;
+
+            if (inherited->username[0] != '\0')
+            {
+                // no task has run on the strand yet, it is this thread's alone
+                strcpy(strand->username, inherited->username);
+                strand->member_id = inherited->member_id;
+                frames_seen = 1;
+            }
+        }
+
+        free(inherited->input);
+        free(inherited);
+    }
+
+    // an inherited connection that hasn't authenticated gets a fresh deadline
+    uint64_t auth_deadline = cross_platform_monotonic_ms() + (uint64_t)auth_deadline_ms;
+
+    while (frame_reader != NULL && transfer_frame == NULL && atomic_load(&server_running))
+    {
+        if (atomic_load(&handoff_pending))
+        {
+            park_client_reader(client_socket, strand, frame_reader);
+            continue;
+        }
+
+        error_list_t *error_struct = thread_error_context();
+
+        // the username is set by whichever worker processes the auth frame
+        mutex_lock(&strand->mutex);
+        strcpy(client_username, strand->username);
+        mutex_unlock(&strand->mutex);
+
+        int poll_timeout_ms = CLIENT_READ_POLL_TIMEOUT_MS;
+        if (client_username[0] == '\0')
+        {
+            uint64_t now = cross_platform_monotonic_ms();
+            if (now >= auth_deadline)
+            {
+                add_error(error_struct, ERR_AUTH_DEADLINE, NON_CRITICAL_ERROR, "Client did not authenticate in time and was disconnected", "handle_client_thread");
+                report_errors(error_struct, callback_error_func);
+                break;
+            }
+            if (auth_deadline - now < (uint64_t)poll_timeout_ms)
+            {
+                poll_timeout_ms = (int)(auth_deadline - now);
+            }
+        }
+
+        // the socket is non-blocking, waiting here keeps the auth deadline and shutdown checks running
+        pollfd_t client_fd;
+        client_fd.fd = client_socket;
+        client_fd.events = POLLIN;
+        client_fd.revents = 0;
+        int ready = socket_poll(&client_fd, 1, poll_timeout_ms, error_struct);
+        if (ready <= 0)
+        {
+            if (ready == SOCKET_ERR)
+            {
+                report_errors(error_struct, callback_error_func);
+                break;
+            }
+            continue;
+        }
+
+        int bytes_received = frame_reader_recv(frame_reader, client_socket, client_username, CONTEXT_SERVER, error_struct);
+
+        if (bytes_received == SOCKET_ERR)
+        {
+            if (last_error_code(error_struct) == SOCKET_EWOULDBLOCK)
+            {
+                // woken without data, nothing to report
+                init_error(error_struct);
+                continue;
+            }
+            else if (last_error_code(error_struct) == SOCKET_ECONNRESET)
+            {
+                // client got disconnected
+                report_errors(error_struct, callback_error_func);
+                break;
+            }
+            else
+            {
+                // other error occurred
+                report_errors(error_struct, callback_error_func);
+                continue;
+            }
+        }
+        else if (bytes_received == 0)
+        {
+            // client disconnected gracefully
+            break;
+        }
+
+        // the reader only splits frames, parsing, auth and broadcasting run on the worker pool
+        char *message_buffer;
+        while ((message_buffer = frame_reader_next(frame_reader)) != NULL)
+        {
+            // a closing room takes nothing new, the reader only stays to notice the connection go away
+            if (atomic_load(&room_closing))
+            {
+                continue;
+            }
+            if (frames_seen++ == 0 && atoi(message_buffer) == MSG_TYPE_TRANSFER)
+            {
+                transfer_frame = message_buffer;
+                break;
+            }
+            client_strand_enqueue(strand, message_buffer, strlen(message_buffer) + 1);
+        }
+    }
+
+    // no more frames are read, a transfer doesn't park and stays with this process through a handoff
+    unregister_reader();
+
+    if (transfer_frame != NULL)
+    {
+        // bulk bytes stay on this thread and this socket, the worker pool and every member's frames never wait on them
+        serve_transfer(client_socket, transfer_frame, frame_reader->buffer + frame_reader->offset, frame_reader->length - frame_reader->offset, callback_error_func);
+    }
+
+    free(frame_reader);
+
+    if (strand != NULL)
+    {
+        // frames still queued belong to a client that is gone, a worker may be in the middle of one though
+        client_strand_close(strand);
+    }
+
+    error_list_t disconnection_error;
+    init_error(&disconnection_error);
+    remove_client(client_socket, &disconnection_error);
+
+    if (strand != NULL)
+    {
+        client_strand_destroy(strand);
+        free(strand);
+    }
+
+    if (disconnection_error.count > 0)
+    {
+        report_errors(&disconnection_error, callback_error_func);
+    }
+
+    logger_thread_detach();
+    free(thread_args);
+    release_connection();
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+void client_strand_init(client_strand_t *strand, socket_t client_socket, void (*callback_error_func)(const char *, int))
+{
+    strand->client_socket = client_socket;
+    strand->callback_error_func = callback_error_func;
+    strand->username[0] = '\0';
+    strand->member_id = 0;
+    strand->alias_lanes = 0;
+    mutex_init(&strand->mutex);
+    cond_init(&strand->cond);
+    strand->inbox_head = NULL;
+    strand->inbox_tail = NULL;
+    strand->pending = 0;
+    strand->pending_bytes = 0;
+    strand->scheduled = 0;
+    strand->closing = 0;
+}
+
+void client_strand_destroy(client_strand_t *strand)
+{
+    outbox_frame_t *frame = strand->inbox_head;
+    while (frame != NULL)
+    {
+        outbox_frame_t *next_frame = frame->next;
+        free(frame);
+        frame = next_frame;
+    }
+    strand->inbox_head = NULL;
+    strand->inbox_tail = NULL;
+    memory_budget_release(MEMORY_INBOX, strand->pending_bytes);
+    strand->pending_bytes = 0;
+
+    mutex_destroy(&strand->mutex);
+    cond_destroy(&strand->cond);
+}
+
+static void set_strand_username(client_strand_t *strand, const char *username)
+{
+    mutex_lock(&strand->mutex);
+    strncpy(strand->username, username, sizeof(strand->username) - 1);
+    strand->username[sizeof(strand->username) - 1] = '\0';
+    mutex_unlock(&strand->mutex);
+}
+
+void client_strand_enqueue(client_strand_t *strand, const char *frame, size_t length)
+{
+    outbox_frame_t *inbox_frame = (outbox_frame_t *)malloc(sizeof(outbox_frame_t) + length);
+    if (inbox_frame == NULL)
+    {
+        error_list_t *error = thread_error_context();
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for an inbox frame, the frame was dropped", "client_strand_enqueue");
+        report_errors(error, strand->callback_error_func);
+        return;
+    }
+
+    inbox_frame->next = NULL;
+    inbox_frame->length = length;
+    memcpy(inbox_frame->data, frame, length);
+
+    size_t frame_bytes = sizeof(outbox_frame_t) + length;
+    int over_budget = memory_budget_try_charge(MEMORY_INBOX, frame_bytes) != 0;
+
+    mutex_lock(&strand->mutex);
+
+    // a client that sends faster than the workers keep up waits here instead of growing its inbox.
+    // once the memory budget is spent every client gets a single frame queued at a time
+    while ((strand->pending >= CLIENT_STRAND_MAX_PENDING || (over_budget && strand->pending > 0)) && !strand->closing)
+    {
+        cond_wait(&strand->cond, &strand->mutex);
+    }
+
+    if (over_budget)
+    {
+        memory_budget_charge(MEMORY_INBOX, frame_bytes);
+    }
+
+    if (strand->inbox_tail == NULL)
+    {
+        strand->inbox_head = inbox_frame;
+    }
+    else
+    {
+        strand->inbox_tail->next = inbox_frame;
+    }
+    strand->inbox_tail = inbox_frame;
+    strand->pending++;
+    strand->pending_bytes += frame_bytes;
+
+    int needs_schedule = !strand->scheduled;
+    strand->scheduled = 1;
+
+    mutex_unlock(&strand->mutex);
+
+    if (needs_schedule && worker_pool_submit(run_client_strand, strand) != 0)
+    {
+        // no pool (not started or shutting down), the reader does the work itself
+        run_client_strand(strand);
+    }
+}
+
+void run_client_strand(void *arg)
+{
+    client_strand_t *strand = (client_strand_t *)arg;
+    error_list_t *error = thread_error_context();
+
+    while (1)
+    {
+        for (int processed = 0; processed < CLIENT_STRAND_BATCH_FRAMES; processed++)
+        {
+            mutex_lock(&strand->mutex);
+
+            outbox_frame_t *frame = strand->closing ? NULL : strand->inbox_head;
+            if (frame == NULL)
+            {
+                strand->scheduled = 0;
+                cond_broadcast(&strand->cond);
+                mutex_unlock(&strand->mutex);
+                return;
+            }
+
+            strand->inbox_head = frame->next;
+            if (strand->inbox_head == NULL)
+            {
+                strand->inbox_tail = NULL;
+            }
+            strand->pending--;
+            strand->pending_bytes -= sizeof(outbox_frame_t) + frame->length;
+            cond_broadcast(&strand->cond);
+
+            mutex_unlock(&strand->mutex);
+
+            // frames of one client are handled one at a time and in order, whichever worker runs the strand
+            init_error(error);
+            process_client_frame(strand, frame->data, error);
+            memory_budget_release(MEMORY_INBOX, sizeof(outbox_frame_t) + frame->length);
+            free(frame);
+        }
+
+        // a chatty client gives the worker back after a batch and queues up behind everyone else
+        if (worker_pool_submit(run_client_strand, strand) == 0)
+        {
+            return;
+        }
+    }
+}
+
+void client_strand_close(client_strand_t *strand)
+{
+    mutex_lock(&strand->mutex);
+
+    strand->closing = 1;
+    cond_broadcast(&strand->cond);
+
+    while (strand->scheduled)
+    {
+        cond_wait(&strand->cond, &strand->mutex);
+    }
+
+    mutex_unlock(&strand->mutex);
+}
+
+// everything a member sends is checked here once, receivers and the fan-out take names and messages as well formed
+static int reject_invalid_text(client_strand_t *strand, const char *text, size_t max_code_points, error_type_t error_type, const char *reason, error_list_t *error)
+{
+    if (utf8_check_text(text, max_code_points) == UTF8_VALID)
+    {
+        return 0;
+    }
+
+    send_error(strand->client_socket, error_type, reason, error, strand->callback_error_func);
+    return 1;
+}
+
+// the room's content filter runs on the decoded text, a masked message is encoded again before it goes out.
+// returns nonzero when the message is blocked
+static int filter_message(const char *sender_username, char *message, char *encoded_message, size_t encoded_message_size)
+{
+    unsigned int actions = content_filter_apply(&content_filter, message);
+
+    if (actions & CONTENT_ACTION_FLAG)
+    {
+        log_event(LOG_LEVEL_WARNING, "filter_message", "A message from %s matched a flagged pattern: %s", sender_username, message);
+    }
+
+    if (actions & CONTENT_ACTION_BLOCK)
+    {
+        return 1;
+    }
+
+    if (actions & CONTENT_ACTION_MASK)
+    {
+        encode_message(message, encoded_message, encoded_message_size);
+    }
+
+    return 0;
+}
+
+void process_client_frame(client_strand_t *strand, char *frame, error_list_t *error)
+{
+    int msg_type;
+    if (sscanf(frame, "%d:", &msg_type) != 1)
+    {
+        return;
+    }
+
+    if (msg_type == MSG_TYPE_AUTH)
+    {
+        user_type_t user_type;
+        char received_secret_key[ENCODED_SECRET_KEY_BUFFER_SIZE];
+        char received_username[USERNAME_BUFFER_SIZE];
+
+        sscanf(frame, "%*d:%d:%72[^:]:%80[^:]", (int *)&user_type, received_secret_key, received_username);
+
+        received_secret_key[ENCODED_SECRET_KEY_BUFFER_SIZE - 1] = '\0';
+        received_username[USERNAME_BUFFER_SIZE - 1] = '\0';
+
+        if (user_type == USER_TYPE_ADMIN)
+        {
+            // the host joins in process, a connection claiming to be the admin is impersonating it
+            send_error(strand->client_socket, ERROR_GENERAL, "Admin sessions can only be opened by the host", error, strand->callback_error_func);
+        }
+        else
+        {
+            char decoded_secret_key[SECRET_KEY_BUFFER_SIZE];
+            decode_message(received_secret_key, decoded_secret_key, sizeof(decoded_secret_key));
+
+            if (strcmp(decoded_secret_key, global_secret_key) != 0)
+            {
+                send_error(strand->client_socket, ERROR_SECRET_KEY, "Incorrect secret key", error, strand->callback_error_func);
+                return;
+            }
+
+            if (reject_invalid_text(strand, received_username, USERNAME_MAX_CHARACTERS, ERROR_USERNAME, "Username must be valid UTF-8 of at most 20 characters", error))
+            {
+                return;
+            }
+
+            // auth frames of different connections run on different workers, only the writer lock can tell who got the name
+            uint32_t member_id = update_client_info(strand->client_socket, received_username, user_type, error);
+            if (member_id == 0)
+            {
+                send_error(strand->client_socket, ERROR_USERNAME, "Username already taken", error, strand->callback_error_func);
+                return;
+            }
+
+            strand->member_id = member_id;
+            set_strand_username(strand, received_username);
+            // a renamed member has to be aliased again before its next message
+            strand->alias_lanes = 0;
+
+            send_notification(strand->client_socket, NOTIFICATION_AUTH_SUCCESS, "", strand->username, error, strand->callback_error_func);
+        }
+
+        if (error->count > 0)
+        {
+            report_errors(error, strand->callback_error_func);
+        }
+    }
+    else if (msg_type == MSG_TYPE_MESSAGE)
+    {
+        char encoded_message[ENCODED_MESSAGE_BUFFER_SIZE];
+        encoded_message[0] = '\0';
+
+        sscanf(frame, "%*d:%3000[^:]", encoded_message);
+
+        encoded_message[ENCODED_MESSAGE_BUFFER_SIZE - 1] = '\0';
+
+        if (strand->member_id == 0)
+        {
+            return;
+        }
+
+        // decoded text is never longer than its encoding, so nothing is cut off before it is counted
+        char decoded_message[ENCODED_MESSAGE_BUFFER_SIZE];
+        decode_message(encoded_message, decoded_message, sizeof(decoded_message));
+        if (reject_invalid_text(strand, decoded_message, MESSAGE_MAX_CHARACTERS, ERROR_GENERAL, "Messages must be valid UTF-8 of at most 250 characters", error))
+        {
+            return;
+        }
+
+        if (filter_message(strand->username, decoded_message, encoded_message, sizeof(encoded_message)))
+        {
+            send_error(strand->client_socket, ERROR_GENERAL, "Your message was blocked by the room's content filter", error, strand->callback_error_func);
+            return;
+        }
+
+        // a sent message ends the member's typing, whether or not its client said so
+        typing_record(strand->member_id, 0);
+        broadcast_member_alias(FRAME_LANE_CHAT, strand->member_id, strand->username, &strand->alias_lanes);
+        broadcast_message(encoded_message, strand->username, strand->member_id, error, strand->callback_error_func);
+    }
+    else if (msg_type == MSG_TYPE_ATTACHMENT)
+    {
+        char hash_hex[BLOB_HASH_HEX_BUFFER_SIZE];
+        char name[ATTACHMENT_NAME_BUFFER_SIZE];
+        uint64_t size;
+        uint64_t stored_size;
+
+        if (strand->member_id == 0)
+        {
+            return;
+        }
+
+        // only blobs that were uploaded completely are announced, the size has to match what is stored
+        if (parse_attachment_reference(strchr(frame, ':') + 1, hash_hex, &size, name, sizeof(name)) != 0 ||
+            blob_store_stat(hash_hex, &stored_size) != 0 || stored_size != size)
+        {
+            send_error(strand->client_socket, ERROR_GENERAL, "Unknown attachment, upload it before sharing it", error, strand->callback_error_func);
+            return;
+        }
+
+        if (reject_invalid_text(strand, name, ATTACHMENT_NAME_MAX_CHARACTERS, ERROR_GENERAL, "Attachment names must be valid UTF-8 of at most 100 characters", error))
+        {
+            return;
+        }
+
+        broadcast_member_alias(FRAME_LANE_BULK, strand->member_id, strand->username, &strand->alias_lanes);
+        broadcast_attachment(hash_hex, size, name, strand->member_id);
+    }
+    else if (msg_type == MSG_TYPE_SEARCH)
+    {
+        char query[SEARCH_QUERY_BUFFER_SIZE];
+        uint64_t since;
+        uint64_t until;
+
+        if (strand->member_id == 0)
+        {
+            return;
+        }
+
+        if (parse_search_request_frame(frame, query, sizeof(query), &since, &until) != 0)
+        {
+            send_error(strand->client_socket, ERROR_GENERAL, "Malformed search request", error, strand->callback_error_func);
+            return;
+        }
+
+        if (reject_invalid_text(strand, query, SEARCH_QUERY_MAX_CHARACTERS, ERROR_GENERAL, "Search queries must be valid UTF-8 of at most 100 characters", error))
+        {
+            return;
+        }
+
+        send_search_results(strand->client_socket, query, since, until, error, strand->callback_error_func);
+    }
+    else if (msg_type == MSG_TYPE_DIRECT)
+    {
+        uint32_t sequence;
+        char recipients[DIRECT_MAX_RECIPIENTS][USERNAME_BUFFER_SIZE];
+        size_t recipient_count;
+        char encoded_message[ENCODED_MESSAGE_BUFFER_SIZE];
+        char message[ENCODED_MESSAGE_BUFFER_SIZE];
+
+        if (strand->member_id == 0)
+        {
+            return;
+        }
+
+        if (parse_direct_request_frame(frame, &sequence, recipients, &recipient_count, encoded_message, sizeof(encoded_message)) != 0)
+        {
+            send_error(strand->client_socket, ERROR_GENERAL, "Malformed direct message", error, strand->callback_error_func);
+            return;
+        }
+
+        decode_message(encoded_message, message, sizeof(message));
+        if (reject_invalid_text(strand, message, MESSAGE_MAX_CHARACTERS, ERROR_GENERAL, "Messages must be valid UTF-8 of at most 250 characters", error))
+        {
+            return;
+        }
+
+        if (filter_message(strand->username, message, encoded_message, sizeof(encoded_message)))
+        {
+            send_error(strand->client_socket, ERROR_GENERAL, "Your message was blocked by the room's content filter", error, strand->callback_error_func);
+            return;
+        }
+
+        route_direct_message(strand->username, sequence, recipients, recipient_count, encoded_message, error, strand->callback_error_func);
+    }
+    else if (msg_type == MSG_TYPE_TYPING)
+    {
+        // never stored, indexed or forwarded to linked rooms, the typing module only keeps the current set
+        const char *field = strchr(frame, ':');
+        char op = field != NULL ? field[1] : '\0';
+
+        if (op == TYPING_OP_SUBSCRIBE || op == TYPING_OP_UNSUBSCRIBE)
+        {
+            set_typing_subscription(strand->client_socket, op == TYPING_OP_SUBSCRIBE);
+        }
+        else if (strand->member_id != 0 && (op == TYPING_OP_ACTIVE || op == TYPING_OP_STOPPED))
+        {
+            typing_record(strand->member_id, op == TYPING_OP_ACTIVE);
+        }
+    }
+}
+
+// with the client list locked, either way. once the memory budget is spent chat and bulk frames are refused,
+// control and presence frames are charged past it so a client still learns it was kicked and who is in the room
+static int append_outbox_frame(client_node_t *client, frame_lane_t lane, outbox_frame_t *outbox_frame, error_list_t *error)
+{
+    size_t frame_bytes = sizeof(outbox_frame_t) + outbox_frame->length;
+    if (lane < FRAME_LANE_CHAT)
+    {
+        memory_budget_charge(MEMORY_OUTBOX, frame_bytes);
+    }
+    else if (memory_budget_try_charge(MEMORY_OUTBOX, frame_bytes) != 0)
+    {
+        add_error(error, ERR_MEMORY_BUDGET, NON_CRITICAL_ERROR, "The memory budget is spent, a frame for one client was dropped", "append_outbox_frame");
+        return 1;
+    }
+
+    client_lane_t *client_lane = &client->lanes[lane];
+    mutex_lock(&client->outbox_mutex);
+    if (client_lane->outbox_tail == NULL)
+    {
+        client_lane->outbox_head = outbox_frame;
+    }
+    else
+    {
+        client_lane->outbox_tail->next = outbox_frame;
+    }
+    client_lane->outbox_tail = outbox_frame;
+    client->outbox_bytes += frame_bytes;
+    mutex_unlock(&client->outbox_mutex);
+
+    return 0;
+}
+
+// with the client list locked, one member's copy of a frame that isn't kept in a room log
+static int deliver_to_client(client_node_t *client, frame_lane_t lane, const char *frame, size_t frame_length, error_list_t *error)
+{
+    if (client->client_info.socket == LOCAL_MEMBER_SOCKET)
+    {
+        local_member_enqueue(frame, frame_length);
+        return 0;
+    }
+
+    if (delivery_mode == DELIVERY_MODE_PULL && atomic_load(&server_running))
+    {
+        outbox_frame_t *outbox_frame = (outbox_frame_t *)malloc(sizeof(outbox_frame_t) + frame_length);
+        if (outbox_frame == NULL)
+        {
+            add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for outbox frame", "deliver_to_client");
+            return 1;
+        }
+
+        outbox_frame->next = NULL;
+        outbox_frame->length = frame_length;
+        memcpy(outbox_frame->data, frame, frame_length);
+        if (append_outbox_frame(client, lane, outbox_frame, error) != 0)
+        {
+            free(outbox_frame);
+            return 1;
+        }
+        return 0;
+    }
+
+    return send_to_client(client->client_info.socket, frame, frame_length, error) == SOCKET_ERR;
+}
+
+void route_direct_message(const char *sender_username, uint32_t sequence, char recipients[][USERNAME_BUFFER_SIZE], size_t recipient_count, const char *encoded_message, error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    // every recipient gets the same bytes, so the frame is built once
+    char frame[DIRECT_MESSAGE_BUFFER_SIZE];
+    size_t frame_length = format_direct_delivery_frame(frame, sizeof(frame), sender_username, recipients, recipient_count, encoded_message);
+
+    rwlock_readerlock(&client_list_rwlock);
+
+    // the sender is looked up like the recipients, its acks take the same path as anything else sent to it
+    client_node_t *sender = username_index_find(&username_index, sender_username);
+
+    for (size_t i = 0; i < recipient_count; i++)
+    {
+        int repeated = 0;
+        for (size_t j = 0; j < i && !repeated; j++)
+        {
+            repeated = strcmp(recipients[i], recipients[j]) == 0;
+        }
+        if (repeated)
+        {
+            continue;
+        }
+
+        char status = DIRECT_STATUS_NOT_FOUND;
+        client_node_t *recipient = username_index_find(&username_index, recipients[i]);
+        if (recipient != NULL && recipient->authenticated)
+        {
+            status = deliver_to_client(recipient, FRAME_LANE_CHAT, frame, frame_length, error) == 0 ? DIRECT_STATUS_DELIVERED : DIRECT_STATUS_FAILED;
+        }
+
+        if (sender != NULL)
+        {
+            char ack[MAX_BUFFER_SIZE];
+            size_t ack_length = format_direct_ack_frame(ack, sizeof(ack), sequence, status, recipients[i]);
+            deliver_to_client(sender, FRAME_LANE_CHAT, ack, ack_length, error);
+        }
+    }
+
+    rwlock_readerunlock(&client_list_rwlock);
+
+    if (delivery_mode == DELIVERY_MODE_PULL)
+    {
+        wake_room_writer();
+    }
+
+    if (error->count > 0)
+    {
+        report_errors(error, callback_error_func);
+    }
+}
+
+static void collect_search_hit(uint64_t timestamp, const char *sender_username, const char *message, void *context)
+{
+    search_reply_t *reply = (search_reply_t *)context;
+
+    char frame[SEARCH_RESULT_BUFFER_SIZE];
+    size_t frame_length = format_search_result_frame(frame, sizeof(frame), timestamp, sender_username, message);
+
+    // a hit that can't be kept is left out, the end frame still counts only what was sent
+    outbox_frame_t *reply_frame = (outbox_frame_t *)malloc(sizeof(outbox_frame_t) + frame_length);
+    if (reply_frame == NULL)
+    {
+        return;
+    }
+
+    reply_frame->next = NULL;
+    reply_frame->length = frame_length;
+    memcpy(reply_frame->data, frame, frame_length);
+
+    if (reply->tail == NULL)
+    {
+        reply->head = reply_frame;
+    }
+    else
+    {
+        reply->tail->next = reply_frame;
+    }
+    reply->tail = reply_frame;
+    reply->count++;
+}
+
+static void send_search_frame(socket_t client_socket, const char *frame, size_t frame_length, error_list_t *error)
+{
+    if (client_socket == LOCAL_MEMBER_SOCKET)
+    {
+        local_member_enqueue(frame, frame_length);
+    }
+    else if (delivery_mode == DELIVERY_MODE_PULL && atomic_load(&server_running))
+    {
+        // results can be long, they go behind the member's chat
+        enqueue_direct_frame(client_socket, FRAME_LANE_BULK, frame, frame_length, error);
+    }
+    else
+    {
+        send_to_client(client_socket, frame, frame_length, error);
+    }
+}
+
+void send_search_results(socket_t client_socket, const char *query, uint64_t since, uint64_t until, error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    // the hits are collected first, nothing is sent while the index is locked
+    search_reply_t reply;
+    reply.head = NULL;
+    reply.tail = NULL;
+    reply.count = 0;
+
+    search_index_query(query, since, until, SEARCH_MAX_RESULTS, collect_search_hit, &reply);
+
+    outbox_frame_t *reply_frame = reply.head;
+    while (reply_frame != NULL)
+    {
+        outbox_frame_t *next_frame = reply_frame->next;
+        send_search_frame(client_socket, reply_frame->data, reply_frame->length, error);
+        free(reply_frame);
+        reply_frame = next_frame;
+    }
+
+    char frame[MAX_BUFFER_SIZE];
+    size_t frame_length = format_search_end_frame(frame, sizeof(frame), reply.count);
+    send_search_frame(client_socket, frame, frame_length, error);
+
+    if (error->count > 0)
+    {
+        report_errors(error, callback_error_func);
+    }
+}
+
+static int send_transfer_frame(socket_t client_socket, const char *frame, error_list_t *error)
+{
+    // the transfer thread owns its socket, replies go out directly instead of through the room writer
+    return socket_send_all(client_socket, frame, strlen(frame) + 1, BLOB_IO_TIMEOUT_MS, error) != 0;
+}
+
+static void reject_transfer(socket_t client_socket, error_type_t error_type, const char *reason)
+{
+    char frame[ERROR_NOTIFICATION_BUFFER_SIZE];
+    snprintf(frame, sizeof(frame), "%d:%d:%s", MSG_TYPE_ERROR, error_type, reason);
+
+    error_list_t reject_error;
+    init_error(&reject_error);
+    send_transfer_frame(client_socket, frame, &reject_error);
+}
+
+void serve_transfer(socket_t client_socket, char *frame, const char *received, size_t received_length, void (*callback_error_func)(const char *, int))
+{
+    // "7:<encoded secret key>:U:<size>" uploads, the server answers "7:R", reads size raw bytes and answers "7:<hash>:<size>"
+    // "7:<encoded secret key>:D:<hash>:<offset>:<length>" downloads, the server answers "7:<hash>:<offset>:<length>" and the raw bytes,
+    // a length of 0 asks for everything from the offset on
+    error_list_t *error = thread_error_context();
+
+    char received_secret_key[ENCODED_SECRET_KEY_BUFFER_SIZE];
+    char operation = '\0';
+    received_secret_key[0] = '\0';
+    sscanf(frame, "%*d:%72[^:]:%c", received_secret_key, &operation);
+
+    char decoded_secret_key[SECRET_KEY_BUFFER_SIZE];
+    decode_message(received_secret_key, decoded_secret_key, sizeof(decoded_secret_key));
+
+    if (strcmp(decoded_secret_key, global_secret_key) != 0)
+    {
+        reject_transfer(client_socket, ERROR_SECRET_KEY, "Incorrect secret key");
+        return;
+    }
+
+    // counted as pending authentication until here, a connection without the key is held to the pending limit
+    mark_transfer_client(client_socket);
+
+    // the connection was accepted for chat traffic, from here on it carries a file
+    socket_apply_profile(client_socket, SOCKET_PROFILE_BULK);
+
+    if (!attachments_enabled)
+    {
+        reject_transfer(client_socket, ERROR_GENERAL, "This room does not accept attachments");
+        return;
+    }
+
+    // the arguments start after "7:<key>:<op>:"
+    const char *arguments = strchr(frame, ':');
+    arguments = arguments != NULL ? strchr(arguments + 1, ':') : NULL;
+    arguments = arguments != NULL ? strchr(arguments + 1, ':') : NULL;
+    if (arguments == NULL)
+    {
+        reject_transfer(client_socket, ERROR_GENERAL, "Malformed transfer request");
+        return;
+    }
+    arguments++;
+
+    char reply[MAX_BUFFER_SIZE];
+    char hash_hex[BLOB_HASH_HEX_BUFFER_SIZE];
+
+    if (operation == 'U')
+    {
+        uint64_t size = strtoull(arguments, NULL, 10);
+        if (size > BLOB_MAX_SIZE)
+        {
+            reject_transfer(client_socket, ERROR_GENERAL, "Attachment exceeds the maximum size");
+            return;
+        }
+
+        // refused before the client sends anything, the store gives the reservation back unless the upload is a new blob
+        if (blob_store_reserve(size, error) != 0)
+        {
+            reject_transfer(client_socket, ERROR_GENERAL, "The room has no space left for attachments");
+            report_errors(error, callback_error_func);
+            return;
+        }
+
+        snprintf(reply, sizeof(reply), "%d:R", MSG_TYPE_TRANSFER);
+        if (send_transfer_frame(client_socket, reply, error) != 0)
+        {
+            blob_store_unreserve(size);
+            report_errors(error, callback_error_func);
+            return;
+        }
+
+        if (blob_store_receive(client_socket, size, received, received_length, hash_hex, error) != 0)
+        {
+            reject_transfer(client_socket, ERROR_GENERAL, "Upload failed");
+            report_errors(error, callback_error_func);
+            return;
+        }
+
+        snprintf(reply, sizeof(reply), "%d:%s:%llu", MSG_TYPE_TRANSFER, hash_hex, (unsigned long long)size);
+        send_transfer_frame(client_socket, reply, error);
+    }
+    else if (operation == 'D')
+    {
+        uint64_t stored_size;
+        if (!blob_hash_is_valid(arguments) || arguments[BLOB_HASH_HEX_LENGTH] != ':')
+        {
+            reject_transfer(client_socket, ERROR_GENERAL, "Malformed transfer request");
+            return;
+        }
+        memcpy(hash_hex, arguments, BLOB_HASH_HEX_LENGTH);
+        hash_hex[BLOB_HASH_HEX_LENGTH] = '\0';
+
+        if (blob_store_stat(hash_hex, &stored_size) != 0)
+        {
+            reject_transfer(client_socket, ERROR_GENERAL, "Unknown attachment");
+            return;
+        }
+
+        char *length_start;
+        uint64_t offset = strtoull(arguments + BLOB_HASH_HEX_LENGTH + 1, &length_start, 10);
+        uint64_t length = *length_start == ':' ? strtoull(length_start + 1, NULL, 10) : 0;
+
+        if (offset > stored_size)
+        {
+            reject_transfer(client_socket, ERROR_GENERAL, "Range starts past the end of the attachment");
+            return;
+        }
+        if (length == 0 || length > stored_size - offset)
+        {
+            length = stored_size - offset;
+        }
+
+        snprintf(reply, sizeof(reply), "%d:%s:%llu:%llu", MSG_TYPE_TRANSFER, hash_hex, (unsigned long long)offset, (unsigned long long)length);
+        if (send_transfer_frame(client_socket, reply, error) != 0 ||
+            blob_store_send(client_socket, hash_hex, offset, length, error) != 0)
+        {
+            report_errors(error, callback_error_func);
+        }
+    }
+    else
+    {
+        reject_transfer(client_socket, ERROR_GENERAL, "Malformed transfer request");
+    }
+}
+
+// only the writer thread calls it, under the list's reader lock. a client that can't get the notice is shut down without it
+static void queue_close_notice(client_node_t *client, error_list_t *error)
+{
+    char buffer[ERROR_NOTIFICATION_BUFFER_SIZE];
+    size_t length = (size_t)snprintf(buffer, sizeof(buffer), "%d:%d:%s", MSG_TYPE_NOTIFICATION, NOTIFICATION_DISCONNECT, "The host closed the room") + 1;
+
+    client->close_notice_queued = 1;
+
+    outbox_frame_t *outbox_frame = (outbox_frame_t *)malloc(sizeof(outbox_frame_t) + length);
+    if (outbox_frame == NULL)
+    {
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for the closing notice", "queue_close_notice");
+        return;
+    }
+
+    outbox_frame->next = NULL;
+    outbox_frame->length = length;
+    memcpy(outbox_frame->data, buffer, length);
+    append_outbox_frame(client, FRAME_LANE_CONTROL, outbox_frame, error);
+}
+
+thread_ret_t THREAD_CALL room_writer_thread(void *arg)
+{
+    room_writer_thread_args_t *thread_args = (room_writer_thread_args_t *)arg;
+    void (*callback_error_func)(const char *, int) = thread_args->callback_error_func;
+
+    pollfd_t *blocked_sockets = NULL;
+    size_t blocked_capacity = 0;
+    client_node_t **staged_clients = NULL;
+    size_t staged_capacity = 0;
+
+    while (atomic_load(&server_running) && !atomic_load(&room_writer_stopping))
+    {
+        error_list_t writer_error;
+        init_error(&writer_error);
+
+        mutex_lock(&room_writer_mutex);
+        unsigned long generation = room_writer_generation;
+        mutex_unlock(&room_writer_mutex);
+
+        size_t blocked_count = 0;
+        int has_more = 0;
+        int closing = atomic_load(&room_closing);
+        // clients of a closing room that haven't been sent their notice and shut down yet
+        size_t draining_count = 0;
+
+        // the frames are picked and copied under the locks and sent after them, so appending to the logs or
+        // changing the list never waits on a send. a client taken off the list meanwhile is freed after the pass
+        mutex_lock(&room_writer_pass_mutex);
+
+        size_t staged_count = 0;
+
+        rwlock_readerlock(&client_list_rwlock);
+        for (int lane = FRAME_LANE_PRESENCE; lane < FRAME_LANE_COUNT; lane++)
+        {
+            room_log_read_lock(&room_logs[lane]);
+        }
+
+        client_node_t *current_client = client_list;
+        while (current_client != NULL)
+        {
+            flush_result_t result = stage_client_frames(current_client, &writer_error);
+
+            if (closing && !current_client->send_failed && !current_client->transfer && current_client->client_info.socket != LOCAL_MEMBER_SOCKET)
+            {
+                draining_count++;
+
+                // everything queued for the client went out, the notice is the last frame it gets
+                if (result == FLUSH_IDLE && !current_client->close_notice_queued)
+                {
+                    queue_close_notice(current_client, &writer_error);
+                    result = stage_client_frames(current_client, &writer_error);
+                }
+            }
+
+            if (result == FLUSH_MORE)
+            {
+                if (staged_count == staged_capacity)
+                {
+                    size_t new_capacity = staged_capacity == 0 ? 64 : staged_capacity * 2;
+                    client_node_t **resized = (client_node_t **)realloc(staged_clients, new_capacity * sizeof(client_node_t *));
+                    if (resized != NULL)
+                    {
+                        staged_clients = resized;
+                        staged_capacity = new_capacity;
+                    }
+                }
+
+                if (staged_count < staged_capacity)
+                {
+                    staged_clients[staged_count++] = current_client;
+                }
+                else
+                {
+                    // the frames stay staged, the client is sent them on the next pass
+                    has_more = 1;
+                }
+            }
+
+            current_client = current_client->next;
+        }
+
+        for (int lane = FRAME_LANE_PRESENCE; lane < FRAME_LANE_COUNT; lane++)
+        {
+            room_log_read_unlock(&room_logs[lane]);
+        }
+        rwlock_readerunlock(&client_list_rwlock);
+
+        for (size_t i = 0; i < staged_count; i++)
+        {
+            flush_result_t result = send_staged_frames(staged_clients[i], &writer_error);
+
+            if (result == FLUSH_MORE)
+            {
+                has_more = 1;
+            }
+            else if (result == FLUSH_BLOCKED)
+            {
+                if (blocked_count == blocked_capacity)
+                {
+                    size_t new_capacity = blocked_capacity == 0 ? 64 : blocked_capacity * 2;
+                    pollfd_t *resized = (pollfd_t *)realloc(blocked_sockets, new_capacity * sizeof(pollfd_t));
+                    if (resized != NULL)
+                    {
+                        blocked_sockets = resized;
+                        blocked_capacity = new_capacity;
+                    }
+                }
+
+                if (blocked_count < blocked_capacity)
+                {
+                    blocked_sockets[blocked_count].fd = staged_clients[i]->client_info.socket;
+                    blocked_sockets[blocked_count].events = POLLOUT;
+                    blocked_sockets[blocked_count].revents = 0;
+                    blocked_count++;
+                }
+                else
+                {
+                    // could not grow the poll set, fall back to retrying on the next pass
+                    has_more = 1;
+                }
+            }
+        }
+
+        mutex_unlock(&room_writer_pass_mutex);
+
+        if (writer_error.count > 0)
+        {
+            report_errors(&writer_error, callback_error_func);
+        }
+
+        if (closing && draining_count == 0)
+        {
+            atomic_store(&room_drained, 1);
+        }
+
+        if (has_more)
+        {
+            continue;
+        }
+
+        if (blocked_count > 0)
+        {
+            // a closed socket in the set only shows up as POLLNVAL, the reader thread removes the client
+            socket_poll(blocked_sockets, blocked_count, ROOM_WRITER_POLL_TIMEOUT_MS, &writer_error);
+            continue;
+        }
+
+        mutex_lock(&room_writer_mutex);
+        if (generation == room_writer_generation && atomic_load(&server_running))
+        {
+            cond_timedwait(&room_writer_cond, &room_writer_mutex, ROOM_WRITER_IDLE_TIMEOUT_MS);
+        }
+        mutex_unlock(&room_writer_mutex);
+    }
+
+    free(blocked_sockets);
+    free(staged_clients);
+    free(thread_args);
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+// the highest lane with frames, unless a lower one has waited out the starvation limit,
+// then the highest of those gets one frame through and every other waiting lane counts another wait
+static int pick_lane(client_node_t *client, const int *has_frame)
+{
+    int chosen = -1;
+    for (int lane = 0; lane < FRAME_LANE_COUNT; lane++)
+    {
+        if (!has_frame[lane])
+        {
+            continue;
+        }
+        if (chosen < 0)
+        {
+            chosen = lane;
+        }
+        else if (client->lanes[lane].waited >= FRAME_LANE_STARVATION_LIMIT)
+        {
+            chosen = lane;
+            break;
+        }
+    }
+
+    for (int lane = 0; lane < FRAME_LANE_COUNT && chosen >= 0; lane++)
+    {
+        if (lane == chosen)
+        {
+            client->lanes[lane].waited = 0;
+        }
+        else if (has_frame[lane])
+        {
+            client->lanes[lane].waited++;
+        }
+    }
+
+    return chosen;
+}
+
+static void restore_lane_waits(client_node_t *client, const unsigned int *waited)
+{
+    for (int lane = 0; lane < FRAME_LANE_COUNT; lane++)
+    {
+        client->lanes[lane].waited = waited[lane];
+    }
+}
+
+// copies the room's typing set behind the frames already copied if the client wants it, hasn't had this one yet
+// and it fits. the copy is what a half sent frame is finished from after the set changed
+static int take_typing_frame(client_node_t *client)
+{
+    if (!client->typing_subscribed || !client->authenticated || atomic_load(&room_closing))
+    {
+        return 0;
+    }
+
+    int taken = 0;
+    mutex_lock(&typing_frame_mutex);
+    if (client->typing_generation != typing_generation && typing_frame_length <= sizeof(client->frame_copy) - client->frame_copy_length)
+    {
+        memcpy(client->frame_copy + client->frame_copy_length, typing_frame, typing_frame_length);
+        client->frame_copy_length += typing_frame_length;
+        client->typing_generation = typing_generation;
+        taken = 1;
+    }
+    mutex_unlock(&typing_frame_mutex);
+
+    return taken;
+}
+
+flush_result_t stage_client_frames(client_node_t *client, error_list_t *error)
+{
+    if (client->send_failed)
+    {
+        return FLUSH_IDLE;
+    }
+
+    if (client->frame_source != FRAME_SOURCE_NONE)
+    {
+        // the last staged frames haven't all gone out yet
+        return FLUSH_MORE;
+    }
+
+    client->frame_copy_length = 0;
+
+    for (int frames_staged = 0; frames_staged < ROOM_WRITER_BATCH_FRAMES; frames_staged++)
+    {
+        int has_direct_frame[FRAME_LANE_COUNT];
+        int has_frame[FRAME_LANE_COUNT];
+        unsigned int waited[FRAME_LANE_COUNT];
+
+        mutex_lock(&client->outbox_mutex);
+        for (int lane = 0; lane < FRAME_LANE_COUNT; lane++)
+        {
+            has_direct_frame[lane] = client->lanes[lane].outbox_head != NULL;
+        }
+        mutex_unlock(&client->outbox_mutex);
+
+        if (frames_staged == 0 && (client->disconnect_pending || client->close_notice_queued) && !has_direct_frame[FRAME_LANE_CONTROL])
+        {
+            // the kick or closing notice went out, whatever else is queued is dropped with the connection.
+            // the reader thread sees the shutdown and removes the client
+            client->send_failed = 1;
+            socket_shutdown(client->client_info.socket, error);
+            return FLUSH_IDLE;
+        }
+
+        for (int lane = 0; lane < FRAME_LANE_COUNT; lane++)
+        {
+            has_frame[lane] = has_direct_frame[lane] ||
+                              (lane >= FRAME_LANE_PRESENCE && client->authenticated && client->lanes[lane].log_cursor < room_log_head(&room_logs[lane]));
+            waited[lane] = client->lanes[lane].waited;
+        }
+
+        int lane = pick_lane(client, has_frame);
+        if (lane < 0)
+        {
+            // typing sets are the lowest priority of all, they only go to a client that has nothing else to read
+            if (take_typing_frame(client))
+            {
+                client->frame_source = FRAME_SOURCE_COPY;
+            }
+            break;
+        }
+
+        if (has_direct_frame[lane])
+        {
+            if (frames_staged > 0)
+            {
+                // an outbox frame is sent on its own, next pass picks it again as if it hadn't been looked at
+                restore_lane_waits(client, waited);
+                break;
+            }
+
+            // only the writer pops from the outbox, so the head stays valid until it is sent
+            client->frame_lane = (frame_lane_t)lane;
+            client->frame_source = FRAME_SOURCE_OUTBOX;
+            break;
+        }
+
+        uint64_t tail = room_log_tail(&room_logs[lane]);
+        if (client->lanes[lane].log_cursor < tail)
+        {
+            // the client fell out of the log window, skip to the oldest frame still retained
+            add_error(error, ERR_SLOW_CLIENT, NON_CRITICAL_ERROR, "A slow client missed messages that left the room log", "stage_client_frames");
+            client->lanes[lane].log_cursor = tail;
+        }
+
+        const room_log_entry_t *entry = room_log_get(&room_logs[lane], client->lanes[lane].log_cursor);
+        // the host is handed its frames one at a time, everyone else gets as many as fit in one send
+        if (entry == NULL || entry->length > sizeof(client->frame_copy) - client->frame_copy_length ||
+            (frames_staged > 0 && client->client_info.socket == LOCAL_MEMBER_SOCKET))
+        {
+            restore_lane_waits(client, waited);
+            break;
+        }
+
+        memcpy(client->frame_copy + client->frame_copy_length, entry->data, entry->length);
+        client->frame_copy_length += entry->length;
+        client->lanes[lane].log_cursor++;
+        client->frame_source = FRAME_SOURCE_COPY;
+    }
+
+    return client->frame_source == FRAME_SOURCE_NONE ? FLUSH_IDLE : FLUSH_MORE;
+}
+
+flush_result_t send_staged_frames(client_node_t *client, error_list_t *error)
+{
+    if (client->send_failed || client->frame_source == FRAME_SOURCE_NONE)
+    {
+        return FLUSH_IDLE;
+    }
+
+    client_lane_t *client_lane = &client->lanes[client->frame_lane];
+    const char *frame_data;
+    size_t frame_length;
+
+    if (client->frame_source == FRAME_SOURCE_OUTBOX)
+    {
+        mutex_lock(&client->outbox_mutex);
+        outbox_frame_t *frame = client_lane->outbox_head;
+        mutex_unlock(&client->outbox_mutex);
+
+        frame_data = frame->data;
+        frame_length = frame->length;
+    }
+    else
+    {
+        frame_data = client->frame_copy;
+        frame_length = client->frame_copy_length;
+    }
+
+    int bytes_sent;
+    if (client->client_info.socket == LOCAL_MEMBER_SOCKET)
+    {
+        // the host's copy is handed over whole, it never blocks the writer
+        local_member_enqueue(frame_data, frame_length);
+        bytes_sent = (int)(frame_length - client->frame_offset);
+    }
+    else
+    {
+        bytes_sent = socket_send_nonblocking(client->client_info.socket, frame_data + client->frame_offset, frame_length - client->frame_offset, error);
+    }
+    if (bytes_sent == SOCKET_ERR)
+    {
+        // the reader thread sees the shutdown and removes the client
+        client->send_failed = 1;
+        socket_shutdown(client->client_info.socket, error);
+        return FLUSH_IDLE;
+    }
+
+    client->frame_offset += (size_t)bytes_sent;
+    if (client->frame_offset < frame_length)
+    {
+        return FLUSH_BLOCKED;
+    }
+
+    client->frame_offset = 0;
+
+    if (client->frame_source == FRAME_SOURCE_OUTBOX)
+    {
+        mutex_lock(&client->outbox_mutex);
+        outbox_frame_t *frame = client_lane->outbox_head;
+        client_lane->outbox_head = frame->next;
+        if (client_lane->outbox_head == NULL)
+        {
+            client_lane->outbox_tail = NULL;
+        }
+        client->outbox_bytes -= sizeof(outbox_frame_t) + frame->length;
+        mutex_unlock(&client->outbox_mutex);
+        memory_budget_release(MEMORY_OUTBOX, sizeof(outbox_frame_t) + frame->length);
+        free(frame);
+    }
+
+    client->frame_source = FRAME_SOURCE_NONE;
+
+    return FLUSH_MORE;
+}
+
+void set_delivery_mode(delivery_mode_t mode)
+{
+    // the mode decides which threads start_chat_room creates, so it can't change while a room is open
+    if (!atomic_load(&server_running))
+    {
+        delivery_mode = mode;
+    }
+}
+
+void wake_room_writer(void)
+{
+    mutex_lock(&room_writer_mutex);
+    room_writer_generation++;
+    cond_signal(&room_writer_cond);
+    mutex_unlock(&room_writer_mutex);
+}
+
+int enqueue_direct_frame(socket_t client_socket, frame_lane_t lane, const char *frame, size_t length, error_list_t *error)
+{
+    outbox_frame_t *outbox_frame = (outbox_frame_t *)malloc(sizeof(outbox_frame_t) + length);
+    if (outbox_frame == NULL)
+    {
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for outbox frame", "enqueue_direct_frame");
+        return 1;
+    }
+
+    outbox_frame->next = NULL;
+    outbox_frame->length = length;
+    memcpy(outbox_frame->data, frame, length);
+
+    int queued = 0;
+
+    rwlock_readerlock(&client_list_rwlock);
+
+    client_node_t *current_client = client_list;
+    while (current_client != NULL)
+    {
+        if (current_client->client_info.socket == client_socket)
+        {
+            queued = append_outbox_frame(current_client, lane, outbox_frame, error) == 0;
+            break;
+        }
+        current_client = current_client->next;
+    }
+
+    rwlock_readerunlock(&client_list_rwlock);
+
+    if (!queued)
+    {
+        free(outbox_frame);
+        return 1;
+    }
+
+    wake_room_writer();
+
+    return 0;
+}
+
+void broadcast_frame(frame_lane_t lane, const char *frame, size_t frame_length)
+{
+    // push delivery sends from the calling thread right away, there is no queue for a lane to jump
+    error_list_t broadcast_error;
+    init_error(&broadcast_error);
+
+    if (delivery_mode == DELIVERY_MODE_PULL)
+    {
+        if (room_log_append(&room_logs[lane], frame, frame_length, &broadcast_error) != 0)
+        {
+            report_errors(&broadcast_error, server_callback_error_func);
+            return;
+        }
+        wake_room_writer();
+        return;
+    }
+
+    rwlock_readerlock(&client_list_rwlock);
+
+    client_node_t *current_client = client_list;
+    while (current_client != NULL)
+    {
+        if (current_client->authenticated && current_client->client_info.socket == LOCAL_MEMBER_SOCKET)
+        {
+            local_member_enqueue(frame, frame_length);
+        }
+        else if (current_client->authenticated)
+        {
+            send_to_client(current_client->client_info.socket, frame, frame_length, &broadcast_error);
+        }
+        current_client = current_client->next;
+    }
+
+    rwlock_readerunlock(&client_list_rwlock);
+
+    if (broadcast_error.count > 0)
+    {
+        report_errors(&broadcast_error, server_callback_error_func);
+    }
+}
+
+void broadcast_attachment(const char *hash_hex, uint64_t size, const char *name, uint32_t sender_member_id)
+{
+    // only the reference travels through the room, the blob is fetched on demand over a transfer connection,
+    // linked rooms don't share this blob store so attachments stay local
+    char frame[MAX_BUFFER_SIZE];
+    size_t frame_length = format_attachment_frame(frame, sizeof(frame), hash_hex, size, name, sender_member_id);
+
+    broadcast_frame(FRAME_LANE_BULK, frame, frame_length);
+}
+
+void broadcast_member_alias(frame_lane_t lane, uint32_t member_id, const char *username, unsigned int *alias_lanes)
+{
+    // binds the ID before the first frame that uses it, the member's join may still be waiting in the presence batch.
+    // lanes overtake each other, so the alias goes into the lane of that frame, once per lane
+    if (*alias_lanes & (1u << lane))
+    {
+        return;
+    }
+    *alias_lanes |= 1u << lane;
+
+    char frame[MAX_BUFFER_SIZE];
+    size_t frame_length = (size_t)snprintf(frame, sizeof(frame), "%d", MSG_TYPE_PRESENCE);
+    frame_length = append_member_id_entry(frame, frame_length, sizeof(frame), member_id);
+    frame_length = append_presence_entry(frame, frame_length, sizeof(frame), PRESENCE_OP_ALIAS, username);
+
+    broadcast_frame(lane, frame, frame_length + 1);
+}
+
+void broadcast_message(const char *message, const char *sender_username, uint32_t sender_member_id, error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    // local members know the sender by ID, linked rooms don't share our IDs and get the name
+    char frame[MAX_BUFFER_SIZE];
+    size_t frame_length = format_member_message_frame(frame, sizeof(frame), message, sender_member_id);
+
+    // only copied here, the indexer thread does the work
+    search_index_submit(sender_username, message);
+
+    if (federation_is_running())
+    {
+        char named_frame[MAX_BUFFER_SIZE];
+        size_t named_frame_length = format_message_frame(named_frame, sizeof(named_frame), message, sender_username, CONTEXT_SERVER);
+
+        if (federation_publish(named_frame, named_frame_length, error) != 0)
+        {
+            report_errors(error, callback_error_func);
+        }
+    }
+
+    if (delivery_mode == DELIVERY_MODE_PULL)
+    {
+        // the frame is built once and every client's cursor picks it up from the shared log
+        broadcast_frame(FRAME_LANE_CHAT, frame, frame_length);
+        return;
+    }
+
+    rwlock_readerlock(&client_list_rwlock);
+
+    client_node_t *current_client = client_list;
+    while (current_client != NULL)
+    {
+        // connections that haven't joined (or only carry a transfer) get no room traffic
+        if (current_client->authenticated && current_client->client_info.socket == LOCAL_MEMBER_SOCKET)
+        {
+            local_member_enqueue(frame, frame_length);
+        }
+        else if (current_client->authenticated && send_to_client(current_client->client_info.socket, frame, frame_length, error) == SOCKET_ERR)
+        {
+            report_errors(error, callback_error_func);
+        }
+        current_client = current_client->next;
+    }
+
+    rwlock_readerunlock(&client_list_rwlock);
+}
+
+int add_client(user_info_t *client_info, error_list_t *error)
+{
+    client_node_t *new_node = (client_node_t *)malloc(sizeof(client_node_t));
+    if (new_node == NULL)
+    {
+        add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for client_node_t struct", "add_client");
+        return 1;
+    }
+    new_node->client_info = *client_info;
+    new_node->authenticated = 0;
+    new_node->frame_offset = 0;
+    new_node->frame_source = FRAME_SOURCE_NONE;
+    new_node->frame_lane = FRAME_LANE_CONTROL;
+    new_node->send_failed = 0;
+    new_node->disconnect_pending = 0;
+    new_node->close_notice_queued = 0;
+    new_node->member_id = 0;
+    new_node->transfer = 0;
+    new_node->handoff_ready = 0;
+    new_node->handoff_input = NULL;
+    new_node->handoff_input_length = 0;
+    new_node->typing_subscribed = 0;
+    new_node->typing_generation = 0;
+    new_node->frame_copy_length = 0;
+    for (int lane = 0; lane < FRAME_LANE_COUNT; lane++)
+    {
+        new_node->lanes[lane].outbox_head = NULL;
+        new_node->lanes[lane].outbox_tail = NULL;
+        new_node->lanes[lane].log_cursor = 0;
+        new_node->lanes[lane].waited = 0;
+    }
+    new_node->outbox_bytes = 0;
+    mutex_init(&new_node->outbox_mutex);
+
+    rwlock_writerlock(&client_list_rwlock);
+
+    // a new client only receives messages broadcast after it joined
+    for (int lane = FRAME_LANE_PRESENCE; lane < FRAME_LANE_COUNT && delivery_mode == DELIVERY_MODE_PULL; lane++)
+    {
+        new_node->lanes[lane].log_cursor = room_log_head(&room_logs[lane]);
+    }
+
+    new_node->next = client_list;
+    client_list = new_node;
+
+    atomic_fetch_add(&connection_count, 1);
+    atomic_fetch_add(&pending_auth_count, 1);
+
+    rwlock_writerunlock(&client_list_rwlock);
+
+    return 0;
+}
+
+uint32_t update_client_info(socket_t client_socket, const char *username, user_type_t user_type, error_list_t *error)
+{
+    char previous_username[USERNAME_BUFFER_SIZE];
+    previous_username[0] = '\0';
+    outbox_frame_t *snapshot = NULL;
+    uint32_t member_id = 0;
+    int found = 0;
+
+    rwlock_writerlock(&client_list_rwlock);
+    client_node_t *current_client = client_list;
+
+    while (current_client != NULL)
+    {
+        if (current_client->client_info.socket == client_socket)
+        {
+            // checked and claimed under the same lock, two connections asking for one name can't both get it
+            client_node_t *holder = username_index_find(&username_index, username);
+            if (username[0] == '\0' || (holder != NULL && holder != current_client))
+            {
+                break;
+            }
+
+            strcpy(previous_username, current_client->client_info.username);
+            strcpy(current_client->client_info.username, username);
+            current_client->client_info.user_type = user_type;
+
+            if (previous_username[0] != '\0' && username_index_find(&username_index, previous_username) == current_client)
+            {
+                username_index_remove(&username_index, previous_username);
+            }
+            // a member the index can't hold still chats, it just can't be found by name
+            username_index_insert(&username_index, username, current_client, error);
+
+            if (previous_username[0] == '\0')
+            {
+                atomic_fetch_sub(&pending_auth_count, 1);
+            }
+
+            if (current_client->member_id == 0)
+            {
+                current_client->member_id = next_member_id++;
+                if (next_member_id == 0)
+                {
+                    next_member_id = 1;
+                }
+            }
+            member_id = current_client->member_id;
+
+            snapshot = build_presence_snapshot();
+
+            if (delivery_mode == DELIVERY_MODE_PULL)
+            {
+                // holding the writer lock keeps the room writer out, so the cursor can be moved here:
+                // the snapshot covers everything before the current heads, the logs cover everything after them.
+                // it is queued in the presence lane, ahead of the deltas in that lane's log
+                current_client->authenticated = 1;
+                for (int lane = FRAME_LANE_PRESENCE; lane < FRAME_LANE_COUNT; lane++)
+                {
+                    current_client->lanes[lane].log_cursor = room_log_head(&room_logs[lane]);
+                }
+
+                if (snapshot != NULL)
+                {
+                    client_lane_t *presence_lane = &current_client->lanes[FRAME_LANE_PRESENCE];
+                    mutex_lock(&current_client->outbox_mutex);
+                    outbox_frame_t *snapshot_tail = snapshot;
+                    size_t snapshot_bytes = sizeof(outbox_frame_t) + snapshot->length;
+                    while (snapshot_tail->next != NULL)
+                    {
+                        snapshot_tail = snapshot_tail->next;
+                        snapshot_bytes += sizeof(outbox_frame_t) + snapshot_tail->length;
+                    }
+                    if (presence_lane->outbox_tail == NULL)
+                    {
+                        presence_lane->outbox_head = snapshot;
+                    }
+                    else
+                    {
+                        presence_lane->outbox_tail->next = snapshot;
+                    }
+                    presence_lane->outbox_tail = snapshot_tail;
+                    current_client->outbox_bytes += snapshot_bytes;
+                    mutex_unlock(&current_client->outbox_mutex);
+                    memory_budget_charge(MEMORY_OUTBOX, snapshot_bytes);
+                    snapshot = NULL;
+                }
+            }
+            else
+            {
+                current_client->authenticated = 1;
+            }
+
+            found = 1;
+            break;
+        }
+        current_client = current_client->next;
+    }
+
+    rwlock_writerunlock(&client_list_rwlock);
+
+    if (!found)
+    {
+        return 0;
+    }
+
+    if (delivery_mode == DELIVERY_MODE_PULL)
+    {
+        wake_room_writer();
+    }
+
+    while (snapshot != NULL)
+    {
+        outbox_frame_t *next_frame = snapshot->next;
+        if (client_socket == LOCAL_MEMBER_SOCKET)
+        {
+            local_member_enqueue(snapshot->data, snapshot->length);
+        }
+        else
+        {
+            send_to_client(client_socket, snapshot->data, snapshot->length, error);
+        }
+        free(snapshot);
+        snapshot = next_frame;
+    }
+
+    if (previous_username[0] == '\0')
+    {
+        presence_record_join(username, member_id);
+    }
+    else if (strcmp(previous_username, username) != 0)
+    {
+        presence_record_rename(previous_username, username, member_id);
+    }
+
+    return member_id;
+}
+
+outbox_frame_t *build_presence_snapshot(void)
+{
+    // the caller holds client_list_rwlock
+    outbox_frame_t *head = NULL;
+    outbox_frame_t *tail = NULL;
+
+    char frame[MAX_BUFFER_SIZE];
+    size_t frame_length = (size_t)snprintf(frame, sizeof(frame), "%d", MSG_TYPE_PRESENCE);
+    frame_length = append_presence_entry(frame, frame_length, sizeof(frame), PRESENCE_OP_SNAPSHOT, "");
+
+    client_node_t *current_client = client_list;
+    while (1)
+    {
+        size_t new_length = 0;
+        if (current_client != NULL && current_client->client_info.username[0] != '\0')
+        {
+            // the ID and the name it belongs to go into the same frame
+            new_length = append_member_id_entry(frame, frame_length, sizeof(frame), current_client->member_id);
+            if (new_length != 0)
+            {
+                new_length = append_presence_entry(frame, new_length, sizeof(frame), PRESENCE_OP_JOIN, current_client->client_info.username);
+            }
+            if (new_length != 0)
+            {
+                frame_length = new_length;
+                current_client = current_client->next;
+                continue;
+            }
+        }
+        else if (current_client != NULL)
+        {
+            current_client = current_client->next;
+            continue;
+        }
+
+        // the frame is full, or this was the last client
+        frame[frame_length] = '\0';
+        outbox_frame_t *snapshot_frame = (outbox_frame_t *)malloc(sizeof(outbox_frame_t) + frame_length + 1);
+        if (snapshot_frame == NULL)
+        {
+            break;
+        }
+
+        snapshot_frame->next = NULL;
+        snapshot_frame->length = frame_length + 1;
+        memcpy(snapshot_frame->data, frame, frame_length + 1);
+
+        if (tail == NULL)
+        {
+            head = snapshot_frame;
+        }
+        else
+        {
+            tail->next = snapshot_frame;
+        }
+        tail = snapshot_frame;
+
+        if (current_client == NULL)
+        {
+            break;
+        }
+
+        frame_length = (size_t)snprintf(frame, sizeof(frame), "%d", MSG_TYPE_PRESENCE);
+    }
+
+    return head;
+}
+
+static void free_client_node(client_node_t *client)
+{
+    for (int lane = 0; lane < FRAME_LANE_COUNT; lane++)
+    {
+        outbox_frame_t *frame = client->lanes[lane].outbox_head;
+        while (frame != NULL)
+        {
+            outbox_frame_t *next_frame = frame->next;
+            free(frame);
+            frame = next_frame;
+        }
+    }
+    memory_budget_release(MEMORY_OUTBOX, client->outbox_bytes);
+    mutex_destroy(&client->outbox_mutex);
+
+    free(client);
+}
+
+// the room writer sends to the clients it staged after letting go of the list's lock, one taken off the list
+// meanwhile keeps its socket and node until that pass is over
+static void wait_for_room_writer_pass(void)
+{
+    if (delivery_mode == DELIVERY_MODE_PULL)
+    {
+        mutex_lock(&room_writer_pass_mutex);
+        mutex_unlock(&room_writer_pass_mutex);
+    }
+}
+
+void remove_client(socket_t client_socket, error_list_t *error)
+{
+    char removed_username[USERNAME_BUFFER_SIZE];
+    removed_username[0] = '\0';
+    uint32_t removed_member_id = 0;
+    client_node_t *removed_client = NULL;
+
+    rwlock_writerlock(&client_list_rwlock);
+
+    client_node_t *current_client = client_list;
+    client_node_t *previous_client = NULL;
+    while (current_client != NULL)
+    {
+        if (current_client->client_info.socket == client_socket)
+        {
+            if (previous_client == NULL)
+            {
+                client_list = current_client->next;
+            }
+            else
+            {
+                previous_client->next = current_client->next;
+            }
+            strcpy(removed_username, current_client->client_info.username);
+            removed_member_id = current_client->member_id;
+            if (removed_username[0] != '\0' && username_index_find(&username_index, removed_username) == current_client)
+            {
+                username_index_remove(&username_index, removed_username);
+            }
+
+            atomic_fetch_sub(&connection_count, 1);
+            if (removed_username[0] == '\0' && !current_client->transfer)
+            {
+                atomic_fetch_sub(&pending_auth_count, 1);
+            }
+
+            removed_client = current_client;
+            break;
+        }
+        previous_client = current_client;
+        current_client = current_client->next;
+    }
+
+    rwlock_writerunlock(&client_list_rwlock);
+
+    if (removed_client != NULL)
+    {
+        wait_for_room_writer_pass();
+        if (client_socket != LOCAL_MEMBER_SOCKET)
+        {
+            socket_close(client_socket, error);
+        }
+        free_client_node(removed_client);
+    }
+
+    if (removed_username[0] != '\0')
+    {
+        typing_record(removed_member_id, 0);
+        presence_record_leave(removed_username, removed_member_id);
+    }
+}
+
+void remove_all_clients(error_list_t *error)
+{
+    // the list is taken whole under the lock and torn down after it, the sockets close without anyone waiting on the lock
+    rwlock_writerlock(&client_list_rwlock);
+
+    client_node_t *removed_clients = client_list;
+    client_list = NULL;
+
+    for (client_node_t *current_client = removed_clients; current_client != NULL; current_client = current_client->next)
+    {
+        const char *username = current_client->client_info.username;
+        if (username[0] != '\0' && username_index_find(&username_index, username) == current_client)
+        {
+            username_index_remove(&username_index, username);
+        }
+    }
+
+    atomic_store(&connection_count, 0);
+    atomic_store(&pending_auth_count, 0);
+
+    rwlock_writerunlock(&client_list_rwlock);
+
+    wait_for_room_writer_pass();
+
+    while (removed_clients != NULL)
+    {
+        client_node_t *next_client = removed_clients->next;
+        if (removed_clients->client_info.socket != LOCAL_MEMBER_SOCKET)
+        {
+            socket_close(removed_clients->client_info.socket, error);
+        }
+        free_client_node(removed_clients);
+        removed_clients = next_client;
+    }
+}
+
+int close_chat_room(error_list_t *error)
+{
+    if (!atomic_exchange(&accept_thread_joinable, 0))
+    {
+        add_error(error, ERR_SERVER_NOT_RUNNING, NON_CRITICAL_ERROR, "There is no room to close", "close_chat_room");
+        return 1;
+    }
+
+    atomic_store(&room_closing, 1);
+
+    // wakes the accept thread out of its poll, on Linux the listener also stops completing handshakes right away.
+    // elsewhere the thread notices within ACCEPT_POLL_TIMEOUT_MS
+    error_list_t shutdown_error;
+    init_error(&shutdown_error);
+    mutex_lock(&listener_mutex);
+    if (listener_open)
+    {
+        socket_shutdown(*listening_socket, &shutdown_error);
+    }
+    mutex_unlock(&listener_mutex);
+
+    thread_join(accept_thread);
+
+    return 0;
+}
+
+static int is_loopback_member(const client_node_t *client, error_list_t *error)
+{
+    if ((ntohl(client->client_info.address.sin_addr.s_addr) >> 24) != 127)
+    {
+        return 0;
+    }
+
+    add_error_with_subject(error, ERR_BAN_LOOPBACK, NON_CRITICAL_ERROR, "\"%s\" connects from this machine, banning the address would shut out every local member, they were kicked instead", client->client_info.username, "kick_client");
+    return 1;
+}
+
+int kick_client(const char *username, notification_type_t notification_type, error_list_t *error)
+{
+    if (!atomic_load(&server_running) || atomic_load(&room_closing))
+    {
+        add_error(error, ERR_SERVER_NOT_RUNNING, NON_CRITICAL_ERROR, "Only the host of a running room can kick or ban", "kick_client");
+        return 1;
+    }
+
+    // the notice goes to the node found under the lock, a descriptor looked up by name could have been reused by then.
+    // pull mode marks the node for the writer, push mode sends and shuts down while the node can't be removed
+    if (delivery_mode == DELIVERY_MODE_PULL)
+    {
+        rwlock_writerlock(&client_list_rwlock);
+    }
+    else
+    {
+        rwlock_readerlock(&client_list_rwlock);
+    }
+
+    int result = 1;
+    client_node_t *current_client = username_index_find(&username_index, username);
+    if (current_client == NULL)
+    {
+        add_error_with_subject(error, ERR_USER_NOT_FOUND, NON_CRITICAL_ERROR, "User \"%s\" is not in the room", username, "kick_client");
+    }
+    else if (current_client->client_info.user_type == USER_TYPE_ADMIN)
+    {
+        add_error(error, ERR_KICK_ADMIN, NON_CRITICAL_ERROR, "The host can't be kicked or banned", "kick_client");
+    }
+    else
+    {
+        // every local transport client and every TCP client on this host share a loopback address, those are only kicked
+        if (notification_type == NOTIFICATION_BAN && is_loopback_member(current_client, error))
+        {
+            notification_type = NOTIFICATION_KICK;
+        }
+
+        // the ban is in place before the notice goes out, so an immediate reconnect is already refused
+        if (notification_type != NOTIFICATION_BAN || ban_filter_add(&ban_filter, ntohl(current_client->client_info.address.sin_addr.s_addr), 32, error) == 0)
+        {
+            char frame[ERROR_NOTIFICATION_BUFFER_SIZE];
+            const char *notice = notification_type == NOTIFICATION_BAN ? "You have been banned from the room" : "You have been kicked from the room";
+            snprintf(frame, sizeof(frame), "%d:%d:%s", MSG_TYPE_NOTIFICATION, notification_type, notice);
+
+            // a notice that can't be queued doesn't keep the member in the room
+            deliver_to_client(current_client, FRAME_LANE_CONTROL, frame, strlen(frame) + 1, error);
+
+            if (delivery_mode == DELIVERY_MODE_PULL)
+            {
+                current_client->disconnect_pending = 1;
+            }
+            else
+            {
+                // the reader thread sees the shutdown and removes the client
+                socket_shutdown(current_client->client_info.socket, error);
+            }
+            result = 0;
+        }
+    }
+
+    if (delivery_mode == DELIVERY_MODE_PULL)
+    {
+        rwlock_writerunlock(&client_list_rwlock);
+        wake_room_writer();
+    }
+    else
+    {
+        rwlock_readerunlock(&client_list_rwlock);
+    }
+
+    // the member is out either way, a notice that didn't make it is only worth a report
+    if (result == 0 && error->count > 0)
+    {
+        report_errors(error, server_callback_error_func);
+        init_error(error);
+    }
+
+    return result;
+}
+
+void mark_transfer_client(socket_t client_socket)
+{
+    rwlock_writerlock(&client_list_rwlock);
+
+    client_node_t *current_client = client_list;
+    while (current_client != NULL)
+    {
+        if (current_client->client_info.socket == client_socket)
+        {
+            if (!current_client->transfer)
+            {
+                current_client->transfer = 1;
+                atomic_fetch_sub(&pending_auth_count, 1);
+            }
+            break;
+        }
+        current_client = current_client->next;
+    }
+
+    rwlock_writerunlock(&client_list_rwlock);
+}
+
+void set_typing_subscription(socket_t client_socket, int subscribed)
+{
+    rwlock_writerlock(&client_list_rwlock);
+
+    client_node_t *current_client = client_list;
+    while (current_client != NULL)
+    {
+        if (current_client->client_info.socket == client_socket)
+        {
+            current_client->typing_subscribed = subscribed;
+            // a new subscriber gets the set as it is now, not just the next change
+            current_client->typing_generation = 0;
+            break;
+        }
+        current_client = current_client->next;
+    }
+
+    rwlock_writerunlock(&client_list_rwlock);
+
+    wake_room_writer();
+}
+
+static int is_handoff_candidate(const client_node_t *client)
+{
+    // a connection on its way out is left to close with this process. so is a local one, its shared memory
+    // belongs to this process and the client reconnects to the new one
+    return client->handoff_ready && !client->send_failed && !client->disconnect_pending && !local_transport_owns(client->client_info.socket);
+}
+
+static int append_handoff_output(upgrade_connection_t *connection, const char *data, size_t length)
+{
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    char *resized = (char *)realloc(connection->output, connection->output_length + length);
+    if (resized == NULL)
+    {
+        return 1;
+    }
+
+    memcpy(resized + connection->output_length, data, length);
+    connection->output = resized;
+    connection->output_length += length;
+
+    return 0;
+}
+
+// everything the room writer would still have sent the client, in the order it would have: the rest of a half sent frame first
+static int capture_handoff_output(client_node_t *client, upgrade_connection_t *connection, error_list_t *error)
+{
+    outbox_frame_t *skipped_frame = NULL;
+    uint64_t log_cursors[FRAME_LANE_COUNT];
+    for (int lane = 0; lane < FRAME_LANE_COUNT; lane++)
+    {
+        log_cursors[lane] = client->lanes[lane].log_cursor;
+    }
+
+    if (client->frame_source == FRAME_SOURCE_OUTBOX)
+    {
+        skipped_frame = client->lanes[client->frame_lane].outbox_head;
+        if (append_handoff_output(connection, skipped_frame->data + client->frame_offset, skipped_frame->length - client->frame_offset) != 0)
+        {
+            return 1;
+        }
+    }
+    else if (client->frame_source == FRAME_SOURCE_COPY)
+    {
+        // the cursors are already past the copied frames
+        if (append_handoff_output(connection, client->frame_copy + client->frame_offset, client->frame_copy_length - client->frame_offset) != 0)
+        {
+            return 1;
+        }
+    }
+
+    for (int lane = 0; lane < FRAME_LANE_COUNT; lane++)
+    {
+        for (outbox_frame_t *frame = client->lanes[lane].outbox_head; frame != NULL; frame = frame->next)
+        {
+            if (frame != skipped_frame && append_handoff_output(connection, frame->data, frame->length) != 0)
+            {
+                return 1;
+            }
+        }
+
+        if (lane < FRAME_LANE_PRESENCE || delivery_mode != DELIVERY_MODE_PULL || !client->authenticated)
+        {
+            continue;
+        }
+
+        uint64_t tail = room_log_tail(&room_logs[lane]);
+        if (log_cursors[lane] < tail)
+        {
+            add_error(error, ERR_SLOW_CLIENT, NON_CRITICAL_ERROR, "A slow client missed messages that left the room log", "capture_handoff_output");
+            log_cursors[lane] = tail;
+        }
+
+        for (uint64_t cursor = log_cursors[lane]; cursor < room_log_head(&room_logs[lane]); cursor++)
+        {
+            const room_log_entry_t *entry = room_log_get(&room_logs[lane], cursor);
+            if (entry != NULL && append_handoff_output(connection, entry->data, entry->length) != 0)
+            {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// the room writer is stopped and every reader parked, so nothing but the host's own member changes the list meanwhile
+static int capture_room_state(upgrade_state_t *state, error_list_t *error)
+{
+    upgrade_state_init(state);
+    state->listening_socket = *listening_socket;
+    strcpy(state->secret_key, global_secret_key);
+    state->banned_addresses = ban_filter_format_list(&ban_filter);
+    state->content_filter_rules = content_filter_format_rules(&content_filter);
+
+    int result = 0;
+
+    rwlock_readerlock(&client_list_rwlock);
+    for (int lane = FRAME_LANE_PRESENCE; lane < FRAME_LANE_COUNT && delivery_mode == DELIVERY_MODE_PULL; lane++)
+    {
+        room_log_read_lock(&room_logs[lane]);
+    }
+
+    state->next_member_id = next_member_id;
+    state->connections = (upgrade_connection_t *)calloc((size_t)atomic_load(&connection_count) + 1, sizeof(upgrade_connection_t));
+    if (state->connections == NULL)
+    {
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for the handoff", "capture_room_state");
+        result = 1;
+    }
+
+    for (client_node_t *current_client = client_list; current_client != NULL && result == 0; current_client = current_client->next)
+    {
+        if (!is_handoff_candidate(current_client))
+        {
+            continue;
+        }
+
+        upgrade_connection_t *connection = &state->connections[state->connection_count];
+        connection->socket = current_client->client_info.socket;
+        connection->address = current_client->client_info.address;
+        strcpy(connection->username, current_client->client_info.username);
+        connection->user_type = current_client->client_info.user_type;
+        connection->member_id = current_client->member_id;
+        connection->typing_subscribed = current_client->typing_subscribed;
+
+        if (current_client->handoff_input_length > 0)
+        {
+            connection->input = (char *)malloc(current_client->handoff_input_length);
+            if (connection->input == NULL)
+            {
+                add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for the handoff", "capture_room_state");
+                result = 1;
+                break;
+            }
+            memcpy(connection->input, current_client->handoff_input, current_client->handoff_input_length);
+            connection->input_length = current_client->handoff_input_length;
+        }
+
+        // counted before the output, so a failure below still frees what was captured
+        state->connection_count++;
+
+        if (capture_handoff_output(current_client, connection, error) != 0)
+        {
+            add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for the handoff", "capture_room_state");
+            result = 1;
+        }
+        else if (!current_client->handoff_ready)
+        {
+            // dropped by the capture, the slot is reused
+            state->connection_count--;
+            free(connection->input);
+            free(connection->output);
+            memset(connection, 0, sizeof(*connection));
+        }
+    }
+
+    for (int lane = FRAME_LANE_PRESENCE; lane < FRAME_LANE_COUNT && delivery_mode == DELIVERY_MODE_PULL; lane++)
+    {
+        room_log_read_unlock(&room_logs[lane]);
+    }
+    rwlock_readerunlock(&client_list_rwlock);
+
+    return result;
+}
+
+// the new process owns the connections now, this one only lets go of its descriptors, nobody left the room
+static void release_handed_off_clients(void)
+{
+    error_list_t close_error;
+    init_error(&close_error);
+
+    rwlock_writerlock(&client_list_rwlock);
+
+    client_node_t **link = &client_list;
+    while (*link != NULL)
+    {
+        client_node_t *current_client = *link;
+        if (!is_handoff_candidate(current_client))
+        {
+            link = &current_client->next;
+            continue;
+        }
+
+        *link = current_client->next;
+        socket_close(current_client->client_info.socket, &close_error);
+        atomic_fetch_sub(&connection_count, 1);
+        if (current_client->client_info.username[0] == '\0')
+        {
+            atomic_fetch_sub(&pending_auth_count, 1);
+        }
+        free_client_node(current_client);
+    }
+
+    rwlock_writerunlock(&client_list_rwlock);
+}
+
+static int hand_off_room(socket_t channel, error_list_t *error)
+{
+    mutex_lock(&handoff_mutex);
+    atomic_store(&handoff_pending, 1);
+    mutex_unlock(&handoff_mutex);
+
+    // joins and leaves still waiting in the presence batch go into the logs that are about to be captured
+    presence_flush();
+
+    uint64_t park_deadline = cross_platform_monotonic_ms() + UPGRADE_PARK_TIMEOUT_MS;
+
+    mutex_lock(&handoff_mutex);
+    while (parked_threads < active_threads)
+    {
+        uint64_t now = cross_platform_monotonic_ms();
+        if (now >= park_deadline)
+        {
+            break;
+        }
+        cond_timedwait(&handoff_cond, &handoff_mutex, (long)(park_deadline - now));
+    }
+    int all_parked = parked_threads == active_threads;
+    mutex_unlock(&handoff_mutex);
+
+    int result = 1;
+    if (!all_parked)
+    {
+        add_error(error, ERR_UPGRADE_FAILED, NON_CRITICAL_ERROR, "Not every connection settled in time for the handoff, this server keeps serving the room", "hand_off_room");
+    }
+    else
+    {
+        join_room_writer();
+
+        upgrade_state_t state;
+        result = capture_room_state(&state, error) != 0 || upgrade_send_state(channel, &state, error) != 0;
+        upgrade_state_free(&state, 0);
+
+        if (result == 0)
+        {
+            release_handed_off_clients();
+            room_handed_off = 1;
+            atomic_store(&server_running, 0);
+        }
+        else if (delivery_mode == DELIVERY_MODE_PULL && start_room_writer(error) != 0)
+        {
+            // nothing would reach the clients anymore
+            atomic_store(&server_running, 0);
+        }
+    }
+
+    mutex_lock(&handoff_mutex);
+    atomic_store(&handoff_pending, 0);
+    handoff_generation++;
+    cond_broadcast(&handoff_cond);
+    mutex_unlock(&handoff_mutex);
+
+    return result;
+}
+
+thread_ret_t THREAD_CALL upgrade_listener_thread(void *arg)
+{
+    (void)arg;
+
+    while (atomic_load(&server_running) && !atomic_load(&room_closing) && !room_handed_off)
+    {
+        error_list_t upgrade_error;
+        init_error(&upgrade_error);
+
+        pollfd_t listen_fd;
+        listen_fd.fd = upgrade_listener;
+        listen_fd.events = POLLIN;
+        listen_fd.revents = 0;
+
+        int ready = socket_poll(&listen_fd, 1, ACCEPT_POLL_TIMEOUT_MS, &upgrade_error);
+        if (ready <= 0)
+        {
+            if (ready == SOCKET_ERR)
+            {
+                report_errors(&upgrade_error, server_callback_error_func);
+                break;
+            }
+            continue;
+        }
+
+        socket_t channel = upgrade_channel_accept(upgrade_listener, &upgrade_error);
+        if (channel != INVALID_SOCK && upgrade_receive_hello(channel, &upgrade_error) == 0)
+        {
+            hand_off_room(channel, &upgrade_error);
+        }
+        upgrade_channel_close(channel);
+
+        if (upgrade_error.count > 0)
+        {
+            report_errors(&upgrade_error, server_callback_error_func);
+        }
+    }
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+int set_upgrade_socket_path(const char *path)
+{
+    // an empty path turns hot upgrade off
+    if (strlen(path) >= sizeof(upgrade_socket_path))
+    {
+        return 1;
+    }
+
+    strcpy(upgrade_socket_path, path);
+
+    return 0;
+}
+
+int set_local_transport_path(const char *path)
+{
+    if (strlen(path) >= sizeof(local_transport_path))
+    {
+        return 1;
+    }
+
+    strcpy(local_transport_path, path);
+
+    return 0;
+}
+
+void set_listener_socket_profile(socket_profile_t profile)
+{
+    listener_socket_profile = profile;
+}
+
+int set_blob_directory(const char *directory)
+{
+    char *copy = (char *)malloc(strlen(directory) + 1);
+    if (copy == NULL)
+    {
+        return 1;
+    }
+    strcpy(copy, directory);
+
+    free(blob_directory_preset);
+    blob_directory_preset = copy;
+
+    return 0;
+}
+
+int set_banned_addresses(const char *list)
+{
+    char *copy = (char *)malloc(strlen(list) + 1);
+    if (copy == NULL)
+    {
+        return 1;
+    }
+    strcpy(copy, list);
+
+    free(banned_addresses_preset);
+    banned_addresses_preset = copy;
+
+    return 0;
+}
+
+int set_content_filter_rules(const char *rules, error_list_t *error)
+{
+    // like the ban filter it outlives the room, rules set before a room starts apply to it.
+    // a running room swaps them in between two messages
+    if (!content_filter_ready)
+    {
+        content_filter_init(&content_filter);
+        content_filter_ready = 1;
+    }
+
+    return content_filter_load(&content_filter, rules, error);
+}
+
+int join_chat_room_locally(const char *username, error_list_t *error, void (*callback_error_func)(const char *, int), void (*callback_message_func)(const char *, const char *), void (*callback_presence_func)(presence_op_t, const char *, const char *), void (*callback_attachment_func)(const char *, const char *, uint64_t, const char *), void (*callback_search_func)(const char *, const char *, uint64_t), void (*callback_typing_func)(const char **, size_t), void (*callback_direct_func)(const char *, const char **, size_t, const char *), void (*callback_direct_ack_func)(uint32_t, char, const char *))
+{
+    if (!atomic_load(&server_running))
+    {
+        add_error(error, ERR_SERVER_NOT_RUNNING, CRITICAL_ERROR, "The room must be running before the host joins it", "join_chat_room_locally");
+        return 1;
+    }
+
+    if (utf8_check_text(username, USERNAME_MAX_CHARACTERS) != UTF8_VALID)
+    {
+        add_error(error, ERR_USERNAME_TOO_LONG, CRITICAL_ERROR, "Username must be valid UTF-8 of at most 20 characters", "join_chat_room_locally");
+        return 1;
+    }
+
+    if (member_table_init(&local_member.members) != 0)
+    {
+        add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for the host's member table", "join_chat_room_locally");
+        return 1;
+    }
+
+    strcpy(local_member.username, username);
+    local_member.callback_error_func = callback_error_func;
+    local_member.callback_message_func = callback_message_func;
+    local_member.callback_presence_func = callback_presence_func;
+    local_member.callback_attachment_func = callback_attachment_func;
+    local_member.callback_search_func = callback_search_func;
+    local_member.callback_typing_func = callback_typing_func;
+    local_member.callback_direct_func = callback_direct_func;
+    local_member.callback_direct_ack_func = callback_direct_ack_func;
+    atomic_store(&local_member.next_direct_sequence, 1);
+    local_member.member_id = 0;
+    local_member.alias_lanes = 0;
+    mutex_init(&local_member.mutex);
+    cond_init(&local_member.cond);
+    local_member.inbox_head = NULL;
+    local_member.inbox_tail = NULL;
+    local_member.pending = 0;
+    local_member.running = 1;
+
+    if (thread_create(&local_member.thread, local_member_thread, &local_member) != 0)
+    {
+        add_error(error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create local member thread", "join_chat_room_locally");
+        mutex_destroy(&local_member.mutex);
+        cond_destroy(&local_member.cond);
+        member_table_destroy(&local_member.members);
+        return 1;
+    }
+
+    user_info_t member_info;
+    memset(&member_info, 0, sizeof(member_info));
+    member_info.socket = LOCAL_MEMBER_SOCKET;
+    member_info.user_type = USER_TYPE_ADMIN;
+
+    if (add_client(&member_info, error) != 0)
+    {
+        mutex_lock(&local_member.mutex);
+        local_member.running = 0;
+        cond_signal(&local_member.cond);
+        mutex_unlock(&local_member.mutex);
+        thread_join(local_member.thread);
+        mutex_destroy(&local_member.mutex);
+        cond_destroy(&local_member.cond);
+        member_table_destroy(&local_member.members);
+        return 1;
+    }
+
+    atomic_store(&local_member_joined, 1);
+
+    // a host UI without a typing callback is never sent typing sets
+    if (callback_typing_func != NULL)
+    {
+        set_typing_subscription(LOCAL_MEMBER_SOCKET, 1);
+    }
+
+    // queues the presence snapshot for the host and announces it to everyone else
+    local_member.member_id = update_client_info(LOCAL_MEMBER_SOCKET, username, USER_TYPE_ADMIN, error);
+
+    return 0;
+}
+
+void leave_chat_room_locally(void)
+{
+    // the JNI thread and the accept thread's shutdown may both get here, only one tears down
+    if (!atomic_exchange(&local_member_joined, 0))
+    {
+        return;
+    }
+
+    error_list_t leave_error;
+    init_error(&leave_error);
+    remove_client(LOCAL_MEMBER_SOCKET, &leave_error);
+
+    mutex_lock(&local_member.mutex);
+    local_member.running = 0;
+    cond_signal(&local_member.cond);
+    mutex_unlock(&local_member.mutex);
+
+    thread_join(local_member.thread);
+
+    outbox_frame_t *frame = local_member.inbox_head;
+    while (frame != NULL)
+    {
+        outbox_frame_t *next_frame = frame->next;
+        free(frame);
+        frame = next_frame;
+    }
+    local_member.inbox_head = NULL;
+    local_member.inbox_tail = NULL;
+
+    mutex_destroy(&local_member.mutex);
+    cond_destroy(&local_member.cond);
+    member_table_destroy(&local_member.members);
+
+    if (leave_error.count > 0)
+    {
+        report_errors(&leave_error, local_member.callback_error_func);
+    }
+}
+
+void send_local_message(const char *message, error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    if (!atomic_load(&local_member_joined))
+    {
+        add_error(error, ERR_SERVER_NOT_RUNNING, NON_CRITICAL_ERROR, "The host is not in a running room", "send_local_message");
+        report_errors(error, callback_error_func);
+        return;
+    }
+
+    if (utf8_check_text(message, MESSAGE_MAX_CHARACTERS) != UTF8_VALID)
+    {
+        add_error(error, ERR_INVALID_TEXT, NON_CRITICAL_ERROR, "Messages must be valid UTF-8 of at most 250 characters", "send_local_message");
+        report_errors(error, callback_error_func);
+        return;
+    }
+
+    // the same path a client's message takes once a worker has parsed it, minus the socket and the parse.
+    // the host's own messages go through the filter too
+    char filtered_message[MESSAGE_BUFFER_SIZE];
+    char encoded_message[ENCODED_MESSAGE_BUFFER_SIZE];
+    strcpy(filtered_message, message);
+    encode_message(filtered_message, encoded_message, sizeof(encoded_message));
+    if (filter_message(local_member.username, filtered_message, encoded_message, sizeof(encoded_message)))
+    {
+        add_error(error, ERR_MESSAGE_BLOCKED, NON_CRITICAL_ERROR, "Your message was blocked by the room's content filter", "send_local_message");
+        report_errors(error, callback_error_func);
+        return;
+    }
+
+    typing_record(local_member.member_id, 0);
+    broadcast_member_alias(FRAME_LANE_CHAT, local_member.member_id, local_member.username, &local_member.alias_lanes);
+    broadcast_message(encoded_message, local_member.username, local_member.member_id, error, callback_error_func);
+
+    if (error->count > 0)
+    {
+        report_errors(error, callback_error_func);
+    }
+}
+
+void send_local_typing(int typing)
+{
+    // nothing to report when it doesn't arrive, the next keystroke refreshes it anyway
+    if (atomic_load(&local_member_joined))
+    {
+        typing_record(local_member.member_id, typing);
+    }
+}
+
+uint32_t send_local_direct_message(const char **recipients, size_t recipient_count, const char *message, error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    if (!atomic_load(&local_member_joined))
+    {
+        add_error(error, ERR_SERVER_NOT_RUNNING, NON_CRITICAL_ERROR, "The host is not in a running room", "send_local_direct_message");
+        report_errors(error, callback_error_func);
+        return 0;
+    }
+
+    if (utf8_check_text(message, MESSAGE_MAX_CHARACTERS) != UTF8_VALID)
+    {
+        add_error(error, ERR_INVALID_TEXT, NON_CRITICAL_ERROR, "Messages must be valid UTF-8 of at most 250 characters", "send_local_direct_message");
+        report_errors(error, callback_error_func);
+        return 0;
+    }
+
+    if (recipient_count == 0 || recipient_count > DIRECT_MAX_RECIPIENTS)
+    {
+        add_error(error, ERR_USER_NOT_FOUND, NON_CRITICAL_ERROR, "A direct message names between 1 and 8 members", "send_local_direct_message");
+        report_errors(error, callback_error_func);
+        return 0;
+    }
+
+    char recipient_names[DIRECT_MAX_RECIPIENTS][USERNAME_BUFFER_SIZE];
+    for (size_t i = 0; i < recipient_count; i++)
+    {
+        // a name that can't belong to anyone is still acked, as not found
+        snprintf(recipient_names[i], USERNAME_BUFFER_SIZE, "%s", recipients[i]);
+    }
+
+    char filtered_message[MESSAGE_BUFFER_SIZE];
+    char encoded_message[ENCODED_MESSAGE_BUFFER_SIZE];
+    strcpy(filtered_message, message);
+    encode_message(filtered_message, encoded_message, sizeof(encoded_message));
+    if (filter_message(local_member.username, filtered_message, encoded_message, sizeof(encoded_message)))
+    {
+        add_error(error, ERR_MESSAGE_BLOCKED, NON_CRITICAL_ERROR, "Your message was blocked by the room's content filter", "send_local_direct_message");
+        report_errors(error, callback_error_func);
+        return 0;
+    }
+
+    uint32_t sequence = atomic_fetch_add(&local_member.next_direct_sequence, 1);
+    route_direct_message(local_member.username, sequence, recipient_names, recipient_count, encoded_message, error, callback_error_func);
+
+    return sequence;
+}
+
+void search_local_history(const char *query, uint64_t since, uint64_t until, error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    if (!atomic_load(&local_member_joined))
+    {
+        add_error(error, ERR_SERVER_NOT_RUNNING, NON_CRITICAL_ERROR, "The host is not in a running room", "search_local_history");
+        report_errors(error, callback_error_func);
+        return;
+    }
+
+    if (utf8_check_text(query, SEARCH_QUERY_MAX_CHARACTERS) != UTF8_VALID)
+    {
+        add_error(error, ERR_INVALID_TEXT, NON_CRITICAL_ERROR, "Search queries must be valid UTF-8 of at most 100 characters", "search_local_history");
+        report_errors(error, callback_error_func);
+        return;
+    }
+
+    // the results reach the host's callbacks through its inbox, in order with everything else it is sent
+    send_search_results(LOCAL_MEMBER_SOCKET, query, since, until, error, callback_error_func);
+}
+
+int share_local_attachment(const char *path, const char *name, error_list_t *error, void (*callback_error_func)(const char *, int))
+{
+    if (!atomic_load(&local_member_joined) || !attachments_enabled)
+    {
+        add_error(error, ERR_SERVER_NOT_RUNNING, NON_CRITICAL_ERROR, "The host is not in a room that accepts attachments", "share_local_attachment");
+        report_errors(error, callback_error_func);
+        return 1;
+    }
+
+    if (utf8_check_text(name, ATTACHMENT_NAME_MAX_CHARACTERS) != UTF8_VALID)
+    {
+        add_error(error, ERR_INVALID_TEXT, NON_CRITICAL_ERROR, "Attachment names must be valid UTF-8 of at most 100 characters", "share_local_attachment");
+        report_errors(error, callback_error_func);
+        return 1;
+    }
 
-    thread_t accept_thread;
-    if (thread_create(&accept_thread, accept_client_thread, thread_args) != 0)
+    // the host's file goes straight into the store, there is no connection to upload it over
+    char hash_hex[BLOB_HASH_HEX_BUFFER_SIZE];
+    uint64_t size;
+    if (blob_store_put_file(path, hash_hex, &size, error) != 0)
     {
-        atomic_store(&server_running, 0);
-        add_error(main_error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create accept client thread", "start_chat_room");
-        socket_close(*listening_socket, main_error);
-        socket_cleanup(main_error);
-        free(listening_socket);
-        listening_socket = NULL;
-        free(thread_args);
+        report_errors(error, callback_error_func);
         return 1;
     }
 
-    thread_detach(accept_thread);
+    broadcast_member_alias(FRAME_LANE_BULK, local_member.member_id, local_member.username, &local_member.alias_lanes);
+    broadcast_attachment(hash_hex, size, name, local_member.member_id);
 
     return 0;
 }
 
-thread_ret_t THREAD_CALL accept_client_thread(void *arg)
+void local_member_enqueue(const char *frame, size_t length)
 {
-    accept_client_thread_args_t *thread_args = (accept_client_thread_args_t *)arg;
-
-    socket_t *listening_socket = thread_args->listening_socket;
-    void (*callback_error_func)(const char *, int) = thread_args->callback_error_func;
+    mutex_lock(&local_member.mutex);
 
-    while (atomic_load(&server_running))
+    // a host UI that stops draining loses frames instead of growing the queue without bound
+    if (!local_member.running || local_member.pending >= LOCAL_MEMBER_MAX_PENDING)
     {
-        struct sockaddr_in client_addr;
-
-        error_t accept_error;
-        init_error(&accept_error);
-
-        socket_t client_socket = socket_accept(*listening_socket, (struct sockaddr *)&client_addr, &accept_error);
-        if (client_socket != INVALID_SOCK)
-        {
-            user_info_t *client_info = (user_info_t *)malloc(sizeof(user_info_t));
-            if (client_info == NULL)
-            {
-                socket_close(client_socket, &accept_error);
-                add_error(&accept_error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for user_info_t struct", "accept_client_thread");
-                report_errors(&accept_error, callback_error_func);
-                break;
-            }
-
-            client_info->socket = client_socket;
-            client_info->address = client_addr;
-            client_info->username[0] = '\0';
-            client_info->user_type = USER_TYPE_REGULAR;
-
-            if (add_client(client_info, &accept_error) != 0)
-            {
-                socket_close(client_socket, &accept_error);
-                free(client_info);
-                report_errors(&accept_error, callback_error_func);
-                break;
-            }
-
-            handle_client_thread_args_t *client_thread_args = (handle_client_thread_args_t *)malloc(sizeof(handle_client_thread_args_t));
-            if (client_thread_args == NULL)
-            {
-                remove_client(client_socket, &accept_error);
-                free(client_info);
-                add_error(&accept_error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for client thread args", "accept_client_thread");
-                report_errors(&accept_error, callback_error_func);
-                break;
-            }
-
-            client_thread_args->client_socket = client_socket;
-            client_thread_args->callback_error_func = callback_error_func;
-
-            thread_t handle_thread;
-            if (thread_create(&handle_thread, handle_client_thread, client_thread_args) != 0)
-            {
-                remove_client(client_socket, &accept_error);
-                free(client_info);
-                free(client_thread_args);
-                add_error(&accept_error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create handle client thread", "accept_client_thread");
-                report_errors(&accept_error, callback_error_func);
-                break;
-            }
-            else
-            {
-                thread_detach(handle_thread);
-            }
-        }
-        else
+        int dropped = local_member.running;
+        mutex_unlock(&local_member.mutex);
+        if (dropped)
         {
-            report_errors(&accept_error, callback_error_func);
-            if (accept_error.max_severity == CRITICAL_ERROR)
-            {
-                break;
-            }
+            error_list_t *error = thread_error_context();
+            add_error(error, ERR_SLOW_CLIENT, NON_CRITICAL_ERROR, "The host fell behind, a frame for it was dropped", "local_member_enqueue");
+            report_errors(error, local_member.callback_error_func);
         }
+        return;
     }
 
-    atomic_store(&server_running, 0);
-
-    error_t cleanup_error;
-    init_error(&cleanup_error);
-    remove_all_clients(&cleanup_error);
-    socket_close(*listening_socket, &cleanup_error);
-    socket_cleanup(&cleanup_error);
-    free(listening_socket);
-    listening_socket = NULL;
+    mutex_unlock(&local_member.mutex);
 
-    if (cleanup_error.count > 0)
+    outbox_frame_t *inbox_frame = (outbox_frame_t *)malloc(sizeof(outbox_frame_t) + length);
+    if (inbox_frame == NULL)
     {
-        report_errors(&cleanup_error, callback_error_func);
+        error_list_t *error = thread_error_context();
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to allocate memory for a host frame, the frame was dropped", "local_member_enqueue");
+        report_errors(error, local_member.callback_error_func);
+        return;
     }
 
-    free(thread_args);
+    inbox_frame->next = NULL;
+    inbox_frame->length = length;
+    memcpy(inbox_frame->data, frame, length);
 
-#ifdef _WIN32
-    return 0;
-#else
-    return NULL;
-#endif
+    mutex_lock(&local_member.mutex);
+    if (local_member.inbox_tail == NULL)
+    {
+        local_member.inbox_head = inbox_frame;
+    }
+    else
+    {
+        local_member.inbox_tail->next = inbox_frame;
+    }
+    local_member.inbox_tail = inbox_frame;
+    local_member.pending++;
+    cond_signal(&local_member.cond);
+    mutex_unlock(&local_member.mutex);
 }
 
-thread_ret_t THREAD_CALL handle_client_thread(void *arg)
+thread_ret_t THREAD_CALL local_member_thread(void *arg)
 {
-    handle_client_thread_args_t *thread_args = (handle_client_thread_args_t *)arg;
-
-    socket_t client_socket = thread_args->client_socket;
-    void (*callback_error_func)(const char *, int) = thread_args->callback_error_func;
+    local_member_t *member = (local_member_t *)arg;
 
-    char client_username[USERNAME_BUFFER_SIZE];
-    client_username[0] = '\0';
-
-    while (atomic_load(&server_running))
+    while (1)
     {
-        error_t error_struct;
-        init_error(&error_struct);
-
-        char message_buffer[MAX_BUFFER_SIZE];
-        int bytes_received = socket_recv(client_socket, message_buffer, sizeof(message_buffer), 0, client_username, CONTEXT_SERVER, &error_struct);
-
-        if (bytes_received == SOCKET_ERR)
+        mutex_lock(&member->mutex);
+        while (member->running && member->inbox_head == NULL)
         {
-            if (strcmp(error_struct.errors[error_struct.count - 1].code, SOCKET_ECONNRESET) == 0)
-            {
-                // client got disconnected
-                report_errors(&error_struct, callback_error_func);
-                break;
-            }
-            else
-            {
-                // other error occurred
-                report_errors(&error_struct, callback_error_func);
-                continue;
-            }
+            cond_wait(&member->cond, &member->mutex);
         }
-        else if (bytes_received == 0)
+
+        if (!member->running)
         {
-            // client disconnected gracefully
+            mutex_unlock(&member->mutex);
             break;
         }
-        else
+
+        // take the whole batch, the callbacks run without the lock so the writer never waits on the UI
+        outbox_frame_t *frame = member->inbox_head;
+        member->inbox_head = NULL;
+        member->inbox_tail = NULL;
+        member->pending = 0;
+        mutex_unlock(&member->mutex);
+
+        while (frame != NULL)
         {
-            message_buffer[bytes_received] = '\0';
+            outbox_frame_t *next_frame = frame->next;
 
             int msg_type;
-            sscanf(message_buffer, "%d:", &msg_type);
-
-            if (msg_type == MSG_TYPE_AUTH)
+            if (sscanf(frame->data, "%d:", &msg_type) == 1)
             {
-                user_type_t user_type;
-                char received_secret_key[ENCODED_SECRET_KEY_BUFFER_SIZE];
-                char received_username[USERNAME_BUFFER_SIZE];
-
-                sscanf(message_buffer, "%*d:%d:%72[^:]:%80[^:]", &user_type, received_secret_key, received_username);
-
-                received_secret_key[ENCODED_SECRET_KEY_BUFFER_SIZE - 1] = '\0';
-                received_username[USERNAME_BUFFER_SIZE - 1] = '\0';
-
-                if (user_type == USER_TYPE_ADMIN)
-                {
-                    update_client_info(client_socket, received_username, user_type);
-                    strncpy(client_username, received_username, sizeof(client_username) - 1);
-                    client_username[sizeof(client_username) - 1] = '\0';
-                }
-                else
+                if (msg_type == MSG_TYPE_MESSAGE || msg_type == MSG_TYPE_MEMBER_MESSAGE)
                 {
-                    char decoded_secret_key[SECRET_KEY_BUFFER_SIZE];
-                    decode_message(received_secret_key, decoded_secret_key, sizeof(decoded_secret_key));
+                    char received_username[USERNAME_BUFFER_SIZE];
+                    char decoded_message[MESSAGE_BUFFER_SIZE];
 
-                    if (strcmp(decoded_secret_key, global_secret_key) != 0)
+                    if (parse_message_frame(frame->data, &member->members, received_username, sizeof(received_username), decoded_message, sizeof(decoded_message)) == 0)
                     {
-                        send_error(client_socket, ERROR_SECRET_KEY, "Incorrect secret key", &error_struct, callback_error_func);
-                        continue;
+                        member->callback_message_func(received_username, decoded_message);
                     }
+                }
+                else if (msg_type == MSG_TYPE_PRESENCE)
+                {
+                    handle_presence_frame(frame->data, &member->members, member->callback_presence_func);
+                }
+                else if (msg_type == MSG_TYPE_ATTACHMENT)
+                {
+                    char received_username[USERNAME_BUFFER_SIZE];
+                    char hash_hex[BLOB_HASH_HEX_BUFFER_SIZE];
+                    char name[ATTACHMENT_NAME_BUFFER_SIZE];
+                    uint64_t size;
 
-                    if (is_username_taken(received_username))
+                    if (parse_attachment_frame(frame->data, &member->members, received_username, sizeof(received_username), hash_hex, &size, name, sizeof(name)) == 0)
                     {
-                        send_error(client_socket, ERROR_USERNAME, "Username already taken", &error_struct, callback_error_func);
-                        continue;
+                        member->callback_attachment_func(received_username, hash_hex, size, name);
                     }
-
-                    update_client_info(client_socket, received_username, user_type);
-                    strncpy(client_username, received_username, sizeof(client_username) - 1);
-                    client_username[sizeof(client_username) - 1] = '\0';
-
-                    send_notification(client_socket, NOTIFICATION_AUTH_SUCCESS, "", client_username, &error_struct, callback_error_func);
+                }
+                else if (msg_type == MSG_TYPE_SEARCH)
+                {
+                    handle_search_frame(frame->data, member->callback_search_func);
+                }
+                else if (msg_type == MSG_TYPE_TYPING)
+                {
+                    handle_typing_frame(frame->data, &member->members, member->callback_typing_func);
+                }
+                else if (msg_type == MSG_TYPE_DIRECT)
+                {
+                    handle_direct_frame(frame->data, member->callback_direct_func, member->callback_direct_ack_func);
                 }
             }
-            else if (msg_type == MSG_TYPE_MESSAGE)
-            {
-                char encoded_message[ENCODED_MESSAGE_BUFFER_SIZE];
-
-                sscanf(message_buffer, "%*d:%3000[^:]", encoded_message);
 
-                encoded_message[ENCODED_MESSAGE_BUFFER_SIZE - 1] = '\0';
-
-                broadcast_message(encoded_message, client_username, &error_struct, callback_error_func);
-            }
+            free(frame);
+            frame = next_frame;
         }
     }
 
-    error_t disconnection_error;
-    init_error(&disconnection_error);
-    remove_client(client_socket, &disconnection_error);
-
-    if (disconnection_error.count > 0)
-    {
-        report_errors(&disconnection_error, callback_error_func);
-    }
-
-    free(thread_args);
+    logger_thread_detach();
 
 #ifdef _WIN32
     return 0;
@@ -342,151 +4091,166 @@ thread_ret_t THREAD_CALL handle_client_thread(void *arg)
 #endif
 }
 
-void broadcast_message(const char *message, const char *sender_username, error_t *error, void (*callback_error_func)(const char *, int))
+int is_username_taken(const char *username)
 {
-    rwlock_readerlock(&client_list_rwlock);
-
-    client_node_t *current_client = client_list;
-    while (current_client != NULL)
+    // an empty name is what every connection has before it authenticates
+    if (username[0] == '\0')
     {
-        const char *receiver_username = current_client->client_info.username;
-        send_message(current_client->client_info.socket, message, sender_username, receiver_username, CONTEXT_SERVER, error, callback_error_func);
-        current_client = current_client->next;
+        return 1;
     }
 
+    rwlock_readerlock(&client_list_rwlock);
+    int taken = username_index_find(&username_index, username) != NULL;
     rwlock_readerunlock(&client_list_rwlock);
+
+    return taken;
 }
 
-int add_client(user_info_t *client_info, error_t *error)
+void generate_secret_key(char *key_buffer, size_t buffer_size)
 {
-    client_node_t *new_node = (client_node_t *)malloc(sizeof(client_node_t));
-    if (new_node == NULL)
-    {
-        add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for client_node_t struct", "add_client");
-        return 1;
-    }
-    new_node->client_info = *client_info;
-
-    rwlock_writerlock(&client_list_rwlock);
+    const size_t char_set_length = strlen(SECRET_KEY_CHAR_SET);
 
-    new_node->next = client_list;
-    client_list = new_node;
+    srand(time(NULL));
 
-    rwlock_writerunlock(&client_list_rwlock);
+    for (size_t i = 0; i < SECRET_KEY_LENGTH; ++i)
+    {
+        key_buffer[i] = SECRET_KEY_CHAR_SET[rand() % char_set_length];
+    }
 
-    return 0;
+    key_buffer[SECRET_KEY_LENGTH] = '\0';
 }
 
-void update_client_info(socket_t client_socket, const char *username, user_type_t user_type)
+const char *get_secret_key(void)
 {
-    rwlock_writerlock(&client_list_rwlock);
-    client_node_t *current_client = client_list;
+    return global_secret_key;
+}
 
-    while (current_client != NULL)
+int set_secret_key(const char *secret_key)
+{
+    if (strlen(secret_key) != SECRET_KEY_LENGTH)
     {
-        if (current_client->client_info.socket == client_socket)
-        {
-            strcpy(current_client->client_info.username, username);
-            current_client->client_info.user_type = user_type;
-            break;
-        }
-        current_client = current_client->next;
+        return 1;
     }
 
-    rwlock_writerunlock(&client_list_rwlock);
+    strcpy(global_secret_key, secret_key);
+    secret_key_preset = 1;
+
+    return 0;
 }
 
-void remove_client(socket_t client_socket, error_t *error)
+int set_server_port(const char *port)
 {
-    rwlock_writerlock(&client_list_rwlock);
-
-    client_node_t *current_client = client_list;
-    client_node_t *previous_client = NULL;
-    while (current_client != NULL)
+    if (strlen(port) == 0 || strlen(port) >= sizeof(server_port))
     {
-        if (current_client->client_info.socket == client_socket)
-        {
-            if (previous_client == NULL)
-            {
-                client_list = current_client->next;
-            }
-            else
-            {
-                previous_client->next = current_client->next;
-            }
-            socket_close(client_socket, error);
-            free(current_client);
-            break;
-        }
-        previous_client = current_client;
-        current_client = current_client->next;
+        return 1;
     }
 
-    rwlock_writerunlock(&client_list_rwlock);
+    strcpy(server_port, port);
+
+    return 0;
 }
 
-void remove_all_clients(error_t *error)
+const char *get_server_port(void)
 {
-    rwlock_writerlock(&client_list_rwlock);
+    return server_port;
+}
 
-    client_node_t *current_client = client_list;
-    while (current_client != NULL)
-    {
-        socket_t client_socket = current_client->client_info.socket;
-        remove_client(client_socket, error);
+void set_worker_pool_size(size_t worker_count)
+{
+    // 0 picks one worker per core
+    worker_pool_size = worker_count;
+}
 
-        current_client = client_list;
+void set_admission_limits(int limit_connections, int limit_pending_auth, int limit_auth_deadline_ms)
+{
+    // non-positive values keep the current limit
+    if (limit_connections > 0)
+    {
+        max_connections = limit_connections;
+    }
+    if (limit_pending_auth > 0)
+    {
+        max_pending_auth = limit_pending_auth;
+    }
+    if (limit_auth_deadline_ms > 0)
+    {
+        auth_deadline_ms = limit_auth_deadline_ms;
     }
-
-    rwlock_writerunlock(&client_list_rwlock);
 }
 
-int is_username_taken(const char *username)
+size_t format_memory_report(char *buffer, size_t buffer_size)
 {
-    rwlock_readerlock(&client_list_rwlock);
-    client_node_t *current_client = client_list;
+    int connections = atomic_load(&charged_connections);
+    size_t largest_outbox = 0;
+    size_t room_log_bytes = 0;
 
-    while (current_client != NULL)
+    if (atomic_load(&server_running))
     {
-        if (strcmp(current_client->client_info.username, username) == 0)
+        rwlock_readerlock(&client_list_rwlock);
+        for (client_node_t *client = client_list; client != NULL; client = client->next)
         {
-            rwlock_readerunlock(&client_list_rwlock);
-            return 1;
+            mutex_lock(&client->outbox_mutex);
+            if (client->outbox_bytes > largest_outbox)
+            {
+                largest_outbox = client->outbox_bytes;
+            }
+            mutex_unlock(&client->outbox_mutex);
         }
-        current_client = current_client->next;
-    }
-
-    rwlock_readerunlock(&client_list_rwlock);
-    return 0;
-}
+        rwlock_readerunlock(&client_list_rwlock);
 
-void generate_secret_key(char *key_buffer, size_t buffer_size)
-{
-    const size_t char_set_length = strlen(SECRET_KEY_CHAR_SET);
+        // every member reads the same logs, they cost the same with one connection or a thousand
+        if (delivery_mode == DELIVERY_MODE_PULL)
+        {
+            room_log_bytes = (size_t)(FRAME_LANE_COUNT - FRAME_LANE_PRESENCE) * ROOM_LOG_CAPACITY * sizeof(room_log_entry_t);
+        }
+    }
 
-    srand(time(NULL));
+    size_t total = memory_budget_total();
+    int length = snprintf(buffer, buffer_size, "connections=%d used=%llu budget=%llu", connections, (unsigned long long)total, (unsigned long long)memory_budget_get());
+    for (int category = 0; category < MEMORY_CATEGORY_COUNT && length > 0 && (size_t)length < buffer_size; category++)
+    {
+        length += snprintf(buffer + length, buffer_size - (size_t)length, " %s=%llu", memory_budget_category_name((memory_category_t)category), (unsigned long long)memory_budget_used((memory_category_t)category));
+    }
+    if (length > 0 && (size_t)length < buffer_size)
+    {
+        length += snprintf(buffer + length, buffer_size - (size_t)length, " per_connection=%llu largest_outbox=%llu thread_stack=%llu room_logs=%llu",
+                           (unsigned long long)(connections > 0 ? total / (size_t)connections : 0), (unsigned long long)largest_outbox,
+                           (unsigned long long)thread_get_stack_size(), (unsigned long long)room_log_bytes);
+    }
 
-    for (size_t i = 0; i < SECRET_KEY_LENGTH; ++i)
+    if (length < 0)
     {
-        key_buffer[i] = SECRET_KEY_CHAR_SET[rand() % char_set_length];
+        buffer[0] = '\0';
+        return 0;
     }
 
-    key_buffer[SECRET_KEY_LENGTH] = '\0';
+    return (size_t)length < buffer_size ? (size_t)length : buffer_size - 1;
 }
 
-const char *get_secret_key(void)
+void set_federation_config(const federation_config_t *config)
 {
-    return global_secret_key;
+    federation_config = *config;
+    federation_enabled = 1;
 }
 
-void send_error(socket_t client_socket, error_type_t error_type, const char *error_message, error_t *error, void (*callback_error_func)(const char *, int))
+void send_error(socket_t client_socket, error_type_t error_type, const char *error_message, error_list_t *error, void (*callback_error_func)(const char *, int))
 {
     char buffer[ERROR_NOTIFICATION_BUFFER_SIZE];
     int result_code;
 
     snprintf(buffer, sizeof(buffer), "%d:%d:%s", MSG_TYPE_ERROR, error_type, error_message);
 
-    result_code = socket_send(client_socket, buffer, strlen(buffer), 0, "", CONTEXT_SERVER, NON_CRITICAL_ERROR, error);
+    if (delivery_mode == DELIVERY_MODE_PULL && atomic_load(&server_running))
+    {
+        // the writer thread owns the socket in pull mode, sending here could split a frame it is halfway through
+        if (enqueue_direct_frame(client_socket, FRAME_LANE_CONTROL, buffer, strlen(buffer) + 1, error) != 0)
+        {
+            report_errors(error, callback_error_func);
+        }
+        return;
+    }
+
+    result_code = send_to_client(client_socket, buffer, strlen(buffer) + 1, error);
 
     if (result_code == SOCKET_ERR)
     {
@@ -494,14 +4258,24 @@ void send_error(socket_t client_socket, error_type_t error_type, const char *err
     }
 }
 
-void send_notification(socket_t client_socket, notification_type_t notification_type, const char *notification_message, const char *receiver_username, error_t *error, void (*callback_error_func)(const char *, int))
+void send_notification(socket_t client_socket, notification_type_t notification_type, const char *notification_message, const char *receiver_username, error_list_t *error, void (*callback_error_func)(const char *, int))
 {
     char buffer[ERROR_NOTIFICATION_BUFFER_SIZE];
     int result_code;
 
     snprintf(buffer, sizeof(buffer), "%d:%d:%s", MSG_TYPE_NOTIFICATION, notification_type, notification_message);
 
-    result_code = socket_send(client_socket, buffer, strlen(buffer), 0, receiver_username, CONTEXT_SERVER, NON_CRITICAL_ERROR, error);
+    if (delivery_mode == DELIVERY_MODE_PULL && atomic_load(&server_running))
+    {
+        // the writer thread owns the socket in pull mode, sending here could split a frame it is halfway through
+        if (enqueue_direct_frame(client_socket, FRAME_LANE_CONTROL, buffer, strlen(buffer) + 1, error) != 0)
+        {
+            report_errors(error, callback_error_func);
+        }
+        return;
+    }
+
+    result_code = send_to_client(client_socket, buffer, strlen(buffer) + 1, error);
 
     if (result_code == SOCKET_ERR)
     {
@@ -1,6 +1,51 @@
 #include "../include/sockets.h"
-
-int socket_cleanup(error_t *error)
+#include "../include/local_transport.h"
+
+// keepalive probes stop after idle + interval * count seconds, the user timeout matches it
+// so unacknowledged data gives up on a dead peer no later than an idle connection does
+static const socket_tuning_t socket_profiles[SOCKET_PROFILE_COUNT] = {
+    [SOCKET_PROFILE_NONE] = {0},
+    [SOCKET_PROFILE_INTERACTIVE] = {
+        .nodelay = 1,
+        .quickack = 1,
+        .keepalive = 1,
+        .keepalive_idle_s = 30,
+        .keepalive_interval_s = 10,
+        .keepalive_count = 3,
+        .user_timeout_ms = 60000,
+        .notsent_lowat = 16 * 1024,
+    },
+    [SOCKET_PROFILE_BULK] = {
+        .send_buffer = 4 * 1024 * 1024,
+        .receive_buffer = 4 * 1024 * 1024,
+        .keepalive = 1,
+        .keepalive_idle_s = 60,
+        .keepalive_interval_s = 15,
+        .keepalive_count = 4,
+        .user_timeout_ms = 120000,
+    },
+    [SOCKET_PROFILE_FANOUT_SERVER] = {
+        .nodelay = 1,
+        .quickack = 1,
+        .send_buffer = 1024 * 1024,
+        .keepalive = 1,
+        .keepalive_idle_s = 30,
+        .keepalive_interval_s = 10,
+        .keepalive_count = 3,
+        .user_timeout_ms = 60000,
+        .busy_poll_us = 50,
+        .notsent_lowat = 64 * 1024,
+    },
+};
+
+static const char *socket_profile_names[SOCKET_PROFILE_COUNT] = {
+    [SOCKET_PROFILE_NONE] = "none",
+    [SOCKET_PROFILE_INTERACTIVE] = "interactive",
+    [SOCKET_PROFILE_BULK] = "bulk",
+    [SOCKET_PROFILE_FANOUT_SERVER] = "fanout-server",
+};
+
+int socket_cleanup(error_list_t *error)
 {
 #ifdef _WIN32
     int retry_count = 3;
@@ -28,7 +73,7 @@ int socket_cleanup(error_t *error)
     return 0;
 }
 
-int socket_init(error_t *error)
+int socket_init(error_list_t *error)
 {
 #ifdef _WIN32
     WSADATA wsaData;
@@ -55,19 +100,26 @@ int socket_init(error_t *error)
     return 0;
 }
 
-socket_t socket_create(int domain, int type, int protocol, error_t *error)
+socket_t socket_create(int domain, int type, int protocol, socket_profile_t profile, error_list_t *error)
 {
     socket_t sock = socket(domain, type, protocol);
 
     if (sock == INVALID_SOCK)
     {
         add_error(error, map_platform_error(get_last_socket_error()), CRITICAL_ERROR, "Socket creation failed", "socket_create");
+        return sock;
+    }
+
+    // the buffers have to be set before connect or listen, the window scale is settled in the handshake
+    if ((domain == AF_INET || domain == AF_INET6) && type == SOCK_STREAM)
+    {
+        socket_apply_profile(sock, profile);
     }
 
     return sock;
 }
 
-int socket_bind(socket_t sock, const struct sockaddr *addr, socklen_t addrlen, error_t *error)
+int socket_bind(socket_t sock, const struct sockaddr *addr, socklen_t addrlen, error_list_t *error)
 {
     int result_code = bind(sock, addr, addrlen);
 
@@ -79,7 +131,7 @@ int socket_bind(socket_t sock, const struct sockaddr *addr, socklen_t addrlen, e
     return result_code;
 }
 
-int socket_listen(socket_t sock, error_t *error)
+int socket_listen(socket_t sock, error_list_t *error)
 {
     int result_code = listen(sock, SOMAXCONN);
 
@@ -91,15 +143,16 @@ int socket_listen(socket_t sock, error_t *error)
     return result_code;
 }
 
-socket_t socket_accept(socket_t sock, struct sockaddr *addr, error_t *error)
+socket_t socket_accept(socket_t sock, struct sockaddr *addr, socket_profile_t profile, error_list_t *error)
 {
-    socket_t client_socket = accept(sock, addr, NULL);
+    socklen_t addrlen = sizeof(struct sockaddr_in);
+    socket_t client_socket = accept(sock, addr, addr != NULL ? &addrlen : NULL);
 
     if (client_socket == INVALID_SOCK)
     {
-        const char *err = map_platform_error(get_last_socket_error());
+        error_code_t err = map_platform_error(get_last_socket_error());
 
-        if (strcmp(err, SOCKET_EINTR) == 0)
+        if (err == SOCKET_EINTR)
         {
             add_error(error, err, NON_CRITICAL_ERROR, "Socket accept interrupted by a signal", "socket_accept");
         }
@@ -107,82 +160,495 @@ socket_t socket_accept(socket_t sock, struct sockaddr *addr, error_t *error)
         {
             add_error(error, err, CRITICAL_ERROR, "Socket accept failed", "socket_accept");
         }
+
+        return INVALID_SOCK;
     }
 
+    socket_apply_profile(client_socket, profile);
+
     return client_socket;
 }
 
-int socket_connect(socket_t sock, const struct sockaddr *addr, socklen_t addrlen, error_t *error)
+socket_t socket_accept_nonblocking(socket_t sock, struct sockaddr *addr, socket_profile_t profile, error_list_t *error)
 {
-    int retry_count = 3;
-    int result_code;
-    const char *last_error = NULL;
+    socklen_t addrlen = sizeof(struct sockaddr_in);
 
-    while (retry_count > 0)
+#ifdef __linux__
+    // one call instead of accept plus two fcntl round trips per connection
+    socket_t client_socket = accept4(sock, addr, addr != NULL ? &addrlen : NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    socket_t client_socket = accept(sock, addr, addr != NULL ? &addrlen : NULL);
+#endif
+
+    if (client_socket == INVALID_SOCK)
     {
-        result_code = connect(sock, addr, addrlen);
-        if (result_code == 0)
+        error_code_t err = map_platform_error(get_last_socket_error());
+
+        switch (err)
+        {
+        case SOCKET_EWOULDBLOCK:
+            // the backlog is empty, not an error worth reporting
+            break;
+        case SOCKET_EINTR:
+        case SOCKET_ECONNABORTED:
+        case SOCKET_EMFILE:
+        case SOCKET_ENOBUFS:
+            add_error(error, err, NON_CRITICAL_ERROR, "Socket accept failed, the connection was dropped", "socket_accept_nonblocking");
+            break;
+        default:
+            add_error(error, err, CRITICAL_ERROR, "Socket accept failed", "socket_accept_nonblocking");
+            break;
+        }
+
+        return INVALID_SOCK;
+    }
+
+#ifndef __linux__
+    if (socket_set_nonblocking(client_socket, 1, error) != 0)
+    {
+        socket_close(client_socket, error);
+        return INVALID_SOCK;
+    }
+#ifndef _WIN32
+    fcntl(client_socket, F_SETFD, FD_CLOEXEC);
+#endif
+#endif
+
+    // most options are copied from the listener, the ACK mode is not and a platform may copy none of them
+    socket_apply_profile(client_socket, profile);
+
+    return client_socket;
+}
+
+int socket_connect(socket_t sock, const struct sockaddr *addr, socklen_t addrlen, error_list_t *error)
+{
+    int result_code = connect(sock, addr, addrlen);
+
+    if (result_code != 0)
+    {
+        add_error(error, map_platform_error(get_last_socket_error()), CRITICAL_ERROR, "Socket connect failed", "socket_connect");
+    }
+
+    return result_code;
+}
+
+void connect_options_init(connect_options_t *options)
+{
+    options->attempt_timeout_ms = CONNECT_ATTEMPT_TIMEOUT_MS;
+    options->deadline_ms = CONNECT_DEADLINE_MS;
+    options->backoff_base_ms = CONNECT_BACKOFF_BASE_MS;
+    options->backoff_max_ms = CONNECT_BACKOFF_MAX_MS;
+    options->cancel = NULL;
+    options->profile = SOCKET_PROFILE_NONE;
+}
+
+int socket_set_nonblocking(socket_t sock, int nonblocking, error_list_t *error)
+{
+#ifdef _WIN32
+    u_long mode = nonblocking ? 1 : 0;
+
+    if (ioctlsocket(sock, FIONBIO, &mode) == SOCKET_ERR)
+    {
+        add_error(error, map_platform_error(get_last_socket_error()), CRITICAL_ERROR, "Failed to change the socket blocking mode", "socket_set_nonblocking");
+        return 1;
+    }
+#else
+    // a local connection keeps its own flag, its sends and receives never reach the descriptor
+    local_transport_set_nonblocking(sock, nonblocking);
+
+    int flags = fcntl(sock, F_GETFL, 0);
+
+    if (flags == -1 || fcntl(sock, F_SETFL, nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK)) == -1)
+    {
+        add_error(error, map_platform_error(get_last_socket_error()), CRITICAL_ERROR, "Failed to change the socket blocking mode", "socket_set_nonblocking");
+        return 1;
+    }
+#endif
+
+    return 0;
+}
+
+static int set_socket_option(socket_t sock, int level, int option, int value)
+{
+    return setsockopt(sock, level, option, (const char *)&value, sizeof(value)) == SOCKET_ERR;
+}
+
+static int get_socket_option(socket_t sock, int level, int option)
+{
+    int value = 0;
+    socklen_t value_length = sizeof(value);
+
+    if (getsockopt(sock, level, option, (char *)&value, &value_length) == SOCKET_ERR)
+    {
+        return 0;
+    }
+
+    return value;
+}
+
+int socket_apply_profile(socket_t sock, socket_profile_t profile)
+{
+    if (profile <= SOCKET_PROFILE_NONE || profile >= SOCKET_PROFILE_COUNT)
+    {
+        return 0;
+    }
+
+    const socket_tuning_t *tuning = &socket_profiles[profile];
+    int refused = 0;
+
+    if (tuning->nodelay != 0)
+    {
+        refused += set_socket_option(sock, IPPROTO_TCP, TCP_NODELAY, tuning->nodelay);
+    }
+#ifdef TCP_QUICKACK
+    // the kernel drops back to delayed ACKs on its own, this covers the start of the connection
+    if (tuning->quickack != 0)
+    {
+        refused += set_socket_option(sock, IPPROTO_TCP, TCP_QUICKACK, tuning->quickack);
+    }
+#endif
+    if (tuning->send_buffer != 0)
+    {
+        refused += set_socket_option(sock, SOL_SOCKET, SO_SNDBUF, tuning->send_buffer);
+    }
+    if (tuning->receive_buffer != 0)
+    {
+        refused += set_socket_option(sock, SOL_SOCKET, SO_RCVBUF, tuning->receive_buffer);
+    }
+    if (tuning->keepalive != 0)
+    {
+        refused += set_socket_option(sock, SOL_SOCKET, SO_KEEPALIVE, tuning->keepalive);
+#ifdef TCP_KEEPIDLE
+        refused += set_socket_option(sock, IPPROTO_TCP, TCP_KEEPIDLE, tuning->keepalive_idle_s);
+#endif
+#ifdef TCP_KEEPINTVL
+        refused += set_socket_option(sock, IPPROTO_TCP, TCP_KEEPINTVL, tuning->keepalive_interval_s);
+#endif
+#ifdef TCP_KEEPCNT
+        refused += set_socket_option(sock, IPPROTO_TCP, TCP_KEEPCNT, tuning->keepalive_count);
+#endif
+    }
+#ifdef TCP_USER_TIMEOUT
+    if (tuning->user_timeout_ms != 0)
+    {
+        refused += set_socket_option(sock, IPPROTO_TCP, TCP_USER_TIMEOUT, tuning->user_timeout_ms);
+    }
+#endif
+#ifdef SO_BUSY_POLL
+    if (tuning->busy_poll_us != 0)
+    {
+        refused += set_socket_option(sock, SOL_SOCKET, SO_BUSY_POLL, tuning->busy_poll_us);
+    }
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+    if (tuning->notsent_lowat != 0)
+    {
+        refused += set_socket_option(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, tuning->notsent_lowat);
+    }
+#endif
+
+    return refused;
+}
+
+void socket_profile_values(socket_profile_t profile, socket_tuning_t *tuning)
+{
+    if (profile < SOCKET_PROFILE_NONE || profile >= SOCKET_PROFILE_COUNT)
+    {
+        profile = SOCKET_PROFILE_NONE;
+    }
+
+    *tuning = socket_profiles[profile];
+}
+
+void socket_read_tuning(socket_t sock, socket_tuning_t *tuning)
+{
+    memset(tuning, 0, sizeof(*tuning));
+
+    tuning->nodelay = get_socket_option(sock, IPPROTO_TCP, TCP_NODELAY);
+#ifdef TCP_QUICKACK
+    tuning->quickack = get_socket_option(sock, IPPROTO_TCP, TCP_QUICKACK);
+#endif
+    tuning->send_buffer = get_socket_option(sock, SOL_SOCKET, SO_SNDBUF);
+    tuning->receive_buffer = get_socket_option(sock, SOL_SOCKET, SO_RCVBUF);
+    tuning->keepalive = get_socket_option(sock, SOL_SOCKET, SO_KEEPALIVE);
+#ifdef TCP_KEEPIDLE
+    tuning->keepalive_idle_s = get_socket_option(sock, IPPROTO_TCP, TCP_KEEPIDLE);
+#endif
+#ifdef TCP_KEEPINTVL
+    tuning->keepalive_interval_s = get_socket_option(sock, IPPROTO_TCP, TCP_KEEPINTVL);
+#endif
+#ifdef TCP_KEEPCNT
+    tuning->keepalive_count = get_socket_option(sock, IPPROTO_TCP, TCP_KEEPCNT);
+#endif
+#ifdef TCP_USER_TIMEOUT
+    tuning->user_timeout_ms = get_socket_option(sock, IPPROTO_TCP, TCP_USER_TIMEOUT);
+#endif
+#ifdef SO_BUSY_POLL
+    tuning->busy_poll_us = get_socket_option(sock, SOL_SOCKET, SO_BUSY_POLL);
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+    tuning->notsent_lowat = get_socket_option(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT);
+#endif
+}
+
+void socket_format_tuning(const socket_tuning_t *tuning, char *buffer, size_t buffer_size)
+{
+    snprintf(buffer, buffer_size, "nodelay=%d quickack=%d sndbuf=%d rcvbuf=%d keepalive=%d/%ds/%ds/%d user_timeout=%dms busy_poll=%dus notsent_lowat=%d",
+             tuning->nodelay, tuning->quickack, tuning->send_buffer, tuning->receive_buffer,
+             tuning->keepalive, tuning->keepalive_idle_s, tuning->keepalive_interval_s, tuning->keepalive_count,
+             tuning->user_timeout_ms, tuning->busy_poll_us, tuning->notsent_lowat);
+}
+
+const char *socket_profile_name(socket_profile_t profile)
+{
+    if (profile < SOCKET_PROFILE_NONE || profile >= SOCKET_PROFILE_COUNT)
+    {
+        return "unknown";
+    }
+
+    return socket_profile_names[profile];
+}
+
+int socket_parse_profile(const char *name, socket_profile_t *profile)
+{
+    for (int index = 0; index < SOCKET_PROFILE_COUNT; index++)
+    {
+        if (strcmp(name, socket_profile_names[index]) == 0)
+        {
+            *profile = (socket_profile_t)index;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int is_connect_cancelled(const connect_options_t *options)
+{
+    return options->cancel != NULL && atomic_load(options->cancel);
+}
+
+static int is_retryable_connect_error(error_code_t err)
+{
+    return err == SOCKET_ECONNREFUSED || err == SOCKET_ETIMEDOUT ||
+           err == SOCKET_EHOSTUNREACH || err == SOCKET_ENETUNREACH;
+}
+
+// starts a connect on a non-blocking socket and waits for it until the attempt timeout or the deadline
+static int connect_attempt(socket_t sock, const struct addrinfo *address, const connect_options_t *options, uint64_t deadline_ms, error_code_t *last_error)
+{
+    if (connect(sock, address->ai_addr, (socklen_t)address->ai_addrlen) == 0)
+    {
+        return 0;
+    }
+
+    int platform_error = get_last_socket_error();
+#ifdef _WIN32
+    if (platform_error != WSAEWOULDBLOCK)
+#else
+    if (platform_error != EINPROGRESS)
+#endif
+    {
+        *last_error = map_platform_error(platform_error);
+        return 1;
+    }
+
+    uint64_t attempt_end_ms = cross_platform_monotonic_ms() + (uint64_t)options->attempt_timeout_ms;
+    if (attempt_end_ms > deadline_ms)
+    {
+        attempt_end_ms = deadline_ms;
+    }
+
+    while (1)
+    {
+        if (is_connect_cancelled(options))
+        {
+            *last_error = SOCKET_ECANCELED;
+            return 1;
+        }
+
+        uint64_t now_ms = cross_platform_monotonic_ms();
+        if (now_ms >= attempt_end_ms)
+        {
+            *last_error = SOCKET_ETIMEDOUT;
+            return 1;
+        }
+
+        uint64_t wait_ms = attempt_end_ms - now_ms;
+        if (wait_ms > CONNECT_WAIT_SLICE_MS)
+        {
+            wait_ms = CONNECT_WAIT_SLICE_MS;
+        }
+
+        error_list_t poll_error;
+        init_error(&poll_error);
+
+        pollfd_t poll_fd;
+        poll_fd.fd = sock;
+        poll_fd.events = POLLOUT;
+        poll_fd.revents = 0;
+
+        int ready = socket_poll(&poll_fd, 1, (int)wait_ms, &poll_error);
+        if (ready < 0)
+        {
+            *last_error = last_error_code(&poll_error);
+            return 1;
+        }
+        if (ready == 0)
+        {
+            continue;
+        }
+
+        // writable means the handshake finished, SO_ERROR tells whether it succeeded
+        int socket_error = 0;
+        socklen_t socket_error_length = sizeof(socket_error);
+        if (getsockopt(sock, SOL_SOCKET, SO_ERROR, (char *)&socket_error, &socket_error_length) != 0)
+        {
+            socket_error = get_last_socket_error();
+        }
+
+        if (socket_error == 0)
         {
             return 0;
         }
 
-        last_error = map_platform_error(get_last_socket_error());
+        *last_error = map_platform_error(socket_error);
+        return 1;
+    }
+}
+
+static uint32_t next_jitter(uint32_t *state)
+{
+    // xorshift32, only needs to spread clients apart, not be unpredictable
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+socket_t socket_connect_with_backoff(const struct addrinfo *address, const connect_options_t *options, error_list_t *error)
+{
+    uint64_t deadline_ms = cross_platform_monotonic_ms() + (uint64_t)options->deadline_ms;
+    error_code_t last_error = SOCKET_ETIMEDOUT;
+
+    // the stack address differs between processes, so clients started together still draw different delays
+    uint32_t jitter_state = (uint32_t)cross_platform_monotonic_ms() ^ (uint32_t)(uintptr_t)&deadline_ms ^ (uint32_t)time(NULL);
+    if (jitter_state == 0)
+    {
+        jitter_state = 0x9E3779B9u;
+    }
+
+    for (int attempt = 0;; attempt++)
+    {
+        socket_t sock = socket_create(address->ai_family, address->ai_socktype, address->ai_protocol, options->profile, error);
+        if (sock == INVALID_SOCK)
+        {
+            return INVALID_SOCK;
+        }
+
+        if (socket_set_nonblocking(sock, 1, error) != 0)
+        {
+            socket_close(sock, error);
+            return INVALID_SOCK;
+        }
 
-        if (strcmp(last_error, SOCKET_ECONNREFUSED) == 0 || strcmp(last_error, SOCKET_ETIMEDOUT) == 0 ||
-            strcmp(last_error, SOCKET_EHOSTUNREACH) == 0 || strcmp(last_error, SOCKET_ENETUNREACH) == 0)
+        if (connect_attempt(sock, address, options, deadline_ms, &last_error) == 0)
         {
-            retry_count--;
-            cross_platform_sleep(1);
+            if (socket_set_nonblocking(sock, 0, error) != 0)
+            {
+                socket_close(sock, error);
+                return INVALID_SOCK;
+            }
+            return sock;
         }
-        else
+
+        // the state of a socket after a failed connect is unspecified, every attempt gets a fresh one
+        error_list_t close_error;
+        init_error(&close_error);
+        socket_close(sock, &close_error);
+
+        if (!is_retryable_connect_error(last_error))
         {
             break;
         }
+
+        // exponential backoff with full jitter: a random delay between 0 and the capped exponential step
+        int shift = attempt < 16 ? attempt : 16;
+        uint64_t backoff_cap_ms = (uint64_t)options->backoff_base_ms << shift;
+        if (backoff_cap_ms > (uint64_t)options->backoff_max_ms)
+        {
+            backoff_cap_ms = (uint64_t)options->backoff_max_ms;
+        }
+        uint64_t backoff_ms = next_jitter(&jitter_state) % (backoff_cap_ms + 1);
+
+        uint64_t resume_ms = cross_platform_monotonic_ms() + backoff_ms;
+        if (resume_ms >= deadline_ms)
+        {
+            break;
+        }
+
+        while (!is_connect_cancelled(options) && cross_platform_monotonic_ms() < resume_ms)
+        {
+            uint64_t now_ms = cross_platform_monotonic_ms();
+            cross_platform_sleep_ms((int)(resume_ms - now_ms < CONNECT_WAIT_SLICE_MS ? resume_ms - now_ms : CONNECT_WAIT_SLICE_MS));
+        }
+
+        if (is_connect_cancelled(options))
+        {
+            last_error = SOCKET_ECANCELED;
+            break;
+        }
     }
 
-    add_error(error, last_error, CRITICAL_ERROR, "Socket connect failed", "socket_connect");
-    return result_code;
+    if (last_error == SOCKET_ECANCELED)
+    {
+        add_error(error, last_error, NON_CRITICAL_ERROR, "Socket connect cancelled", "socket_connect_with_backoff");
+    }
+    else
+    {
+        add_error(error, last_error, CRITICAL_ERROR, "Socket connect failed", "socket_connect_with_backoff");
+    }
+
+    return INVALID_SOCK;
 }
 
-int socket_send(socket_t sock, const void *buf, size_t len, int flags, const char *client_username, context_t context, error_severity_t severity, error_t *error)
+int socket_send(socket_t sock, const void *buf, size_t len, int flags, const char *client_username, context_t context, error_severity_t severity, error_list_t *error)
 {
-    int result_code = send(sock, buf, len, flags);
+    int result_code = local_transport_owns(sock) ? local_transport_send(sock, buf, len, flags) : send(sock, buf, len, flags);
 
     if (result_code == SOCKET_ERR)
     {
-        const char *err = map_platform_error(get_last_socket_error());
-        char error_message[256];
+        error_code_t err = map_platform_error(get_last_socket_error());
 
         if (context == CONTEXT_SERVER)
         {
             if (client_username[0] == '\0')
             {
-                snprintf(error_message, sizeof(error_message), "Failed to send to a client");
+                add_error(error, err, severity, "Failed to send to a client", "socket_send");
             }
             else
             {
-                snprintf(error_message, sizeof(error_message), "Failed to send to client \"%s\"", client_username);
+                add_error_with_subject(error, err, severity, "Failed to send to client \"%s\"", client_username, "socket_send");
             }
         }
         else
         {
-            snprintf(error_message, sizeof(error_message), "Failed to send to the server");
+            add_error(error, err, severity, "Failed to send to the server", "socket_send");
         }
-
-        add_error(error, err, severity, error_message, "socket_send");
     }
 
     return result_code;
 }
 
-int socket_recv(socket_t sock, void *buf, size_t len, int flags, const char *client_username, context_t context, error_t *error)
+int socket_recv(socket_t sock, void *buf, size_t len, int flags, const char *client_username, context_t context, error_list_t *error)
 {
-    int result_code = recv(sock, buf, len, flags);
+    int result_code = local_transport_owns(sock) ? local_transport_recv(sock, buf, len, flags) : recv(sock, buf, len, flags);
 
     if (result_code == SOCKET_ERR)
     {
-        const char *err = map_platform_error(get_last_socket_error());
-        char error_message[256];
+        error_code_t err = map_platform_error(get_last_socket_error());
 
         // note: not all errors may be critical for the client
         //       this can be adjusted based on specific error types if needed
@@ -190,48 +656,46 @@ int socket_recv(socket_t sock, void *buf, size_t len, int flags, const char *cli
 
         if (context == CONTEXT_SERVER)
         {
-            if (strcmp(err, SOCKET_ECONNRESET) == 0)
+            if (err == SOCKET_ECONNRESET)
             {
                 if (client_username[0] == '\0')
                 {
-                    snprintf(error_message, sizeof(error_message), "A client disconnected");
+                    add_error(error, err, severity, "A client disconnected", "socket_recv");
                 }
                 else
                 {
-                    snprintf(error_message, sizeof(error_message), "Client \"%s\" got disconnected", client_username);
+                    add_error_with_subject(error, err, severity, "Client \"%s\" got disconnected", client_username, "socket_recv");
                 }
             }
             else
             {
                 if (client_username[0] == '\0')
                 {
-                    snprintf(error_message, sizeof(error_message), "A client encountered an error");
+                    add_error(error, err, severity, "A client encountered an error", "socket_recv");
                 }
                 else
                 {
-                    snprintf(error_message, sizeof(error_message), "Client \"%s\" encountered an error", client_username);
+                    add_error_with_subject(error, err, severity, "Client \"%s\" encountered an error", client_username, "socket_recv");
                 }
             }
         }
         else
         {
-            if (strcmp(err, SOCKET_ECONNRESET) == 0)
+            if (err == SOCKET_ECONNRESET)
             {
-                snprintf(error_message, sizeof(error_message), "The server disconnected");
+                add_error(error, err, severity, "The server disconnected", "socket_recv");
             }
             else
             {
-                snprintf(error_message, sizeof(error_message), "The server encountered an error");
+                add_error(error, err, severity, "The server encountered an error", "socket_recv");
             }
         }
-
-        add_error(error, err, severity, error_message, "socket_recv");
     }
 
     return result_code;
 }
 
-int socket_close(socket_t sock, error_t *error)
+int socket_close(socket_t sock, error_list_t *error)
 {
     int retry_count = 3;
     int result_code;
@@ -241,7 +705,7 @@ int socket_close(socket_t sock, error_t *error)
 #ifdef _WIN32
         result_code = closesocket(sock);
 #else
-        result_code = close(sock);
+        result_code = local_transport_owns(sock) ? local_transport_close(sock) : close(sock);
 #endif
 
         if (result_code != SOCKET_ERR)
@@ -261,6 +725,103 @@ int socket_close(socket_t sock, error_t *error)
     return result_code;
 }
 
+int socket_shutdown(socket_t sock, error_list_t *error)
+{
+    local_transport_shutdown(sock);
+
+    int result_code = shutdown(sock, SOCKET_SHUTDOWN_BOTH);
+
+    if (result_code == SOCKET_ERR)
+    {
+        add_error(error, map_platform_error(get_last_socket_error()), NON_CRITICAL_ERROR, "Socket shutdown failed", "socket_shutdown");
+    }
+
+    return result_code;
+}
+
+int socket_poll(pollfd_t *fds, size_t count, int timeout_ms, error_list_t *error)
+{
+#ifdef _WIN32
+    int result_code = WSAPoll(fds, (ULONG)count, timeout_ms);
+#else
+    int result_code = local_transport_active() ? local_transport_poll(fds, count, timeout_ms) : poll(fds, (nfds_t)count, timeout_ms);
+#endif
+
+    if (result_code == SOCKET_ERR)
+    {
+        error_code_t err = map_platform_error(get_last_socket_error());
+
+        if (err == SOCKET_EINTR)
+        {
+            return 0;
+        }
+
+        add_error(error, err, NON_CRITICAL_ERROR, "Socket poll failed", "socket_poll");
+    }
+
+    return result_code;
+}
+
+int socket_send_nonblocking(socket_t sock, const void *buf, size_t len, error_list_t *error)
+{
+    int result_code = local_transport_owns(sock) ? local_transport_send(sock, buf, len, SOCKET_SEND_NONBLOCKING) : send(sock, buf, len, SOCKET_SEND_NONBLOCKING);
+
+    if (result_code == SOCKET_ERR)
+    {
+        error_code_t err = map_platform_error(get_last_socket_error());
+
+        // the socket buffer is full, the caller retries once the socket is writable again
+        if (err == SOCKET_EWOULDBLOCK || err == SOCKET_EINTR)
+        {
+            return 0;
+        }
+
+        add_error(error, err, NON_CRITICAL_ERROR, "Non-blocking send failed", "socket_send_nonblocking");
+    }
+
+    return result_code;
+}
+
+int socket_send_all(socket_t sock, const void *buf, size_t len, int timeout_ms, error_list_t *error)
+{
+    const char *data = (const char *)buf;
+    uint64_t deadline = cross_platform_monotonic_ms() + (uint64_t)timeout_ms;
+
+    while (len > 0)
+    {
+        int sent = socket_send_nonblocking(sock, data, len, error);
+        if (sent == SOCKET_ERR)
+        {
+            return SOCKET_ERR;
+        }
+
+        data += sent;
+        len -= (size_t)sent;
+        if (len == 0)
+        {
+            break;
+        }
+
+        uint64_t now = cross_platform_monotonic_ms();
+        if (now >= deadline)
+        {
+            add_error(error, ERR_SLOW_CLIENT, NON_CRITICAL_ERROR, "The other side didn't take a frame in time", "socket_send_all");
+            return SOCKET_ERR;
+        }
+
+        pollfd_t writable;
+        writable.fd = sock;
+        writable.events = POLLOUT;
+        writable.revents = 0;
+        if (socket_poll(&writable, 1, (int)(deadline - now), error) == SOCKET_ERR)
+        {
+            return SOCKET_ERR;
+        }
+    }
+
+    return 0;
+}
+
 int get_last_socket_error()
 {
 #ifdef _WIN32
@@ -270,7 +831,7 @@ int get_last_socket_error()
 #endif
 }
 
-const char *map_platform_error(int platform_error)
+error_code_t map_platform_error(int platform_error)
 {
     switch (platform_error)
     {
@@ -293,6 +854,14 @@ const char *map_platform_error(int platform_error)
         return SOCKET_ECONNREFUSED;
     case WSAEHOSTUNREACH:
         return SOCKET_EHOSTUNREACH;
+    case WSAEWOULDBLOCK:
+        return SOCKET_EWOULDBLOCK;
+    case WSAECONNABORTED:
+        return SOCKET_ECONNABORTED;
+    case WSAEMFILE:
+        return SOCKET_EMFILE;
+    case WSAENOBUFS:
+        return SOCKET_ENOBUFS;
     case WSASYSNOTREADY:
         return SOCKET_WSASYSNOTREADY;
     case WSAVERNOTSUPPORTED:
@@ -316,6 +885,20 @@ const char *map_platform_error(int platform_error)
         return SOCKET_ECONNREFUSED;
     case EHOSTUNREACH:
         return SOCKET_EHOSTUNREACH;
+    case EWOULDBLOCK:
+        return SOCKET_EWOULDBLOCK;
+    case ECONNABORTED:
+        return SOCKET_ECONNABORTED;
+    case EMFILE:
+    case ENFILE:
+        return SOCKET_EMFILE;
+    case ENOBUFS:
+    case ENOMEM:
+        return SOCKET_ENOBUFS;
+#if EAGAIN != EWOULDBLOCK
+    case EAGAIN:
+        return SOCKET_EWOULDBLOCK;
+#endif
 #endif
     default:
         return SOCKET_UNKNOWN_ERROR;
@@ -329,4 +912,27 @@ void cross_platform_sleep(int seconds)
 #else
     sleep(seconds);
 #endif
+}
+
+void cross_platform_sleep_ms(int milliseconds)
+{
+#ifdef _WIN32
+    Sleep((DWORD)milliseconds);
+#else
+    struct timespec duration;
+    duration.tv_sec = milliseconds / 1000;
+    duration.tv_nsec = (long)(milliseconds % 1000) * 1000000;
+    nanosleep(&duration, NULL);
+#endif
+}
+
+uint64_t cross_platform_monotonic_ms(void)
+{
+#ifdef _WIN32
+    return (uint64_t)GetTickCount64();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "../include/threads.h"
+
+// rounded up to 64 KB, a multiple of the page size everywhere and of the allocation granularity on Windows
+#define THREAD_STACK_GRANULARITY (64 * 1024)
+
+// read by thread_create without a lock, it is only set before the threads that use it exist
+static size_t thread_stack_size = THREAD_STACK_SIZE;
+
+void thread_set_stack_size(size_t stack_size)
+{
+    if (stack_size == 0)
+    {
+        thread_stack_size = 0;
+        return;
+    }
+
+    if (stack_size < THREAD_MIN_STACK_SIZE)
+    {
+        stack_size = THREAD_MIN_STACK_SIZE;
+    }
+
+    thread_stack_size = (stack_size + THREAD_STACK_GRANULARITY - 1) / THREAD_STACK_GRANULARITY * THREAD_STACK_GRANULARITY;
+}
+
+size_t thread_get_stack_size(void)
+{
+    if (thread_stack_size != 0)
+    {
+        return thread_stack_size;
+    }
+
+#ifdef _WIN32
+    // the reservation the executable was linked with, 1 MB unless it asked for something else
+    return 1024 * 1024;
+#else
+    size_t default_size = 0;
+    pthread_attr_t attributes;
+    if (pthread_attr_init(&attributes) == 0)
+    {
+        pthread_attr_getstacksize(&attributes, &default_size);
+        pthread_attr_destroy(&attributes);
+    }
+    return default_size;
+#endif
+}
+
+#ifdef _WIN32
+static BOOL CALLBACK run_once(PINIT_ONCE once, PVOID func, PVOID *context)
+{
+    ((void (*)(void))func)();
+    return TRUE;
+}
+#endif
+
+void thread_once(thread_once_t *once, void (*func)(void))
+{
+#ifdef _WIN32
+    InitOnceExecuteOnce(once, run_once, (PVOID)func, NULL);
+#else
+    pthread_once(once, func);
+#endif
+}
+
+int thread_key_create(thread_key_t *key, void (THREAD_KEY_CALL *destructor)(void *))
+{
+#ifdef _WIN32
+    *key = FlsAlloc(destructor);
+    return *key == FLS_OUT_OF_INDEXES ? -1 : 0;
+#else
+    return pthread_key_create(key, destructor) == 0 ? 0 : -1;
+#endif
+}
+
+void thread_key_set(thread_key_t key, void *value)
+{
+#ifdef _WIN32
+    FlsSetValue(key, value);
+#else
+    pthread_setspecific(key, value);
+#endif
+}
+
+int thread_create(thread_t *thread, thread_ret_t (THREAD_CALL *func)(void *), void *arg)
+{
+#ifdef _WIN32
+    // without the flag the size is only the initial commit and the reservation stays the executable's default
+    *thread = CreateThread(NULL, thread_stack_size, (LPTHREAD_START_ROUTINE)func, arg, thread_stack_size != 0 ? STACK_SIZE_PARAM_IS_A_RESERVATION : 0, NULL);
+    return *thread == NULL ? -1 : 0;
+#else
+    if (thread_stack_size == 0)
+    {
+        return pthread_create(thread, NULL, func, arg);
+    }
+
+    pthread_attr_t attributes;
+    if (pthread_attr_init(&attributes) != 0)
+    {
+        return pthread_create(thread, NULL, func, arg);
+    }
+
+    // a size the system refuses leaves the attribute at its default, the thread still starts
+    pthread_attr_setstacksize(&attributes, thread_stack_size);
+
+    int result = pthread_create(thread, &attributes, func, arg);
+    pthread_attr_destroy(&attributes);
+
+    return result;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,189 @@
+#include "../include/typing.h"
+
+static typing_entry_t typing_entries[TYPING_MAX_MEMBERS];
+static size_t typing_count = 0;
+// set when the set may differ from the last one published, the flush thread compares before it sends anything
+static int typing_changed = 0;
+static char published_frame[TYPING_FRAME_BUFFER_SIZE];
+static size_t published_length = 0;
+static mutex_t typing_mutex;
+static cond_t typing_cond;
+static atomic_int typing_running = ATOMIC_VAR_INIT(0);
+static thread_t typing_thread;
+static void (*typing_publish_frame)(const char *, size_t) = NULL;
+
+int typing_start(void (*publish_frame_func)(const char *, size_t), error_list_t *error)
+{
+    typing_count = 0;
+    typing_changed = 0;
+    published_length = 0;
+    typing_publish_frame = publish_frame_func;
+
+    mutex_init(&typing_mutex);
+    cond_init(&typing_cond);
+
+    atomic_store(&typing_running, 1);
+
+    if (thread_create(&typing_thread, typing_flush_thread, NULL) != 0)
+    {
+        atomic_store(&typing_running, 0);
+        add_error(error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create typing flush thread", "typing_start");
+        mutex_destroy(&typing_mutex);
+        cond_destroy(&typing_cond);
+        return 1;
+    }
+
+    return 0;
+}
+
+void typing_stop(void)
+{
+    if (!atomic_load(&typing_running))
+    {
+        return;
+    }
+
+    mutex_lock(&typing_mutex);
+    atomic_store(&typing_running, 0);
+    cond_broadcast(&typing_cond);
+    mutex_unlock(&typing_mutex);
+
+    thread_join(typing_thread);
+
+    mutex_destroy(&typing_mutex);
+    cond_destroy(&typing_cond);
+}
+
+static void mark_changed(void)
+{
+    // only the first change of a window wakes the thread, the rest would cut the window short
+    if (!typing_changed)
+    {
+        typing_changed = 1;
+        cond_signal(&typing_cond);
+    }
+}
+
+void typing_record(uint32_t member_id, int typing)
+{
+    if (!atomic_load(&typing_running) || member_id == 0)
+    {
+        return;
+    }
+
+    mutex_lock(&typing_mutex);
+
+    size_t index = 0;
+    while (index < typing_count && typing_entries[index].member_id != member_id)
+    {
+        index++;
+    }
+
+    if (typing)
+    {
+        if (index < typing_count)
+        {
+            // a refresh only pushes the expiry out, the set is the same
+            typing_entries[index].expires_ms = cross_platform_monotonic_ms() + TYPING_TIMEOUT_MS;
+        }
+        else if (typing_count < TYPING_MAX_MEMBERS)
+        {
+            typing_entries[typing_count].member_id = member_id;
+            typing_entries[typing_count].expires_ms = cross_platform_monotonic_ms() + TYPING_TIMEOUT_MS;
+            typing_count++;
+            mark_changed();
+        }
+    }
+    else if (index < typing_count)
+    {
+        // arrival order isn't kept, the set is announced whole
+        typing_entries[index] = typing_entries[--typing_count];
+        mark_changed();
+    }
+
+    mutex_unlock(&typing_mutex);
+}
+
+// returns the time until the next entry expires, with typing_mutex held
+static uint64_t expire_entries(void)
+{
+    uint64_t now = cross_platform_monotonic_ms();
+    uint64_t next_expiry = TYPING_TIMEOUT_MS;
+
+    size_t i = 0;
+    while (i < typing_count)
+    {
+        if (typing_entries[i].expires_ms <= now)
+        {
+            typing_entries[i] = typing_entries[--typing_count];
+            typing_changed = 1;
+            continue;
+        }
+
+        if (typing_entries[i].expires_ms - now < next_expiry)
+        {
+            next_expiry = typing_entries[i].expires_ms - now;
+        }
+        i++;
+    }
+
+    return next_expiry;
+}
+
+thread_ret_t THREAD_CALL typing_flush_thread(void *arg)
+{
+    (void)arg;
+
+    char frame[TYPING_FRAME_BUFFER_SIZE];
+
+    while (atomic_load(&typing_running))
+    {
+        mutex_lock(&typing_mutex);
+        while (atomic_load(&typing_running))
+        {
+            uint64_t next_expiry = expire_entries();
+            if (typing_changed)
+            {
+                break;
+            }
+            cond_timedwait(&typing_cond, &typing_mutex, (long)next_expiry);
+        }
+
+        // a burst of keystrokes from several members lands in one frame
+        if (atomic_load(&typing_running))
+        {
+            cond_timedwait(&typing_cond, &typing_mutex, TYPING_COALESCE_WINDOW_MS);
+            expire_entries();
+        }
+
+        uint32_t member_ids[TYPING_MAX_MEMBERS];
+        for (size_t i = 0; i < typing_count; i++)
+        {
+            member_ids[i] = typing_entries[i].member_id;
+        }
+        size_t frame_length = format_typing_frame(frame, sizeof(frame), member_ids, typing_count);
+        typing_changed = 0;
+        mutex_unlock(&typing_mutex);
+
+        if (!atomic_load(&typing_running))
+        {
+            break;
+        }
+
+        // a member that started and stopped within the window leaves the set as it was, nobody needs to hear about it
+        if (frame_length == published_length && memcmp(frame, published_frame, frame_length) == 0)
+        {
+            continue;
+        }
+
+        memcpy(published_frame, frame, frame_length);
+        published_length = frame_length;
+        typing_publish_frame(frame, frame_length);
+    }
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
\ No newline at end of file
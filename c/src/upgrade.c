@@ -0,0 +1,550 @@
+#include "../include/upgrade.h"
+
+#ifndef _WIN32
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif
+
+// UPGRADE_ACK: sent by the new process once it holds every descriptor
+#define UPGRADE_ACK 'A'
+// UPGRADE_COMMIT: the old process's last word on the channel, after it the room belongs to the new process
+#define UPGRADE_COMMIT 'C'
+
+// the channel's wire layout, both ends are builds of the same UPGRADE_VERSION so the structs go over as they are
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+} upgrade_hello_t;
+
+typedef struct
+{
+    uint32_t next_member_id;
+    uint32_t connection_count;
+    uint32_t banned_addresses_length;
+    uint32_t content_filter_rules_length;
+    char secret_key[SECRET_KEY_BUFFER_SIZE];
+} upgrade_header_t;
+
+typedef struct
+{
+    struct sockaddr_in address;
+    char username[USERNAME_BUFFER_SIZE];
+    uint32_t user_type;
+    uint32_t member_id;
+    uint32_t typing_subscribed;
+    uint32_t input_length;
+    uint32_t output_length;
+} upgrade_record_t;
+
+void upgrade_state_init(upgrade_state_t *state)
+{
+    state->listening_socket = INVALID_SOCK;
+    state->secret_key[0] = '\0';
+    state->next_member_id = 1;
+    state->banned_addresses = NULL;
+    state->content_filter_rules = NULL;
+    state->connections = NULL;
+    state->connection_count = 0;
+}
+
+void upgrade_state_free(upgrade_state_t *state, int close_sockets)
+{
+    error_list_t close_error;
+    init_error(&close_error);
+
+    if (close_sockets && state->listening_socket != INVALID_SOCK)
+    {
+        socket_close(state->listening_socket, &close_error);
+    }
+
+    for (size_t i = 0; i < state->connection_count; i++)
+    {
+        if (close_sockets && state->connections[i].socket != INVALID_SOCK)
+        {
+            socket_close(state->connections[i].socket, &close_error);
+        }
+        free(state->connections[i].input);
+        free(state->connections[i].output);
+    }
+
+    free(state->connections);
+    free(state->banned_addresses);
+    free(state->content_filter_rules);
+    upgrade_state_init(state);
+}
+
+#ifdef _WIN32
+
+// winsock can't pass a socket along with data, WSADuplicateSocket would need the new process's ID up front
+static void add_unsupported_error(error_list_t *error, const char *function_name)
+{
+    add_error(error, ERR_UPGRADE_UNSUPPORTED, NON_CRITICAL_ERROR, "Hot upgrade passes sockets over a Unix domain socket, which Windows can't do", function_name);
+}
+
+socket_t upgrade_channel_listen(const char *path, error_list_t *error)
+{
+    (void)path;
+    add_unsupported_error(error, "upgrade_channel_listen");
+    return INVALID_SOCK;
+}
+
+socket_t upgrade_channel_accept(socket_t channel_listener, error_list_t *error)
+{
+    (void)channel_listener;
+    add_unsupported_error(error, "upgrade_channel_accept");
+    return INVALID_SOCK;
+}
+
+socket_t upgrade_channel_connect(const char *path, error_list_t *error)
+{
+    (void)path;
+    add_unsupported_error(error, "upgrade_channel_connect");
+    return INVALID_SOCK;
+}
+
+void upgrade_channel_close(socket_t channel)
+{
+    (void)channel;
+}
+
+int upgrade_receive_hello(socket_t channel, error_list_t *error)
+{
+    (void)channel;
+    add_unsupported_error(error, "upgrade_receive_hello");
+    return 1;
+}
+
+int upgrade_send_state(socket_t channel, const upgrade_state_t *state, error_list_t *error)
+{
+    (void)channel;
+    (void)state;
+    add_unsupported_error(error, "upgrade_send_state");
+    return 1;
+}
+
+int upgrade_receive_state(socket_t channel, upgrade_state_t *state, error_list_t *error)
+{
+    (void)channel;
+    upgrade_state_init(state);
+    add_unsupported_error(error, "upgrade_receive_state");
+    return 1;
+}
+
+#else
+
+static int set_channel_address(struct sockaddr_un *address, const char *path, error_list_t *error, const char *function_name)
+{
+    if (strlen(path) >= sizeof(address->sun_path))
+    {
+        add_error(error, ERR_UPGRADE_FAILED, NON_CRITICAL_ERROR, "Upgrade socket path is too long", function_name);
+        return 1;
+    }
+
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, path);
+
+    return 0;
+}
+
+// the channel is blocking, a peer that stalls fails the handoff instead of hanging it
+static void set_channel_options(socket_t channel)
+{
+    struct timeval timeout;
+    timeout.tv_sec = UPGRADE_IO_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (UPGRADE_IO_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(channel, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(channel, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    fcntl(channel, F_SETFD, FD_CLOEXEC);
+}
+
+// attached_socket rides along with the first byte, INVALID_SOCK for none
+static int send_exact(socket_t channel, const void *data, size_t length, socket_t attached_socket)
+{
+    const char *cursor = (const char *)data;
+
+    while (length > 0)
+    {
+        struct iovec iov;
+        iov.iov_base = (void *)cursor;
+        iov.iov_len = length;
+
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+
+        union
+        {
+            struct cmsghdr header;
+            char buffer[CMSG_SPACE(sizeof(int))];
+        } control;
+
+        if (attached_socket != INVALID_SOCK)
+        {
+            memset(&control, 0, sizeof(control));
+            message.msg_control = control.buffer;
+            message.msg_controllen = sizeof(control.buffer);
+
+            struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(header), &attached_socket, sizeof(int));
+        }
+
+        ssize_t sent = sendmsg(channel, &message, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return 1;
+        }
+
+        attached_socket = INVALID_SOCK;
+        cursor += sent;
+        length -= (size_t)sent;
+    }
+
+    return 0;
+}
+
+// a descriptor that arrives with the data is stored in attached_socket, or closed if none was expected
+static int recv_exact(socket_t channel, void *data, size_t length, socket_t *attached_socket)
+{
+    char *cursor = (char *)data;
+
+    if (attached_socket != NULL)
+    {
+        *attached_socket = INVALID_SOCK;
+    }
+
+    while (length > 0)
+    {
+        struct iovec iov;
+        iov.iov_base = cursor;
+        iov.iov_len = length;
+
+        union
+        {
+            struct cmsghdr header;
+            char buffer[CMSG_SPACE(sizeof(int))];
+        } control;
+
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+
+        ssize_t received = recvmsg(channel, &message, 0);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            return 1;
+        }
+
+        for (struct cmsghdr *header = CMSG_FIRSTHDR(&message); header != NULL; header = CMSG_NXTHDR(&message, header))
+        {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+            {
+                continue;
+            }
+
+            socket_t received_socket;
+            memcpy(&received_socket, CMSG_DATA(header), sizeof(int));
+
+            if (attached_socket != NULL && *attached_socket == INVALID_SOCK)
+            {
+                fcntl(received_socket, F_SETFD, FD_CLOEXEC);
+                *attached_socket = received_socket;
+            }
+            else
+            {
+                close(received_socket);
+            }
+        }
+
+        if (message.msg_flags & MSG_CTRUNC)
+        {
+            // a descriptor was dropped on the way, the connection it belonged to can't be served
+            return 1;
+        }
+
+        cursor += received;
+        length -= (size_t)received;
+    }
+
+    return 0;
+}
+
+socket_t upgrade_channel_listen(const char *path, error_list_t *error)
+{
+    struct sockaddr_un address;
+    if (set_channel_address(&address, path, error, "upgrade_channel_listen") != 0)
+    {
+        return INVALID_SOCK;
+    }
+
+    socket_t channel_listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (channel_listener == INVALID_SOCK)
+    {
+        add_error(error, map_platform_error(errno), NON_CRITICAL_ERROR, "Failed to create the upgrade socket", "upgrade_channel_listen");
+        return INVALID_SOCK;
+    }
+
+    // the caller found nobody listening, or just took the room over from whoever was, so the file is free to replace
+    unlink(path);
+
+    // whoever connects gets every client's socket, so only this user may
+    if (bind(channel_listener, (struct sockaddr *)&address, sizeof(address)) != 0 || chmod(path, 0600) != 0 || listen(channel_listener, 1) != 0)
+    {
+        add_error(error, map_platform_error(errno), NON_CRITICAL_ERROR, "Failed to listen on the upgrade socket", "upgrade_channel_listen");
+        close(channel_listener);
+        return INVALID_SOCK;
+    }
+
+    fcntl(channel_listener, F_SETFD, FD_CLOEXEC);
+
+    return channel_listener;
+}
+
+socket_t upgrade_channel_accept(socket_t channel_listener, error_list_t *error)
+{
+    socket_t channel = accept(channel_listener, NULL, NULL);
+    if (channel == INVALID_SOCK)
+    {
+        add_error(error, map_platform_error(errno), NON_CRITICAL_ERROR, "Failed to accept an upgrade connection", "upgrade_channel_accept");
+        return INVALID_SOCK;
+    }
+
+#ifdef __linux__
+    // the file mode already keeps other users out, this also covers a socket file created before the chmod
+    struct ucred credentials;
+    socklen_t credentials_length = sizeof(credentials);
+    if (getsockopt(channel, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_length) != 0 || credentials.uid != getuid())
+    {
+        add_error(error, ERR_UPGRADE_FAILED, NON_CRITICAL_ERROR, "Refused an upgrade connection from another user", "upgrade_channel_accept");
+        close(channel);
+        return INVALID_SOCK;
+    }
+#endif
+
+    set_channel_options(channel);
+
+    return channel;
+}
+
+socket_t upgrade_channel_connect(const char *path, error_list_t *error)
+{
+    struct sockaddr_un address;
+    if (set_channel_address(&address, path, error, "upgrade_channel_connect") != 0)
+    {
+        return INVALID_SOCK;
+    }
+
+    socket_t channel = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (channel == INVALID_SOCK)
+    {
+        add_error(error, map_platform_error(errno), NON_CRITICAL_ERROR, "Failed to create the upgrade socket", "upgrade_channel_connect");
+        return INVALID_SOCK;
+    }
+
+    if (connect(channel, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        int connect_error = errno;
+        close(channel);
+
+        // no file, or nobody behind it: there is no running room to take over, which is the usual case
+        if (connect_error != ENOENT && connect_error != ECONNREFUSED)
+        {
+            add_error(error, map_platform_error(connect_error), NON_CRITICAL_ERROR, "Failed to reach the running server over the upgrade socket", "upgrade_channel_connect");
+        }
+        return INVALID_SOCK;
+    }
+
+    set_channel_options(channel);
+
+    return channel;
+}
+
+void upgrade_channel_close(socket_t channel)
+{
+    if (channel != INVALID_SOCK)
+    {
+        close(channel);
+    }
+}
+
+int upgrade_receive_hello(socket_t channel, error_list_t *error)
+{
+    upgrade_hello_t hello;
+    if (recv_exact(channel, &hello, sizeof(hello), NULL) != 0)
+    {
+        add_error(error, ERR_UPGRADE_FAILED, NON_CRITICAL_ERROR, "The new server closed the upgrade connection before saying hello", "upgrade_receive_hello");
+        return 1;
+    }
+
+    if (hello.magic != UPGRADE_MAGIC || hello.version != UPGRADE_VERSION)
+    {
+        add_error(error, ERR_UPGRADE_FAILED, NON_CRITICAL_ERROR, "The new server's handoff format doesn't match this one's, it was refused", "upgrade_receive_hello");
+        return 1;
+    }
+
+    return 0;
+}
+
+int upgrade_send_state(socket_t channel, const upgrade_state_t *state, error_list_t *error)
+{
+    upgrade_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.next_member_id = state->next_member_id;
+    header.connection_count = (uint32_t)state->connection_count;
+    header.banned_addresses_length = state->banned_addresses != NULL ? (uint32_t)strlen(state->banned_addresses) : 0;
+    header.content_filter_rules_length = state->content_filter_rules != NULL ? (uint32_t)strlen(state->content_filter_rules) : 0;
+    memcpy(header.secret_key, state->secret_key, sizeof(header.secret_key));
+
+    int failed = send_exact(channel, &header, sizeof(header), state->listening_socket) != 0 ||
+                 send_exact(channel, state->banned_addresses, header.banned_addresses_length, INVALID_SOCK) != 0 ||
+                 send_exact(channel, state->content_filter_rules, header.content_filter_rules_length, INVALID_SOCK) != 0;
+
+    for (size_t i = 0; i < state->connection_count && !failed; i++)
+    {
+        const upgrade_connection_t *connection = &state->connections[i];
+
+        upgrade_record_t record;
+        memset(&record, 0, sizeof(record));
+        record.address = connection->address;
+        memcpy(record.username, connection->username, sizeof(record.username));
+        record.user_type = (uint32_t)connection->user_type;
+        record.member_id = connection->member_id;
+        record.typing_subscribed = (uint32_t)connection->typing_subscribed;
+        record.input_length = (uint32_t)connection->input_length;
+        record.output_length = (uint32_t)connection->output_length;
+
+        failed = send_exact(channel, &record, sizeof(record), connection->socket) != 0 ||
+                 send_exact(channel, connection->input, connection->input_length, INVALID_SOCK) != 0 ||
+                 send_exact(channel, connection->output, connection->output_length, INVALID_SOCK) != 0;
+    }
+
+    // until the ack arrives the new process may still give up, and then this one keeps serving
+    char ack = '\0';
+    if (failed || recv_exact(channel, &ack, 1, NULL) != 0 || ack != UPGRADE_ACK)
+    {
+        add_error(error, ERR_UPGRADE_FAILED, NON_CRITICAL_ERROR, "The new server did not take the room over, this one keeps serving it", "upgrade_send_state");
+        return 1;
+    }
+
+    // the new process doesn't touch the connections before this byte, a commit that can't be sent keeps them here
+    char commit = UPGRADE_COMMIT;
+    if (send_exact(channel, &commit, 1, INVALID_SOCK) != 0)
+    {
+        add_error(error, ERR_UPGRADE_FAILED, NON_CRITICAL_ERROR, "The new server went away before the handoff was committed, this one keeps serving the room", "upgrade_send_state");
+        return 1;
+    }
+
+    return 0;
+}
+
+static int recv_allocated(socket_t channel, char **data, size_t length, int terminate)
+{
+    *data = NULL;
+    if (length == 0 && !terminate)
+    {
+        return 0;
+    }
+
+    *data = (char *)malloc(length + (terminate ? 1 : 0));
+    if (*data == NULL || recv_exact(channel, *data, length, NULL) != 0)
+    {
+        return 1;
+    }
+
+    if (terminate)
+    {
+        (*data)[length] = '\0';
+    }
+
+    return 0;
+}
+
+int upgrade_receive_state(socket_t channel, upgrade_state_t *state, error_list_t *error)
+{
+    upgrade_state_init(state);
+
+    upgrade_hello_t hello;
+    hello.magic = UPGRADE_MAGIC;
+    hello.version = UPGRADE_VERSION;
+
+    upgrade_header_t header;
+    int failed = send_exact(channel, &hello, sizeof(hello), INVALID_SOCK) != 0 ||
+                 recv_exact(channel, &header, sizeof(header), &state->listening_socket) != 0 ||
+                 state->listening_socket == INVALID_SOCK;
+
+    if (!failed)
+    {
+        memcpy(state->secret_key, header.secret_key, sizeof(state->secret_key));
+        state->secret_key[sizeof(state->secret_key) - 1] = '\0';
+        state->next_member_id = header.next_member_id;
+
+        state->connections = (upgrade_connection_t *)calloc(header.connection_count > 0 ? header.connection_count : 1, sizeof(upgrade_connection_t));
+        failed = state->connections == NULL ||
+                 (header.banned_addresses_length > 0 && recv_allocated(channel, &state->banned_addresses, header.banned_addresses_length, 1) != 0) ||
+                 (header.content_filter_rules_length > 0 && recv_allocated(channel, &state->content_filter_rules, header.content_filter_rules_length, 1) != 0);
+    }
+
+    for (uint32_t i = 0; i < header.connection_count && !failed; i++)
+    {
+        upgrade_connection_t *connection = &state->connections[i];
+        upgrade_record_t record;
+
+        failed = recv_exact(channel, &record, sizeof(record), &connection->socket) != 0;
+        if (connection->socket == INVALID_SOCK)
+        {
+            failed = 1;
+            break;
+        }
+        // counted as soon as its descriptor is here, so a failure further on still closes it
+        state->connection_count++;
+
+        if (failed || record.input_length > FRAME_READER_BUFFER_SIZE)
+        {
+            failed = 1;
+            break;
+        }
+
+        connection->address = record.address;
+        memcpy(connection->username, record.username, sizeof(connection->username));
+        connection->username[sizeof(connection->username) - 1] = '\0';
+        connection->user_type = record.user_type == USER_TYPE_ADMIN ? USER_TYPE_ADMIN : USER_TYPE_REGULAR;
+        connection->member_id = record.member_id;
+        connection->typing_subscribed = record.typing_subscribed != 0;
+        connection->input_length = record.input_length;
+        connection->output_length = record.output_length;
+
+        failed = recv_allocated(channel, &connection->input, record.input_length, 0) != 0 ||
+                 recv_allocated(channel, &connection->output, record.output_length, 0) != 0;
+    }
+
+    // without the commit the old process may still be serving the connections, they are closed here instead of adopted
+    char ack = UPGRADE_ACK;
+    char commit = '\0';
+    if (failed || send_exact(channel, &ack, 1, INVALID_SOCK) != 0 || recv_exact(channel, &commit, 1, NULL) != 0 || commit != UPGRADE_COMMIT)
+    {
+        add_error(error, ERR_UPGRADE_FAILED, CRITICAL_ERROR, "Taking the room over from the running server failed, it keeps serving the room", "upgrade_receive_state");
+        upgrade_state_free(state, 1);
+        return 1;
+    }
+
+    return 0;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "../include/username_index.h"
+
+static uint32_t hash_username(const char *username)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)username; *c != '\0'; ++c)
+    {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// returns the slot holding the name or the empty slot where it belongs
+static size_t find_slot(const username_index_entry_t *entries, size_t capacity, const char *username, uint32_t hash)
+{
+    size_t slot = hash & (capacity - 1);
+    while (entries[slot].client != NULL && (entries[slot].hash != hash || strcmp(entries[slot].username, username) != 0))
+    {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return slot;
+}
+
+int username_index_init(username_index_t *index, error_list_t *error)
+{
+    index->entries = (username_index_entry_t *)calloc(USERNAME_INDEX_INITIAL_CAPACITY, sizeof(username_index_entry_t));
+    if (index->entries == NULL)
+    {
+        add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for the username index", "username_index_init");
+        return 1;
+    }
+
+    index->capacity = USERNAME_INDEX_INITIAL_CAPACITY;
+    index->count = 0;
+
+    return 0;
+}
+
+void username_index_destroy(username_index_t *index)
+{
+    free(index->entries);
+    index->entries = NULL;
+    index->capacity = 0;
+    index->count = 0;
+}
+
+static int grow(username_index_t *index, error_list_t *error)
+{
+    size_t new_capacity = index->capacity * 2;
+    username_index_entry_t *new_entries = (username_index_entry_t *)calloc(new_capacity, sizeof(username_index_entry_t));
+    if (new_entries == NULL)
+    {
+        add_error(error, MALLOC_ERROR, NON_CRITICAL_ERROR, "Failed to grow the username index", "username_index_insert");
+        return 1;
+    }
+
+    for (size_t i = 0; i < index->capacity; i++)
+    {
+        if (index->entries[i].client != NULL)
+        {
+            new_entries[find_slot(new_entries, new_capacity, index->entries[i].username, index->entries[i].hash)] = index->entries[i];
+        }
+    }
+
+    free(index->entries);
+    index->entries = new_entries;
+    index->capacity = new_capacity;
+
+    return 0;
+}
+
+int username_index_insert(username_index_t *index, const char *username, struct client_node *client, error_list_t *error)
+{
+    if (index->entries == NULL)
+    {
+        return 1;
+    }
+
+    if ((index->count + 1) * 2 > index->capacity && grow(index, error) != 0)
+    {
+        return 1;
+    }
+
+    uint32_t hash = hash_username(username);
+    username_index_entry_t *entry = &index->entries[find_slot(index->entries, index->capacity, username, hash)];
+    if (entry->client == NULL)
+    {
+        entry->hash = hash;
+        strncpy(entry->username, username, sizeof(entry->username) - 1);
+        entry->username[sizeof(entry->username) - 1] = '\0';
+        index->count++;
+    }
+    entry->client = client;
+
+    return 0;
+}
+
+void username_index_remove(username_index_t *index, const char *username)
+{
+    if (index->entries == NULL)
+    {
+        return;
+    }
+
+    size_t mask = index->capacity - 1;
+    size_t slot = find_slot(index->entries, index->capacity, username, hash_username(username));
+    if (index->entries[slot].client == NULL)
+    {
+        return;
+    }
+
+    // backward shift deletion: entries further along the probe sequence move up into the hole,
+    // so lookups never need tombstones
+    size_t hole = slot;
+    size_t next = (hole + 1) & mask;
+    while (index->entries[next].client != NULL)
+    {
+        size_t home = index->entries[next].hash & mask;
+        // the entry may fill the hole unless its home lies cyclically in (hole, next]
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            index->entries[hole] = index->entries[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+
+    index->entries[hole].client = NULL;
+    index->count--;
+}
+
+struct client_node *username_index_find(const username_index_t *index, const char *username)
+{
+    if (index->entries == NULL || username[0] == '\0')
+    {
+        return NULL;
+    }
+
+    return index->entries[find_slot(index->entries, index->capacity, username, hash_username(username))].client;
+}
\ No newline at end of file
@@ -0,0 +1,382 @@
+#include "../include/utf8.h"
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define UTF8_SSSE3 1
+#define UTF8_SSSE3_TARGET
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// built for plain SSE2, the SSSE3 path is compiled for it anyway and picked at run time
+#include <tmmintrin.h>
+#define UTF8_SSSE3 1
+#define UTF8_SSSE3_TARGET __attribute__((target("ssse3")))
+#define UTF8_SSSE3_RUNTIME_CHECK 1
+#endif
+
+// the bytes of the well formed sequence starting at c, 0 if it is malformed or cut off
+static size_t sequence_length(const unsigned char *c, size_t available)
+{
+    unsigned char lead = c[0];
+    size_t length;
+    // the range of the second byte is what rules out overlong forms, surrogates and code points past U+10FFFF
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+
+    if (lead < 0x80)
+    {
+        return 1;
+    }
+    else if (lead >= 0xC2 && lead <= 0xDF)
+    {
+        length = 2;
+    }
+    else if (lead >= 0xE0 && lead <= 0xEF)
+    {
+        length = 3;
+        if (lead == 0xE0)
+        {
+            low = 0xA0;
+        }
+        else if (lead == 0xED)
+        {
+            high = 0x9F;
+        }
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        length = 4;
+        if (lead == 0xF0)
+        {
+            low = 0x90;
+        }
+        else if (lead == 0xF4)
+        {
+            high = 0x8F;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (length > available || c[1] < low || c[1] > high)
+    {
+        return 0;
+    }
+
+    for (size_t i = 2; i < length; i++)
+    {
+        if ((c[i] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+    }
+
+    return length;
+}
+
+static int validate_scalar(const unsigned char *data, size_t length, size_t *code_points)
+{
+    size_t count = 0;
+    size_t offset = 0;
+
+    while (offset < length)
+    {
+        size_t step = sequence_length(data + offset, length - offset);
+        if (step == 0)
+        {
+            return 1;
+        }
+        offset += step;
+        count++;
+    }
+
+    *code_points = count;
+    return 0;
+}
+
+#ifdef UTF8_SSSE3
+
+// the error classes of the lookup method by Keiser and Lemire: each table maps a nibble of a byte pair
+// to the classes it can belong to, a pair is only wrong when all three nibbles agree on a class
+#define UTF8_TOO_SHORT (1 << 0)
+#define UTF8_TOO_LONG (1 << 1)
+#define UTF8_OVERLONG_3 (1 << 2)
+#define UTF8_TOO_LARGE (1 << 3)
+#define UTF8_SURROGATE (1 << 4)
+#define UTF8_OVERLONG_2 (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4 (1 << 6)
+#define UTF8_TWO_CONTINUATIONS (1 << 7)
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTINUATIONS)
+
+static unsigned int count_bits(unsigned int mask)
+{
+#ifdef __GNUC__
+    return (unsigned int)__builtin_popcount(mask);
+#else
+    unsigned int count = 0;
+    while (mask != 0)
+    {
+        mask &= mask - 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+UTF8_SSSE3_TARGET static __m128i check_block(__m128i input, __m128i previous)
+{
+    // high nibble of the first byte of a pair
+    const __m128i byte_1_high_table = _mm_setr_epi8(
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        (char)UTF8_TWO_CONTINUATIONS, (char)UTF8_TWO_CONTINUATIONS, (char)UTF8_TWO_CONTINUATIONS, (char)UTF8_TWO_CONTINUATIONS,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+        UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+        UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+    // low nibble of the first byte
+    const __m128i byte_1_low_table = _mm_setr_epi8(
+        (char)(UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4),
+        (char)(UTF8_CARRY | UTF8_OVERLONG_2),
+        (char)UTF8_CARRY,
+        (char)UTF8_CARRY,
+        (char)(UTF8_CARRY | UTF8_TOO_LARGE),
+        (char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        (char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        (char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        (char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        (char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        (char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        (char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        (char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        (char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE),
+        (char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        (char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000));
+    // high nibble of the second byte
+    const __m128i byte_2_high_table = _mm_setr_epi8(
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        (char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATIONS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4),
+        (char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATIONS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE),
+        (char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATIONS | UTF8_SURROGATE | UTF8_TOO_LARGE),
+        (char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATIONS | UTF8_SURROGATE | UTF8_TOO_LARGE),
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+
+    __m128i previous_1 = _mm_alignr_epi8(input, previous, 15);
+    __m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_table, _mm_and_si128(_mm_srli_epi16(previous_1, 4), nibble_mask));
+    __m128i byte_1_low = _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(previous_1, nibble_mask));
+    __m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_table, _mm_and_si128(_mm_srli_epi16(input, 4), nibble_mask));
+    __m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+    // the third and fourth bytes of a sequence have to be continuations, the pairs above only see two bytes
+    __m128i previous_2 = _mm_alignr_epi8(input, previous, 14);
+    __m128i previous_3 = _mm_alignr_epi8(input, previous, 13);
+    __m128i is_third_byte = _mm_subs_epu8(previous_2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+    __m128i is_fourth_byte = _mm_subs_epu8(previous_3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+    __m128i must_be_continuation = _mm_and_si128(_mm_or_si128(is_third_byte, is_fourth_byte), _mm_set1_epi8((char)0x80));
+
+    return _mm_xor_si128(must_be_continuation, special_cases);
+}
+
+UTF8_SSSE3_TARGET static int validate_ssse3(const unsigned char *data, size_t length, size_t *code_points)
+{
+    // a lead byte this close to the end of a block continues in the next one
+    const __m128i incomplete_limits = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                    (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    __m128i error = _mm_setzero_si128();
+    __m128i previous = _mm_setzero_si128();
+    __m128i previous_incomplete = _mm_setzero_si128();
+    size_t count = 0;
+
+    for (size_t offset = 0; offset < length; offset += 16)
+    {
+        size_t block_length = length - offset < 16 ? length - offset : 16;
+        __m128i input;
+
+        if (block_length == 16)
+        {
+            input = _mm_loadu_si128((const __m128i *)(data + offset));
+        }
+        else
+        {
+            // the tail is padded with ASCII, a sequence cut off by the end shows up as too short
+            unsigned char padded[16] = {0};
+            memcpy(padded, data + offset, block_length);
+            input = _mm_loadu_si128((const __m128i *)padded);
+        }
+
+        if (_mm_movemask_epi8(input) == 0)
+        {
+            // all ASCII: only a sequence left open by the block before can be wrong
+            error = _mm_or_si128(error, previous_incomplete);
+            previous_incomplete = _mm_setzero_si128();
+            count += block_length;
+        }
+        else
+        {
+            error = _mm_or_si128(error, check_block(input, previous));
+            previous_incomplete = _mm_subs_epu8(input, incomplete_limits);
+
+            // every byte but a continuation (0x80 to 0xBF, below -64 as signed) starts a code point, padding included
+            unsigned int starts = (unsigned int)_mm_movemask_epi8(_mm_cmpgt_epi8(input, _mm_set1_epi8(-65)));
+            count += count_bits(starts) - (16 - block_length);
+        }
+
+        previous = input;
+    }
+
+    error = _mm_or_si128(error, previous_incomplete);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) != 0xFFFF)
+    {
+        return 1;
+    }
+
+    *code_points = count;
+    return 0;
+}
+
+#ifdef UTF8_SSSE3_RUNTIME_CHECK
+static atomic_int ssse3_support = ATOMIC_VAR_INIT(-1);
+
+static int has_ssse3(void)
+{
+    int supported = atomic_load(&ssse3_support);
+    if (supported < 0)
+    {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("ssse3") ? 1 : 0;
+        atomic_store(&ssse3_support, supported);
+    }
+    return supported;
+}
+#else
+#define has_ssse3() 1
+#endif
+
+#endif
+
+int utf8_validate(const char *data, size_t length, size_t *code_points)
+{
+#ifdef UTF8_SSSE3
+    if (has_ssse3())
+    {
+        return validate_ssse3((const unsigned char *)data, length, code_points);
+    }
+#endif
+    return validate_scalar((const unsigned char *)data, length, code_points);
+}
+
+utf8_status_t utf8_check_text(const char *text, size_t max_code_points)
+{
+    size_t code_points;
+    if (utf8_validate(text, strlen(text), &code_points) != 0)
+    {
+        return UTF8_MALFORMED;
+    }
+    return code_points > max_code_points ? UTF8_TOO_LONG : UTF8_VALID;
+}
+
+size_t utf8_to_utf16(const char *input, uint16_t *output)
+{
+    const unsigned char *c = (const unsigned char *)input;
+    size_t available = strlen(input);
+    size_t length = 0;
+
+    while (available > 0)
+    {
+        size_t step = sequence_length(c, available);
+        uint32_t code_point;
+
+        switch (step)
+        {
+        case 1:
+            code_point = c[0];
+            break;
+        case 2:
+            code_point = ((uint32_t)(c[0] & 0x1F) << 6) | (c[1] & 0x3F);
+            break;
+        case 3:
+            code_point = ((uint32_t)(c[0] & 0x0F) << 12) | ((uint32_t)(c[1] & 0x3F) << 6) | (c[2] & 0x3F);
+            break;
+        case 4:
+            code_point = ((uint32_t)(c[0] & 0x07) << 18) | ((uint32_t)(c[1] & 0x3F) << 12) | ((uint32_t)(c[2] & 0x3F) << 6) | (c[3] & 0x3F);
+            break;
+        default:
+            // one replacement per bad byte, a 4 byte sequence is the only one that takes two units and it is well formed
+            code_point = UTF8_REPLACEMENT_CHARACTER;
+            step = 1;
+            break;
+        }
+
+        if (code_point >= 0x10000)
+        {
+            code_point -= 0x10000;
+            output[length++] = (uint16_t)(0xD800 | (code_point >> 10));
+            output[length++] = (uint16_t)(0xDC00 | (code_point & 0x3FF));
+        }
+        else
+        {
+            output[length++] = (uint16_t)code_point;
+        }
+
+        c += step;
+        available -= step;
+    }
+
+    return length;
+}
+
+size_t utf16_to_utf8(const uint16_t *input, size_t length, char *output)
+{
+    unsigned char *out = (unsigned char *)output;
+    size_t written = 0;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        uint32_t code_point = input[i];
+
+        if (code_point >= 0xD800 && code_point <= 0xDBFF && i + 1 < length && input[i + 1] >= 0xDC00 && input[i + 1] <= 0xDFFF)
+        {
+            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (input[i + 1] - 0xDC00);
+            i++;
+        }
+        else if (code_point >= 0xD800 && code_point <= 0xDFFF)
+        {
+            code_point = UTF8_REPLACEMENT_CHARACTER;
+        }
+
+        // U+0000 would end the string early, Java allows it in a string, a frame can't carry it
+        if (code_point == 0)
+        {
+            code_point = UTF8_REPLACEMENT_CHARACTER;
+        }
+
+        if (code_point < 0x80)
+        {
+            out[written++] = (unsigned char)code_point;
+        }
+        else if (code_point < 0x800)
+        {
+            out[written++] = (unsigned char)(0xC0 | (code_point >> 6));
+            out[written++] = (unsigned char)(0x80 | (code_point & 0x3F));
+        }
+        else if (code_point < 0x10000)
+        {
+            out[written++] = (unsigned char)(0xE0 | (code_point >> 12));
+            out[written++] = (unsigned char)(0x80 | ((code_point >> 6) & 0x3F));
+            out[written++] = (unsigned char)(0x80 | (code_point & 0x3F));
+        }
+        else
+        {
+            out[written++] = (unsigned char)(0xF0 | (code_point >> 18));
+            out[written++] = (unsigned char)(0x80 | ((code_point >> 12) & 0x3F));
+            out[written++] = (unsigned char)(0x80 | ((code_point >> 6) & 0x3F));
+            out[written++] = (unsigned char)(0x80 | (code_point & 0x3F));
+        }
+    }
+
+    out[written] = '\0';
+    return written;
+}
\ No newline at end of file
@@ -0,0 +1,342 @@
+#include "../include/worker_pool.h"
+
+static atomic_int pool_running = ATOMIC_VAR_INIT(0);
+// cleared first by worker_pool_stop, a submit that still sees it set is counted in flight until its task is pushed
+static atomic_int pool_accepting = ATOMIC_VAR_INIT(0);
+static atomic_int submits_in_flight = ATOMIC_VAR_INIT(0);
+static worker_deque_t deques[WORKER_POOL_MAX_WORKERS];
+static thread_t workers[WORKER_POOL_MAX_WORKERS];
+static size_t worker_count = 0;
+
+static atomic_size_t pending_tasks = ATOMIC_VAR_INIT(0);
+static atomic_size_t next_submit_worker = ATOMIC_VAR_INIT(0);
+static atomic_int idle_workers = ATOMIC_VAR_INIT(0);
+static mutex_t pool_mutex;
+static cond_t pool_cond;
+
+// lets a task submitted from a worker land on that worker's own deque
+static THREAD_LOCAL int current_worker = -1;
+
+size_t worker_pool_default_size(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    long cpu_count = (long)system_info.dwNumberOfProcessors;
+#else
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (cpu_count < 1)
+    {
+        return 1;
+    }
+
+    return cpu_count > WORKER_POOL_MAX_WORKERS ? WORKER_POOL_MAX_WORKERS : (size_t)cpu_count;
+}
+
+static int deque_init(worker_deque_t *deque)
+{
+    deque->tasks = (worker_task_t *)malloc(WORKER_DEQUE_INITIAL_CAPACITY * sizeof(worker_task_t));
+    if (deque->tasks == NULL)
+    {
+        return 1;
+    }
+
+    mutex_init(&deque->mutex);
+    deque->capacity = WORKER_DEQUE_INITIAL_CAPACITY;
+    deque->top = 0;
+    deque->bottom = 0;
+
+    return 0;
+}
+
+static void deque_destroy(worker_deque_t *deque)
+{
+    free(deque->tasks);
+    deque->tasks = NULL;
+    mutex_destroy(&deque->mutex);
+}
+
+static int deque_push(worker_deque_t *deque, worker_task_t task)
+{
+    mutex_lock(&deque->mutex);
+
+    if (deque->bottom - deque->top == deque->capacity)
+    {
+        // grow and unwrap, the indices keep counting up so only the positions in the array change
+        worker_task_t *tasks = (worker_task_t *)malloc(deque->capacity * 2 * sizeof(worker_task_t));
+        if (tasks == NULL)
+        {
+            mutex_unlock(&deque->mutex);
+            return 1;
+        }
+
+        for (size_t i = deque->top; i != deque->bottom; i++)
+        {
+            tasks[i % (deque->capacity * 2)] = deque->tasks[i % deque->capacity];
+        }
+
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->capacity *= 2;
+    }
+
+    deque->tasks[deque->bottom % deque->capacity] = task;
+    deque->bottom++;
+
+    mutex_unlock(&deque->mutex);
+    return 0;
+}
+
+static int deque_pop_bottom(worker_deque_t *deque, worker_task_t *task)
+{
+    int found = 0;
+
+    mutex_lock(&deque->mutex);
+    if (deque->bottom != deque->top)
+    {
+        deque->bottom--;
+        *task = deque->tasks[deque->bottom % deque->capacity];
+        found = 1;
+    }
+    mutex_unlock(&deque->mutex);
+
+    return found;
+}
+
+static int deque_steal_top(worker_deque_t *deque, worker_task_t *task)
+{
+    int found = 0;
+
+    mutex_lock(&deque->mutex);
+    if (deque->bottom != deque->top)
+    {
+        *task = deque->tasks[deque->top % deque->capacity];
+        deque->top++;
+        found = 1;
+    }
+    mutex_unlock(&deque->mutex);
+
+    return found;
+}
+
+int worker_pool_start(size_t requested_workers, error_list_t *error)
+{
+    if (requested_workers == 0)
+    {
+        requested_workers = worker_pool_default_size();
+    }
+    if (requested_workers > WORKER_POOL_MAX_WORKERS)
+    {
+        requested_workers = WORKER_POOL_MAX_WORKERS;
+    }
+
+    for (size_t i = 0; i < requested_workers; i++)
+    {
+        if (deque_init(&deques[i]) != 0)
+        {
+            add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for a worker deque", "worker_pool_start");
+            while (i > 0)
+            {
+                deque_destroy(&deques[--i]);
+            }
+            return 1;
+        }
+    }
+
+    mutex_init(&pool_mutex);
+    cond_init(&pool_cond);
+    atomic_store(&pending_tasks, 0);
+    atomic_store(&idle_workers, 0);
+
+    // published before the first worker runs, a worker picks its steal victims modulo this count
+    worker_count = requested_workers;
+    atomic_store(&pool_running, 1);
+    atomic_store(&pool_accepting, 1);
+
+    size_t started_workers = 0;
+    for (size_t i = 0; i < requested_workers; i++)
+    {
+        worker_thread_args_t *thread_args = (worker_thread_args_t *)malloc(sizeof(worker_thread_args_t));
+        if (thread_args == NULL)
+        {
+            add_error(error, MALLOC_ERROR, CRITICAL_ERROR, "Failed to allocate memory for worker thread args", "worker_pool_start");
+            break;
+        }
+
+        thread_args->worker_index = i;
+
+        if (thread_create(&workers[i], worker_thread, thread_args) != 0)
+        {
+            add_error(error, THREAD_CREATE_ERROR, CRITICAL_ERROR, "Failed to create worker thread", "worker_pool_start");
+            free(thread_args);
+            break;
+        }
+
+        started_workers++;
+    }
+
+    if (started_workers < requested_workers)
+    {
+        // nothing was submitted yet so the deques beyond the started workers are empty, stop only joins the started ones
+        worker_count = started_workers;
+        worker_pool_stop();
+        for (size_t i = started_workers; i < requested_workers; i++)
+        {
+            deque_destroy(&deques[i]);
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+void worker_pool_stop(void)
+{
+    if (!atomic_load(&pool_running))
+    {
+        return;
+    }
+
+    // no submit gets past the check from here on, the ones already past it finish their push before the workers
+    // are told to exit, so every queued task still runs and the deques outlive every push
+    atomic_store(&pool_accepting, 0);
+    while (atomic_load(&submits_in_flight) > 0)
+    {
+        cross_platform_sleep_ms(1);
+    }
+
+    atomic_store(&pool_running, 0);
+
+    mutex_lock(&pool_mutex);
+    cond_broadcast(&pool_cond);
+    mutex_unlock(&pool_mutex);
+
+    // workers finish every queued task before they exit, connection readers may be waiting on them
+    for (size_t i = 0; i < worker_count; i++)
+    {
+        thread_join(workers[i]);
+    }
+
+    for (size_t i = 0; i < worker_count; i++)
+    {
+        deque_destroy(&deques[i]);
+    }
+
+    worker_count = 0;
+    mutex_destroy(&pool_mutex);
+    cond_destroy(&pool_cond);
+}
+
+int worker_pool_is_running(void)
+{
+    return atomic_load(&pool_running);
+}
+
+int worker_pool_submit(void (*run)(void *arg), void *arg)
+{
+    atomic_fetch_add(&submits_in_flight, 1);
+    if (!atomic_load(&pool_accepting))
+    {
+        // the caller runs the task itself, a strand never stays scheduled on a pool that won't run it
+        atomic_fetch_sub(&submits_in_flight, 1);
+        return 1;
+    }
+
+    worker_task_t task;
+    task.run = run;
+    task.arg = arg;
+
+    size_t target = current_worker >= 0 ? (size_t)current_worker : atomic_fetch_add(&next_submit_worker, 1) % worker_count;
+
+    // counted before it is visible, a worker that steals it at once must not take the count below zero
+    atomic_fetch_add(&pending_tasks, 1);
+    if (deque_push(&deques[target], task) != 0)
+    {
+        atomic_fetch_sub(&pending_tasks, 1);
+        atomic_fetch_sub(&submits_in_flight, 1);
+        return 1;
+    }
+
+    atomic_fetch_sub(&submits_in_flight, 1);
+
+    if (atomic_load(&idle_workers) > 0)
+    {
+        mutex_lock(&pool_mutex);
+        cond_signal(&pool_cond);
+        mutex_unlock(&pool_mutex);
+    }
+
+    return 0;
+}
+
+static int find_task(size_t worker_index, uint32_t *steal_state, worker_task_t *task)
+{
+    if (deque_pop_bottom(&deques[worker_index], task))
+    {
+        return 1;
+    }
+
+    // start stealing at a random victim so idle workers don't all pile onto the same deque
+    *steal_state ^= *steal_state << 13;
+    *steal_state ^= *steal_state >> 17;
+    *steal_state ^= *steal_state << 5;
+
+    size_t start = *steal_state % worker_count;
+    for (size_t i = 0; i < worker_count; i++)
+    {
+        size_t victim = (start + i) % worker_count;
+        if (victim != worker_index && deque_steal_top(&deques[victim], task))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+thread_ret_t THREAD_CALL worker_thread(void *arg)
+{
+    worker_thread_args_t *thread_args = (worker_thread_args_t *)arg;
+    size_t worker_index = thread_args->worker_index;
+    free(thread_args);
+
+    current_worker = (int)worker_index;
+    uint32_t steal_state = (uint32_t)(worker_index * 2654435761u) | 1u;
+
+    while (1)
+    {
+        worker_task_t task;
+        if (find_task(worker_index, &steal_state, &task))
+        {
+            atomic_fetch_sub(&pending_tasks, 1);
+            task.run(task.arg);
+            continue;
+        }
+
+        if (!atomic_load(&pool_running) && atomic_load(&pending_tasks) == 0)
+        {
+            break;
+        }
+
+        mutex_lock(&pool_mutex);
+        atomic_fetch_add(&idle_workers, 1);
+        if (atomic_load(&pending_tasks) == 0 && atomic_load(&pool_running))
+        {
+            // a submit either sees this worker idle or this check sees its task, the timeout is only a safety net
+            cond_timedwait(&pool_cond, &pool_mutex, WORKER_IDLE_TIMEOUT_MS);
+        }
+        atomic_fetch_sub(&idle_workers, 1);
+        mutex_unlock(&pool_mutex);
+    }
+
+    current_worker = -1;
+    logger_thread_detach();
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
\ No newline at end of file
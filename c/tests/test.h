@@ -0,0 +1,27 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+static int test_failures = 0;
+
+// a failed check is printed and counted, the test goes on so one run shows every failure
+#define CHECK(condition)                                           \
+    do                                                             \
+    {                                                              \
+        if (!(condition))                                          \
+        {                                                          \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            test_failures++;                                       \
+        }                                                          \
+    } while (0)
+
+// the exit code of a test program, test.sh lists every program that doesn't return 0
+static inline int test_report(const char *test_name)
+{
+    printf("%s: %s (%d failed)\n", test_name, test_failures == 0 ? "passed" : "FAILED", test_failures);
+
+    return test_failures == 0 ? 0 : 1;
+}
+
+#endif
\ No newline at end of file
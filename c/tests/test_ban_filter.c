@@ -0,0 +1,143 @@
+#include "../include/ban_filter.h"
+#include "test.h"
+
+#define ADDRESS(a, b, c, d) ((uint32_t)(a) << 24 | (uint32_t)(b) << 16 | (uint32_t)(c) << 8 | (uint32_t)(d))
+
+static void test_empty_filter(void)
+{
+    error_list_t error;
+    init_error(&error);
+    ban_filter_t filter;
+    CHECK(ban_filter_init(&filter, &error) == 0);
+
+    CHECK(!ban_filter_contains(&filter, ADDRESS(10, 0, 0, 1)));
+    CHECK(ban_filter_format_list(&filter) == NULL);
+
+    ban_filter_destroy(&filter);
+}
+
+static void test_networks(void)
+{
+    error_list_t error;
+    init_error(&error);
+    ban_filter_t filter;
+    CHECK(ban_filter_init(&filter, &error) == 0);
+
+    CHECK(ban_filter_add_list(&filter, "10.9.0.0/16,192.168.1.7,172.16.0.0/12", &error) == 0);
+
+    CHECK(ban_filter_contains(&filter, ADDRESS(10, 9, 200, 1)));
+    CHECK(!ban_filter_contains(&filter, ADDRESS(10, 10, 0, 1)));
+    CHECK(ban_filter_contains(&filter, ADDRESS(192, 168, 1, 7)));
+    CHECK(!ban_filter_contains(&filter, ADDRESS(192, 168, 1, 8)));
+    CHECK(ban_filter_contains(&filter, ADDRESS(172, 16, 0, 0)));
+    CHECK(ban_filter_contains(&filter, ADDRESS(172, 31, 255, 255)));
+    CHECK(!ban_filter_contains(&filter, ADDRESS(172, 32, 0, 0)));
+
+    // host bits of a network entry don't matter
+    CHECK(ban_filter_add(&filter, ADDRESS(8, 8, 8, 8), 8, &error) == 0);
+    CHECK(ban_filter_contains(&filter, ADDRESS(8, 1, 2, 3)));
+
+    // /0 is every address
+    CHECK(ban_filter_add(&filter, 0, 0, &error) == 0);
+    CHECK(ban_filter_contains(&filter, ADDRESS(1, 2, 3, 4)));
+
+    CHECK(ban_filter_add(&filter, 0, 33, &error) != 0);
+    CHECK(error.count == 1 && error.errors[0].code == ERR_BAN_ENTRY_INVALID);
+
+    ban_filter_destroy(&filter);
+}
+
+static void test_many_addresses(void)
+{
+    error_list_t error;
+    init_error(&error);
+    ban_filter_t filter;
+    CHECK(ban_filter_init(&filter, &error) == 0);
+
+    // well past the initial capacity, the table grows and the bloom filter fills up
+    for (uint32_t i = 0; i < 5000; i++)
+    {
+        CHECK(ban_filter_add(&filter, ADDRESS(11, 0, 0, 0) + i * 7, 32, &error) == 0);
+    }
+    CHECK(filter.count == 5000);
+
+    // a bloom hit is confirmed in the table, so the neighbours stay unbanned
+    int misses = 0;
+    int false_hits = 0;
+    for (uint32_t i = 0; i < 5000; i++)
+    {
+        misses += !ban_filter_contains(&filter, ADDRESS(11, 0, 0, 0) + i * 7);
+        false_hits += ban_filter_contains(&filter, ADDRESS(11, 0, 0, 0) + i * 7 + 1);
+    }
+    CHECK(misses == 0);
+    CHECK(false_hits == 0);
+
+    // adding an entry again doesn't count it twice
+    CHECK(ban_filter_add(&filter, ADDRESS(11, 0, 0, 0), 32, &error) == 0);
+    CHECK(filter.count == 5000);
+
+    ban_filter_destroy(&filter);
+}
+
+static void test_parse_entry(void)
+{
+    uint32_t address;
+    int prefix_length;
+
+    CHECK(ban_filter_parse_entry("1.2.3.4", 7, &address, &prefix_length) == 0);
+    CHECK(address == ADDRESS(1, 2, 3, 4) && prefix_length == 32);
+    CHECK(ban_filter_parse_entry("10.0.0.0/8", 10, &address, &prefix_length) == 0);
+    CHECK(address == ADDRESS(10, 0, 0, 0) && prefix_length == 8);
+    // the length bounds the entry, the rest of a list is not part of it
+    CHECK(ban_filter_parse_entry("1.2.3.4,5.6.7.8", 7, &address, &prefix_length) == 0);
+
+    CHECK(ban_filter_parse_entry("1.2.3.4/33", 10, &address, &prefix_length) != 0);
+    CHECK(ban_filter_parse_entry("1.2.3/8", 7, &address, &prefix_length) != 0);
+    CHECK(ban_filter_parse_entry("1.2.3.4/", 8, &address, &prefix_length) != 0);
+    CHECK(ban_filter_parse_entry("", 0, &address, &prefix_length) != 0);
+    CHECK(ban_filter_parse_entry("255.255.255.255/32x", 19, &address, &prefix_length) != 0);
+}
+
+static void test_list_round_trip(void)
+{
+    error_list_t error;
+    init_error(&error);
+    ban_filter_t filter;
+    ban_filter_t copy;
+    CHECK(ban_filter_init(&filter, &error) == 0);
+    CHECK(ban_filter_init(&copy, &error) == 0);
+
+    CHECK(ban_filter_add_list(&filter, "10.9.0.0/16,192.168.1.7", &error) == 0);
+
+    // a malformed entry stops the list, the ones before it stay
+    CHECK(ban_filter_add_list(&filter, "1.1.1.1,bad,2.2.2.2", &error) != 0);
+    CHECK(ban_filter_contains(&filter, ADDRESS(1, 1, 1, 1)));
+    CHECK(!ban_filter_contains(&filter, ADDRESS(2, 2, 2, 2)));
+
+    char *list = ban_filter_format_list(&filter);
+    CHECK(list != NULL);
+    if (list != NULL)
+    {
+        CHECK(ban_filter_add_list(&copy, list, &error) == 0);
+        free(list);
+    }
+
+    CHECK(copy.count == 3);
+    CHECK(ban_filter_contains(&copy, ADDRESS(10, 9, 1, 1)));
+    CHECK(ban_filter_contains(&copy, ADDRESS(192, 168, 1, 7)));
+    CHECK(ban_filter_contains(&copy, ADDRESS(1, 1, 1, 1)));
+
+    ban_filter_destroy(&filter);
+    ban_filter_destroy(&copy);
+}
+
+int main(void)
+{
+    test_empty_filter();
+    test_networks();
+    test_many_addresses();
+    test_parse_entry();
+    test_list_round_trip();
+
+    return test_report("ban_filter");
+}
\ No newline at end of file
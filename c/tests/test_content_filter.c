@@ -0,0 +1,189 @@
+#include "../include/content_filter.h"
+#include "../include/logger.h"
+#include "test.h"
+
+static unsigned int apply(content_filter_t *filter, const char *message, char *text)
+{
+    snprintf(text, MESSAGE_BUFFER_SIZE, "%s", message);
+    return content_filter_apply(filter, text);
+}
+
+static void test_empty_filter(void)
+{
+    content_filter_t filter;
+    content_filter_init(&filter);
+    char text[MESSAGE_BUFFER_SIZE];
+
+    CHECK(apply(&filter, "anything at all", text) == 0);
+    CHECK(strcmp(text, "anything at all") == 0);
+    CHECK(content_filter_format_rules(&filter) == NULL);
+
+    content_filter_destroy(&filter);
+}
+
+static void test_actions(void)
+{
+    error_list_t error;
+    init_error(&error);
+    content_filter_t filter;
+    content_filter_init(&filter);
+    char text[MESSAGE_BUFFER_SIZE];
+
+    CHECK(content_filter_load(&filter, "# comment\r\nflag spam\r\n\r\nmask darn\nblock forbidden", &error) == 0);
+
+    CHECK(apply(&filter, "nothing here", text) == 0);
+    CHECK(apply(&filter, "this is SPAM", text) == CONTENT_ACTION_FLAG);
+    CHECK(strcmp(text, "this is SPAM") == 0);
+
+    // anywhere in a word, ASCII letters in any case
+    CHECK(apply(&filter, "Darn it, DARNED", text) == CONTENT_ACTION_MASK);
+    CHECK(strcmp(text, "**** it, ****ED") == 0);
+
+    // a blocked message isn't masked, it isn't sent at all
+    CHECK(apply(&filter, "darn forbidden spam", text) == (CONTENT_ACTION_MASK | CONTENT_ACTION_BLOCK | CONTENT_ACTION_FLAG));
+    CHECK(strcmp(text, "darn forbidden spam") == 0);
+
+    content_filter_destroy(&filter);
+}
+
+static void test_overlapping_patterns(void)
+{
+    error_list_t error;
+    init_error(&error);
+    content_filter_t filter;
+    content_filter_init(&filter);
+    char text[MESSAGE_BUFFER_SIZE];
+
+    // the textbook set, "ushers" holds "she", "he" and "hers", the last two only reachable through failure links
+    CHECK(content_filter_load(&filter, "mask he\nmask she\nflag his\nmask hers", &error) == 0);
+    CHECK(apply(&filter, "ushers", text) == CONTENT_ACTION_MASK);
+    CHECK(strcmp(text, "u*****") == 0);
+    CHECK(apply(&filter, "this", text) == CONTENT_ACTION_FLAG);
+
+    // a pattern ending inside a longer one is found through the output links
+    CHECK(content_filter_load(&filter, "flag abcd\nmask bc", &error) == 0);
+    CHECK(apply(&filter, "xabcy", text) == CONTENT_ACTION_MASK);
+    CHECK(strcmp(text, "xa**y") == 0);
+    CHECK(apply(&filter, "abcd", text) == (CONTENT_ACTION_FLAG | CONTENT_ACTION_MASK));
+
+    content_filter_destroy(&filter);
+}
+
+static void test_multibyte_patterns(void)
+{
+    error_list_t error;
+    init_error(&error);
+    content_filter_t filter;
+    content_filter_init(&filter);
+    char text[MESSAGE_BUFFER_SIZE];
+
+    // every masked character becomes one mask character, however many bytes it takes
+    CHECK(content_filter_load(&filter, "mask caf\xC3\xA9\nmask \xF0\x9F\x98\x80", &error) == 0);
+    CHECK(apply(&filter, "un CAF\xC3\xA9 \xF0\x9F\x98\x80!", text) == CONTENT_ACTION_MASK);
+    CHECK(strcmp(text, "un **** *!") == 0);
+
+    content_filter_destroy(&filter);
+}
+
+static void test_reloading(void)
+{
+    error_list_t error;
+    init_error(&error);
+    content_filter_t filter;
+    content_filter_init(&filter);
+    char text[MESSAGE_BUFFER_SIZE];
+
+    CHECK(content_filter_load(&filter, "block bad", &error) == 0);
+
+    // a malformed list leaves the current one in place
+    CHECK(content_filter_load(&filter, "block worse\nignore this", &error) != 0);
+    CHECK(error.count == 1 && error.errors[0].code == ERR_FILTER_RULE_INVALID);
+    CHECK(apply(&filter, "bad", text) == CONTENT_ACTION_BLOCK);
+    CHECK(apply(&filter, "worse", text) == 0);
+
+    init_error(&error);
+    CHECK(content_filter_load(&filter, "block \xC3", &error) != 0);
+    CHECK(content_filter_load(&filter, "block ", &error) != 0);
+
+    char *rules = content_filter_format_rules(&filter);
+    CHECK(rules != NULL && strcmp(rules, "block bad") == 0);
+    free(rules);
+
+    // an empty list turns the filter off
+    CHECK(content_filter_load(&filter, "", &error) == 0);
+    CHECK(apply(&filter, "bad", text) == 0);
+    CHECK(content_filter_format_rules(&filter) == NULL);
+
+    content_filter_destroy(&filter);
+}
+
+static void test_random_text(void)
+{
+    // short patterns over a small alphabet match often and overlap a lot, the automaton has to find
+    // exactly what searching for each pattern on its own finds
+    error_list_t error;
+    init_error(&error);
+    content_filter_t filter;
+    content_filter_init(&filter);
+    char text[MESSAGE_BUFFER_SIZE];
+    char message[128];
+    srand(11);
+
+    for (int run = 0; run < 200; run++)
+    {
+        char rules[512];
+        char patterns[16][8];
+        unsigned int pattern_actions[16];
+        size_t rules_length = 0;
+        int pattern_count = 1 + rand() % 16;
+        for (int p = 0; p < pattern_count; p++)
+        {
+            int length = 1 + rand() % 4;
+            for (int k = 0; k < length; k++)
+            {
+                patterns[p][k] = (char)('a' + rand() % 3);
+            }
+            patterns[p][length] = '\0';
+            pattern_actions[p] = rand() % 2 == 0 ? CONTENT_ACTION_FLAG : CONTENT_ACTION_BLOCK;
+            rules_length += (size_t)snprintf(rules + rules_length, sizeof(rules) - rules_length, "%s %s\n", pattern_actions[p] == CONTENT_ACTION_FLAG ? "flag" : "block", patterns[p]);
+        }
+        CHECK(content_filter_load(&filter, rules, &error) == 0);
+
+        for (int m = 0; m < 50; m++)
+        {
+            int length = rand() % 40;
+            for (int k = 0; k < length; k++)
+            {
+                message[k] = (char)('a' + rand() % 4);
+            }
+            message[length] = '\0';
+
+            unsigned int expected = 0;
+            for (int p = 0; p < pattern_count; p++)
+            {
+                if (strstr(message, patterns[p]) != NULL)
+                {
+                    expected |= pattern_actions[p];
+                }
+            }
+            CHECK(apply(&filter, message, text) == expected);
+        }
+    }
+
+    content_filter_destroy(&filter);
+}
+
+int main(void)
+{
+    // every load logs its automaton's size
+    logger_set_level(LOG_LEVEL_WARNING);
+
+    test_empty_filter();
+    test_actions();
+    test_overlapping_patterns();
+    test_multibyte_patterns();
+    test_reloading();
+    test_random_text();
+
+    return test_report("content_filter");
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "../include/common.h"
+#include "test.h"
+
+static void test_varint_round_trip(void)
+{
+    const uint32_t member_ids[] = {1, 127, 128, 16383, 16384, 2097151, 2097152, 268435455, 268435456, 0xFFFFFFFFu};
+    const size_t expected_lengths[] = {1, 1, 2, 2, 3, 3, 4, 4, 5, 5};
+
+    for (size_t i = 0; i < sizeof(member_ids) / sizeof(member_ids[0]); i++)
+    {
+        char varint[MEMBER_ID_VARINT_MAX_SIZE + 1];
+        memset(varint, 0x7F, sizeof(varint));
+
+        size_t length = encode_member_id(member_ids[i], varint);
+        CHECK(length == expected_lengths[i]);
+
+        // no byte of a varint can be taken for the frame delimiter
+        for (size_t j = 0; j < length; j++)
+        {
+            CHECK(varint[j] != FRAME_DELIMITER);
+        }
+
+        uint32_t decoded = 0;
+        CHECK(decode_member_id(varint, &decoded) == length);
+        CHECK(decoded == member_ids[i]);
+    }
+}
+
+static void test_varint_rejects_invalid_input(void)
+{
+    uint32_t member_id;
+
+    // ID 0 is never handed out, its varint would be the delimiter
+    CHECK(decode_member_id("\0", &member_id) == 0);
+    // more continuation bytes than a 32 bit ID needs
+    CHECK(decode_member_id("\x80\x80\x80\x80\x80\x01", &member_id) == 0);
+}
+
+static void test_member_message_frame(void)
+{
+    member_table_t members;
+    CHECK(member_table_init(&members) == 0);
+    CHECK(member_table_set(&members, 300, "alice") == 0);
+
+    char frame[MAX_BUFFER_SIZE];
+    size_t frame_length = format_member_message_frame(frame, sizeof(frame), "hello", 300);
+
+    // the type, ':', two varint bytes, the message and the delimiter
+    char prefix[8];
+    size_t prefix_length = (size_t)snprintf(prefix, sizeof(prefix), "%d:", MSG_TYPE_MEMBER_MESSAGE);
+    CHECK(frame_length == prefix_length + 2 + strlen("hello") + 1);
+    CHECK(frame[frame_length - 1] == FRAME_DELIMITER);
+
+    char username[USERNAME_BUFFER_SIZE];
+    char message[MESSAGE_BUFFER_SIZE];
+    CHECK(parse_message_frame(frame, &members, username, sizeof(username), message, sizeof(message)) == 0);
+    CHECK(strcmp(username, "alice") == 0);
+    CHECK(strcmp(message, "hello") == 0);
+
+    // a sender the receiver has no name for is still shown, by ID
+    frame_length = format_member_message_frame(frame, sizeof(frame), "hi", 301);
+    CHECK(parse_message_frame(frame, &members, username, sizeof(username), message, sizeof(message)) == 0);
+    CHECK(strcmp(username, "#301") == 0);
+
+    member_table_destroy(&members);
+}
+
+static void ignore_presence(presence_op_t presence_op, const char *username, const char *new_username)
+{
+    (void)presence_op;
+    (void)username;
+    (void)new_username;
+}
+
+static void test_presence_binds_member_ids(void)
+{
+    member_table_t members;
+    CHECK(member_table_init(&members) == 0);
+
+    char frame[MAX_BUFFER_SIZE];
+    snprintf(frame, sizeof(frame), "%d:*:#1:+admin:#2:+alice", MSG_TYPE_PRESENCE);
+    handle_presence_frame(frame, &members, ignore_presence);
+    CHECK(member_table_find(&members, 1) != NULL && strcmp(member_table_find(&members, 1), "admin") == 0);
+    CHECK(member_table_find(&members, 2) != NULL && strcmp(member_table_find(&members, 2), "alice") == 0);
+
+    snprintf(frame, sizeof(frame), "%d:~alice:#2:=alicia", MSG_TYPE_PRESENCE);
+    handle_presence_frame(frame, &members, ignore_presence);
+    CHECK(member_table_find(&members, 2) != NULL && strcmp(member_table_find(&members, 2), "alicia") == 0);
+
+    // a message can still be in a lane the leave overtook, the name stays until the table is rebuilt
+    snprintf(frame, sizeof(frame), "%d:#2:-alicia", MSG_TYPE_PRESENCE);
+    handle_presence_frame(frame, &members, ignore_presence);
+    CHECK(member_table_find(&members, 2) != NULL);
+
+    // a snapshot starts the table over
+    snprintf(frame, sizeof(frame), "%d:*:#1:+admin", MSG_TYPE_PRESENCE);
+    handle_presence_frame(frame, &members, ignore_presence);
+    CHECK(member_table_find(&members, 2) == NULL);
+    CHECK(member_table_find(&members, 1) != NULL);
+
+    member_table_destroy(&members);
+}
+
+static void test_member_table_growth(void)
+{
+    member_table_t members;
+    CHECK(member_table_init(&members) == 0);
+
+    char username[USERNAME_BUFFER_SIZE];
+    for (uint32_t member_id = 1; member_id <= 1000; member_id++)
+    {
+        snprintf(username, sizeof(username), "member%u", (unsigned int)member_id);
+        CHECK(member_table_set(&members, member_id, username) == 0);
+        // half of them leave again, the rebuilds drop them
+        if (member_id % 2 == 0)
+        {
+            member_table_depart(&members, member_id);
+        }
+    }
+
+    CHECK(member_table_find(&members, 999) != NULL && strcmp(member_table_find(&members, 999), "member999") == 0);
+    CHECK(member_table_find(&members, 1) != NULL && strcmp(member_table_find(&members, 1), "member1") == 0);
+    CHECK(member_table_find(&members, 2) == NULL);
+    CHECK(member_table_find(&members, 1001) == NULL);
+    CHECK(member_table_set(&members, 0, "nobody") != 0);
+
+    member_table_destroy(&members);
+}
+
+int main(void)
+{
+    test_varint_round_trip();
+    test_varint_rejects_invalid_input();
+    test_member_message_frame();
+    test_presence_binds_member_ids();
+    test_member_table_growth();
+
+    return test_report("member_id");
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "../include/presence.h"
+#include "test.h"
+
+#define MAX_CAPTURED_FRAMES 16
+
+static char captured_frames[MAX_CAPTURED_FRAMES][MAX_BUFFER_SIZE];
+static size_t captured_count = 0;
+
+static void capture_frame(const char *frame, size_t frame_length)
+{
+    // every frame goes out with its delimiter
+    CHECK(frame_length > 0 && frame[frame_length - 1] == '\0');
+    if (captured_count < MAX_CAPTURED_FRAMES)
+    {
+        memcpy(captured_frames[captured_count++], frame, frame_length);
+    }
+}
+
+// flushes what was recorded so far and checks it came out as the one expected frame, or none for NULL
+static void check_flush(const char *expected_entries)
+{
+    captured_count = 0;
+    presence_flush();
+
+    if (expected_entries == NULL)
+    {
+        CHECK(captured_count == 0);
+        return;
+    }
+
+    char expected_frame[MAX_BUFFER_SIZE];
+    snprintf(expected_frame, sizeof(expected_frame), "%d%s", MSG_TYPE_PRESENCE, expected_entries);
+
+    CHECK(captured_count == 1);
+    if (captured_count == 1 && strcmp(captured_frames[0], expected_frame) != 0)
+    {
+        printf("expected \"%s\", got \"%s\"\n", expected_frame, captured_frames[0]);
+        test_failures++;
+    }
+}
+
+static void test_joins_are_batched(void)
+{
+    presence_record_join("alice", 1);
+    presence_record_join("bob", 2);
+    check_flush(":#1:+alice:#2:+bob");
+
+    // nothing happened since
+    check_flush(NULL);
+}
+
+static void test_join_and_leave_cancel_out(void)
+{
+    presence_record_join("carol", 3);
+    presence_record_leave("carol", 3);
+    check_flush(NULL);
+}
+
+static void test_rename_is_one_entry_pair(void)
+{
+    presence_record_rename("bob", "robert", 2);
+    check_flush(":~bob:#2:=robert");
+
+    // renamed and back within the window, the list is what it was
+    presence_record_rename("robert", "bobby", 2);
+    presence_record_rename("bobby", "robert", 2);
+    check_flush(NULL);
+}
+
+static void test_rejoin_sends_the_new_id(void)
+{
+    presence_record_leave("alice", 1);
+    presence_record_join("alice", 4);
+    check_flush(":#4:@alice");
+
+    presence_record_leave("alice", 4);
+    presence_record_leave("robert", 2);
+    check_flush(":#4:-alice:#2:-robert");
+}
+
+static void test_long_batch_is_split(void)
+{
+    char username[USERNAME_BUFFER_SIZE];
+    for (uint32_t i = 0; i < 400; i++)
+    {
+        snprintf(username, sizeof(username), "member_with_a_long_name_%u", (unsigned int)i);
+        presence_record_join(username, 100 + i);
+    }
+
+    captured_count = 0;
+    presence_flush();
+
+    // every join arrives once, in order, spread over frames that each fit a buffer
+    CHECK(captured_count > 1);
+    uint32_t next_member = 0;
+    for (size_t i = 0; i < captured_count; i++)
+    {
+        char *entry = strchr(captured_frames[i], ':');
+        while (entry != NULL)
+        {
+            char expected_entry[64];
+            snprintf(expected_entry, sizeof(expected_entry), ":#%u:+member_with_a_long_name_%u", (unsigned int)(100 + next_member), (unsigned int)next_member);
+            CHECK(strncmp(entry, expected_entry, strlen(expected_entry)) == 0);
+            next_member++;
+
+            // past the ID entry and its name entry
+            entry = strchr(entry + 1, ':');
+            entry = entry != NULL ? strchr(entry + 1, ':') : NULL;
+        }
+    }
+    CHECK(next_member == 400);
+}
+
+int main(void)
+{
+    error_list_t error;
+    init_error(&error);
+    if (presence_start(capture_frame, &error) != 0)
+    {
+        printf("presence_start failed\n");
+        return 1;
+    }
+
+    test_joins_are_batched();
+    test_join_and_leave_cancel_out();
+    test_rename_is_one_entry_pair();
+    test_rejoin_sends_the_new_id();
+    test_long_batch_is_split();
+
+    presence_stop();
+
+    return test_report("presence");
+}
\ No newline at end of file
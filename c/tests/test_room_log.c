@@ -0,0 +1,125 @@
+#include "../include/room_log.h"
+#include "test.h"
+
+static void append_frame(room_log_t *log, const char *frame)
+{
+    error_list_t error;
+    init_error(&error);
+    CHECK(room_log_append(log, frame, strlen(frame) + 1, &error) == 0);
+}
+
+static void test_append_and_get(void)
+{
+    error_list_t error;
+    init_error(&error);
+    room_log_t log;
+    CHECK(room_log_init(&log, 4, &error) == 0);
+
+    CHECK(room_log_head(&log) == 0);
+    CHECK(room_log_tail(&log) == 0);
+
+    append_frame(&log, "2:alice:hello");
+    append_frame(&log, "2:bob:hi");
+    CHECK(room_log_head(&log) == 2);
+
+    room_log_read_lock(&log);
+    const room_log_entry_t *entry = room_log_get(&log, 1);
+    CHECK(entry != NULL && entry->sequence == 1);
+    CHECK(entry != NULL && entry->length == strlen("2:bob:hi") + 1);
+    CHECK(entry != NULL && strcmp(entry->data, "2:bob:hi") == 0);
+    // the head is the sequence the next frame gets, nothing is there yet
+    CHECK(room_log_get(&log, 2) == NULL);
+    room_log_read_unlock(&log);
+
+    room_log_destroy(&log);
+}
+
+static void test_cursor_falls_behind(void)
+{
+    error_list_t error;
+    init_error(&error);
+    room_log_t log;
+    CHECK(room_log_init(&log, 4, &error) == 0);
+
+    char frame[32];
+    for (int i = 0; i < 6; i++)
+    {
+        snprintf(frame, sizeof(frame), "2:alice:%d", i);
+        append_frame(&log, frame);
+    }
+
+    // the first two frames were overwritten, a cursor still on them has to skip to the tail
+    CHECK(room_log_head(&log) == 6);
+    CHECK(room_log_tail(&log) == 2);
+
+    room_log_read_lock(&log);
+    CHECK(room_log_get(&log, 0) == NULL);
+    CHECK(room_log_get(&log, 1) == NULL);
+
+    uint64_t cursor = 0;
+    if (cursor < room_log_tail(&log))
+    {
+        cursor = room_log_tail(&log);
+    }
+
+    int expected = 2;
+    for (; cursor < room_log_head(&log); cursor++)
+    {
+        const room_log_entry_t *entry = room_log_get(&log, cursor);
+        snprintf(frame, sizeof(frame), "2:alice:%d", expected++);
+        CHECK(entry != NULL && entry->sequence == cursor && strcmp(entry->data, frame) == 0);
+    }
+    CHECK(expected == 6);
+    room_log_read_unlock(&log);
+
+    room_log_destroy(&log);
+}
+
+static void test_frame_length_limits(void)
+{
+    error_list_t error;
+    init_error(&error);
+    room_log_t log;
+    CHECK(room_log_init(&log, 4, &error) == 0);
+
+    char *frame = (char *)malloc(MAX_BUFFER_SIZE + 1);
+    CHECK(frame != NULL);
+    if (frame == NULL)
+    {
+        room_log_destroy(&log);
+        return;
+    }
+    memset(frame, 'a', MAX_BUFFER_SIZE + 1);
+
+    // nothing to deliver, nothing is logged
+    CHECK(room_log_append(&log, frame, 0, &error) == 0);
+    CHECK(room_log_head(&log) == 0);
+
+    // a frame that fills an entry exactly keeps its last byte, the delimiter
+    frame[MAX_BUFFER_SIZE - 1] = '\0';
+    CHECK(room_log_append(&log, frame, MAX_BUFFER_SIZE, &error) == 0);
+    CHECK(error.count == 0);
+    room_log_read_lock(&log);
+    const room_log_entry_t *entry = room_log_get(&log, 0);
+    CHECK(entry != NULL && entry->length == MAX_BUFFER_SIZE && entry->data[MAX_BUFFER_SIZE - 1] == '\0');
+    room_log_read_unlock(&log);
+
+    // one byte more is refused rather than cut
+    frame[MAX_BUFFER_SIZE - 1] = 'a';
+    frame[MAX_BUFFER_SIZE] = '\0';
+    CHECK(room_log_append(&log, frame, MAX_BUFFER_SIZE + 1, &error) != 0);
+    CHECK(error.count == 1 && error.errors[0].code == ERR_FRAME_TOO_LONG);
+    CHECK(room_log_head(&log) == 1);
+
+    free(frame);
+    room_log_destroy(&log);
+}
+
+int main(void)
+{
+    test_append_and_get();
+    test_cursor_falls_behind();
+    test_frame_length_limits();
+
+    return test_report("room_log");
+}
\ No newline at end of file
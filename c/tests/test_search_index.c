@@ -0,0 +1,161 @@
+#include "../include/search_index.h"
+#include "test.h"
+
+// the indexer runs on its own thread, a submitted message takes a moment to become searchable
+#define INDEX_WAIT_MS 10000
+
+typedef struct
+{
+    size_t count;
+    char last_message[MESSAGE_BUFFER_SIZE];
+    uint64_t last_timestamp;
+} hits_t;
+
+static void collect_hit(uint64_t timestamp, const char *sender_username, const char *message, void *context)
+{
+    (void)sender_username;
+    hits_t *hits = (hits_t *)context;
+    hits->count++;
+    hits->last_timestamp = timestamp;
+    snprintf(hits->last_message, sizeof(hits->last_message), "%s", message);
+}
+
+static size_t count_hits(const char *query, uint64_t since, uint64_t until, size_t max_hits, hits_t *hits)
+{
+    memset(hits, 0, sizeof(*hits));
+    size_t count = search_index_query(query, since, until, max_hits, collect_hit, hits);
+    CHECK(count == hits->count);
+    return count;
+}
+
+static void submit(const char *sender_username, const char *message)
+{
+    char encoded_message[ENCODED_MESSAGE_BUFFER_SIZE];
+    encode_message(message, encoded_message, sizeof(encoded_message));
+    search_index_submit(sender_username, encoded_message);
+}
+
+static int wait_until_indexed(const char *query)
+{
+    hits_t hits;
+    for (int waited = 0; waited < INDEX_WAIT_MS; waited += 10)
+    {
+        if (count_hits(query, 0, 0, 1, &hits) > 0)
+        {
+            return 1;
+        }
+        cross_platform_sleep_ms(10);
+    }
+    return 0;
+}
+
+static void test_queries(void)
+{
+    submit("alice", "Hello World: the quick brown fox");
+    submit("bob", "a quick reply");
+    submit("alice", "brown quick fox again");
+    submit("carol", "done");
+    CHECK(wait_until_indexed("done"));
+
+    hits_t hits;
+
+    // every term has to occur, in any case
+    CHECK(count_hits("quick", 0, 0, SEARCH_MAX_RESULTS, &hits) == 3);
+    CHECK(count_hits("QUICK fox", 0, 0, SEARCH_MAX_RESULTS, &hits) == 2);
+    CHECK(count_hits("quick missing", 0, 0, SEARCH_MAX_RESULTS, &hits) == 0);
+
+    // newest first, so the oldest hit is the last one reported
+    CHECK(count_hits("fox", 0, 0, SEARCH_MAX_RESULTS, &hits) == 2);
+    CHECK(strcmp(hits.last_message, "Hello World: the quick brown fox") == 0);
+
+    // a phrase has to occur in that order
+    CHECK(count_hits("\"quick brown\"", 0, 0, SEARCH_MAX_RESULTS, &hits) == 1);
+    CHECK(strcmp(hits.last_message, "Hello World: the quick brown fox") == 0);
+    CHECK(count_hits("\"brown quick\"", 0, 0, SEARCH_MAX_RESULTS, &hits) == 1);
+    CHECK(count_hits("\"fox brown\"", 0, 0, SEARCH_MAX_RESULTS, &hits) == 0);
+
+    CHECK(count_hits("quick", 0, 0, 1, &hits) == 1);
+    CHECK(count_hits("", 0, 0, SEARCH_MAX_RESULTS, &hits) == 0);
+
+    // the messages were all sent just now
+    uint64_t now = (uint64_t)time(NULL);
+    CHECK(count_hits("quick", now - 60, 0, SEARCH_MAX_RESULTS, &hits) == 3);
+    CHECK(count_hits("quick", now + 60, 0, SEARCH_MAX_RESULTS, &hits) == 0);
+    CHECK(count_hits("quick", 0, now - 60, SEARCH_MAX_RESULTS, &hits) == 0);
+}
+
+static void test_long_posting_list(void)
+{
+    // several posting blocks, a term in every other message
+    char message[64];
+    for (int i = 0; i < SEARCH_POSTING_BLOCK_SIZE * 5; i++)
+    {
+        snprintf(message, sizeof(message), "bulk%d %s", i, i % 2 == 0 ? "even" : "odd");
+        submit("dave", message);
+    }
+    snprintf(message, sizeof(message), "bulk%d", SEARCH_POSTING_BLOCK_SIZE * 5 - 1);
+    CHECK(wait_until_indexed(message));
+
+    hits_t hits;
+    CHECK(count_hits("even", 0, 0, SIZE_MAX, &hits) == SEARCH_POSTING_BLOCK_SIZE * 5 / 2);
+    CHECK(strcmp(hits.last_message, "bulk0 even") == 0);
+    CHECK(count_hits("odd bulk1", 0, 0, SIZE_MAX, &hits) == 1);
+    CHECK(count_hits("even bulk1", 0, 0, SIZE_MAX, &hits) == 0);
+}
+
+static void test_eviction(void)
+{
+    // the first message of the run, everything before it is already in the index
+    submit("erin", "evictfirst");
+    CHECK(wait_until_indexed("evictfirst"));
+
+    // past SEARCH_INDEX_MAX_DOCUMENTS the oldest 1/SEARCH_INDEX_EVICT_DIVISOR goes, the submissions are paced
+    // so the indexer's queue never drops one
+    char message[64];
+    for (uint32_t i = 0; i < SEARCH_INDEX_MAX_DOCUMENTS; i++)
+    {
+        snprintf(message, sizeof(message), "evict%u filler", (unsigned int)i);
+        submit("erin", message);
+        if ((i + 1) % (SEARCH_INDEX_MAX_PENDING / 2) == 0)
+        {
+            CHECK(wait_until_indexed(message));
+        }
+    }
+    submit("erin", "evictlast");
+    CHECK(wait_until_indexed("evictlast"));
+
+    hits_t hits;
+    CHECK(count_hits("evictfirst", 0, 0, SEARCH_MAX_RESULTS, &hits) == 0);
+    CHECK(count_hits("evict0", 0, 0, SEARCH_MAX_RESULTS, &hits) == 0);
+    CHECK(count_hits("quick", 0, 0, SEARCH_MAX_RESULTS, &hits) == 0);
+
+    // SEARCH_INDEX_MAX_BYTES may have cut earlier than the document limit, the newest messages are kept either way
+    // and are still found after being renumbered
+    size_t fillers = count_hits("filler", 0, 0, SIZE_MAX, &hits);
+    CHECK(fillers > 0 && fillers < SEARCH_INDEX_MAX_DOCUMENTS);
+    CHECK(strcmp(hits.last_message, "evict0 filler") != 0);
+    for (uint32_t i = SEARCH_INDEX_MAX_DOCUMENTS - 1000; i < SEARCH_INDEX_MAX_DOCUMENTS; i++)
+    {
+        snprintf(message, sizeof(message), "evict%u", (unsigned int)i);
+        CHECK(count_hits(message, 0, 0, SEARCH_MAX_RESULTS, &hits) == 1);
+    }
+}
+
+int main(void)
+{
+    error_list_t error;
+    init_error(&error);
+    if (search_index_start(&error) != 0)
+    {
+        printf("search_index_start failed\n");
+        return 1;
+    }
+
+    test_queries();
+    test_long_posting_list();
+    test_eviction();
+
+    search_index_stop();
+
+    return test_report("search_index");
+}
\ No newline at end of file
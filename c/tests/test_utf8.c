@@ -0,0 +1,199 @@
+#include "../include/utf8.h"
+#include "test.h"
+
+// RFC 3629 one byte at a time, what utf8_validate has to agree with on every input
+static int reference_validate(const unsigned char *data, size_t length, size_t *code_points)
+{
+    size_t count = 0;
+    size_t i = 0;
+    while (i < length)
+    {
+        unsigned char c = data[i];
+        size_t sequence_length;
+        uint32_t code_point;
+        if (c < 0x80)
+        {
+            sequence_length = 1;
+            code_point = c;
+        }
+        else if (c >= 0xC2 && c <= 0xDF)
+        {
+            sequence_length = 2;
+            code_point = c & 0x1F;
+        }
+        else if (c >= 0xE0 && c <= 0xEF)
+        {
+            sequence_length = 3;
+            code_point = c & 0x0F;
+        }
+        else if (c >= 0xF0 && c <= 0xF4)
+        {
+            sequence_length = 4;
+            code_point = c & 0x07;
+        }
+        else
+        {
+            return 1;
+        }
+
+        if (i + sequence_length > length)
+        {
+            return 1;
+        }
+        for (size_t k = 1; k < sequence_length; k++)
+        {
+            if ((data[i + k] & 0xC0) != 0x80)
+            {
+                return 1;
+            }
+            code_point = (code_point << 6) | (data[i + k] & 0x3F);
+        }
+
+        if ((sequence_length == 3 && code_point < 0x800) || (sequence_length == 4 && code_point < 0x10000) ||
+            (code_point >= 0xD800 && code_point <= 0xDFFF) || code_point > 0x10FFFF)
+        {
+            return 1;
+        }
+
+        i += sequence_length;
+        count++;
+    }
+
+    *code_points = count;
+    return 0;
+}
+
+static int validate(const char *text, size_t *code_points)
+{
+    return utf8_validate(text, strlen(text), code_points);
+}
+
+static void test_valid_text(void)
+{
+    size_t code_points;
+
+    CHECK(validate("", &code_points) == 0 && code_points == 0);
+    CHECK(validate("hello", &code_points) == 0 && code_points == 5);
+    // 2, 3 and 4 byte characters, and the highest ones allowed
+    CHECK(validate("caf\xC3\xA9", &code_points) == 0 && code_points == 4);
+    CHECK(validate("\xE2\x82\xAC 5", &code_points) == 0 && code_points == 3);
+    CHECK(validate("\xF0\x9F\x98\x80", &code_points) == 0 && code_points == 1);
+    CHECK(validate("\xED\x9F\xBF\xEE\x80\x80\xF4\x8F\xBF\xBF", &code_points) == 0 && code_points == 3);
+}
+
+static void test_malformed_text(void)
+{
+    size_t code_points;
+
+    // overlong forms
+    CHECK(validate("\xC0\x80", &code_points) != 0);
+    CHECK(validate("\xC1\xBF", &code_points) != 0);
+    CHECK(validate("\xE0\x9F\xBF", &code_points) != 0);
+    CHECK(validate("\xF0\x8F\xBF\xBF", &code_points) != 0);
+    // surrogates and past U+10FFFF
+    CHECK(validate("\xED\xA0\x80", &code_points) != 0);
+    CHECK(validate("\xED\xBF\xBF", &code_points) != 0);
+    CHECK(validate("\xF4\x90\x80\x80", &code_points) != 0);
+    CHECK(validate("\xF5\x80\x80\x80", &code_points) != 0);
+    // a stray continuation byte, a cut sequence and a byte that never occurs
+    CHECK(validate("a\x80", &code_points) != 0);
+    CHECK(validate("\xE2\x82", &code_points) != 0);
+    CHECK(validate("\xE2\x82" "a", &code_points) != 0);
+    CHECK(validate("\xFF", &code_points) != 0);
+}
+
+static void test_long_text(void)
+{
+    // the vector path takes 16 bytes at a time, a bad byte at every offset, a character split across every boundary
+    char text[128];
+    size_t code_points;
+
+    for (size_t offset = 0; offset < 64; offset++)
+    {
+        memset(text, 'a', 80);
+        text[80] = '\0';
+        text[offset] = (char)0x80;
+        CHECK(validate(text, &code_points) != 0);
+
+        memset(text, 'a', 80);
+        memcpy(text + offset, "\xF0\x9F\x98\x80", 4);
+        CHECK(validate(text, &code_points) == 0 && code_points == 77);
+
+        // the same character with its last byte missing
+        memset(text, 'a', 80);
+        memcpy(text + offset, "\xF0\x9F\x98", 3);
+        CHECK(validate(text, &code_points) != 0);
+    }
+}
+
+static void test_random_text(void)
+{
+    // valid characters and random bytes mixed, utf8_validate has to agree with the reference on all of them
+    static const char *const pieces[] = {"a", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\xED\x9F\xBF", "\xF4\x8F\xBF\xBF", "\xEF\xBF\xBF"};
+    unsigned char data[200];
+    srand(7);
+
+    for (int run = 0; run < 200000; run++)
+    {
+        size_t length = 0;
+        while (length < 150)
+        {
+            const char *piece = pieces[rand() % 7];
+            memcpy(data + length, piece, strlen(piece));
+            length += strlen(piece);
+        }
+        length = (size_t)rand() % length;
+        if (run % 2 == 0 && length > 0)
+        {
+            data[rand() % length] = (unsigned char)rand();
+        }
+
+        size_t expected = 0;
+        size_t code_points = 0;
+        int expected_result = reference_validate(data, length, &expected);
+        int result = utf8_validate((const char *)data, length, &code_points);
+        CHECK((result != 0) == (expected_result != 0));
+        CHECK(result != 0 || code_points == expected);
+    }
+}
+
+static void test_check_text(void)
+{
+    CHECK(utf8_check_text("caf\xC3\xA9", 4) == UTF8_VALID);
+    CHECK(utf8_check_text("caf\xC3\xA9", 3) == UTF8_TOO_LONG);
+    CHECK(utf8_check_text("caf\xC3", 4) == UTF8_MALFORMED);
+}
+
+static void test_utf16_conversion(void)
+{
+    uint16_t units[64];
+    char text[64 * 3 + 1];
+
+    // a character past U+FFFF is a surrogate pair in UTF-16
+    size_t unit_count = utf8_to_utf16("a\xF0\x9F\x98\x80" "b", units);
+    CHECK(unit_count == 4);
+    CHECK(units[0] == 'a' && units[1] == 0xD83D && units[2] == 0xDE00 && units[3] == 'b');
+
+    CHECK(utf16_to_utf8(units, unit_count, text) == 6);
+    CHECK(strcmp(text, "a\xF0\x9F\x98\x80" "b") == 0);
+
+    // malformed input turns into U+FFFD both ways
+    unit_count = utf8_to_utf16("x\xFFy", units);
+    CHECK(unit_count == 3 && units[1] == UTF8_REPLACEMENT_CHARACTER);
+
+    const uint16_t lone_surrogate[] = {'x', 0xD83D, 'y'};
+    utf16_to_utf8(lone_surrogate, 3, text);
+    CHECK(strcmp(text, "x\xEF\xBF\xBDy") == 0);
+}
+
+int main(void)
+{
+    test_valid_text();
+    test_malformed_text();
+    test_long_text();
+    test_random_text();
+    test_check_text();
+    test_utf16_conversion();
+
+    return test_report("utf8");
+}
\ No newline at end of file
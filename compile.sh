@@ -1,5 +1,5 @@
 JAVA_HOME="C:/Program Files/Java/jdk-21"
-C_SOURCE_FILES="c/src/bridge.c c/src/server.c c/src/client.c c/src/errors.c c/src/sockets.c c/src/common.c"
+C_SOURCE_FILES="c/src/bridge.c c/src/server.c c/src/client.c c/src/errors.c c/src/sockets.c c/src/common.c c/src/room_log.c c/src/presence.c c/src/federation.c c/src/public_ip.c c/src/logger.c c/src/worker_pool.c c/src/ban_filter.c c/src/blob_store.c c/src/upgrade.c c/src/search_index.c c/src/utf8.c c/src/typing.c c/src/username_index.c c/src/content_filter.c c/src/local_transport.c c/src/threads.c c/src/memory_budget.c"
 
 # JAVA_BRIDGE_DIR="java/src/jni"
 # C_INCLUDE_DIR="c/include"
@@ -10,6 +10,6 @@ C_SOURCE_FILES="c/src/bridge.c c/src/server.c c/src/client.c c/src/errors.c c/sr
 
 # cd -
 
-gcc -shared -o build/c/main.dll $C_SOURCE_FILES -I"$JAVA_HOME/include" -I"$JAVA_HOME/include/win32" -lws2_32 -liphlpapi
+gcc -shared -D_GNU_SOURCE -o build/c/main.dll $C_SOURCE_FILES -I"$JAVA_HOME/include" -I"$JAVA_HOME/include/win32" -lws2_32 -liphlpapi
 
 find java -name "*.java" | xargs javac -d build/java
\ No newline at end of file
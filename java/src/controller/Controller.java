@@ -2,13 +2,59 @@ package controller;
 
 import javax.swing.SwingUtilities;
 import javax.swing.SwingWorker;
+import javax.swing.Timer;
+import java.time.Instant;
+import java.time.ZoneId;
+import java.time.format.DateTimeFormatter;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ConcurrentLinkedQueue;
 import java.util.concurrent.ExecutionException;
+import java.util.concurrent.atomic.AtomicBoolean;
 import jni.Bridge;
+import view.MainChatRoomPanel;
 import view.MainFrame;
 
 public class Controller {
 
+    // must match presence_op_t in common.h
+    private static final int PRESENCE_SNAPSHOT = 0;
+    private static final int PRESENCE_JOIN = 1;
+    private static final int PRESENCE_LEAVE = 2;
+    private static final int PRESENCE_RENAME = 3;
+
+    // must match send_status_t in client.h
+    private static final int SEND_STATUS_COMPLETED = 0;
+    private static final int SEND_STATUS_FAILED = 1;
+    private static final int SEND_STATUS_CANCELLED = 2;
+
+    private record PresenceDelta(int presenceOp, String username, String newUsername) {
+    }
+
+    // must match TYPING_REFRESH_MS in common.h
+    private static final int TYPING_REFRESH_MS = 3000;
+    // the input counts as abandoned once it hasn't changed for this long
+    private static final int TYPING_IDLE_MS = 5000;
+
+    private static final DateTimeFormatter SEARCH_TIME_FORMAT = DateTimeFormatter.ofPattern("yyyy-MM-dd HH:mm")
+            .withZone(ZoneId.systemDefault());
+
     private static MainFrame mainFrame;
+    // kick and ban run on the server, only the host of the room has one
+    private static volatile boolean hosting = false;
+    private static final ConcurrentLinkedQueue<PresenceDelta> pendingPresence = new ConcurrentLinkedQueue<>();
+    private static final AtomicBoolean presenceDrainScheduled = new AtomicBoolean(false);
+    // our own name is left out of the typing indicator
+    private static volatile String ownUsername = "";
+    // typing state is only touched on the EDT
+    private static boolean typing = false;
+    private static long typingSentAt = 0;
+    private static final Timer typingIdleTimer = new Timer(TYPING_IDLE_MS, e -> updateTyping(false));
+    // the rules the room filters with, shown again the next time the host edits them
+    private static volatile String contentFilterRules = "";
+    // messages queued for the server and not yet written, by request ID
+    private static final ConcurrentHashMap<Long, String> pendingSends = new ConcurrentHashMap<>();
 
     public void setMainFrame(MainFrame mainFrame) {
         Controller.mainFrame = mainFrame;
@@ -19,6 +65,7 @@ public class Controller {
     }
 
     public void startChatRoom(String username) {
+        ownUsername = username;
         new SwingWorker<Integer, Void>() {
             @Override
             protected Integer doInBackground() throws Exception {
@@ -29,6 +76,7 @@ public class Controller {
             protected void done() {
                 try {
                     if (get() == 0) {
+                        hosting = true;
                         swithPanel("MAIN");
                     }
                 } catch (InterruptedException | ExecutionException e) {
@@ -39,18 +87,254 @@ public class Controller {
     }
 
     public void joinChatRoom(String ipAddress, String port, String secretKey, String username) {
-        SwingUtilities.invokeLater(() -> mainFrame.getJoinChatRoomPanel().clearErrors());
+        ownUsername = username;
+        mainFrame.getJoinChatRoomPanel().clearErrors();
+        mainFrame.getJoinChatRoomPanel().setJoining(true);
+        Bridge.joinChatRoomAsync(ipAddress, port, secretKey, username);
+    }
+
+    public void cancelJoin() {
+        Bridge.cancelConnect();
+    }
+
+    // the panel switches once the server accepts us, this only ends the wait
+    public static void joinCompleted(final boolean joined) {
+        SwingUtilities.invokeLater(() -> mainFrame.getJoinChatRoomPanel().setJoining(false));
+    }
+
+    public void sendMessage(String message) {
+        // the server ends our typing when the message arrives
+        typing = false;
+        typingSentAt = 0;
+        typingIdleTimer.stop();
+        long requestId = Bridge.sendMessageAsync(message);
+        if (requestId != 0) {
+            pendingSends.put(requestId, message);
+        }
+    }
+
+    // called from the native send thread, or the thread that cancelled the message
+    public static void sendCompleted(final long requestId, final int status) {
+        String message = pendingSends.remove(requestId);
+        if (message == null || status != SEND_STATUS_FAILED) {
+            return;
+        }
+        SwingUtilities.invokeLater(() -> {
+            mainFrame.getMainChatRoomPanel().appendError("ERROR: Your message was not sent: " + message + "\n");
+        });
+    }
+
+    // called on the EDT for every edit of the input. the server only hears about a change,
+    // or a refresh every TYPING_REFRESH_MS while the typing goes on
+    public static void updateTyping(boolean nowTyping) {
+        if (!nowTyping) {
+            typingIdleTimer.stop();
+            if (typing) {
+                typing = false;
+                typingSentAt = 0;
+                Bridge.sendTyping(false);
+            }
+            return;
+        }
+
+        typingIdleTimer.restart();
+        long now = System.currentTimeMillis();
+        if (!typing || now - typingSentAt >= TYPING_REFRESH_MS) {
+            typing = true;
+            typingSentAt = now;
+            Bridge.sendTyping(true);
+        }
+    }
+
+    // the whole set of members typing right now, it replaces whatever was shown
+    public static void displayTyping(final String[] usernames) {
+        SwingUtilities.invokeLater(() -> {
+            List<String> others = new ArrayList<>();
+            for (String username : usernames) {
+                if (!username.equals(ownUsername)) {
+                    others.add(username);
+                }
+            }
+
+            String text;
+            if (others.isEmpty()) {
+                text = " ";
+            } else if (others.size() == 1) {
+                text = others.get(0) + " is typing...";
+            } else if (others.size() <= 3) {
+                text = String.join(", ", others.subList(0, others.size() - 1)) + " and " + others.get(others.size() - 1) + " are typing...";
+            } else {
+                text = "Several people are typing...";
+            }
+            mainFrame.getMainChatRoomPanel().setTypingText(text);
+        });
+    }
+
+    // only the named members get it, each one is acked through displayDirectAck
+    public void sendDirectMessage(String[] recipients, String message) {
+        mainFrame.getMainChatRoomPanel().appendMessage("[private] " + ownUsername + " -> " + String.join(", ", recipients) + ": " + message + "\n");
         new SwingWorker<Void, Void>() {
             @Override
             protected Void doInBackground() throws Exception {
-                Bridge.joinChatRoom(ipAddress, port, secretKey, username);
+                Bridge.sendDirectMessage(recipients, message);
                 return null;
             }
         }.execute();
     }
 
-    public void sendMessage(String message) {
-        Bridge.sendMessage(message);
+    public static void displayDirectMessage(final String username, final String[] recipients, final String message) {
+        SwingUtilities.invokeLater(() -> {
+            mainFrame.getMainChatRoomPanel().appendMessage("[private] " + username + " -> " + String.join(", ", recipients) + ": " + message + "\n");
+        });
+    }
+
+    // a delivered ack needs nothing shown, the message was already echoed when it was sent
+    public static void displayDirectAck(final long sequence, final boolean delivered, final String recipient) {
+        if (delivered) {
+            return;
+        }
+        SwingUtilities.invokeLater(() -> {
+            mainFrame.getMainChatRoomPanel().appendError("ERROR: " + recipient + " did not get your private message\n");
+        });
+    }
+
+    public String getOwnUsername() {
+        return ownUsername;
+    }
+
+    public boolean isHosting() {
+        return hosting;
+    }
+
+    // the clients are told the room is closing, this returns once they are gone or the drain timed out
+    // the goodbye to the members can take a few seconds, onClosed runs on the EDT once it is over
+    public void closeChatRoom(Runnable onClosed) {
+        if (!hosting) {
+            onClosed.run();
+            return;
+        }
+
+        hosting = false;
+        new SwingWorker<Void, Void>() {
+            @Override
+            protected Void doInBackground() throws Exception {
+                Bridge.closeChatRoom();
+                return null;
+            }
+
+            @Override
+            protected void done() {
+                onClosed.run();
+            }
+        }.execute();
+    }
+
+    public void kickUser(String username) {
+        new SwingWorker<Void, Void>() {
+            @Override
+            protected Void doInBackground() throws Exception {
+                Bridge.kickUser(username);
+                return null;
+            }
+        }.execute();
+    }
+
+    public void banUser(String username) {
+        new SwingWorker<Void, Void>() {
+            @Override
+            protected Void doInBackground() throws Exception {
+                Bridge.banUser(username);
+                return null;
+            }
+        }.execute();
+    }
+
+    public String getContentFilterRules() {
+        return contentFilterRules;
+    }
+
+    // the room keeps its old rules when the new ones don't compile, the reason arrives as an error
+    public void setContentFilter(String rules) {
+        new SwingWorker<Integer, Void>() {
+            @Override
+            protected Integer doInBackground() throws Exception {
+                return Bridge.setContentFilter(rules);
+            }
+
+            @Override
+            protected void done() {
+                try {
+                    if (get() == 0) {
+                        contentFilterRules = rules;
+                        mainFrame.getMainChatRoomPanel().appendMessage("Content filter updated\n");
+                    }
+                } catch (InterruptedException | ExecutionException e) {
+                    e.printStackTrace();
+                }
+            }
+        }.execute();
+    }
+
+    public void sendAttachment(String path, String name) {
+        new SwingWorker<Void, Void>() {
+            @Override
+            protected Void doInBackground() throws Exception {
+                Bridge.sendAttachment(path, name);
+                return null;
+            }
+        }.execute();
+    }
+
+    public void downloadAttachment(String hash, String path) {
+        new SwingWorker<Integer, Void>() {
+            @Override
+            protected Integer doInBackground() throws Exception {
+                return Bridge.downloadAttachment(hash, path);
+            }
+
+            @Override
+            protected void done() {
+                try {
+                    if (get() == 0) {
+                        mainFrame.getMainChatRoomPanel().appendMessage("Saved attachment to " + path + "\n");
+                    }
+                } catch (Exception e) {
+                    logNonCriticalError("Attachment download failed: " + e.getMessage());
+                }
+            }
+        }.execute();
+    }
+
+    // since and until are unix seconds, 0 leaves that end open. the hits arrive through displaySearchResult
+    public void searchHistory(String query, long since, long until) {
+        new SwingWorker<Void, Void>() {
+            @Override
+            protected Void doInBackground() throws Exception {
+                Bridge.searchHistory(query, since, until);
+                return null;
+            }
+        }.execute();
+    }
+
+    public static void displaySearchResult(final String username, final String message, final long timestamp) {
+        SwingUtilities.invokeLater(() -> {
+            String time = SEARCH_TIME_FORMAT.format(Instant.ofEpochSecond(timestamp));
+            mainFrame.getMainChatRoomPanel().appendMessage("[search] " + time + " " + username + ": " + message + "\n");
+        });
+    }
+
+    public static void displaySearchDone(final long hits) {
+        SwingUtilities.invokeLater(() -> {
+            mainFrame.getMainChatRoomPanel().appendMessage("[search] " + hits + (hits == 1 ? " match\n" : " matches\n"));
+        });
+    }
+
+    public static void displayAttachment(final String username, final String hash, final long size, final String name) {
+        SwingUtilities.invokeLater(() -> {
+            MainChatRoomPanel mainChatRoomPanel = mainFrame.getMainChatRoomPanel();
+            mainChatRoomPanel.appendMessage(username + " shared " + name + " (" + size + " bytes)\n");
+            mainChatRoomPanel.addAttachment(hash, size, name);
+        });
     }
 
     public static void displayMessage(final String username, final String message) {
@@ -59,6 +343,32 @@ public class Controller {
         });
     }
 
+    public static void applyPresence(int presenceOp, String username, String newUsername) {
+        pendingPresence.add(new PresenceDelta(presenceOp, username, newUsername));
+
+        // a whole batch of deltas is applied in a single pass on the EDT
+        if (presenceDrainScheduled.compareAndSet(false, true)) {
+            SwingUtilities.invokeLater(Controller::drainPresence);
+        }
+    }
+
+    private static void drainPresence() {
+        presenceDrainScheduled.set(false);
+
+        MainChatRoomPanel mainChatRoomPanel = mainFrame.getMainChatRoomPanel();
+        PresenceDelta delta;
+        while ((delta = pendingPresence.poll()) != null) {
+            switch (delta.presenceOp()) {
+                case PRESENCE_SNAPSHOT -> mainChatRoomPanel.clearUsers();
+                case PRESENCE_JOIN -> mainChatRoomPanel.addUser(delta.username());
+                case PRESENCE_LEAVE -> mainChatRoomPanel.removeUser(delta.username());
+                case PRESENCE_RENAME -> mainChatRoomPanel.renameUser(delta.username(), delta.newUsername());
+                default -> {
+                }
+            }
+        }
+    }
+
     public static void showCriticalError(String errorMessage) {
         SwingUtilities.invokeLater(() -> {
             mainFrame.getMainChatRoomPanel().showCriticalError(errorMessage);
@@ -83,6 +393,18 @@ public class Controller {
         });
     }
 
+    public static void showRemovedFromRoom(String message) {
+        // the connection is going away, whatever is still queued would only fail
+        for (Long requestId : pendingSends.keySet()) {
+            Bridge.cancelSend(requestId);
+        }
+        SwingUtilities.invokeLater(() -> {
+            mainFrame.getMainChatRoomPanel().showRemovedFromRoom(message);
+            mainFrame.getMainChatRoomPanel().clearUsers();
+            mainFrame.swithPanel("START");
+        });
+    }
+
     public static void switchToMainPanel() {
         SwingUtilities.invokeLater(() -> mainFrame.swithPanel("MAIN"));
     }
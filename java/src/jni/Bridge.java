@@ -8,14 +8,42 @@ public class Bridge {
 
     public static native void joinChatRoom(String ipAddress, String port, String secretKey, String username);
 
+    // connects on a native thread and returns at once, the outcome comes back through Controller.joinCompleted
+    public static native void joinChatRoomAsync(String ipAddress, String port, String secretKey, String username);
+
+    // stops a joinChatRoomAsync that is still connecting, Controller.joinCompleted then reports it as failed
+    public static native void cancelConnect();
+
     public static native void sendMessage(String message);
 
+    // queues the message and returns its request ID, 0 if nothing was queued. Controller.sendCompleted reports the outcome
+    public static native long sendMessageAsync(String message);
+
+    // true if the message was still queued, it is then reported as cancelled
+    public static native boolean cancelSend(long requestId);
+
+    public static native void sendAttachment(String path, String name);
+
+    public static native int downloadAttachment(String hash, String path);
+
+    public static native void searchHistory(String query, long since, long until);
+
+    public static native void sendTyping(boolean typing);
+
+    // returns the sequence the acks for each recipient carry, 0 if nothing was sent
+    public static native long sendDirectMessage(String[] recipients, String message);
+
     public static native void kickUser(String username);
 
     public static native void banUser(String username);
 
+    public static native int setContentFilter(String rules);
+
     public static native void leaveChatRoom();
 
     public static native void closeChatRoom();
+
+    // what the hosted room's connections use, "key=value" pairs in bytes
+    public static native String getMemoryReport();
     
 }
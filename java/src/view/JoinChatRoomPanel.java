@@ -23,6 +23,7 @@ public class JoinChatRoomPanel extends JPanel {
     private static final String CHAT_ROOM_KEY_LABEL_TEXT = "Chat Room Secret key";
     private static final String PORT_LABEL_TEXT = "Port";
     private static final String JOIN_BUTTON_TEXT = "Join Chat Room";
+    private static final String CANCEL_BUTTON_TEXT = "Cancel";
     private static final Dimension BACK_BUTTON_DIMENSIONS = new Dimension(75, 30);
     private static final Dimension OTHER_COMPONENT_DIMENSIONS = new Dimension(150, 35);
     private static final Dimension SPACER_DIMENSIONS = new Dimension(75, 40);
@@ -36,6 +37,8 @@ public class JoinChatRoomPanel extends JPanel {
     private JTextField portField;
     private JLabel usernameErrorLabel;
     private JLabel chatRoomKeyErrorLabel;
+    private JButton joinChatRoomButton;
+    private JButton cancelJoinButton;
 
     public JoinChatRoomPanel(Controller controller) {
         setLayout(new BorderLayout());
@@ -118,7 +121,7 @@ public class JoinChatRoomPanel extends JPanel {
         constraints.gridy = 10;
         constraints.insets = OTHER_INSETS;
 
-        JButton joinChatRoomButton = new JButton(JOIN_BUTTON_TEXT);
+        joinChatRoomButton = new JButton(JOIN_BUTTON_TEXT);
         joinChatRoomButton.setPreferredSize(OTHER_COMPONENT_DIMENSIONS);
         joinChatRoomButton.addActionListener(e -> controller.joinChatRoom(
                 chatRoomAddressField.getText(),
@@ -127,6 +130,15 @@ public class JoinChatRoomPanel extends JPanel {
                 usernameField.getText()));
         centralPanel.add(joinChatRoomButton, constraints);
 
+        constraints.gridy = 11;
+        constraints.insets = OTHER_INSETS;
+
+        cancelJoinButton = new JButton(CANCEL_BUTTON_TEXT);
+        cancelJoinButton.setPreferredSize(OTHER_COMPONENT_DIMENSIONS);
+        cancelJoinButton.setEnabled(false);
+        cancelJoinButton.addActionListener(e -> controller.cancelJoin());
+        centralPanel.add(cancelJoinButton, constraints);
+
         add(headerPanel, BorderLayout.NORTH);
         add(centralPanel, BorderLayout.CENTER);
 
@@ -145,6 +157,12 @@ public class JoinChatRoomPanel extends JPanel {
         chatRoomKeyErrorLabel.setText(errorMessage);
     }
 
+    // the connection is made in the background, a second click while it is under way would start another one
+    public void setJoining(boolean joining) {
+        joinChatRoomButton.setEnabled(!joining);
+        cancelJoinButton.setEnabled(joining);
+    }
+
     public void clearErrors() {
         usernameField.setBorder(BorderFactory.createLineBorder(Color.GRAY));
         chatRoomKeyField.setBorder(BorderFactory.createLineBorder(Color.GRAY));
@@ -1,6 +1,9 @@
 package view;
 
+import javax.swing.DefaultListModel;
 import javax.swing.JButton;
+import javax.swing.JFileChooser;
+import javax.swing.JLabel;
 import javax.swing.JPanel;
 import javax.swing.JTextArea;
 import javax.swing.JTextField;
@@ -8,18 +11,51 @@ import javax.swing.JList;
 import javax.swing.JScrollPane;
 import javax.swing.JSplitPane;
 import javax.swing.JOptionPane;
+import javax.swing.JMenuItem;
+import javax.swing.JPopupMenu;
+import javax.swing.SwingUtilities;
+import javax.swing.event.DocumentEvent;
+import javax.swing.event.DocumentListener;
 import java.awt.BorderLayout;
 import java.awt.Dimension;
+import java.awt.FlowLayout;
+import java.io.File;
+import java.time.LocalDate;
+import java.time.ZoneId;
+import java.time.format.DateTimeParseException;
+import java.awt.event.ComponentAdapter;
+import java.awt.event.ComponentEvent;
+import java.awt.event.MouseAdapter;
+import java.awt.event.MouseEvent;
+import java.util.ArrayList;
+import java.util.List;
 
 import controller.Controller;
 
 public class MainChatRoomPanel extends JPanel {
 
+    // must match DIRECT_MAX_RECIPIENTS in common.h
+    private static final int DIRECT_MAX_RECIPIENTS = 8;
+
     private JTextArea messageDisplayArea;
     private JTextArea errorDisplayArea; // New area for non-critical errors
     private JList<String> userList;
+    private DefaultListModel<String> userListModel;
     private JTextField messageInputField;
     private JButton sendButton;
+    private JButton attachButton;
+    private JButton searchButton;
+    private JButton filterButton;
+    private JLabel typingLabel;
+    private JList<Attachment> attachmentList;
+    private DefaultListModel<Attachment> attachmentListModel;
+
+    private record Attachment(String hash, long size, String name) {
+        @Override
+        public String toString() {
+            return name + " (" + size + " bytes)";
+        }
+    }
 
     public MainChatRoomPanel(Controller controller) {
         setLayout(new BorderLayout());
@@ -43,18 +79,69 @@ public class MainChatRoomPanel extends JPanel {
         add(splitPane, BorderLayout.CENTER);
 
         // User list panel
-        userList = new JList<>();
+        userListModel = new DefaultListModel<>();
+        userList = new JList<>(userListModel);
+        userList.addMouseListener(new MouseAdapter() {
+            @Override
+            public void mousePressed(MouseEvent e) {
+                showUserMenu(controller, e);
+            }
+
+            @Override
+            public void mouseReleased(MouseEvent e) {
+                showUserMenu(controller, e);
+            }
+        });
         JScrollPane userScrollPane = new JScrollPane(userList);
-        userScrollPane.setPreferredSize(new Dimension(150, 0)); // Width of 150 pixels, height flexible
-        add(userScrollPane, BorderLayout.EAST);
+
+        // Attachments shared in the room, double click to save one
+        attachmentListModel = new DefaultListModel<>();
+        attachmentList = new JList<>(attachmentListModel);
+        attachmentList.addMouseListener(new MouseAdapter() {
+            @Override
+            public void mouseClicked(MouseEvent e) {
+                if (e.getClickCount() == 2) {
+                    saveAttachment(controller, attachmentList.getSelectedValue());
+                }
+            }
+        });
+        JScrollPane attachmentScrollPane = new JScrollPane(attachmentList);
+
+        JSplitPane sidePane = new JSplitPane(JSplitPane.VERTICAL_SPLIT, userScrollPane, attachmentScrollPane);
+        sidePane.setResizeWeight(0.6);
+        sidePane.setDividerSize(2);
+        sidePane.setPreferredSize(new Dimension(150, 0)); // Width of 150 pixels, height flexible
+        add(sidePane, BorderLayout.EAST);
 
         // Message input and send button
         JPanel inputPanel = new JPanel(new BorderLayout());
         messageInputField = new JTextField();
         sendButton = new JButton("Send");
+        attachButton = new JButton("Attach");
+        searchButton = new JButton("Search");
+        filterButton = new JButton("Filter");
+
+        JPanel buttonPanel = new JPanel(new FlowLayout(FlowLayout.RIGHT, 0, 0));
+        buttonPanel.add(attachButton);
+        buttonPanel.add(searchButton);
+        buttonPanel.add(filterButton);
+        buttonPanel.add(sendButton);
+
+        // only the host edits the filter, the panel is built before anyone knows who hosts
+        addComponentListener(new ComponentAdapter() {
+            @Override
+            public void componentShown(ComponentEvent e) {
+                filterButton.setVisible(controller.isHosting());
+            }
+        });
 
+        // who else is typing, a blank label keeps the input from jumping when it fills
+        typingLabel = new JLabel(" ");
+        typingLabel.setForeground(java.awt.Color.GRAY);
+
+        inputPanel.add(typingLabel, BorderLayout.NORTH);
         inputPanel.add(messageInputField, BorderLayout.CENTER);
-        inputPanel.add(sendButton, BorderLayout.EAST);
+        inputPanel.add(buttonPanel, BorderLayout.EAST);
 
         add(inputPanel, BorderLayout.SOUTH);
 
@@ -66,6 +153,150 @@ public class MainChatRoomPanel extends JPanel {
                 messageInputField.setText(""); // Clear the input field after sending
             }
         });
+
+        messageInputField.getDocument().addDocumentListener(new DocumentListener() {
+            @Override
+            public void insertUpdate(DocumentEvent e) {
+                Controller.updateTyping(e.getDocument().getLength() > 0);
+            }
+
+            @Override
+            public void removeUpdate(DocumentEvent e) {
+                Controller.updateTyping(e.getDocument().getLength() > 0);
+            }
+
+            @Override
+            public void changedUpdate(DocumentEvent e) {
+            }
+        });
+
+        attachButton.addActionListener(e -> {
+            JFileChooser fileChooser = new JFileChooser();
+            if (fileChooser.showOpenDialog(this) == JFileChooser.APPROVE_OPTION) {
+                File file = fileChooser.getSelectedFile();
+                controller.sendAttachment(file.getAbsolutePath(), file.getName());
+            }
+        });
+
+        filterButton.addActionListener(e -> editContentFilter(controller));
+
+        searchButton.addActionListener(e -> {
+            String input = JOptionPane.showInputDialog(this,
+                    "Words to find, \"quoted\" for a phrase, after:YYYY-MM-DD and before:YYYY-MM-DD to limit the dates",
+                    "Search Messages", JOptionPane.QUESTION_MESSAGE);
+            if (input != null && !input.isBlank()) {
+                search(controller, input);
+            }
+        });
+    }
+
+    private void editContentFilter(Controller controller) {
+        JTextArea rulesArea = new JTextArea(controller.getContentFilterRules(), 15, 40);
+        JScrollPane rulesScrollPane = new JScrollPane(rulesArea);
+        JPanel rulesPanel = new JPanel(new BorderLayout());
+        rulesPanel.add(new JLabel("One rule per line: block, mask or flag, then the text to match"), BorderLayout.NORTH);
+        rulesPanel.add(rulesScrollPane, BorderLayout.CENTER);
+
+        int choice = JOptionPane.showConfirmDialog(SwingUtilities.getWindowAncestor(this), rulesPanel,
+                "Content Filter", JOptionPane.OK_CANCEL_OPTION, JOptionPane.PLAIN_MESSAGE);
+        if (choice == JOptionPane.OK_OPTION) {
+            controller.setContentFilter(rulesArea.getText());
+        }
+    }
+
+    // the date filters are taken out of the input here, the rest is the query as the server matches it
+    private void search(Controller controller, String input) {
+        StringBuilder query = new StringBuilder();
+        long since = 0;
+        long until = 0;
+
+        for (String word : input.trim().split("\\s+")) {
+            try {
+                if (word.startsWith("after:")) {
+                    since = LocalDate.parse(word.substring(6)).plusDays(1).atStartOfDay(ZoneId.systemDefault()).toEpochSecond();
+                    continue;
+                }
+                if (word.startsWith("before:")) {
+                    until = LocalDate.parse(word.substring(7)).atStartOfDay(ZoneId.systemDefault()).toEpochSecond() - 1;
+                    continue;
+                }
+            } catch (DateTimeParseException ex) {
+                appendError("ERROR: " + word + " is not a YYYY-MM-DD date\n");
+                return;
+            }
+            query.append(word).append(' ');
+        }
+
+        if (query.length() > 0) {
+            appendMessage("[search] " + input.trim() + "\n");
+            controller.searchHistory(query.toString().trim(), since, until);
+        }
+    }
+
+    private void saveAttachment(Controller controller, Attachment attachment) {
+        if (attachment == null) {
+            return;
+        }
+
+        JFileChooser fileChooser = new JFileChooser();
+        fileChooser.setSelectedFile(new File(attachment.name()));
+        if (fileChooser.showSaveDialog(this) == JFileChooser.APPROVE_OPTION) {
+            controller.downloadAttachment(attachment.hash(), fileChooser.getSelectedFile().getAbsolutePath());
+        }
+    }
+
+    // anyone can message the selected members privately, kick and ban are only offered to the host.
+    // the popup trigger differs per platform so both mouse events check it
+    private void showUserMenu(Controller controller, MouseEvent e) {
+        if (!e.isPopupTrigger()) {
+            return;
+        }
+
+        int index = userList.locationToIndex(e.getPoint());
+        if (index < 0 || !userList.getCellBounds(index, index).contains(e.getPoint())) {
+            return;
+        }
+        // a right click inside the selection keeps it, anywhere else it selects just that member
+        if (!userList.isSelectedIndex(index)) {
+            userList.setSelectedIndex(index);
+        }
+        String username = userListModel.get(index);
+
+        List<String> recipients = new ArrayList<>(userList.getSelectedValuesList());
+        recipients.remove(controller.getOwnUsername());
+
+        JPopupMenu userMenu = new JPopupMenu();
+        if (!recipients.isEmpty() && recipients.size() <= DIRECT_MAX_RECIPIENTS) {
+            String names = recipients.size() == 1 ? recipients.get(0) : recipients.size() + " members";
+            JMenuItem messageItem = new JMenuItem("Message " + names);
+            messageItem.addActionListener(event -> {
+                String message = JOptionPane.showInputDialog(SwingUtilities.getWindowAncestor(this),
+                        "Private message to " + String.join(", ", recipients), "Direct Message", JOptionPane.QUESTION_MESSAGE);
+                if (message != null && !message.isEmpty()) {
+                    controller.sendDirectMessage(recipients.toArray(new String[0]), message);
+                }
+            });
+            userMenu.add(messageItem);
+        }
+
+        if (controller.isHosting()) {
+            JMenuItem kickItem = new JMenuItem("Kick " + username);
+            JMenuItem banItem = new JMenuItem("Ban " + username);
+            kickItem.addActionListener(event -> controller.kickUser(username));
+            banItem.addActionListener(event -> {
+                int choice = JOptionPane.showConfirmDialog(SwingUtilities.getWindowAncestor(this),
+                        "Ban " + username + "? Their address won't be able to rejoin.", "Ban User", JOptionPane.YES_NO_OPTION);
+                if (choice == JOptionPane.YES_OPTION) {
+                    controller.banUser(username);
+                }
+            });
+            userMenu.add(kickItem);
+            userMenu.add(banItem);
+        }
+
+        if (userMenu.getComponentCount() > 0) {
+            userMenu.show(userList, e.getX(), e.getY());
+        }
     }
 
     public void appendMessage(String message) {
@@ -76,10 +307,65 @@ public class MainChatRoomPanel extends JPanel {
         errorDisplayArea.append(error);
     }
 
+    public void setTypingText(String text) {
+        typingLabel.setText(text);
+    }
+
+    public void clearUsers() {
+        userListModel.clear();
+    }
+
+    // the list is kept sorted so a presence change finds its member by binary search instead of a scan,
+    // returns the member's index or (-(insertion point) - 1) like Collections.binarySearch
+    private int findUser(String username) {
+        int low = 0;
+        int high = userListModel.size() - 1;
+        while (low <= high) {
+            int middle = (low + high) >>> 1;
+            int comparison = userListModel.get(middle).compareTo(username);
+            if (comparison < 0) {
+                low = middle + 1;
+            } else if (comparison > 0) {
+                high = middle - 1;
+            } else {
+                return middle;
+            }
+        }
+        return -(low + 1);
+    }
+
+    public void addUser(String username) {
+        int index = findUser(username);
+        if (index < 0) {
+            userListModel.add(-(index + 1), username);
+        }
+    }
+
+    public void removeUser(String username) {
+        int index = findUser(username);
+        if (index >= 0) {
+            userListModel.remove(index);
+        }
+    }
+
+    public void renameUser(String oldUsername, String newUsername) {
+        // the new name sorts somewhere else
+        removeUser(oldUsername);
+        addUser(newUsername);
+    }
+
+    public void addAttachment(String hash, long size, String name) {
+        attachmentListModel.addElement(new Attachment(hash, size, name));
+    }
+
     public void showCriticalError(String errorMessage) {
         JOptionPane.showMessageDialog(this, errorMessage, "Critical Error", JOptionPane.ERROR_MESSAGE);
     }
 
+    public void showRemovedFromRoom(String message) {
+        JOptionPane.showMessageDialog(this, message, "Removed From Room", JOptionPane.INFORMATION_MESSAGE);
+    }
+
     public JTextArea getMessageDisplayArea() {
         return messageDisplayArea;
     }
@@ -5,6 +5,8 @@ import javax.swing.JPanel;
 import javax.swing.WindowConstants;
 import java.awt.CardLayout;
 import java.awt.Dimension;
+import java.awt.event.WindowAdapter;
+import java.awt.event.WindowEvent;
 
 import controller.Controller;
 
@@ -19,10 +21,27 @@ public class MainFrame extends JFrame {
    private MainChatRoomPanel mainChatRoomPanel;
    private JoinChatRoomPanel joinChatRoomPanel;
 
+   private boolean closing = false;
+
    public MainFrame(Controller controller) {
       initializeMainFrame();
       controller.setMainFrame(this);
 
+      // a hosted room says goodbye to its members before the process exits, the window stays responsive meanwhile
+      addWindowListener(new WindowAdapter() {
+         @Override
+         public void windowClosing(WindowEvent e) {
+            if (closing) {
+               return;
+            }
+            closing = true;
+            controller.closeChatRoom(() -> {
+               dispose();
+               System.exit(0);
+            });
+         }
+      });
+
       cardLayout = new CardLayout();
       cards = new JPanel(cardLayout);
 
@@ -41,7 +60,7 @@ public class MainFrame extends JFrame {
    private void initializeMainFrame() {
       setSize(STARTING_WINDOW_SIZE);
       setTitle(TITLE);
-      setDefaultCloseOperation(WindowConstants.EXIT_ON_CLOSE);
+      setDefaultCloseOperation(WindowConstants.DO_NOTHING_ON_CLOSE);
       setLocationRelativeTo(null);
    }
 
@@ -0,0 +1,25 @@
+C_SOURCE_FILES="c/src/server.c c/src/client.c c/src/errors.c c/src/sockets.c c/src/common.c c/src/room_log.c c/src/presence.c c/src/federation.c c/src/public_ip.c c/src/logger.c c/src/worker_pool.c c/src/ban_filter.c c/src/blob_store.c c/src/upgrade.c c/src/search_index.c c/src/utf8.c c/src/typing.c c/src/username_index.c c/src/content_filter.c c/src/local_transport.c c/src/threads.c c/src/memory_budget.c"
+TESTS="room_log presence ban_filter member_id search_index utf8 content_filter"
+
+# the library without bridge.c, the tests call the modules directly and need no JVM
+case "$(uname -s)" in
+    MINGW* | MSYS* | CYGWIN*) LIBRARIES="-lws2_32 -liphlpapi" ;;
+    *) LIBRARIES="-lpthread" ;;
+esac
+
+cd "$(dirname "$0")"
+mkdir -p build/c/tests
+
+FAILED=""
+for TEST in $TESTS; do
+    if ! gcc -D_GNU_SOURCE -o "build/c/tests/test_$TEST" "c/tests/test_$TEST.c" $C_SOURCE_FILES $LIBRARIES || ! "build/c/tests/test_$TEST"; then
+        FAILED="$FAILED $TEST"
+    fi
+done
+
+if [ -n "$FAILED" ]; then
+    echo "Failed:$FAILED"
+    exit 1
+fi
+
+echo "All tests passed."
\ No newline at end of file